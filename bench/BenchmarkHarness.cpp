@@ -0,0 +1,270 @@
+#include "BenchmarkHarness.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// Calls to operator new, counted by the replacements below. The
+	// benchmarks are single threaded.
+	uint64_t num_allocations = 0;
+
+	// Number of empty windows timed to measure the window overhead.
+	const size_t kOverheadWindows = 10000;
+
+	int64_t NowNanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Opens a counter of the user-space instructions this thread retires, or
+	// returns -1 if the kernel does not provide one.
+	int OpenInstructionCounter()
+	{
+#if defined(__linux__)
+		perf_event_attr attr = {};
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		int fd = static_cast<int> (syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+		if (fd < 0)
+			return -1;
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		return fd;
+#else
+		return -1;
+#endif
+	}
+
+	double Median(std::vector<double> values)
+	{
+		std::sort(values.begin(), values.end());
+		size_t middle = values.size() / 2;
+		return values.size() % 2 == 1 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+	}
+
+	// Writes |value| as a JSON string.
+	void PrintJsonString(FILE* out, const std::string& value)
+	{
+		fputc('"', out);
+		for (char c : value)
+		{
+			if (c == '"' || c == '\\')
+				fputc('\\', out);
+			fputc(c, out);
+		}
+		fputc('"', out);
+	}
+} // namespace
+
+void* operator new(size_t size)
+{
+	++num_allocations;
+	if (void* memory = malloc(size == 0 ? 1 : size))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	++num_allocations;
+	size_t align = static_cast<size_t> (alignment);
+	if (void* memory = aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept
+{
+	free(memory);
+}
+
+uint64_t NumAllocations()
+{
+	return num_allocations;
+}
+
+BenchmarkTimer::BenchmarkTimer(int instruction_counter, const BenchmarkCounters& window_overhead) :
+	instruction_counter_(instruction_counter),
+	window_overhead_(window_overhead)
+{ }
+
+void BenchmarkTimer::Start()
+{
+	start_instructions_ = ReadInstructions();
+	start_allocations_ = num_allocations;
+	start_ns_ = NowNanoseconds();
+}
+
+void BenchmarkTimer::Stop(uint64_t calls)
+{
+	int64_t end_ns = NowNanoseconds();
+	uint64_t end_allocations = num_allocations;
+	uint64_t end_instructions = ReadInstructions();
+
+	totals_.nanoseconds += std::max(0.0, static_cast<double> (end_ns - start_ns_) - window_overhead_.nanoseconds);
+	totals_.allocations += static_cast<double> (end_allocations - start_allocations_);
+	totals_.instructions += std::max(0.0, static_cast<double> (end_instructions - start_instructions_) - window_overhead_.instructions);
+	calls_ += calls;
+}
+
+uint64_t BenchmarkTimer::ReadInstructions() const
+{
+	uint64_t count = 0;
+#if defined(__linux__)
+	if (instruction_counter_ >= 0 && read(instruction_counter_, &count, sizeof(count)) != sizeof(count))
+		count = 0;
+#endif
+	return count;
+}
+
+BenchmarkRunner::BenchmarkRunner(size_t repetitions, const std::string& filter) :
+	repetitions_(std::max<size_t>(repetitions, 1)),
+	filter_(filter),
+	instruction_counter_(OpenInstructionCounter())
+{
+	window_overhead_ = MeasureWindowOverhead();
+}
+
+BenchmarkRunner::~BenchmarkRunner()
+{
+#if defined(__linux__)
+	if (instruction_counter_ >= 0)
+		close(instruction_counter_);
+#endif
+}
+
+bool BenchmarkRunner::Matches(const std::string& name) const
+{
+	return filter_.empty() || name.find(filter_) != std::string::npos;
+}
+
+void BenchmarkRunner::Run(const std::string& name, const BenchmarkFunction& function)
+{
+	if (!Matches(name))
+		return;
+
+	BenchmarkTimer warm_up(instruction_counter_, window_overhead_);
+	function(&warm_up);
+
+	std::vector<double> nanoseconds;
+	std::vector<double> allocations;
+	std::vector<double> instructions;
+	BenchmarkResult result;
+	result.name = name;
+	result.repetitions = repetitions_;
+	for (size_t i = 0; i < repetitions_; ++i)
+	{
+		BenchmarkTimer timer(instruction_counter_, window_overhead_);
+		function(&timer);
+		if (timer.calls() == 0)
+		{
+			fprintf(stderr, "%s: no calls timed, skipped\n", name.c_str());
+			return;
+		}
+		double calls = static_cast<double> (timer.calls());
+		nanoseconds.push_back(timer.totals().nanoseconds / calls);
+		allocations.push_back(timer.totals().allocations / calls);
+		instructions.push_back(timer.totals().instructions / calls);
+		result.calls = timer.calls();
+	}
+	result.ns_per_call = Median(nanoseconds);
+	result.allocations_per_call = Median(allocations);
+	if (has_instruction_counter())
+		result.instructions_per_call = Median(instructions);
+	results_.push_back(result);
+}
+
+void BenchmarkRunner::PrintJson(FILE* out, const std::vector<std::pair<std::string, std::string> >& context) const
+{
+	fprintf(out, "{\n");
+	for (const std::pair<std::string, std::string>& field : context)
+	{
+		fprintf(out, "  ");
+		PrintJsonString(out, field.first);
+		fprintf(out, ": ");
+		PrintJsonString(out, field.second);
+		fprintf(out, ",\n");
+	}
+	fprintf(out, "  \"repetitions\": %zu,\n", repetitions_);
+	fprintf(out, "  \"instruction_counter\": %s,\n", has_instruction_counter() ? "true" : "false");
+	fprintf(out, "  \"results\": [\n");
+	for (size_t i = 0; i < results_.size(); ++i)
+	{
+		const BenchmarkResult& result = results_[i];
+		fprintf(out, "    {\"name\": ");
+		PrintJsonString(out, result.name);
+		fprintf(out, ", \"calls\": %llu, \"ns_per_call\": %.3f, \"allocations_per_call\": %.4f, \"instructions_per_call\": ",
+			static_cast<unsigned long long> (result.calls),
+			result.ns_per_call,
+			result.allocations_per_call);
+		if (result.instructions_per_call < 0)
+			fprintf(out, "null");
+		else
+			fprintf(out, "%.1f", result.instructions_per_call);
+		fprintf(out, "}%s\n", i + 1 < results_.size() ? "," : "");
+	}
+	fprintf(out, "  ]\n");
+	fprintf(out, "}\n");
+}
+
+void BenchmarkRunner::PrintText(FILE* out) const
+{
+	fprintf(out, "%-56s %12s %12s %12s\n", "benchmark", "ns/call", "allocs/call", "instrs/call");
+	for (const BenchmarkResult& result : results_)
+	{
+		fprintf(out, "%-56s %12.2f %12.3f ", result.name.c_str(), result.ns_per_call, result.allocations_per_call);
+		if (result.instructions_per_call < 0)
+			fprintf(out, "%12s\n", "n/a");
+		else
+			fprintf(out, "%12.1f\n", result.instructions_per_call);
+	}
+}
+
+BenchmarkCounters BenchmarkRunner::MeasureWindowOverhead() const
+{
+	BenchmarkCounters no_overhead;
+	std::vector<double> nanoseconds;
+	std::vector<double> instructions;
+	for (size_t i = 0; i < kOverheadWindows; ++i)
+	{
+		BenchmarkTimer timer(instruction_counter_, no_overhead);
+		timer.Start();
+		timer.Stop(1);
+		nanoseconds.push_back(timer.totals().nanoseconds);
+		instructions.push_back(timer.totals().instructions);
+	}
+
+	BenchmarkCounters overhead;
+	overhead.nanoseconds = Median(nanoseconds);
+	overhead.instructions = Median(instructions);
+	return overhead;
+}
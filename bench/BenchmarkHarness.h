@@ -0,0 +1,112 @@
+// Minimal harness for the pcc_bench microbenchmarks: timing windows with
+// allocation and instruction counts, repetitions and JSON reporting.
+
+#ifndef PCC_BENCH_BENCHMARK_HARNESS_H_
+#define PCC_BENCH_BENCHMARK_HARNESS_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Returns the number of operator new calls made by this process so far.
+uint64_t NumAllocations();
+
+// BenchmarkCounters, what a benchmark window measured.
+
+struct BenchmarkCounters
+{
+	double nanoseconds = 0.0;
+	double allocations = 0.0;
+	// Instructions retired in user space, 0 when counters are unavailable.
+	double instructions = 0.0;
+};
+
+// BenchmarkTimer accumulates the cost of the code run between Start() and
+// Stop() over any number of windows. The cost of an empty window is measured
+// once and subtracted, so windows may be as short as a single call.
+
+class BenchmarkTimer
+{
+public:
+	// Uses |instruction_counter|, a perf event file descriptor, or -1 when
+	// instruction counts are unavailable. |window_overhead| is subtracted from
+	// every window.
+	BenchmarkTimer(int instruction_counter, const BenchmarkCounters& window_overhead);
+
+	void Start();
+	// Ends the window, which made |calls| calls of the benchmarked function.
+	void Stop(uint64_t calls);
+
+	uint64_t calls() const { return calls_; }
+	const BenchmarkCounters& totals() const { return totals_; }
+
+private:
+	uint64_t ReadInstructions() const;
+
+	int instruction_counter_;
+	BenchmarkCounters window_overhead_;
+	BenchmarkCounters totals_;
+	uint64_t calls_ = 0;
+	int64_t start_ns_ = 0;
+	uint64_t start_allocations_ = 0;
+	uint64_t start_instructions_ = 0;
+};
+
+// BenchmarkResult, the per-call cost of a benchmark as the median over its
+// repetitions.
+
+struct BenchmarkResult
+{
+	std::string name;
+	size_t repetitions = 0;
+	// Calls timed in each repetition.
+	uint64_t calls = 0;
+	double ns_per_call = 0.0;
+	double allocations_per_call = 0.0;
+	// Negative when instruction counters are unavailable.
+	double instructions_per_call = -1.0;
+};
+
+// Runs one repetition of a benchmark, timing the calls it makes with the
+// timer. A benchmark that times no calls, e.g. because it could not set up
+// its state, is skipped.
+typedef std::function<void(BenchmarkTimer* timer)> BenchmarkFunction;
+
+// BenchmarkRunner runs the benchmarks whose name contains a filter and
+// collects their results.
+
+class BenchmarkRunner
+{
+public:
+	BenchmarkRunner(size_t repetitions, const std::string& filter);
+	~BenchmarkRunner();
+	BenchmarkRunner(const BenchmarkRunner&) = delete;
+	BenchmarkRunner& operator=(const BenchmarkRunner&) = delete;
+
+	// Returns true if the benchmark |name| passes the filter.
+	bool Matches(const std::string& name) const;
+	// Runs |function| |repetitions| times, after one untimed warm-up
+	// repetition, if |name| passes the filter.
+	void Run(const std::string& name, const BenchmarkFunction& function);
+
+	bool has_instruction_counter() const { return instruction_counter_ >= 0; }
+	const std::vector<BenchmarkResult>& results() const { return results_; }
+
+	// Prints the results as one JSON object. |context| lists extra top-level
+	// string fields as name/value pairs.
+	void PrintJson(FILE* out, const std::vector<std::pair<std::string, std::string> >& context) const;
+	void PrintText(FILE* out) const;
+
+private:
+	BenchmarkCounters MeasureWindowOverhead() const;
+
+	size_t repetitions_;
+	std::string filter_;
+	int instruction_counter_ = -1;
+	BenchmarkCounters window_overhead_;
+	std::vector<BenchmarkResult> results_;
+};
+
+#endif  // PCC_BENCH_BENCHMARK_HARNESS_H_
@@ -0,0 +1,179 @@
+#include "SyntheticPath.h"
+
+#include <algorithm>
+
+namespace
+{
+	const double kBitsPerByte = 8.0;
+	const double kNumMicrosPerSecond = 1e6;
+	// Most packets a single Send() passes to the controller.
+	const size_t kMaxPacketsPerSend = 1 << 16;
+	// Packet number at which the path restarts, well before it wraps.
+	const QuicPacketNumber kMaxPacketNumber = 1 << 30;
+} // namespace
+
+SyntheticPath::SyntheticPath(const SyntheticPathConfig& config) :
+	config_(config)
+{
+	config_.ack_batch = std::max<size_t>(config_.ack_batch, 1);
+	send_times_.resize(kMaxPacketsPerSend);
+	acked_packets_.reserve(config_.ack_batch);
+	lost_packets_.reserve(config_.ack_batch);
+	Restart();
+}
+
+void SyntheticPath::Restart()
+{
+	controller_.reset();
+	controller_.reset(new CongestionController(config_.rtt_us,
+		config_.initial_congestion_window,
+		config_.max_congestion_window,
+		config_.pcc_config));
+	next_packet_number_ = 0;
+	next_send_time_us_ = 0.0;
+	queue_bytes_ = 0.0;
+	queue_time_us_ = 0.0;
+	in_flight_.clear();
+	in_flight_head_ = 0;
+}
+
+void SyntheticPath::SendPackets(BenchmarkTimer* timer)
+{
+	// The next batch is due once its last packet is acked, and packets sent
+	// before then cannot be part of it.
+	if (num_in_flight() < config_.ack_batch)
+		Send(config_.ack_batch - num_in_flight(), -1.0, timer);
+	QuicTime deadline = in_flight_[in_flight_head_ + config_.ack_batch - 1].ack_time;
+	while (Send(kMaxPacketsPerSend, static_cast<double> (deadline), timer) == kMaxPacketsPerSend)
+		continue;
+}
+
+void SyntheticPath::DeliverAcks(BenchmarkTimer* timer)
+{
+	acked_packets_.clear();
+	lost_packets_.clear();
+	QuicTime event_time = 0;
+	QuicTime rtt = 0;
+	for (size_t i = 0; i < config_.ack_batch; ++i)
+	{
+		const SentPacket& packet = in_flight_[in_flight_head_ + i];
+		CongestionEvent event;
+		event.packet_number = packet.packet_number;
+		event.bytes_acked = packet.lost ? 0 : static_cast<int32_t> (config_.packet_size);
+		event.bytes_lost = packet.lost ? static_cast<int32_t> (config_.packet_size) : 0;
+		event.time = static_cast<uint64_t> (packet.ack_time);
+		if (packet.lost)
+		{
+			lost_packets_.push_back(event);
+		} else {
+			acked_packets_.push_back(event);
+			rtt = packet.ack_time - packet.sent_time;
+		}
+		event_time = std::max(event_time, packet.ack_time);
+	}
+	in_flight_head_ += config_.ack_batch;
+	if (in_flight_head_ * 2 > in_flight_.size())
+	{
+		in_flight_.erase(in_flight_.begin(), in_flight_.begin() + in_flight_head_);
+		in_flight_head_ = 0;
+	}
+
+	if (timer != nullptr)
+		timer->Start();
+	controller_->OnCongestionEvent(event_time, rtt, acked_packets_, lost_packets_);
+	if (timer != nullptr)
+		timer->Stop(1);
+}
+
+void SyntheticPath::Step()
+{
+	SendPackets(nullptr);
+	DeliverAcks(nullptr);
+}
+
+bool SyntheticPath::WarmUp(CongestionController::SenderMode mode, size_t max_steps)
+{
+	if (next_packet_number_ > kMaxPacketNumber ||
+		(mode == CongestionController::STARTING && controller_->mode() != mode))
+		Restart();
+
+	for (size_t step = 0; controller_->mode() != mode; ++step)
+	{
+		if (step == max_steps)
+			return false;
+		Step();
+	}
+	return true;
+}
+
+bool SyntheticPath::WarmUpQuiescent(size_t max_steps)
+{
+	if (next_packet_number_ > kMaxPacketNumber)
+		Restart();
+
+	for (size_t step = 0; !controller_->is_quiescent(); ++step)
+	{
+		if (step == max_steps)
+			return false;
+		Step();
+	}
+	return true;
+}
+
+size_t SyntheticPath::Send(size_t max_packets, double deadline, BenchmarkTimer* timer)
+{
+	max_packets = std::min(max_packets, kMaxPacketsPerSend);
+	QuicTime* send_times = send_times_.data();
+	double bits_per_packet = static_cast<double> (config_.packet_size) * kBitsPerByte * kNumMicrosPerSecond;
+	size_t count = 0;
+
+	if (timer != nullptr)
+		timer->Start();
+	for (; count < max_packets && (deadline < 0 || next_send_time_us_ <= deadline); ++count)
+	{
+		QuicTime sent_time = static_cast<QuicTime> (next_send_time_us_);
+		controller_->OnPacketSent(sent_time, next_packet_number_ + static_cast<QuicPacketNumber> (count), config_.packet_size, true);
+		send_times[count] = sent_time;
+		next_send_time_us_ += bits_per_packet / std::max(controller_->PacingRate(), 1.0);
+	}
+	if (timer != nullptr)
+		timer->Stop(count);
+
+	Enqueue(count);
+	return count;
+}
+
+void SyntheticPath::Enqueue(size_t count)
+{
+	double bytes_per_us = config_.bandwidth_bps / kBitsPerByte / kNumMicrosPerSecond;
+	for (size_t i = 0; i < count; ++i)
+	{
+		QuicTime sent_time = send_times_[i];
+		double now = static_cast<double> (sent_time);
+		queue_bytes_ = std::max(0.0, queue_bytes_ - (now - queue_time_us_) * bytes_per_us);
+		queue_time_us_ = now;
+
+		SentPacket packet;
+		packet.packet_number = next_packet_number_++;
+		packet.sent_time = sent_time;
+		packet.lost = queue_bytes_ + config_.packet_size > config_.buffer_bytes;
+		if (!packet.lost)
+			queue_bytes_ += config_.packet_size;
+		packet.ack_time = sent_time + config_.rtt_us + static_cast<QuicTime> (queue_bytes_ / bytes_per_us);
+		in_flight_.push_back(packet);
+	}
+}
+
+const char* SenderModeName(CongestionController::SenderMode mode)
+{
+	switch (mode)
+	{
+		case CongestionController::STARTING:
+			return "starting";
+		case CongestionController::PROBING:
+			return "probing";
+		case CongestionController::DECISION_MADE:
+			return "decision_made";
+	}
+	return "unknown";
+}
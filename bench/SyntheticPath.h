@@ -0,0 +1,106 @@
+// Fluid model of one bottleneck that feeds a CongestionController the sends
+// and acks of a benchmark.
+
+#ifndef PCC_BENCH_SYNTHETIC_PATH_H_
+#define PCC_BENCH_SYNTHETIC_PATH_H_
+
+#include <memory>
+#include <vector>
+
+#include "BenchmarkHarness.h"
+#include "CongestionController.h"
+#include "PccConfig.h"
+
+// SyntheticPathConfig, the bottleneck and the shape of the acks.
+
+struct SyntheticPathConfig
+{
+	double bandwidth_bps = 1e9;
+	QuicTime rtt_us = 20000;
+	// Capacity of the bottleneck buffer, one bandwidth-delay product.
+	QuicByteCount buffer_bytes = 2500000;
+	QuicByteCount packet_size = 1400;
+	// Number of packets acked or lost per OnCongestionEvent.
+	size_t ack_batch = 8;
+	QuicPacketCount initial_congestion_window = 10;
+	QuicPacketCount max_congestion_window = 100000;
+	// Tuning of the controller.
+	std::shared_ptr<const PccConfig> pcc_config = PccConfig::Default();
+};
+
+// SyntheticPath paces packets at the controller's rate into a drop-tail
+// bottleneck and acks them |ack_batch| at a time once the last of them is
+// due. It keeps no event queue: each Step() sends everything due before the
+// next ack batch arrives and then delivers that batch, so it is cheap enough
+// to warm a controller up between timed calls.
+
+class SyntheticPath
+{
+public:
+	explicit SyntheticPath(const SyntheticPathConfig& config);
+	SyntheticPath(const SyntheticPath&) = delete;
+	SyntheticPath& operator=(const SyntheticPath&) = delete;
+
+	// Starts over with an empty path and a new controller.
+	void Restart();
+
+	// Sends the packets due before the next ack batch arrives. When |timer| is
+	// not null, it times the OnPacketSent calls together with the PacingRate
+	// query a pacer makes after each of them.
+	void SendPackets(BenchmarkTimer* timer);
+	// Delivers the next ack batch. When |timer| is not null, it times the
+	// OnCongestionEvent call.
+	void DeliverAcks(BenchmarkTimer* timer);
+	// SendPackets() and DeliverAcks() without timing.
+	void Step();
+
+	// Steps until the controller is in |mode|, restarting first when it can
+	// no longer get there, e.g. once it left STARTING. Returns false if it
+	// does not get there within |max_steps| steps.
+	bool WarmUp(CongestionController::SenderMode mode, size_t max_steps);
+	// Steps until the controller is on the quiescent fast path, which its
+	// config must turn on, restarting first when the path is about to wrap.
+	// Returns false if it does not get there within |max_steps| steps.
+	bool WarmUpQuiescent(size_t max_steps);
+
+	CongestionController& controller() { return *controller_; }
+	const SyntheticPathConfig& config() const { return config_; }
+
+private:
+	struct SentPacket
+	{
+		QuicPacketNumber packet_number;
+		QuicTime sent_time;
+		// Time the packet is acked, or declared lost if |lost|.
+		QuicTime ack_time;
+		bool lost;
+	};
+
+	// Sends up to |max_packets| packets, stopping at the first one due after
+	// |deadline|. Returns the number of packets sent.
+	size_t Send(size_t max_packets, double deadline, BenchmarkTimer* timer);
+	// Passes |count| packets sent at |send_times_| through the bottleneck.
+	void Enqueue(size_t count);
+	size_t num_in_flight() const { return in_flight_.size() - in_flight_head_; }
+
+	SyntheticPathConfig config_;
+	std::unique_ptr<CongestionController> controller_;
+	QuicPacketNumber next_packet_number_ = 0;
+	double next_send_time_us_ = 0.0;
+	// Bytes queued at the bottleneck as of |queue_time_us_|.
+	double queue_bytes_ = 0.0;
+	double queue_time_us_ = 0.0;
+	// Packets not yet acked or declared lost, oldest first from
+	// |in_flight_head_|.
+	std::vector<SentPacket> in_flight_;
+	size_t in_flight_head_ = 0;
+	// Send times of the packets sent by the last Send().
+	std::vector<QuicTime> send_times_;
+	AckedPacketVector acked_packets_;
+	LostPacketVector lost_packets_;
+};
+
+// Returns the name of |mode| as used in benchmark names.
+const char* SenderModeName(CongestionController::SenderMode mode);
+
+#endif  // PCC_BENCH_SYNTHETIC_PATH_H_
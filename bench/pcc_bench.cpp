@@ -0,0 +1,520 @@
+// pcc_bench: microbenchmarks of the controller hot path. Reports the median
+// ns, allocations and instructions per call over the repetitions.
+//
+//   pcc_bench --filter=OnCongestionEvent --repetitions=9 --json
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BenchmarkHarness.h"
+#include "FixedPoint.h"
+#include "Pacer.h"
+#include "SyntheticPath.h"
+#include "UtilityFunctions.h"
+#include "VivaceUtility.h"
+
+namespace
+{
+	const CongestionController::SenderMode kModes[] = {
+		CongestionController::STARTING,
+		CongestionController::PROBING,
+		CongestionController::DECISION_MADE
+	};
+	// Packets acked per OnCongestionEvent.
+	const size_t kAckBatches[] = { 1, 8, 64, 512 };
+	// Monitor intervals with packets in flight at once.
+	const size_t kIntervalCounts[] = { 1, 2, 4, 8 };
+	// RTT samples per monitor interval.
+	const size_t kSampleCounts[] = { 16, 256 };
+	// Flows scheduled by one Pacer.
+	const size_t kPacerFlowCounts[] = { 1000, 10000 };
+
+	// Packets sent per repetition of the OnPacketSent benchmarks.
+	const uint64_t kPacketsPerRepetition = 1 << 16;
+	// Calls per repetition of the benchmarks that time calls one at a time.
+	const uint64_t kCallsPerRepetition = 1 << 14;
+	// Fewest calls per repetition when calls are batches of packets.
+	const uint64_t kMinCallsPerRepetition = 256;
+	// Path steps a controller may take to reach the benchmarked mode.
+	const size_t kMaxWarmUpSteps = 1 << 22;
+	// Ack batch of the path in the OnPacketSent benchmarks.
+	const size_t kSendBenchmarkAckBatch = 64;
+	// DECISION_MADE rounds with a steady gradient before the controllers of
+	// the quiescent benchmarks take the fast path.
+	const size_t kQuiescentRounds = 3;
+	// Packets sent per monitor interval in the queue benchmarks.
+	const size_t kPacketsPerInterval = 64;
+	const QuicTime kRttUs = 20000;
+	const QuicTime kPacketGapUs = 10;
+	const QuicByteCount kPacketSize = 1400;
+
+	void PrintUsage()
+	{
+		fprintf(stderr,
+			"usage: pcc_bench [flags]\n"
+			"  --filter=S           run only benchmarks whose name contains S\n"
+			"  --repetitions=N      timed repetitions per benchmark (5)\n"
+			"  --json               print results as JSON\n");
+	}
+
+	// Returns the value of |arg| if it is --|name|=value, otherwise nullptr.
+	const char* FlagValue(const char* arg, const char* name)
+	{
+		size_t length = strlen(name);
+		if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, length) != 0 || arg[2 + length] != '=')
+			return nullptr;
+		return arg + 3 + length;
+	}
+
+	// Delegate of the standalone queues, which only needs the utilities to be
+	// delivered.
+	class NullDelegate : public MonitorIntervalQueueDelegateInterface
+	{
+	public:
+		void OnUtilityAvailable(UtilityInfoSpan utility_info) override
+		{
+			num_utilities_ += utility_info.size();
+		}
+
+	private:
+		size_t num_utilities_ = 0;
+	};
+
+	// Returns the config of the controllers of the quiescent benchmarks.
+	std::shared_ptr<const PccConfig> QuiescentConfig()
+	{
+		PccConfig config;
+		config.quiescent_rounds = kQuiescentRounds;
+		return PccConfig::Create(config, nullptr);
+	}
+
+	// Steps |path| until its controller is in |mode|, or on the quiescent fast
+	// path if |quiescent|.
+	bool WarmUp(CongestionController::SenderMode mode, bool quiescent, SyntheticPath* path)
+	{
+		return quiescent ? path->WarmUpQuiescent(kMaxWarmUpSteps) : path->WarmUp(mode, kMaxWarmUpSteps);
+	}
+
+	// Sends paced packets to a controller in |mode|, or on the quiescent fast
+	// path if |quiescent|.
+	void BenchmarkOnPacketSent(CongestionController::SenderMode mode, bool quiescent, BenchmarkTimer* timer)
+	{
+		SyntheticPathConfig config;
+		config.ack_batch = kSendBenchmarkAckBatch;
+		if (quiescent)
+			config.pcc_config = QuiescentConfig();
+		SyntheticPath path(config);
+		while (timer->calls() < kPacketsPerRepetition)
+		{
+			if (!WarmUp(mode, quiescent, &path))
+				return;
+			path.SendPackets(timer);
+			path.DeliverAcks(nullptr);
+		}
+	}
+
+	// Acks |ack_batch| packets at a time to a controller in |mode|, or on the
+	// quiescent fast path if |quiescent|.
+	void BenchmarkOnCongestionEvent(CongestionController::SenderMode mode, bool quiescent, size_t ack_batch,
+		BenchmarkTimer* timer)
+	{
+		SyntheticPathConfig config;
+		config.ack_batch = ack_batch;
+		if (quiescent)
+			config.pcc_config = QuiescentConfig();
+		SyntheticPath path(config);
+		uint64_t calls = std::max(kMinCallsPerRepetition, kCallsPerRepetition / ack_batch);
+		while (timer->calls() < calls)
+		{
+			if (!WarmUp(mode, quiescent, &path))
+				return;
+			path.SendPackets(nullptr);
+			path.DeliverAcks(timer);
+		}
+	}
+
+	// Brings a new controller to |mode| with utilities that grow with the
+	// sending rate, so that it leaves STARTING only when told to and every
+	// PROBING round reaches a decision.
+	bool EnterMode(CongestionController::SenderMode mode, CongestionController* controller)
+	{
+		std::vector<UtilityInfo> utility_info(1);
+		if (mode != CongestionController::STARTING)
+		{
+			// A lower utility than the last one ends STARTING.
+			utility_info[0] = UtilityInfo(controller->PacingRate(), -1.0f);
+			controller->OnUtilityAvailable(utility_info);
+		}
+		if (mode == CongestionController::DECISION_MADE)
+		{
+			QuicBandwidth rate = controller->PacingRate();
+			utility_info.clear();
+			utility_info.push_back(UtilityInfo(rate * 1.05, 1.05f));
+			utility_info.push_back(UtilityInfo(rate * 0.95, 0.95f));
+			utility_info.push_back(UtilityInfo(rate * 0.95, 0.95f));
+			utility_info.push_back(UtilityInfo(rate * 1.05, 1.05f));
+			controller->OnUtilityAvailable(utility_info);
+		}
+		return controller->mode() == mode;
+	}
+
+	// Reports the utilities of one decision to new controllers in |mode|:
+	// STARTING doubles the rate, PROBING decides and DECISION_MADE keeps
+	// changing the rate in the same direction. A decision is too short to time
+	// alone, so each window covers one decision of many controllers.
+	void BenchmarkOnUtilityAvailable(CongestionController::SenderMode mode, BenchmarkTimer* timer)
+	{
+		const size_t kControllersPerWindow = 64;
+		std::vector<std::unique_ptr<CongestionController> > controllers(kControllersPerWindow);
+		std::vector<std::vector<UtilityInfo> > utility_info(kControllersPerWindow);
+		while (timer->calls() < kCallsPerRepetition)
+		{
+			for (size_t i = 0; i < kControllersPerWindow; ++i)
+			{
+				controllers[i].reset();
+				controllers[i].reset(new CongestionController(kRttUs, 10, 100000));
+				if (!EnterMode(mode, controllers[i].get()))
+					return;
+
+				QuicBandwidth rate = controllers[i]->PacingRate();
+				utility_info[i].clear();
+				if (mode == CongestionController::PROBING)
+				{
+					utility_info[i].push_back(UtilityInfo(rate * 1.05, 1.05f));
+					utility_info[i].push_back(UtilityInfo(rate * 0.95, 0.95f));
+					utility_info[i].push_back(UtilityInfo(rate * 0.95, 0.95f));
+					utility_info[i].push_back(UtilityInfo(rate * 1.05, 1.05f));
+				} else {
+					utility_info[i].push_back(UtilityInfo(rate, 2.0f));
+				}
+			}
+
+			timer->Start();
+			for (size_t i = 0; i < kControllersPerWindow; ++i)
+				controllers[i]->OnUtilityAvailable(utility_info[i]);
+			timer->Stop(kControllersPerWindow);
+		}
+	}
+
+	// Acks the packets of |num_intervals| useful intervals |ack_batch| at a
+	// time, the last batch completing all of them, as single packets or as one
+	// range per batch if |ranges|.
+	void BenchmarkQueueOnCongestionEvent(size_t num_intervals, size_t ack_batch, bool ranges, BenchmarkTimer* timer)
+	{
+		NullDelegate delegate;
+		std::unique_ptr<MonitorIntervalQueue> queue;
+		size_t packets_per_interval = std::max(kPacketsPerInterval, (ack_batch + num_intervals - 1) / num_intervals);
+		size_t num_batches = (num_intervals * packets_per_interval + ack_batch - 1) / ack_batch;
+		std::vector<AckedPacketVector> batches(num_batches);
+		std::vector<PacketNumberRangeVector> range_batches(num_batches, PacketNumberRangeVector(1));
+		const LostPacketVector no_losses;
+		const PacketNumberRangeVector no_lost_ranges;
+		QuicPacketNumber packet_number = 0;
+		QuicTime now = 0;
+		uint64_t calls = std::max(kMinCallsPerRepetition, kCallsPerRepetition / ack_batch);
+
+		while (timer->calls() < calls)
+		{
+			queue.reset();
+			queue.reset(new MonitorIntervalQueue(delegate));
+			for (AckedPacketVector& batch : batches)
+				batch.clear();
+			QuicPacketNumber first_packet_number = packet_number;
+			for (size_t i = 0; i < num_intervals; ++i)
+			{
+				queue->EnqueueNewMonitorInterval(1e8, true, 0.0f, kRttUs, now + packets_per_interval * kPacketGapUs);
+				for (size_t j = 0; j < packets_per_interval; ++j)
+				{
+					queue->OnPacketSent(now, packet_number, kPacketSize);
+					CongestionEvent event;
+					event.packet_number = packet_number;
+					event.bytes_acked = static_cast<int32_t> (kPacketSize);
+					event.bytes_lost = 0;
+					event.time = static_cast<uint64_t> (now + kRttUs);
+					size_t batch = (packet_number - first_packet_number) / ack_batch;
+					batches[batch].push_back(event);
+					PacketNumberRange& range = range_batches[batch][0];
+					if (batches[batch].size() == 1)
+					{
+						range.first_packet_number = packet_number;
+						range.bytes = 0;
+					}
+					range.last_packet_number = packet_number;
+					range.bytes += kPacketSize;
+					++packet_number;
+					now += kPacketGapUs;
+				}
+			}
+
+			QuicTime event_time = now + kRttUs;
+			timer->Start();
+			if (ranges)
+			{
+				for (const PacketNumberRangeVector& batch : range_batches)
+					queue->OnCongestionEvent(batch, no_lost_ranges, kRttUs, event_time);
+			} else {
+				for (const AckedPacketVector& batch : batches)
+					queue->OnCongestionEvent(batch, no_losses, kRttUs, event_time);
+			}
+			timer->Stop(num_batches);
+		}
+	}
+
+	// Computes the utility of one interval with |num_samples| RTT samples.
+	template <class UtilityFunction>
+	void BenchmarkCalculateUtility(RttStatsMode rtt_stats_mode, size_t num_samples, BenchmarkTimer* timer)
+	{
+		const size_t kCallsPerWindow = 256;
+		NullDelegate delegate;
+		BasicMonitorIntervalQueue<UtilityFunction> queue(delegate);
+		MonitorInterval interval;
+		interval.Reset(1e8, true, 0.0f, kRttUs, num_samples * kPacketGapUs, rtt_stats_mode, num_samples);
+		interval.first_packet_sent_time = 0;
+		interval.last_packet_sent_time = (num_samples - 1) * kPacketGapUs;
+		interval.first_packet_number = 0;
+		interval.last_packet_number = static_cast<QuicPacketNumber> (num_samples - 1);
+		interval.bytes_sent = num_samples * kPacketSize;
+		interval.bytes_acked = interval.bytes_sent;
+		interval.n_packets = static_cast<int> (num_samples);
+		// RTT grows by 1us every other packet, as with a slowly filling queue.
+		for (size_t i = 0; i < num_samples; ++i)
+			interval.rtt_samples.OnSample(static_cast<QuicTime> (i * kPacketGapUs), kRttUs + static_cast<QuicTime> (i / 2));
+
+		while (timer->calls() < kCallsPerRepetition)
+		{
+			timer->Start();
+			for (size_t i = 0; i < kCallsPerWindow; ++i)
+				queue.CalculateUtility(&interval);
+			timer->Stop(kCallsPerWindow);
+		}
+	}
+
+	// Computes the Vivace utility of one of a set of intervals per call, in
+	// floating point as CalculateVivaceUtility or, if |fixed_point|, as
+	// CalculateVivaceUtilityFixedPoint.
+	void BenchmarkVivaceUtility(bool fixed_point, BenchmarkTimer* timer)
+	{
+		const size_t kIntervals = 64;
+		std::vector<QuicByteCount> bytes_sent(kIntervals);
+		std::vector<QuicByteCount> bytes_lost(kIntervals);
+		std::vector<QuicTime> mi_duration_us(kIntervals);
+		std::vector<int32_t> n_packets(kIntervals);
+		std::vector<float> latency_inflation(kIntervals);
+		for (size_t i = 0; i < kIntervals; ++i)
+		{
+			n_packets[i] = static_cast<int32_t> (64 + i);
+			bytes_sent[i] = n_packets[i] * kPacketSize;
+			bytes_lost[i] = static_cast<QuicByteCount> (i % 5) * kPacketSize;
+			mi_duration_us[i] = n_packets[i] * kPacketGapUs * static_cast<QuicTime> (1 + i % 7);
+			latency_inflation[i] = 0.001f * static_cast<float> (i % 40) - 0.02f;
+		}
+		const VivaceUtilityCoefficients coefficients;
+		const FixedVivaceUtilityCoefficients fixed_coefficients = ToFixedPoint(coefficients);
+
+		float float_sum = 0.0f;
+		FixedPoint fixed_sum = 0;
+		while (timer->calls() < kCallsPerRepetition)
+		{
+			timer->Start();
+			for (size_t i = 0; i < kIntervals; ++i)
+			{
+				if (fixed_point)
+					fixed_sum += CalculateVivaceUtilityFixedPoint(bytes_sent[i],
+						bytes_lost[i],
+						mi_duration_us[i],
+						n_packets[i],
+						static_cast<int32_t> (latency_inflation[i] * 100),
+						fixed_coefficients);
+				else
+					float_sum += CalculateVivaceUtility(static_cast<float> (bytes_sent[i]),
+						static_cast<float> (bytes_lost[i]),
+						static_cast<float> (mi_duration_us[i]),
+						n_packets[i],
+						latency_inflation[i],
+						coefficients);
+			}
+			timer->Stop(kIntervals);
+		}
+		// Keeps the calls from being optimized away.
+		if (float_sum == 1.0f && fixed_sum == 1)
+			fprintf(stderr, "\n");
+	}
+
+	// Computes the rate change of a controller from alternately rising and
+	// falling utilities, in floating point or, if |fixed_point|, with
+	// PccConfig::fixed_point_arithmetic.
+	void BenchmarkComputeRateChange(bool fixed_point, BenchmarkTimer* timer)
+	{
+		PccConfig config;
+		config.fixed_point_arithmetic = fixed_point;
+		CongestionController controller(kRttUs, 10, 100000, PccConfig::Create(config, nullptr));
+		QuicBandwidth rate = controller.PacingRate();
+		const UtilityInfo samples[] = {
+			UtilityInfo(rate * 1.05, 105.0f),
+			UtilityInfo(rate * 0.95, 95.0f),
+			UtilityInfo(rate * 1.05, 95.0f),
+			UtilityInfo(rate * 0.95, 105.0f)
+		};
+
+		QuicBandwidth total_change = 0;
+		const size_t kCallsPerWindow = 64;
+		while (timer->calls() < kCallsPerRepetition)
+		{
+			timer->Start();
+			for (size_t i = 0; i < kCallsPerWindow; ++i)
+			{
+				size_t pair = (i / 8) % 2;
+				total_change += controller.ComputeRateChange(samples[2 * pair], samples[2 * pair + 1]);
+			}
+			timer->Stop(kCallsPerWindow);
+		}
+		if (total_change == 1.0)
+			fprintf(stderr, "\n");
+	}
+
+	// Sends one packet of whichever flow is due per call, sleeping on the
+	// virtual clock until one is, for |num_flows| flows at spread out rates.
+	void BenchmarkPacerSend(size_t num_flows, BenchmarkTimer* timer)
+	{
+		Pacer pacer(num_flows);
+		for (size_t i = 0; i < num_flows; ++i)
+			pacer.AddFlow(static_cast<FlowId> (i), 1e6 * static_cast<double> (1 + i % 100), 0);
+
+		QuicTime now = 0;
+		const size_t kCallsPerWindow = 64;
+		while (timer->calls() < kCallsPerRepetition)
+		{
+			timer->Start();
+			for (size_t i = 0; i < kCallsPerWindow; ++i)
+			{
+				FlowId flow;
+				while (!pacer.NextFlowToSend(now, &flow))
+					now += pacer.TimeUntilNextSend(now);
+				pacer.OnPacketSent(flow, now, kPacketSize);
+			}
+			timer->Stop(kCallsPerWindow);
+		}
+	}
+
+	void RunBenchmarks(BenchmarkRunner* runner)
+	{
+		for (CongestionController::SenderMode mode : kModes)
+		{
+			std::string name = std::string("controller/OnPacketSent/mode=") + SenderModeName(mode);
+			runner->Run(name, [mode](BenchmarkTimer* timer) { BenchmarkOnPacketSent(mode, false, timer); });
+		}
+		runner->Run("controller/OnPacketSent/mode=quiescent", [](BenchmarkTimer* timer) {
+			BenchmarkOnPacketSent(CongestionController::DECISION_MADE, true, timer);
+		});
+		for (CongestionController::SenderMode mode : kModes)
+		{
+			for (size_t ack_batch : kAckBatches)
+			{
+				std::string name = std::string("controller/OnCongestionEvent/mode=") + SenderModeName(mode) +
+					"/batch=" + std::to_string(ack_batch);
+				runner->Run(name, [mode, ack_batch](BenchmarkTimer* timer) {
+					BenchmarkOnCongestionEvent(mode, false, ack_batch, timer);
+				});
+			}
+		}
+		for (size_t ack_batch : kAckBatches)
+		{
+			std::string name = "controller/OnCongestionEvent/mode=quiescent/batch=" + std::to_string(ack_batch);
+			runner->Run(name, [ack_batch](BenchmarkTimer* timer) {
+				BenchmarkOnCongestionEvent(CongestionController::DECISION_MADE, true, ack_batch, timer);
+			});
+		}
+		for (CongestionController::SenderMode mode : kModes)
+		{
+			std::string name = std::string("controller/OnUtilityAvailable/mode=") + SenderModeName(mode);
+			runner->Run(name, [mode](BenchmarkTimer* timer) { BenchmarkOnUtilityAvailable(mode, timer); });
+		}
+		for (bool ranges : { false, true })
+		{
+			for (size_t num_intervals : kIntervalCounts)
+			{
+				for (size_t ack_batch : kAckBatches)
+				{
+					std::string name = std::string(ranges ? "queue/OnCongestionEventRanges" : "queue/OnCongestionEvent") +
+						"/intervals=" + std::to_string(num_intervals) + "/batch=" + std::to_string(ack_batch);
+					runner->Run(name, [num_intervals, ack_batch, ranges](BenchmarkTimer* timer) {
+						BenchmarkQueueOnCongestionEvent(num_intervals, ack_batch, ranges, timer);
+					});
+				}
+			}
+		}
+		for (RttStatsMode rtt_stats_mode : { RTT_STATS_REGRESSION, RTT_STATS_HALF_SPLIT })
+		{
+			for (size_t num_samples : kSampleCounts)
+			{
+				std::string name = std::string("queue/CalculateUtility/rtt_stats=") +
+					(rtt_stats_mode == RTT_STATS_REGRESSION ? "regression" : "half_split") +
+					"/samples=" + std::to_string(num_samples);
+				runner->Run(name, [rtt_stats_mode, num_samples](BenchmarkTimer* timer) {
+					BenchmarkCalculateUtility<VivaceLatencyUtility>(rtt_stats_mode, num_samples, timer);
+				});
+			}
+		}
+		runner->Run("queue/CalculateUtility/utility=vivace_loss", [](BenchmarkTimer* timer) {
+			BenchmarkCalculateUtility<VivaceLossUtility>(RTT_STATS_REGRESSION, kSampleCounts[0], timer);
+		});
+		runner->Run("queue/CalculateUtility/utility=scavenger", [](BenchmarkTimer* timer) {
+			BenchmarkCalculateUtility<ScavengerUtility>(RTT_STATS_REGRESSION, kSampleCounts[0], timer);
+		});
+		for (bool fixed_point : { false, true })
+		{
+			const char* arithmetic = fixed_point ? "fixed_point" : "float";
+			runner->Run(std::string("utility/CalculateVivaceUtility/arithmetic=") + arithmetic, [fixed_point](BenchmarkTimer* timer) {
+				BenchmarkVivaceUtility(fixed_point, timer);
+			});
+			runner->Run(std::string("controller/ComputeRateChange/arithmetic=") + arithmetic, [fixed_point](BenchmarkTimer* timer) {
+				BenchmarkComputeRateChange(fixed_point, timer);
+			});
+		}
+		for (size_t num_flows : kPacerFlowCounts)
+		{
+			std::string name = "pacer/NextFlowToSend/flows=" + std::to_string(num_flows);
+			runner->Run(name, [num_flows](BenchmarkTimer* timer) { BenchmarkPacerSend(num_flows, timer); });
+		}
+	}
+} // namespace
+
+int main(int argc, char** argv)
+{
+	std::string filter;
+	size_t repetitions = 5;
+	bool json = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* value = nullptr;
+		if ((value = FlagValue(argv[i], "filter")))
+			filter = value;
+		else if ((value = FlagValue(argv[i], "repetitions")))
+			repetitions = static_cast<size_t> (std::max(atoi(value), 1));
+		else if (strcmp(argv[i], "--json") == 0)
+			json = true;
+		else
+		{
+			PrintUsage();
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
+
+	BenchmarkRunner runner(repetitions, filter);
+	RunBenchmarks(&runner);
+
+	if (json)
+	{
+		std::vector<std::pair<std::string, std::string> > context;
+		context.push_back(std::make_pair(std::string("benchmark"), std::string("pcc_bench")));
+		runner.PrintJson(stdout, context);
+	} else {
+		runner.PrintText(stdout);
+	}
+	return 0;
+}
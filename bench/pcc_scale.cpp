@@ -0,0 +1,233 @@
+// pcc_scale: times a ShardedFlowManager with 1, 2, 4, ... workers over the
+// same events and reports the events per second, and the speedup and
+// efficiency over one worker, of each.
+//
+//   pcc_scale --flows=4096 --max_workers=8 --json
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "ShardedFlowManager.h"
+
+namespace
+{
+	const QuicTime kRttUs = 20000;
+	const QuicTime kStepUs = 1000;
+	const QuicByteCount kPacketSize = 1400;
+	const QuicPacketCount kInitialCongestionWindow = 10;
+	const QuicPacketCount kMaxCongestionWindow = 100000;
+	// Every this many flows one is an elephant.
+	const size_t kElephantEvery = 50;
+	// Every this many packets one is lost.
+	const QuicPacketNumber kLossEvery = 100;
+	// Ring slots of each shard. Events are posted while the workers are
+	// stopped until a ring is full, then drained with the clock running.
+	const size_t kRingCapacity = 1 << 14;
+
+	void PrintUsage()
+	{
+		fprintf(stderr,
+			"usage: pcc_scale [flags]\n"
+			"  --flows=N        flows (4096)\n"
+			"  --steps=N        steps of each flow, each sending packets and acking the previous step (256)\n"
+			"  --skew=N         packets an elephant sends per step, 1 for none (16)\n"
+			"  --max_workers=N  most workers to time (the number of cores)\n"
+			"  --pin            pin each worker to a core\n"
+			"  --json           print results as JSON\n");
+	}
+
+	// Returns the value of |arg| if it is --|name|=value, otherwise nullptr.
+	const char* FlagValue(const char* arg, const char* name)
+	{
+		size_t length = strlen(name);
+		if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, length) != 0 || arg[2 + length] != '=')
+			return nullptr;
+		return arg + 3 + length;
+	}
+
+	struct ScaleResult
+	{
+		size_t workers = 0;
+		uint64_t events = 0;
+		uint64_t steals = 0;
+		double seconds = 0;
+
+		double events_per_second() const { return seconds > 0 ? events / seconds : 0; }
+	};
+
+	// Posts the events of the flows, step by step, to a manager with
+	// |workers| workers and times how long the workers take to apply them.
+	// Only the draining is timed: events are posted while the workers are
+	// stopped, until a ring fills, then the workers run until they are done.
+	ScaleResult RunScale(size_t workers, size_t flows, size_t steps, size_t skew, bool pin)
+	{
+		ShardedFlowManagerConfig config;
+		config.num_workers = workers;
+		config.ring_capacity = kRingCapacity;
+		// Four times the flows of a shard on average, as the hash spreads them
+		// unevenly.
+		config.max_flows_per_shard = flows / workers / 4 + 64;
+		config.pin_workers = pin;
+		ShardedFlowManager manager(config);
+
+		ScaleResult result;
+		result.workers = workers;
+		std::chrono::steady_clock::duration elapsed(0);
+		uint64_t events = 0;
+		// Applies the events posted so far with the clock running.
+		auto drain = [&]() {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			manager.Start();
+			while (manager.num_processed_slots() != manager.num_posted_slots())
+				std::this_thread::yield();
+			manager.Stop();
+			elapsed += std::chrono::steady_clock::now() - start;
+			result.events += events;
+			events = 0;
+		};
+		// Posts an event, draining the rings first if it does not fit.
+		auto post = [&](auto&& post_event) {
+			if (!post_event())
+			{
+				drain();
+				post_event();
+			}
+			++events;
+		};
+
+		for (uint64_t flow = 0; flow < flows; ++flow)
+			post([&]() { return manager.PostFlowAdded(flow, kRttUs, kInitialCongestionWindow, kMaxCongestionWindow); });
+
+		std::vector<QuicPacketNumber> next_packet(flows, 0);
+		std::vector<QuicPacketNumber> next_ack(flows, 0);
+		AckedPacketVector acked_packets;
+		LostPacketVector lost_packets;
+		for (size_t step = 0; step < steps; ++step)
+		{
+			QuicTime now = static_cast<QuicTime> (step) * kStepUs;
+			for (uint64_t flow = 0; flow < flows; ++flow)
+			{
+				acked_packets.clear();
+				lost_packets.clear();
+				for (; next_ack[flow] < next_packet[flow]; ++next_ack[flow])
+				{
+					CongestionEvent packet = {};
+					packet.packet_number = next_ack[flow];
+					packet.time = static_cast<uint64_t> (now);
+					if (next_ack[flow] % kLossEvery == kLossEvery - 1)
+					{
+						packet.bytes_lost = kPacketSize;
+						lost_packets.push_back(packet);
+					}
+					else
+					{
+						packet.bytes_acked = kPacketSize;
+						acked_packets.push_back(packet);
+					}
+				}
+				if (!acked_packets.empty() || !lost_packets.empty())
+				{
+					QuicTime rtt = kRttUs + static_cast<QuicTime> ((flow + step) % 16) * 100;
+					post([&]() { return manager.PostCongestionEvent(flow, now, rtt, acked_packets, lost_packets); });
+				}
+
+				size_t packets = flow % kElephantEvery == 0 ? skew : 1;
+				for (size_t i = 0; i < packets; ++i)
+				{
+					post([&]() { return manager.PostPacketSent(flow, now, next_packet[flow], kPacketSize, true); });
+					++next_packet[flow];
+				}
+			}
+		}
+		drain();
+
+		if (manager.num_rejected_flows() > 0)
+			fprintf(stderr, "pcc_scale: %llu flows did not fit in their shards\n",
+				static_cast<unsigned long long> (manager.num_rejected_flows()));
+		result.steals = manager.num_steals();
+		result.seconds = std::chrono::duration<double>(elapsed).count();
+		return result;
+	}
+} // namespace
+
+int main(int argc, char** argv)
+{
+	size_t flows = 4096;
+	size_t steps = 256;
+	size_t skew = 16;
+	size_t max_workers = std::max(std::thread::hardware_concurrency(), 1u);
+	bool pin = false;
+	bool json = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* value = nullptr;
+		if ((value = FlagValue(argv[i], "flows")))
+			flows = static_cast<size_t> (std::max(atoi(value), 1));
+		else if ((value = FlagValue(argv[i], "steps")))
+			steps = static_cast<size_t> (std::max(atoi(value), 1));
+		else if ((value = FlagValue(argv[i], "skew")))
+			skew = static_cast<size_t> (std::max(atoi(value), 1));
+		else if ((value = FlagValue(argv[i], "max_workers")))
+			max_workers = static_cast<size_t> (std::max(atoi(value), 1));
+		else if (strcmp(argv[i], "--pin") == 0)
+			pin = true;
+		else if (strcmp(argv[i], "--json") == 0)
+			json = true;
+		else
+		{
+			PrintUsage();
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
+
+	std::vector<size_t> worker_counts;
+	for (size_t workers = 1; workers < max_workers; workers *= 2)
+		worker_counts.push_back(workers);
+	worker_counts.push_back(max_workers);
+
+	std::vector<ScaleResult> results;
+	for (size_t workers : worker_counts)
+		results.push_back(RunScale(workers, flows, steps, skew, pin));
+	double base = results[0].events_per_second();
+
+	if (json)
+	{
+		printf("{\n  \"context\": {\"benchmark\": \"pcc_scale\", \"flows\": %zu, \"steps\": %zu, \"skew\": %zu, \"cores\": %u},\n",
+			flows, steps, skew, std::thread::hardware_concurrency());
+		printf("  \"results\": [\n");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const ScaleResult& result = results[i];
+			double speedup = base > 0 ? result.events_per_second() / base : 0;
+			printf("    {\"workers\": %zu, \"events\": %llu, \"seconds\": %.6f, \"events_per_second\": %.1f, \"speedup\": %.3f, \"efficiency\": %.3f, \"steals\": %llu}%s\n",
+				result.workers,
+				static_cast<unsigned long long> (result.events),
+				result.seconds,
+				result.events_per_second(),
+				speedup,
+				speedup / result.workers,
+				static_cast<unsigned long long> (result.steals),
+				i + 1 < results.size() ? "," : "");
+		}
+		printf("  ]\n}\n");
+	} else {
+		printf("%-8s %14s %9s %11s %8s\n", "workers", "events/s", "speedup", "efficiency", "steals");
+		for (const ScaleResult& result : results)
+		{
+			double speedup = base > 0 ? result.events_per_second() / base : 0;
+			printf("%-8zu %14.0f %8.2fx %10.0f%% %8llu\n",
+				result.workers,
+				result.events_per_second(),
+				speedup,
+				100 * speedup / result.workers,
+				static_cast<unsigned long long> (result.steals));
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,519 @@
+#include "Simulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+
+namespace
+{
+	// Number of microseconds per second.
+	const double kNumMicrosPerSecond = 1000000.0;
+	// Number of bits per byte.
+	const double kBitsPerByte = 8.0;
+	// Lost packets without a later ack are reported after this many RTTs.
+	const QuicTime kLossTimeoutRtts = 3;
+
+	// A packet of a flow that is neither acked nor reported lost.
+	struct OutstandingPacket
+	{
+		QuicPacketNumber packet_number;
+		QuicByteCount bytes;
+		QuicTime sent_time;
+		// Time the ack reaches the sender, or -1 until the packet leaves the
+		// bottleneck.
+		QuicTime ack_time;
+		bool dropped;
+	};
+} // namespace
+
+struct Simulator::Flow
+{
+	Flow(const FlowConfig& config, QuicTime rtt_us) :
+		config(config),
+		rtt_us(rtt_us),
+		controller(rtt_us, config.initial_congestion_window, config.max_congestion_window, config.pcc_config)
+	{
+	}
+
+	FlowConfig config;
+	// Round-trip propagation delay of this flow.
+	QuicTime rtt_us;
+	CongestionController controller;
+
+	QuicPacketNumber next_packet_number = 0;
+	// Send time of the next packet, kept fractional for fast links.
+	double next_send_time_us = 0.0;
+	// Packets in packet number order, starting with the oldest unreported.
+	std::deque<OutstandingPacket> outstanding;
+	bool loss_timeout_pending = false;
+	// The oldest dropped packet timed out behind a packet still in flight, and
+	// is reported lost with the ack of that packet.
+	bool loss_timeout_overdue = false;
+	// Deadline the controller timer is scheduled for.
+	QuicTime controller_timer_deadline = CongestionController::kNoTimerDeadline;
+	// Reusable congestion event storage.
+	AckedPacketVector acked_packets;
+	LostPacketVector lost_packets;
+
+	// Bytes delivered in the current sample interval.
+	QuicByteCount sample_bytes = 0;
+	FlowResult result;
+};
+
+Simulator::Simulator(const SimulationConfig& config) :
+	config_(config),
+	random_(config.seed),
+	bandwidth_bps_(config.link.bandwidth_bps)
+{
+	for (const FlowConfig& flow_config : config_.flows)
+	{
+		flows_.emplace_back(new Flow(flow_config, config_.link.rtt_us + flow_config.extra_rtt_us));
+		flows_.back()->controller.set_random_seed(config.seed + flows_.size() - 1);
+	}
+}
+
+Simulator::~Simulator()
+{
+}
+
+SimulationResult Simulator::Run()
+{
+	for (size_t i = 0; i < flows_.size(); ++i)
+	{
+		Schedule(flows_[i]->config.start_time_us, FLOW_START, static_cast<uint32_t> (i));
+		if (flows_[i]->config.stop_time_us != 0)
+			Schedule(flows_[i]->config.stop_time_us, FLOW_STOP, static_cast<uint32_t> (i));
+	}
+	for (size_t i = 0; i < config_.link.bandwidth_steps.size(); ++i)
+		Schedule(config_.link.bandwidth_steps[i].time_us, BANDWIDTH_STEP, static_cast<uint32_t> (i));
+	Schedule(config_.sample_interval_us, SAMPLE, 0);
+
+	while (!events_.empty() && events_.top().time <= config_.duration_us)
+	{
+		Event event = events_.top();
+		events_.pop();
+		now_ = event.time;
+		++num_events_;
+
+		switch (event.type)
+		{
+			case FLOW_START:
+				OnFlowStart(event.index);
+				break;
+			case FLOW_STOP:
+				OnFlowStop(event.index);
+				break;
+			case FLOW_SEND:
+				OnFlowSend(event.index);
+				break;
+			case LINK_DEPARTURE:
+				OnLinkDeparture();
+				break;
+			case ACK_ARRIVAL:
+				OnAckArrival(event.index);
+				break;
+			case LOSS_TIMEOUT:
+				OnLossTimeout(event.index);
+				break;
+			case CONTROLLER_TIMER:
+				OnControllerTimer(event.index);
+				break;
+			case BANDWIDTH_STEP:
+				capacity_bits_ += bandwidth_bps_ * (now_ - capacity_accounted_until_) / kNumMicrosPerSecond;
+				capacity_accounted_until_ = now_;
+				bandwidth_bps_ = config_.link.bandwidth_steps[event.index].bandwidth_bps;
+				break;
+			case SAMPLE:
+				OnSample();
+				break;
+		}
+	}
+	now_ = config_.duration_us;
+	capacity_bits_ += bandwidth_bps_ * (now_ - capacity_accounted_until_) / kNumMicrosPerSecond;
+	capacity_accounted_until_ = now_;
+
+	SimulationResult result;
+	result.num_events = num_events_;
+	result.link_utilization = capacity_bits_ > 0.0 ? delivered_bits_ / capacity_bits_ : 0.0;
+	result.loss_rate = packets_sent_ > 0 ? static_cast<double> (packets_dropped_) / packets_sent_ : 0.0;
+	if (!queueing_delays_us_.empty())
+	{
+		double sum = 0.0;
+		for (int32_t delay : queueing_delays_us_)
+			sum += delay;
+		result.mean_queueing_delay_us = sum / queueing_delays_us_.size();
+		size_t p99_index = queueing_delays_us_.size() * 99 / 100;
+		std::nth_element(queueing_delays_us_.begin(), queueing_delays_us_.begin() + p99_index, queueing_delays_us_.end());
+		result.p99_queueing_delay_us = queueing_delays_us_[p99_index];
+	}
+
+	for (const std::unique_ptr<Flow>& flow : flows_)
+	{
+		FlowResult flow_result = flow->result;
+		flow_result.controller_stats = flow->controller.stats();
+		QuicTime end = flow->config.stop_time_us != 0 ? std::min(flow->config.stop_time_us, config_.duration_us) : config_.duration_us;
+		QuicTime active_us = end - flow->config.start_time_us;
+		if (active_us > 0)
+			flow_result.throughput_bps = flow_result.bytes_delivered * kBitsPerByte * kNumMicrosPerSecond / active_us;
+		result.flows.push_back(flow_result);
+	}
+	ComputeEpochs(&result);
+	return result;
+}
+
+void Simulator::Schedule(QuicTime time, EventType type, uint32_t index)
+{
+	Event event;
+	event.time = time;
+	event.sequence = next_sequence_++;
+	event.type = type;
+	event.index = index;
+	events_.push(event);
+}
+
+void Simulator::OnFlowStart(uint32_t index)
+{
+	Flow& flow = *flows_[index];
+	if (flow.config.path_cache != nullptr)
+		flow.controller.set_path_cache(flow.config.path_cache, flow.config.destination, now_);
+	flow.next_send_time_us = static_cast<double> (now_);
+	OnFlowSend(index);
+}
+
+void Simulator::OnFlowStop(uint32_t index)
+{
+	flows_[index]->controller.OnConnectionClosed(now_);
+}
+
+void Simulator::OnFlowSend(uint32_t index)
+{
+	Flow& flow = *flows_[index];
+	if (!IsActive(flow, now_))
+		return;
+
+	Packet packet;
+	packet.flow = index;
+	packet.packet_number = flow.next_packet_number++;
+	packet.bytes = flow.config.packet_size;
+	packet.sent_time = now_;
+	packet.enqueue_time = now_;
+	flow.controller.OnPacketSent(now_, packet.packet_number, packet.bytes, true);
+	if (flow.config.event_log != nullptr)
+		flow.config.event_log->OnPacketSent(now_, packet.packet_number, packet.bytes, true);
+	ArmControllerTimer(index);
+	++packets_sent_;
+	++flow.result.packets_sent;
+
+	OutstandingPacket outstanding;
+	outstanding.packet_number = packet.packet_number;
+	outstanding.bytes = packet.bytes;
+	outstanding.sent_time = now_;
+	outstanding.ack_time = -1;
+	outstanding.dropped = false;
+
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	bool randomly_lost = config_.link.random_loss_rate > 0.0 && uniform(random_) < config_.link.random_loss_rate;
+	if (randomly_lost || link_queue_bytes_ + packet.bytes > config_.link.buffer_bytes)
+	{
+		outstanding.dropped = true;
+		++packets_dropped_;
+		if (!flow.loss_timeout_pending)
+		{
+			flow.loss_timeout_pending = true;
+			Schedule(now_ + kLossTimeoutRtts * flow.rtt_us, LOSS_TIMEOUT, index);
+		}
+	} else {
+		link_queue_.push_back(packet);
+		link_queue_bytes_ += packet.bytes;
+		StartTransmission();
+	}
+	flow.outstanding.push_back(outstanding);
+
+	QuicBandwidth pacing_rate = std::max<QuicBandwidth>(flow.controller.PacingRate(), 1.0);
+	flow.next_send_time_us = std::max(flow.next_send_time_us + packet.bytes * kBitsPerByte * kNumMicrosPerSecond / pacing_rate,
+		static_cast<double> (now_));
+	Schedule(static_cast<QuicTime> (std::ceil(flow.next_send_time_us)), FLOW_SEND, index);
+}
+
+void Simulator::StartTransmission()
+{
+	if (link_busy_ || link_queue_head_ == link_queue_.size())
+		return;
+
+	const Packet& packet = link_queue_[link_queue_head_];
+	queueing_delays_us_.push_back(static_cast<int32_t> (now_ - packet.enqueue_time));
+	double transmission_us = packet.bytes * kBitsPerByte * kNumMicrosPerSecond / bandwidth_bps_;
+	transmission_end_us_ = std::max(transmission_end_us_, static_cast<double> (now_)) + transmission_us;
+	link_busy_ = true;
+	Schedule(std::max(now_, static_cast<QuicTime> (std::ceil(transmission_end_us_))), LINK_DEPARTURE, 0);
+}
+
+void Simulator::OnLinkDeparture()
+{
+	Packet packet = link_queue_[link_queue_head_++];
+	link_queue_bytes_ -= packet.bytes;
+	link_busy_ = false;
+	if (link_queue_head_ * 2 >= link_queue_.size())
+	{
+		link_queue_.erase(link_queue_.begin(), link_queue_.begin() + link_queue_head_);
+		link_queue_head_ = 0;
+	}
+
+	Flow& flow = *flows_[packet.flow];
+	delivered_bits_ += packet.bytes * kBitsPerByte;
+	flow.sample_bytes += packet.bytes;
+	flow.result.bytes_delivered += packet.bytes;
+
+	OutstandingPacket& outstanding = flow.outstanding[packet.packet_number - flow.outstanding.front().packet_number];
+	outstanding.ack_time = now_ + flow.rtt_us;
+	Schedule(outstanding.ack_time, ACK_ARRIVAL, packet.flow);
+
+	StartTransmission();
+}
+
+void Simulator::OnAckArrival(uint32_t index)
+{
+	Flow& flow = *flows_[index];
+	bool overdue = flow.loss_timeout_overdue;
+	DeliverCongestionEvent(index, overdue);
+	if (overdue)
+		ArmLossTimeout(index);
+}
+
+void Simulator::OnLossTimeout(uint32_t index)
+{
+	Flow& flow = *flows_[index];
+	flow.loss_timeout_pending = false;
+	DeliverCongestionEvent(index, true);
+	ArmLossTimeout(index);
+}
+
+void Simulator::ArmLossTimeout(uint32_t index)
+{
+	Flow& flow = *flows_[index];
+	flow.loss_timeout_overdue = false;
+	for (const OutstandingPacket& packet : flow.outstanding)
+	{
+		if (packet.dropped)
+		{
+			// Past its timeout, the packet is only left because a packet in
+			// front of it is still in flight, and a timeout now would find it
+			// stuck again.
+			QuicTime deadline = packet.sent_time + kLossTimeoutRtts * flow.rtt_us;
+			if (deadline <= now_)
+			{
+				flow.loss_timeout_overdue = true;
+				return;
+			}
+			flow.loss_timeout_pending = true;
+			Schedule(deadline, LOSS_TIMEOUT, index);
+			return;
+		}
+	}
+}
+
+void Simulator::DeliverCongestionEvent(uint32_t index, bool on_timeout)
+{
+	Flow& flow = *flows_[index];
+	flow.acked_packets.clear();
+	flow.lost_packets.clear();
+
+	// Acks arrive in packet number order, so a dropped packet is detected as
+	// lost once a later packet is acked, or by the loss timeout.
+	size_t num_reported = 0;
+	QuicTime latest_sent_time = -1;
+	for (size_t i = 0; i < flow.outstanding.size(); ++i)
+	{
+		const OutstandingPacket& packet = flow.outstanding[i];
+		if (packet.dropped)
+		{
+			if (on_timeout && packet.sent_time + kLossTimeoutRtts * flow.rtt_us <= now_)
+				num_reported = i + 1;
+			continue;
+		}
+		if (packet.ack_time < 0 || packet.ack_time > now_)
+			break;
+		latest_sent_time = packet.sent_time;
+		num_reported = i + 1;
+	}
+	if (num_reported == 0)
+		return;
+
+	for (size_t i = 0; i < num_reported; ++i)
+	{
+		const OutstandingPacket& packet = flow.outstanding.front();
+		CongestionEvent event;
+		event.packet_number = packet.packet_number;
+		event.time = static_cast<uint64_t> (now_);
+		if (packet.dropped)
+		{
+			event.bytes_acked = 0;
+			event.bytes_lost = static_cast<int32_t> (packet.bytes);
+			flow.lost_packets.push_back(event);
+			++flow.result.packets_lost;
+		} else {
+			event.bytes_acked = static_cast<int32_t> (packet.bytes);
+			event.bytes_lost = 0;
+			flow.acked_packets.push_back(event);
+		}
+		flow.outstanding.pop_front();
+	}
+
+	QuicTime rtt = latest_sent_time >= 0 ? now_ - latest_sent_time : 0;
+	flow.controller.OnCongestionEvent(now_, rtt, flow.acked_packets, flow.lost_packets);
+	if (flow.config.event_log != nullptr)
+		flow.config.event_log->OnCongestionEvent(now_, rtt, flow.acked_packets, flow.lost_packets);
+	ArmControllerTimer(index);
+}
+
+void Simulator::OnControllerTimer(uint32_t index)
+{
+	Flow& flow = *flows_[index];
+	// Superseded by an earlier deadline, whose event rescheduled the timer.
+	if (now_ != flow.controller_timer_deadline)
+		return;
+
+	flow.controller_timer_deadline = CongestionController::kNoTimerDeadline;
+	if (!IsActive(flow, now_))
+		return;
+	flow.controller.OnTimer(now_);
+	if (flow.config.event_log != nullptr)
+		flow.config.event_log->OnTimer(now_);
+	ArmControllerTimer(index);
+}
+
+void Simulator::ArmControllerTimer(uint32_t index)
+{
+	Flow& flow = *flows_[index];
+	if (!flow.config.use_controller_timer)
+		return;
+
+	QuicTime deadline = flow.controller.NextTimerDeadline();
+	if (deadline == CongestionController::kNoTimerDeadline)
+		return;
+	deadline = std::max(deadline, now_);
+	if (deadline >= flow.controller_timer_deadline && flow.controller_timer_deadline >= now_)
+		return;
+	flow.controller_timer_deadline = deadline;
+	Schedule(deadline, CONTROLLER_TIMER, index);
+}
+
+void Simulator::OnSample()
+{
+	double interval_us = static_cast<double> (config_.sample_interval_us);
+	capacity_bits_ += bandwidth_bps_ * (now_ - capacity_accounted_until_) / kNumMicrosPerSecond;
+	capacity_accounted_until_ = now_;
+	capacity_samples_bps_.push_back((capacity_bits_ - sampled_capacity_bits_) * kNumMicrosPerSecond / interval_us);
+	sampled_capacity_bits_ = capacity_bits_;
+
+	for (const std::unique_ptr<Flow>& flow : flows_)
+	{
+		flow->result.throughput_samples_bps.push_back(flow->sample_bytes * kBitsPerByte * kNumMicrosPerSecond / interval_us);
+		flow->result.pacing_rate_samples_bps.push_back(IsActive(*flow, now_) ? flow->controller.PacingRate() : 0.0);
+		flow->sample_bytes = 0;
+	}
+	Schedule(now_ + config_.sample_interval_us, SAMPLE, 0);
+}
+
+bool Simulator::IsActive(const Flow& flow, QuicTime time) const
+{
+	return time >= flow.config.start_time_us &&
+		(flow.config.stop_time_us == 0 || time < flow.config.stop_time_us);
+}
+
+void Simulator::ComputeEpochs(SimulationResult* result) const
+{
+	std::vector<QuicTime> changes(1, 0);
+	for (const std::unique_ptr<Flow>& flow : flows_)
+	{
+		changes.push_back(flow->config.start_time_us);
+		if (flow->config.stop_time_us != 0)
+			changes.push_back(flow->config.stop_time_us);
+	}
+	for (const BandwidthStep& step : config_.link.bandwidth_steps)
+		changes.push_back(step.time_us);
+	changes.push_back(config_.duration_us);
+	std::sort(changes.begin(), changes.end());
+	changes.erase(std::unique(changes.begin(), changes.end()), changes.end());
+
+	const QuicTime interval = config_.sample_interval_us;
+	for (size_t e = 0; e + 1 < changes.size() && changes[e] < config_.duration_us; ++e)
+	{
+		EpochResult epoch;
+		epoch.start_time_us = changes[e];
+		epoch.end_time_us = changes[e + 1];
+
+		std::vector<size_t> active;
+		for (size_t f = 0; f < flows_.size(); ++f)
+		{
+			if (IsActive(*flows_[f], epoch.start_time_us))
+				active.push_back(f);
+		}
+		epoch.num_active_flows = active.size();
+
+		// Samples lying entirely within the epoch.
+		size_t first_sample = static_cast<size_t> ((epoch.start_time_us + interval - 1) / interval);
+		size_t end_sample = std::min(static_cast<size_t> (epoch.end_time_us / interval), capacity_samples_bps_.size());
+		if (active.empty() || first_sample >= end_sample)
+		{
+			result->epochs.push_back(epoch);
+			continue;
+		}
+
+		double capacity = 0.0;
+		double delivered = 0.0;
+		std::vector<double> flow_throughput(active.size(), 0.0);
+		for (size_t s = first_sample; s < end_sample; ++s)
+		{
+			capacity += capacity_samples_bps_[s];
+			for (size_t a = 0; a < active.size(); ++a)
+			{
+				flow_throughput[a] += result->flows[active[a]].throughput_samples_bps[s];
+				delivered += result->flows[active[a]].throughput_samples_bps[s];
+			}
+		}
+		size_t num_samples = end_sample - first_sample;
+		epoch.fair_share_bps = capacity / num_samples / active.size();
+		epoch.link_utilization = delivered / capacity;
+
+		double sum = 0.0;
+		double sum_of_squares = 0.0;
+		for (double throughput : flow_throughput)
+		{
+			sum += throughput / num_samples;
+			sum_of_squares += (throughput / num_samples) * (throughput / num_samples);
+		}
+		if (sum_of_squares > 0.0)
+			epoch.jain_fairness_index = sum * sum / (active.size() * sum_of_squares);
+
+		// A flow converged at the start of the trailing run of samples within
+		// the tolerance of the fair share; all flows converged once the last of
+		// them did.
+		size_t converged_from = first_sample;
+		std::vector<size_t> flow_converged_from(active.size(), end_sample);
+		for (size_t a = 0; a < active.size(); ++a)
+		{
+			for (size_t s = end_sample; s > first_sample; --s)
+			{
+				double fair_share = capacity_samples_bps_[s - 1] / active.size();
+				double throughput = result->flows[active[a]].throughput_samples_bps[s - 1];
+				if (std::fabs(throughput - fair_share) > kConvergenceTolerance * fair_share)
+					break;
+				flow_converged_from[a] = s - 1;
+			}
+			converged_from = std::max(converged_from, flow_converged_from[a]);
+		}
+
+		if (converged_from < end_sample)
+			epoch.convergence_time_us = static_cast<QuicTime> (converged_from) * interval - epoch.start_time_us;
+		for (size_t a = 0; a < active.size(); ++a)
+		{
+			FlowResult& flow_result = result->flows[active[a]];
+			QuicTime start = flows_[active[a]]->config.start_time_us;
+			if (start == epoch.start_time_us && flow_converged_from[a] < end_sample)
+				flow_result.convergence_time_us = static_cast<QuicTime> (flow_converged_from[a]) * interval - start;
+		}
+		result->epochs.push_back(epoch);
+	}
+}
@@ -0,0 +1,239 @@
+// Deterministic discrete-event model of PCC flows sharing one bottleneck.
+
+#ifndef PCC_SIM_SIMULATOR_H_
+#define PCC_SIM_SIMULATOR_H_
+
+#include <cstdint>
+#include <memory>
+#include <queue>
+#include <random>
+#include <vector>
+
+#include "CongestionController.h"
+#include "ReplayLog.h"
+
+// A change of the bottleneck bandwidth at |time_us|.
+struct BandwidthStep
+{
+	QuicTime time_us = 0;
+	double bandwidth_bps = 0.0;
+};
+
+// LinkConfig, the shared bottleneck: a drop-tail FIFO drained at the
+// bottleneck bandwidth, followed by a fixed propagation delay.
+
+struct LinkConfig
+{
+	double bandwidth_bps = 100e6;
+	// Round-trip propagation delay, all of it behind the bottleneck queue.
+	QuicTime rtt_us = 30000;
+	// Capacity of the bottleneck buffer.
+	QuicByteCount buffer_bytes = 375000;
+	// Probability that a packet is dropped regardless of the buffer.
+	double random_loss_rate = 0.0;
+	// Bandwidth changes, in time order.
+	std::vector<BandwidthStep> bandwidth_steps;
+};
+
+// FlowConfig, a PCC sender that always has data to send while active.
+
+struct FlowConfig
+{
+	QuicTime start_time_us = 0;
+	// Time the flow stops sending, or 0 to send until the end.
+	QuicTime stop_time_us = 0;
+	// Propagation delay added to this flow's round trip only.
+	QuicTime extra_rtt_us = 0;
+	QuicByteCount packet_size = 1400;
+	QuicPacketCount initial_congestion_window = 10;
+	QuicPacketCount max_congestion_window = 100000;
+	// Tuning of the flow's controller.
+	std::shared_ptr<const PccConfig> pcc_config = PccConfig::Default();
+	// Records the calls of the flow's controller for pcc_replay if not null.
+	// Not owned, and must be open.
+	ReplayLogWriter* event_log = nullptr;
+	// Shares the path to |destination| with the flows before and after this
+	// one if not null (see BasicCongestionController::set_path_cache). Not
+	// owned.
+	PathCache* path_cache = nullptr;
+	uint64_t destination = 0;
+	// Calls the controller's OnTimer() at its NextTimerDeadline(), as a
+	// transport with a timer would.
+	bool use_controller_timer = false;
+};
+
+// SimulationConfig, everything that determines a simulation run. Two runs of
+// the same config produce the same results.
+
+struct SimulationConfig
+{
+	LinkConfig link;
+	std::vector<FlowConfig> flows;
+	QuicTime duration_us = 30000000;
+	// Width of the throughput samples used for convergence.
+	QuicTime sample_interval_us = 100000;
+	// Seeds the random loss and the controllers' probing order.
+	uint64_t seed = 1;
+};
+
+// FlowResult, what one flow achieved.
+
+struct FlowResult
+{
+	// Average goodput while the flow was active.
+	double throughput_bps = 0.0;
+	QuicByteCount bytes_delivered = 0;
+	uint64_t packets_sent = 0;
+	uint64_t packets_lost = 0;
+	// Time from the flow's start until its throughput stays within the
+	// convergence tolerance of its fair share up to the next change of the
+	// link or the set of flows, or -1 if it never does.
+	QuicTime convergence_time_us = -1;
+	// Goodput of each sample interval, 0 while inactive.
+	std::vector<double> throughput_samples_bps;
+	// Pacing rate at the end of each sample interval.
+	std::vector<double> pacing_rate_samples_bps;
+	// Stats of the flow's controller at the end of the run.
+	ControllerStats controller_stats;
+};
+
+// EpochResult, the period between two changes of the link bandwidth or the
+// set of active flows.
+
+struct EpochResult
+{
+	QuicTime start_time_us = 0;
+	QuicTime end_time_us = 0;
+	size_t num_active_flows = 0;
+	double fair_share_bps = 0.0;
+	// Time from the start of the epoch until all active flows stay within the
+	// convergence tolerance of the fair share, or -1 if they never do.
+	QuicTime convergence_time_us = -1;
+	// Jain's fairness index of the active flows' throughput over the epoch.
+	double jain_fairness_index = 0.0;
+	double link_utilization = 0.0;
+};
+
+// SimulationResult, link-wide and per-flow metrics of a run.
+
+struct SimulationResult
+{
+	std::vector<FlowResult> flows;
+	std::vector<EpochResult> epochs;
+	// Delivered bits over the bits the link could have carried.
+	double link_utilization = 0.0;
+	double mean_queueing_delay_us = 0.0;
+	double p99_queueing_delay_us = 0.0;
+	// Packets dropped by the buffer or at random over packets sent.
+	double loss_rate = 0.0;
+	uint64_t num_events = 0;
+};
+
+// Relative distance from the fair share within which a flow is converged.
+const double kConvergenceTolerance = 0.1;
+
+// Simulator runs a SimulationConfig on a virtual clock. Each flow drives its
+// own CongestionController through OnPacketSent and OnCongestionEvent.
+
+class Simulator
+{
+public:
+	explicit Simulator(const SimulationConfig& config);
+	~Simulator();
+	Simulator(const Simulator&) = delete;
+	Simulator& operator=(const Simulator&) = delete;
+
+	// Runs the whole simulation. May only be called once.
+	SimulationResult Run();
+
+private:
+	enum EventType
+	{
+		FLOW_START,
+		FLOW_STOP,
+		FLOW_SEND,
+		LINK_DEPARTURE,
+		ACK_ARRIVAL,
+		LOSS_TIMEOUT,
+		CONTROLLER_TIMER,
+		BANDWIDTH_STEP,
+		SAMPLE
+	};
+
+	struct Event
+	{
+		QuicTime time;
+		// Insertion order, breaks ties deterministically.
+		uint64_t sequence;
+		EventType type;
+		uint32_t index;
+
+		bool operator>(const Event& other) const
+		{
+			return time != other.time ? time > other.time : sequence > other.sequence;
+		}
+	};
+
+	struct Packet
+	{
+		uint32_t flow;
+		QuicPacketNumber packet_number;
+		QuicByteCount bytes;
+		QuicTime sent_time;
+		QuicTime enqueue_time;
+	};
+
+	struct Flow;
+
+	void Schedule(QuicTime time, EventType type, uint32_t index);
+	void OnFlowStart(uint32_t flow);
+	void OnFlowStop(uint32_t flow);
+	void OnFlowSend(uint32_t flow);
+	void OnLinkDeparture();
+	void OnAckArrival(uint32_t flow);
+	void OnLossTimeout(uint32_t flow);
+	void OnControllerTimer(uint32_t flow);
+	// Schedules the loss timeout of the oldest dropped packet of |flow|, if
+	// any.
+	void ArmLossTimeout(uint32_t flow);
+	// Schedules the controller timer of |flow| if its deadline moved earlier.
+	void ArmControllerTimer(uint32_t flow);
+	void OnSample();
+	// Starts transmitting the packet at the head of the bottleneck queue.
+	void StartTransmission();
+	// Reports the acked and lost packets of |flow| due by now.
+	void DeliverCongestionEvent(uint32_t flow, bool on_timeout);
+	bool IsActive(const Flow& flow, QuicTime time) const;
+
+	void ComputeEpochs(SimulationResult* result) const;
+
+	SimulationConfig config_;
+	QuicTime now_ = 0;
+	uint64_t next_sequence_ = 0;
+	std::priority_queue<Event, std::vector<Event>, std::greater<Event> > events_;
+	std::mt19937_64 random_;
+
+	std::vector<std::unique_ptr<Flow> > flows_;
+
+	// Bottleneck state.
+	double bandwidth_bps_;
+	std::vector<Packet> link_queue_;
+	size_t link_queue_head_ = 0;
+	QuicByteCount link_queue_bytes_ = 0;
+	bool link_busy_ = false;
+	// End of the current transmission, kept fractional for fast links.
+	double transmission_end_us_ = 0.0;
+	// Bits delivered and bits the link could have delivered.
+	double delivered_bits_ = 0.0;
+	double capacity_bits_ = 0.0;
+	QuicTime capacity_accounted_until_ = 0;
+	std::vector<int32_t> queueing_delays_us_;
+	uint64_t packets_sent_ = 0;
+	uint64_t packets_dropped_ = 0;
+	// Average link capacity during each sample interval.
+	std::vector<double> capacity_samples_bps_;
+	double sampled_capacity_bits_ = 0.0;
+	uint64_t num_events_ = 0;
+};
+
+#endif  // PCC_SIM_SIMULATOR_H_
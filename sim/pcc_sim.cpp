@@ -0,0 +1,325 @@
+// pcc_sim: runs PCC flows over a simulated bottleneck and reports how well
+// they use it.
+//
+//   pcc_sim --bandwidth_mbps=100 --rtt_ms=30 --buffer_bdp=1 --loss=0.001
+//           --duration_s=30 --flows=1 --bw_step=10:50 --json
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "ReplayLog.h"
+#include "Simulator.h"
+#include "Trace.h"
+
+namespace
+{
+	void PrintUsage()
+	{
+		fprintf(stderr,
+			"usage: pcc_sim [flags]\n"
+			"  --bandwidth_mbps=N   bottleneck bandwidth (100)\n"
+			"  --rtt_ms=N           round-trip propagation delay (30)\n"
+			"  --buffer_bdp=N       buffer size in bandwidth-delay products (1)\n"
+			"  --buffer_kb=N        buffer size in kilobytes, overrides --buffer_bdp\n"
+			"  --loss=P             random loss probability (0)\n"
+			"  --duration_s=N       simulated time (30)\n"
+			"  --flows=N            number of flows (1)\n"
+			"  --flow_interval_s=N  delay between flow starts (0)\n"
+			"  --bw_step=T:MBPS     set the bandwidth to MBPS at T seconds, repeatable\n"
+			"  --seed=N             random seed (1)\n"
+			"  --preset=NAME        controller tuning: datacenter, wan or satellite (wan)\n"
+			"  --fixed_point        compute utilities and rate changes in fixed point\n"
+			"  --gradient=NAME      utility gradient: pair or least_squares (pair)\n"
+			"  --quiescent_rounds=N steady DECISION_MADE rounds before the quiescent\n"
+			"                       fast path, 0 for never (0)\n"
+			"  --flow_duration_s=N  time each flow sends, 0 for until the end (0)\n"
+			"  --warm_start         start each flow from what the earlier flows learned\n"
+			"  --timer              call each controller's OnTimer at its deadline\n"
+			"  --record=PATH        record the first flow's events to PATH, see pcc_replay\n"
+			"  --trace=PATH         write a decision trace to PATH, see pcc_trace\n"
+			"  --stats=PATH         write each flow's controller stats to PATH in the\n"
+			"                       Prometheus text format\n"
+			"  --json               print results as JSON\n");
+	}
+
+	// Returns the value of |arg| if it is --|name|=value, otherwise nullptr.
+	const char* FlagValue(const char* arg, const char* name)
+	{
+		size_t length = strlen(name);
+		if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, length) != 0 || arg[2 + length] != '=')
+			return nullptr;
+		return arg + 3 + length;
+	}
+
+	void PrintJson(const SimulationConfig& config, const SimulationResult& result, double wall_seconds)
+	{
+		printf("{\n");
+		printf("  \"bandwidth_bps\": %.0f,\n", config.link.bandwidth_bps);
+		printf("  \"rtt_us\": %lld,\n", static_cast<long long> (config.link.rtt_us));
+		printf("  \"buffer_bytes\": %lld,\n", static_cast<long long> (config.link.buffer_bytes));
+		printf("  \"random_loss_rate\": %g,\n", config.link.random_loss_rate);
+		printf("  \"duration_us\": %lld,\n", static_cast<long long> (config.duration_us));
+		printf("  \"seed\": %llu,\n", static_cast<unsigned long long> (config.seed));
+		printf("  \"link_utilization\": %.6f,\n", result.link_utilization);
+		printf("  \"mean_queueing_delay_us\": %.1f,\n", result.mean_queueing_delay_us);
+		printf("  \"p99_queueing_delay_us\": %.1f,\n", result.p99_queueing_delay_us);
+		printf("  \"loss_rate\": %.6f,\n", result.loss_rate);
+		printf("  \"events\": %llu,\n", static_cast<unsigned long long> (result.num_events));
+		printf("  \"wall_seconds\": %.3f,\n", wall_seconds);
+		printf("  \"flows\": [\n");
+		for (size_t i = 0; i < result.flows.size(); ++i)
+		{
+			const FlowResult& flow = result.flows[i];
+			printf("    {\"throughput_bps\": %.0f, \"packets_sent\": %llu, \"packets_lost\": %llu, \"convergence_time_us\": %lld}%s\n",
+				flow.throughput_bps,
+				static_cast<unsigned long long> (flow.packets_sent),
+				static_cast<unsigned long long> (flow.packets_lost),
+				static_cast<long long> (flow.convergence_time_us),
+				i + 1 < result.flows.size() ? "," : "");
+		}
+		printf("  ],\n");
+		printf("  \"epochs\": [\n");
+		for (size_t i = 0; i < result.epochs.size(); ++i)
+		{
+			const EpochResult& epoch = result.epochs[i];
+			printf("    {\"start_us\": %lld, \"end_us\": %lld, \"flows\": %zu, \"fair_share_bps\": %.0f, \"convergence_time_us\": %lld, \"jain_fairness_index\": %.4f, \"link_utilization\": %.4f}%s\n",
+				static_cast<long long> (epoch.start_time_us),
+				static_cast<long long> (epoch.end_time_us),
+				epoch.num_active_flows,
+				epoch.fair_share_bps,
+				static_cast<long long> (epoch.convergence_time_us),
+				epoch.jain_fairness_index,
+				epoch.link_utilization,
+				i + 1 < result.epochs.size() ? "," : "");
+		}
+		printf("  ]\n");
+		printf("}\n");
+	}
+
+	void PrintText(const SimulationConfig& config, const SimulationResult& result, double wall_seconds)
+	{
+		double simulated_seconds = config.duration_us / 1e6;
+		printf("link: %.1f Mbps, rtt %.1f ms, buffer %lld bytes, loss %g\n",
+			config.link.bandwidth_bps / 1e6,
+			config.link.rtt_us / 1e3,
+			static_cast<long long> (config.link.buffer_bytes),
+			config.link.random_loss_rate);
+		printf("simulated %.1f s in %.3f s (%.0fx real time, %llu events)\n",
+			simulated_seconds,
+			wall_seconds,
+			wall_seconds > 0 ? simulated_seconds / wall_seconds : 0.0,
+			static_cast<unsigned long long> (result.num_events));
+		printf("utilization %.1f%%, queueing delay mean %.2f ms p99 %.2f ms, loss %.3f%%\n",
+			result.link_utilization * 100,
+			result.mean_queueing_delay_us / 1e3,
+			result.p99_queueing_delay_us / 1e3,
+			result.loss_rate * 100);
+		for (size_t i = 0; i < result.flows.size(); ++i)
+		{
+			const FlowResult& flow = result.flows[i];
+			printf("flow %zu: %.2f Mbps, %llu sent, %llu lost, converged %s",
+				i,
+				flow.throughput_bps / 1e6,
+				static_cast<unsigned long long> (flow.packets_sent),
+				static_cast<unsigned long long> (flow.packets_lost),
+				flow.convergence_time_us < 0 ? "never" : "after");
+			if (flow.convergence_time_us >= 0)
+				printf(" %.1f s", flow.convergence_time_us / 1e6);
+			printf("\n");
+		}
+	}
+} // namespace
+
+int main(int argc, char** argv)
+{
+	SimulationConfig config;
+	double buffer_bdp = 1.0;
+	double buffer_kb = -1.0;
+	int num_flows = 1;
+	double flow_interval_s = 0.0;
+	bool json = false;
+	bool fixed_point = false;
+	GradientEstimatorMode gradient_estimator = GRADIENT_PAIR;
+	size_t quiescent_rounds = 0;
+	double flow_duration_s = 0.0;
+	bool warm_start = false;
+	bool timer = false;
+	const char* trace_path = nullptr;
+	const char* record_path = nullptr;
+	const char* stats_path = nullptr;
+	std::shared_ptr<const PccConfig> pcc_config = PccConfig::Wan();
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* value = nullptr;
+		if ((value = FlagValue(argv[i], "bandwidth_mbps")))
+			config.link.bandwidth_bps = atof(value) * 1e6;
+		else if ((value = FlagValue(argv[i], "rtt_ms")))
+			config.link.rtt_us = static_cast<QuicTime> (atof(value) * 1e3);
+		else if ((value = FlagValue(argv[i], "buffer_bdp")))
+			buffer_bdp = atof(value);
+		else if ((value = FlagValue(argv[i], "buffer_kb")))
+			buffer_kb = atof(value);
+		else if ((value = FlagValue(argv[i], "loss")))
+			config.link.random_loss_rate = atof(value);
+		else if ((value = FlagValue(argv[i], "duration_s")))
+			config.duration_us = static_cast<QuicTime> (atof(value) * 1e6);
+		else if ((value = FlagValue(argv[i], "flows")))
+			num_flows = atoi(value);
+		else if ((value = FlagValue(argv[i], "flow_interval_s")))
+			flow_interval_s = atof(value);
+		else if ((value = FlagValue(argv[i], "seed")))
+			config.seed = strtoull(value, nullptr, 10);
+		else if ((value = FlagValue(argv[i], "preset")))
+		{
+			if (strcmp(value, "datacenter") == 0)
+				pcc_config = PccConfig::Datacenter();
+			else if (strcmp(value, "wan") == 0)
+				pcc_config = PccConfig::Wan();
+			else if (strcmp(value, "satellite") == 0)
+				pcc_config = PccConfig::Satellite();
+			else
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if ((value = FlagValue(argv[i], "bw_step")))
+		{
+			const char* colon = strchr(value, ':');
+			if (colon == nullptr)
+			{
+				PrintUsage();
+				return 1;
+			}
+			BandwidthStep step;
+			step.time_us = static_cast<QuicTime> (atof(value) * 1e6);
+			step.bandwidth_bps = atof(colon + 1) * 1e6;
+			config.link.bandwidth_steps.push_back(step);
+		}
+		else if ((value = FlagValue(argv[i], "record")))
+			record_path = value;
+		else if ((value = FlagValue(argv[i], "trace")))
+			trace_path = value;
+		else if ((value = FlagValue(argv[i], "stats")))
+			stats_path = value;
+		else if ((value = FlagValue(argv[i], "flow_duration_s")))
+			flow_duration_s = atof(value);
+		else if (strcmp(argv[i], "--warm_start") == 0)
+			warm_start = true;
+		else if (strcmp(argv[i], "--timer") == 0)
+			timer = true;
+		else if (strcmp(argv[i], "--fixed_point") == 0)
+			fixed_point = true;
+		else if ((value = FlagValue(argv[i], "gradient")))
+		{
+			if (strcmp(value, "pair") == 0)
+				gradient_estimator = GRADIENT_PAIR;
+			else if (strcmp(value, "least_squares") == 0)
+				gradient_estimator = GRADIENT_WEIGHTED_LEAST_SQUARES;
+			else
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if ((value = FlagValue(argv[i], "quiescent_rounds")))
+			quiescent_rounds = static_cast<size_t> (atoi(value));
+		else if (strcmp(argv[i], "--json") == 0)
+			json = true;
+		else
+		{
+			PrintUsage();
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
+
+	if (config.link.bandwidth_bps <= 0 || config.link.rtt_us <= 0 || config.duration_us <= 0 || num_flows <= 0)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (fixed_point || gradient_estimator != GRADIENT_PAIR || quiescent_rounds != 0)
+	{
+		PccConfig tuned_config = *pcc_config;
+		tuned_config.fixed_point_arithmetic = fixed_point;
+		tuned_config.gradient_estimator = gradient_estimator;
+		tuned_config.quiescent_rounds = quiescent_rounds;
+		std::string config_error;
+		pcc_config = PccConfig::Create(tuned_config, &config_error);
+		if (pcc_config == nullptr)
+		{
+			fprintf(stderr, "pcc_sim: %s\n", config_error.c_str());
+			return 1;
+		}
+	}
+
+	config.link.buffer_bytes = buffer_kb >= 0
+		? static_cast<QuicByteCount> (buffer_kb * 1000)
+		: static_cast<QuicByteCount> (buffer_bdp * config.link.bandwidth_bps * config.link.rtt_us / 8e6);
+	PathCache path_cache;
+	for (int i = 0; i < num_flows; ++i)
+	{
+		FlowConfig flow;
+		flow.start_time_us = static_cast<QuicTime> (i * flow_interval_s * 1e6);
+		if (flow_duration_s > 0)
+			flow.stop_time_us = flow.start_time_us + static_cast<QuicTime> (flow_duration_s * 1e6);
+		flow.pcc_config = pcc_config;
+		if (warm_start)
+			flow.path_cache = &path_cache;
+		flow.use_controller_timer = timer;
+		config.flows.push_back(flow);
+	}
+
+	ReplayLogWriter event_log;
+	std::string error;
+	if (record_path != nullptr)
+	{
+		const FlowConfig& flow = config.flows[0];
+		QuicTime rtt_us = config.link.rtt_us + flow.extra_rtt_us;
+		if (!event_log.Open(record_path, rtt_us, flow.initial_congestion_window, flow.max_congestion_window, &error))
+		{
+			fprintf(stderr, "pcc_sim: %s\n", error.c_str());
+			return 1;
+		}
+		config.flows[0].event_log = &event_log;
+	}
+
+	if (trace_path != nullptr && !Trace::Start(trace_path, Trace::kDefaultFileBytes, &error))
+	{
+		fprintf(stderr, "pcc_sim: %s\n", error.c_str());
+		return 1;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Simulator simulator(config);
+	SimulationResult result = simulator.Run();
+	double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	Trace::Stop();
+	if (event_log.is_open() && !event_log.Close())
+	{
+		fprintf(stderr, "pcc_sim: cannot write %s\n", record_path);
+		return 1;
+	}
+	if (stats_path != nullptr)
+	{
+		std::vector<std::pair<std::string, ControllerStats> > series;
+		for (size_t i = 0; i < result.flows.size(); ++i)
+			series.push_back(std::make_pair("flow=\"" + std::to_string(i) + "\"", result.flows[i].controller_stats));
+		if (!WritePrometheusStats(stats_path, series, &error))
+		{
+			fprintf(stderr, "pcc_sim: %s\n", error.c_str());
+			return 1;
+		}
+	}
+
+	if (json)
+		PrintJson(config, result, wall_seconds);
+	else
+		PrintText(config, result, wall_seconds);
+	return 0;
+}
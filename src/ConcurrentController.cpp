@@ -0,0 +1,88 @@
+#include "ConcurrentController.h"
+#include "UtilityFunctions.h"
+
+template <class UtilityFunction>
+BasicConcurrentController<UtilityFunction>::BasicConcurrentController(QuicTime initial_rtt_us,
+	QuicPacketCount initial_congestion_window,
+	QuicPacketCount max_congestion_window,
+	std::shared_ptr<const PccConfig> config,
+	size_t ring_capacity) :
+	controller_(initial_rtt_us, initial_congestion_window, max_congestion_window, std::move(config)),
+	ring_(ring_capacity)
+{
+	PublishOutputs();
+}
+
+template <class UtilityFunction>
+bool BasicConcurrentController<UtilityFunction>::PostPacketSent(QuicTime sent_time, QuicPacketNumber packet_number, QuicByteCount bytes, bool is_retransmittable)
+{
+	if (ring_.PostPacketSent(0, sent_time, packet_number, bytes, is_retransmittable) == 0)
+	{
+		num_dropped_events_.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+template <class UtilityFunction>
+bool BasicConcurrentController<UtilityFunction>::PostCongestionEvent(QuicTime event_time,
+	QuicTime rtt,
+	const AckedPacketVector& acked_packets,
+	const LostPacketVector& lost_packets)
+{
+	if (ring_.PostCongestionEvent(0, event_time, rtt, acked_packets, lost_packets) == 0)
+	{
+		num_dropped_events_.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+template <class UtilityFunction>
+size_t BasicConcurrentController<UtilityFunction>::ProcessEvents(size_t max_events)
+{
+	size_t num_applied = 0;
+	while (num_applied < max_events)
+	{
+		const RingEvent* event = ring_.Front();
+		if (event == nullptr)
+			break;
+
+		if (event->type == RingEvent::PACKET_SENT)
+		{
+			controller_.OnPacketSent(event->time,
+				event->packets[0].packet_number,
+				event->packets[0].bytes_acked,
+				event->is_retransmittable);
+			ring_.PopFront();
+			++num_applied;
+			continue;
+		}
+
+		bool complete = pending_event_.Add(*event);
+		ring_.PopFront();
+		if (!complete)
+			continue;
+
+		controller_.OnCongestionEvent(pending_event_.event_time(),
+			pending_event_.rtt(),
+			pending_event_.acked_packets(),
+			pending_event_.lost_packets());
+		++num_applied;
+	}
+
+	if (num_applied > 0)
+		PublishOutputs();
+	return num_applied;
+}
+
+template <class UtilityFunction>
+void BasicConcurrentController<UtilityFunction>::PublishOutputs()
+{
+	published_.Publish(controller_.PacingRate(), controller_.GetCongestionWindow());
+	published_stats_.Publish(controller_.stats());
+}
+
+template class BasicConcurrentController<VivaceLatencyUtility>;
+template class BasicConcurrentController<VivaceLossUtility>;
+template class BasicConcurrentController<ScavengerUtility>;
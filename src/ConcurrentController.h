@@ -0,0 +1,81 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_CONCURRENT_CONTROLLER_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_CONCURRENT_CONTROLLER_H_
+
+#include <atomic>
+#include <memory>
+
+#include "CongestionController.h"
+#include "EventRing.h"
+#include "RateSnapshot.h"
+
+// BasicConcurrentController runs a BasicCongestionController on a control
+// thread for datapath threads that send packets and receive ACKs. The
+// datapath posts its events to a lock-free EventRing and reads the pacing
+// rate and congestion window from a RatePublisher, so it never waits for the
+// rate logic. The control thread calls ProcessEvents() to apply the posted
+// events in order and publish the new outputs.
+
+template <class UtilityFunction>
+class BasicConcurrentController
+{
+public:
+	// Events the ring holds by default.
+	static const size_t kDefaultRingCapacity = 4096;
+
+	BasicConcurrentController(QuicTime initial_rtt_us,
+		QuicPacketCount initial_congestion_window,
+		QuicPacketCount max_congestion_window,
+		std::shared_ptr<const PccConfig> config = PccConfig::Default(),
+		size_t ring_capacity = kDefaultRingCapacity);
+	BasicConcurrentController(const BasicConcurrentController&) = delete;
+	BasicConcurrentController& operator=(const BasicConcurrentController&) = delete;
+
+	// Datapath, any thread. Each returns false, and counts the event as
+	// dropped, if the ring is full or the event cannot fit in it.
+	bool PostPacketSent(QuicTime sent_time,
+		QuicPacketNumber packet_number,
+		QuicByteCount bytes,
+		bool is_retransmittable);
+	bool PostCongestionEvent(QuicTime event_time,
+		QuicTime rtt,
+		const AckedPacketVector& acked_packets,
+		const LostPacketVector& lost_packets);
+
+	// Datapath, any thread. The outputs as of the last ProcessEvents().
+	QuicBandwidth PacingRate() const { return published_.pacing_rate(); }
+	QuicByteCount GetCongestionWindow() const { return published_.congestion_window(); }
+	// Both outputs from the same ProcessEvents().
+	RateSnapshot Snapshot() const { return published_.Read(); }
+	// Any thread. The controller's stats as of the last ProcessEvents(), for
+	// a metrics thread to aggregate.
+	ControllerStats Stats() const { return published_stats_.Read(); }
+	// Events dropped because the ring was full.
+	uint64_t num_dropped_events() const { return num_dropped_events_.load(std::memory_order_relaxed); }
+
+	// Control thread. Applies up to |max_events| posted sent packets and
+	// congestion events to the controller in posting order, then publishes its
+	// outputs if any were applied. Returns the number applied.
+	size_t ProcessEvents(size_t max_events = SIZE_MAX);
+
+	// Control thread only.
+	BasicCongestionController<UtilityFunction>& controller() { return controller_; }
+
+private:
+	// Publishes the controller's current outputs and stats.
+	void PublishOutputs();
+
+	BasicCongestionController<UtilityFunction> controller_;
+	EventRing ring_;
+	RatePublisher published_;
+	ControllerStatsPublisher published_stats_;
+	alignas(64) std::atomic<uint64_t> num_dropped_events_{0};
+
+	// The congestion event being reassembled from its chunks by the control
+	// thread, which may have seen only some of them.
+	CongestionEventAssembler pending_event_;
+};
+
+// The concurrent controller of the Vivace latency-based utility.
+typedef BasicConcurrentController<VivaceLatencyUtility> ConcurrentController;
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_CONCURRENT_CONTROLLER_H_
@@ -1,62 +1,82 @@
 #include "CongestionController.h"
-
-//#define DEBUG_RATE_CONTROL
+#include "Snapshot.h"
+#include "Trace.h"
+#include "UtilityFunctions.h"
 
 #include <algorithm>
-
-//Ignore RTT fluctuation within 30 percent in STARTING mode
-static float FLAGS_max_rtt_fluctuation_tolerance_ratio_in_starting = 0.3f;
-//Ignore RTT fluctuation within 5 percent in DECISION_MADE mode
-static float FLAGS_max_rtt_fluctuation_tolerance_ratio_in_decision_made = 0.05f;
+#include <cmath>
 
 namespace
 {
 	// Number of bits per Mbit.
 	const size_t kMegabit = 1024 * 1024;
-	const QuicBandwidth kMinSendingRate = 2.0f * kMegabit;
-	// The smallest amount that the rate can be changed by at a time.
-	const QuicBandwidth kMinimumRateChange = (int64_t) (0.5f * kMegabit);
 	// Number of microseconds per second.
 	const float kNumMicrosPerSecond = 1000000.0f;
-	// Default TCPMSS used in UDT only.
-	const size_t kDefaultTCPMSS = 1400;
-	// An inital RTT value to use (10ms)
-	const size_t kInitialRttMicroseconds = 1 * 1000;
-	// Step size for rate change in PROBING mode.
-	const float kProbingStepSize = 0.05f;
-	// Base step size for rate change in DECISION_MADE mode.
-	const float kDecisionMadeStepSize = 0.02f;
-	// Maximum step size for rate change in DECISION_MADE mode.
-	const float kMaxDecisionMadeStepSize = 0.10f;
-	// Groups of useful monitor intervals each time in PROBING mode.
-	const size_t kNumIntervalGroupsInProbing = 2;
 	// Number of bits per byte.
 	const size_t kBitsPerByte = 8;
-	// Minimum number of packers per interval.
-	const size_t kMinimumPacketsPerInterval = 10;
-	// Number of gradients to average.
-	const size_t kAvgGradientSampleSize = 1;
-	// The factor that converts average utility gradient to a rate change (in Mbps).
-	float kUtilityGradientToRateChangeFactor = 1.0f * kMegabit;
-	// The initial maximum proportional rate change.
-	float kInitialMaximumProportionalChange = 0.05f;
-	// The additional maximum proportional change each time it is incremented.
-	float kMaximumProportionalChangeStepSize = 0.06f;
+	// "PCCSTATE" in the leading bytes of a controller snapshot.
+	const uint64_t kSnapshotMagic = 0x4554415453434350ULL;
+	// Version of the snapshot layout, to be bumped whenever it changes.
+	const uint32_t kSnapshotVersion = 5;
 } // namespace
 
-QuicTime CongestionController::ComputeMonitorDuration(QuicBandwidth sending_rate, QuicTime rtt)
+static_assert(ControllerStats::kNumModes == CongestionControllerBase::DECISION_MADE + 1, "ControllerStats counts every SenderMode");
+
+template <class UtilityFunction>
+QuicTime BasicCongestionController<UtilityFunction>::ComputeMonitorDuration(QuicBandwidth sending_rate, QuicTime rtt)
+{
+	return std::max(1.5 * rtt, config_->minimum_packets_per_interval * kBitsPerByte * config_->max_segment_size / sending_rate);
+}
+
+template <class UtilityFunction>
+BasicCongestionController<UtilityFunction>::BasicCongestionController(QuicTime initial_rtt_us, QuicPacketCount initial_congestion_window, QuicPacketCount max_congestion_window, std::shared_ptr<const PccConfig> config) :
+	config_(std::move(config)),
+	sending_rate_( initial_congestion_window * config_->max_segment_size * kBitsPerByte * kNumMicrosPerSecond / initial_rtt_us),
+	interval_queue_(*this, *config_, MonitorIntervalCapacity(*config_)),
+	initial_rtt_(initial_rtt_us),
+	fixed_rate_control_coefficients_(ToFixedPoint(*config_)),
+	gradient_estimator_(config_->gradient_window, config_->gradient_sample_decay)
 {
-	return std::max(1.5 * rtt, kMinimumPacketsPerInterval * kBitsPerByte * kDefaultTCPMSS / sending_rate);
+	interval_queue_.set_trace_id(trace_id_);
+	if (config_->quiescent_rounds > 0)
+		quiescent_interval_.Reserve(config_->rtt_stats_mode, config_->max_tracked_packets_per_interval);
 }
 
-CongestionController::CongestionController(QuicTime initial_rtt_us, QuicPacketCount initial_congestion_window, QuicPacketCount max_congestion_window) :
-	sending_rate_( initial_congestion_window * kDefaultTCPMSS * kBitsPerByte * kNumMicrosPerSecond / initial_rtt_us),
-	interval_queue_(*this),
-	initial_rtt_(initial_rtt_us)
-{ }
+template <class UtilityFunction>
+BasicCongestionController<UtilityFunction>::BasicCongestionController(QuicTime initial_rtt_us, QuicPacketCount initial_congestion_window, QuicPacketCount max_congestion_window, std::shared_ptr<const PccConfig> config, MonitorInterval* interval_storage) :
+	config_(std::move(config)),
+	sending_rate_( initial_congestion_window * config_->max_segment_size * kBitsPerByte * kNumMicrosPerSecond / initial_rtt_us),
+	interval_queue_(*this, *config_, interval_storage, MonitorIntervalCapacity(*config_)),
+	initial_rtt_(initial_rtt_us),
+	fixed_rate_control_coefficients_(ToFixedPoint(*config_)),
+	gradient_estimator_(config_->gradient_window, config_->gradient_sample_decay)
+{
+	interval_queue_.set_trace_id(trace_id_);
+	if (config_->quiescent_rounds > 0)
+		quiescent_interval_.Reserve(config_->rtt_stats_mode, config_->max_tracked_packets_per_interval);
+}
+
+template <class UtilityFunction>
+size_t BasicCongestionController<UtilityFunction>::MonitorIntervalCapacity(const PccConfig& config)
+{
+	// The useful intervals of a PROBING round and the non-useful ones sent
+	// while their utilities are pending.
+	return 4 * config.num_interval_groups_in_probing;
+}
 
-void CongestionController::OnPacketSent(QuicTime sent_time, QuicByteCount bytes_in_flight, QuicPacketNumber packet_number, QuicByteCount bytes, bool is_retransmittable)
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::OnPacketSent(QuicTime sent_time, QuicPacketNumber packet_number, QuicByteCount bytes, bool is_retransmittable)
 {
+	// Packets without retransmittable data, such as ACK-only packets, are
+	// not congestion controlled and may never be acked or declared lost.
+	if (!is_retransmittable)
+		return;
+	if (quiescent_)
+	{
+		OnQuiescentPacketSent(sent_time, packet_number, bytes);
+		return;
+	}
+
 	// Start a new monitor interval if the interval queue is empty. If latest RTT
 	// is available, start a new monitor interval if (1) there is no useful
 	// interval or (2) it has been more than monitor_duration since the last
@@ -75,26 +95,236 @@ void CongestionController::OnPacketSent(QuicTime sent_time, QuicByteCount bytes_
 		// No rtt fluctuation tolerance no during PROBING.
 		if (mode_ == STARTING)
 			// Use a larger tolerance at START to boost sending rate.
-			rtt_fluctuation_tolerance_ratio = FLAGS_max_rtt_fluctuation_tolerance_ratio_in_starting;
+			rtt_fluctuation_tolerance_ratio = config_->max_rtt_fluctuation_tolerance_ratio_in_starting;
 		else if (mode_ == DECISION_MADE)
-			rtt_fluctuation_tolerance_ratio = FLAGS_max_rtt_fluctuation_tolerance_ratio_in_decision_made;
+			rtt_fluctuation_tolerance_ratio = config_->max_rtt_fluctuation_tolerance_ratio_in_decision_made;
 
 
 		bool is_useful = CreateUsefulInterval();
 		interval_queue_.EnqueueNewMonitorInterval(sending_rate_, is_useful, rtt_fluctuation_tolerance_ratio,avg_rtt_, sent_time + monitor_duration_);
+		if (Trace::enabled())
+			Trace::Record(TRACE_INTERVAL_CREATED,
+				trace_id_,
+				sending_rate_,
+				is_useful,
+				rtt_fluctuation_tolerance_ratio,
+				static_cast<double> (avg_rtt_),
+				static_cast<double> (sent_time + monitor_duration_),
+				mode_);
+		NotifyPacingRateObserver();
 	}
 	interval_queue_.OnPacketSent(sent_time, packet_number, bytes);
 }
 
-void CongestionController::OnCongestionEvent(QuicTime event_time,
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::OnCongestionEvent(QuicTime event_time,
 					     QuicTime rtt,
 					     const AckedPacketVector& acked_packets,
 					     const LostPacketVector& lost_packets)
+{
+	latest_event_time_ = event_time;
+	CountModeTime(event_time);
+	if (!OnRttSample(rtt))
+		return;
+
+	if (quiescent_)
+	{
+		OnQuiescentCongestionEvent(event_time, rtt, acked_packets, lost_packets);
+	} else {
+		interval_queue_.OnCongestionEvent(acked_packets, lost_packets, rtt, event_time);
+		// Intervals whose ACKs are overdue complete on the next event, so that
+		// their wait is bounded even if the transport never calls OnTimer().
+		if (event_time >= interval_queue_.EarliestDeadline())
+			interval_queue_.OnTimer(event_time, SmoothedRtt());
+	}
+	// Removing the intervals whose utilities were used may change the rate.
+	NotifyPacingRateObserver();
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::OnCongestionEvent(QuicTime event_time,
+					     QuicTime rtt,
+					     const PacketNumberRangeVector& acked_ranges,
+					     const PacketNumberRangeVector& lost_ranges)
+{
+	latest_event_time_ = event_time;
+	CountModeTime(event_time);
+	if (!OnRttSample(rtt))
+		return;
+
+	if (quiescent_)
+	{
+		OnQuiescentCongestionEvent(event_time, rtt, acked_ranges, lost_ranges);
+	} else {
+		interval_queue_.OnCongestionEvent(acked_ranges, lost_ranges, rtt, event_time);
+		if (event_time >= interval_queue_.EarliestDeadline())
+			interval_queue_.OnTimer(event_time, SmoothedRtt());
+	}
+	NotifyPacingRateObserver();
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::OnQuiescentPacketSent(QuicTime sent_time, QuicPacketNumber packet_number, QuicByteCount bytes)
+{
+	if (quiescent_interval_state_ == NO_QUIESCENT_INTERVAL)
+	{
+		monitor_duration_ = ComputeMonitorDuration(sending_rate_, avg_rtt_);
+		float rtt_fluctuation_tolerance_ratio = config_->max_rtt_fluctuation_tolerance_ratio_in_decision_made;
+		QuicTime end_time = sent_time + monitor_duration_;
+		quiescent_interval_.Reset(sending_rate_, rtt_fluctuation_tolerance_ratio, avg_rtt_, end_time, interval_queue_.rtt_stats_mode(), config_->max_tracked_packets_per_interval);
+		quiescent_interval_state_ = QUIESCENT_INTERVAL_SENDING;
+		++stats_.quiescent_intervals;
+		// A non-useful interval at the same rate stands in for it in the queue,
+		// which PacingRate() and snapshots go by.
+		interval_queue_.EnqueueNewMonitorInterval(sending_rate_, false, rtt_fluctuation_tolerance_ratio, avg_rtt_, end_time);
+		interval_queue_.AdvanceLargestSentPacketNumber(largest_sent_packet_number_);
+		if (Trace::enabled())
+			Trace::Record(TRACE_INTERVAL_CREATED,
+				trace_id_,
+				sending_rate_,
+				true,
+				rtt_fluctuation_tolerance_ratio,
+				static_cast<double> (avg_rtt_),
+				static_cast<double> (end_time),
+				mode_);
+		NotifyPacingRateObserver();
+	} else if (quiescent_interval_state_ == QUIESCENT_INTERVAL_SENDING &&
+		sent_time - quiescent_interval_.interval().first_packet_sent_time > monitor_duration_)
+	{
+		quiescent_interval_state_ = QUIESCENT_INTERVAL_PENDING;
+	}
+
+	if (packet_number <= largest_sent_packet_number_)
+		return;
+	largest_sent_packet_number_ = packet_number;
+	if (quiescent_interval_state_ == QUIESCENT_INTERVAL_SENDING)
+		quiescent_interval_.OnPacketSent(sent_time, packet_number, bytes);
+}
+
+template <class UtilityFunction>
+template <class Reports>
+void BasicCongestionController<UtilityFunction>::OnQuiescentCongestionEvent(QuicTime event_time, QuicTime rtt, const Reports& acked, const Reports& lost)
+{
+	if (quiescent_interval_state_ == NO_QUIESCENT_INTERVAL)
+		return;
+
+	quiescent_interval_.OnCongestionEvent(acked, lost, rtt, event_time);
+	if (quiescent_interval_.IsComplete(event_time))
+		quiescent_interval_.mutable_interval()->rtt_on_monitor_end_us = rtt;
+	else if (event_time >= QuiescentDeadline())
+		quiescent_interval_.OnTimeout(SmoothedRtt());
+	else
+		return;
+	CompleteQuiescentInterval();
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::CompleteQuiescentInterval()
+{
+	quiescent_interval_state_ = NO_QUIESCENT_INTERVAL;
+	MonitorInterval* interval = quiescent_interval_.mutable_interval();
+	if (quiescent_interval_.num_inexact_packets() > config_->quiescent_inexact_tolerance * interval->n_packets)
+	{
+		++stats_.quiescent_fallbacks;
+		++stats_.discarded_intervals;
+		ExitQuiescence();
+		return;
+	}
+	if (!interval_queue_.CalculateUtility(interval))
+	{
+		++stats_.invalid_utilities;
+		++stats_.discarded_intervals;
+		return;
+	}
+	UtilityInfo utility_info(interval->sending_rate, interval->utility);
+	OnUtilityAvailable(UtilityInfoSpan(&utility_info, 1));
+}
+
+template <class UtilityFunction>
+QuicTime BasicCongestionController<UtilityFunction>::QuiescentDeadline() const
+{
+	if (quiescent_interval_state_ == NO_QUIESCENT_INTERVAL)
+		return kNoTimerDeadline;
+	const MonitorInterval& interval = quiescent_interval_.interval();
+	if (interval.packets_outstanding() <= 0)
+		return interval.end_time;
+	return interval.end_time + static_cast<QuicTime> (config_->monitor_interval_timeout_rtts * SmoothedRtt());
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::UpdateQuiescence()
+{
+	if (config_->quiescent_rounds == 0)
+		return;
+
+	// The first round of DECISION_MADE has no gradient of the mode to be
+	// compared with.
+	double gradient = LatestGradient();
+	bool is_steady = stats_.mode_rounds[DECISION_MADE] - mode_entry_rounds_ > 1 &&
+		std::abs(gradient - steady_gradient_) <= config_->quiescent_gradient_tolerance * std::abs(steady_gradient_);
+	steady_gradient_ = gradient;
+	steady_gradient_rounds_ = is_steady ? steady_gradient_rounds_ + 1 : 0;
+	if (!is_steady && quiescent_)
+	{
+		ExitQuiescence();
+	} else if (!quiescent_ && steady_gradient_rounds_ >= config_->quiescent_rounds)
+	{
+		// Called from the queue, which has just reported its only useful
+		// interval; the next packet opens the first quiescent interval.
+		quiescent_ = true;
+		quiescent_interval_state_ = NO_QUIESCENT_INTERVAL;
+		largest_sent_packet_number_ = interval_queue_.largest_sent_packet_number();
+	}
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::ExitQuiescence()
+{
+	if (quiescent_interval_state_ != NO_QUIESCENT_INTERVAL)
+		++stats_.discarded_intervals;
+	quiescent_ = false;
+	quiescent_interval_state_ = NO_QUIESCENT_INTERVAL;
+	steady_gradient_rounds_ = 0;
+	// The next packet starts a useful interval in the queue, as no useful
+	// interval is left there.
+	interval_queue_.AdvanceLargestSentPacketNumber(largest_sent_packet_number_);
+}
+
+template <class UtilityFunction>
+QuicTime BasicCongestionController<UtilityFunction>::NextTimerDeadline() const
+{
+	if (quiescent_)
+		return QuiescentDeadline();
+	return interval_queue_.NextDeadline(SmoothedRtt());
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::OnTimer(QuicTime now)
+{
+	if (now < NextTimerDeadline())
+		return;
+
+	latest_event_time_ = now;
+	CountModeTime(now);
+	if (quiescent_)
+	{
+		quiescent_interval_.OnTimeout(SmoothedRtt());
+		CompleteQuiescentInterval();
+	} else {
+		interval_queue_.OnTimer(now, SmoothedRtt());
+	}
+	NotifyPacingRateObserver();
+}
+
+template <class UtilityFunction>
+bool BasicCongestionController<UtilityFunction>::OnRttSample(QuicTime rtt)
 {
 	int64_t avg_rtt_us = rtt;
 
 	if (avg_rtt_us)
 	{
+		if (min_rtt_ == 0 || rtt < min_rtt_)
+			min_rtt_ = rtt;
 		if (avg_rtt_ == 0)
 			avg_rtt_ = rtt;
 		else
@@ -102,19 +332,278 @@ void CongestionController::OnCongestionEvent(QuicTime event_time,
 		
 		if (mode_ == STARTING && !interval_queue_.empty() &&
 			interval_queue_.current().rtt_on_monitor_start_us != 0 &&
-			avg_rtt_us > static_cast<int64_t> ((1 + FLAGS_max_rtt_fluctuation_tolerance_ratio_in_starting) * static_cast<float> (interval_queue_.current().rtt_on_monitor_start_us)))
+			avg_rtt_us > static_cast<int64_t> ((1 + config_->max_rtt_fluctuation_tolerance_ratio_in_starting) * static_cast<float> (interval_queue_.current().rtt_on_monitor_start_us)))
 		{
 			// Directly enter PROBING when rtt inflation already exceeds the tolerance
 			// ratio, so as to reduce packet losses and mitigate rtt inflation.
+			++stats_.rtt_inflation_exits;
 			interval_queue_.OnRttInflationInStarting();
 			EnterProbing();
-			return;
+			return false;
 		}
 	}
+	return true;
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::set_pacing_rate_observer(PacingRateObserverInterface* observer)
+{
+	pacing_rate_observer_ = observer;
+	observed_pacing_rate_ = PacingRate();
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::set_path_cache(PathCache* cache, uint64_t destination, QuicTime now)
+{
+	path_cache_ = cache;
+	path_destination_ = destination;
+
+	PathInfo info;
+	if (path_cache_ == nullptr || mode_ != STARTING || !interval_queue_.empty()
+		|| !path_cache_->Lookup(destination, now, &info))
+		return;
+	// A rate that decayed below the initial one says less about the path
+	// than STARTING learns from it, and probing around the initial rate
+	// would skip the doubling that finds a higher one.
+	if (info.sending_rate < sending_rate_)
+		return;
+	if (info.min_rtt > 0)
+	{
+		initial_rtt_ = info.min_rtt;
+		avg_rtt_ = info.min_rtt;
+	}
+	SetSendingRate(info.sending_rate, TRACE_RATE_WARM_START);
+	SetMode(PROBING);
+	rounds_ = 1;
+	NotifyPacingRateObserver();
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::OnConnectionClosed(QuicTime now)
+{
+	if (mode_ != STARTING)
+		RecordPath(now);
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::RecordPath(QuicTime now)
+{
+	if (path_cache_ == nullptr)
+		return;
+
+	PathInfo info;
+	info.sending_rate = sending_rate_;
+	info.min_rtt = min_rtt_;
+	info.record_time = now;
+	path_cache_->Record(path_destination_, info);
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::SaveSnapshot(std::vector<uint8_t>* snapshot) const
+{
+	std::vector<uint8_t> payload;
+	SnapshotWriter writer(&payload);
+
+	size_t controller_section = writer.BeginSection();
+	writer.WriteUint8(static_cast<uint8_t> (mode_));
+	writer.WriteDouble(sending_rate_);
+	writer.WriteDouble(latest_utility_info_.sending_rate);
+	writer.WriteFloat(latest_utility_info_.utility);
+	writer.WriteInt64(monitor_duration_);
+	writer.WriteUint8(static_cast<uint8_t> (direction_));
+	writer.WriteUint64(rounds_);
+	writer.WriteFloat(avg_gradient_);
+	writer.WriteUint64(kAvgGradientSampleSize);
+	for (size_t i = 0; i < kAvgGradientSampleSize; ++i)
+		writer.WriteFloat(gradient_samples_[i]);
+	writer.WriteUint64(num_gradient_samples_);
+	writer.WriteUint64(oldest_gradient_sample_);
+	writer.WriteInt64(initial_rtt_);
+	writer.WriteInt64(avg_rtt_);
+	writer.WriteUint64(swing_buffer_);
+	writer.WriteFloat(rate_change_amplifier_);
+	writer.WriteUint64(rate_change_proportion_allowance_);
+	writer.WriteDouble(previous_change_);
+	writer.WriteInt64(fixed_rate_control_.avg_gradient);
+	writer.WriteUint64(FixedRateControlState::kAvgGradientSampleSize);
+	for (size_t i = 0; i < FixedRateControlState::kAvgGradientSampleSize; ++i)
+		writer.WriteInt64(fixed_rate_control_.gradient_samples[i]);
+	writer.WriteUint64(fixed_rate_control_.num_gradient_samples);
+	writer.WriteUint64(fixed_rate_control_.oldest_gradient_sample);
+	writer.WriteInt64(fixed_rate_control_.rate_change_amplifier_halves);
+	writer.WriteUint64(fixed_rate_control_.swing_buffer);
+	writer.WriteUint64(fixed_rate_control_.rate_change_proportion_allowance);
+	writer.WriteUint64(random_state_);
+	writer.WriteInt64(min_rtt_);
+	writer.WriteInt64(latest_event_time_);
+	gradient_estimator_.SaveSnapshot(&writer);
+	writer.WriteFloat(gradient_confidence_);
+	writer.EndSection(controller_section);
+
+	size_t queue_section = writer.BeginSection();
+	interval_queue_.SaveSnapshot(&writer);
+	writer.EndSection(queue_section);
 
-	interval_queue_.OnCongestionEvent(acked_packets, lost_packets, avg_rtt_us, event_time);
+	snapshot->clear();
+	SnapshotWriter header(snapshot);
+	header.WriteUint64(kSnapshotMagic);
+	header.WriteUint32(kSnapshotVersion);
+	header.WriteUint32(static_cast<uint32_t> (payload.size()));
+	header.WriteUint64(SnapshotChecksum(payload.data(), payload.size()));
+	snapshot->insert(snapshot->end(), payload.begin(), payload.end());
 }
-QuicBandwidth CongestionController::PacingRate() const
+
+template <class UtilityFunction>
+bool BasicCongestionController<UtilityFunction>::RestoreSnapshot(const uint8_t* data, size_t size, std::string* error)
+{
+	auto fail = [error](const std::string& reason) {
+		if (error != nullptr)
+			*error = reason;
+		return false;
+	};
+
+	SnapshotReader header(data, size);
+	uint64_t magic;
+	uint32_t version;
+	uint32_t payload_size;
+	uint64_t checksum;
+	if (!header.ReadUint64(&magic) || magic != kSnapshotMagic)
+		return fail("not a controller snapshot");
+	if (!header.ReadUint32(&version))
+		return fail("truncated snapshot");
+	if (version != kSnapshotVersion)
+		return fail("unsupported snapshot version " + std::to_string(version));
+	if (!header.ReadUint32(&payload_size) || !header.ReadUint64(&checksum) || payload_size != header.remaining())
+		return fail("truncated snapshot");
+	const uint8_t* payload = data + (size - payload_size);
+	if (SnapshotChecksum(payload, payload_size) != checksum)
+		return fail("snapshot checksum mismatch");
+
+	// Everything is read into locals first, so that the controller stays as it
+	// was if the snapshot turns out to be malformed.
+	SnapshotReader reader(payload, payload_size);
+	SnapshotReader controller(nullptr, 0);
+	SnapshotReader queue(nullptr, 0);
+	if (!reader.ReadSection(&controller) || !reader.ReadSection(&queue) || reader.remaining() != 0)
+		return fail("malformed snapshot");
+
+	uint8_t mode;
+	QuicBandwidth sending_rate;
+	UtilityInfo latest_utility_info;
+	QuicTime monitor_duration;
+	uint8_t direction;
+	uint64_t rounds;
+	float avg_gradient;
+	uint64_t gradient_sample_size;
+	float gradient_samples[kAvgGradientSampleSize];
+	uint64_t num_gradient_samples;
+	uint64_t oldest_gradient_sample;
+	QuicTime initial_rtt;
+	QuicTime avg_rtt;
+	uint64_t swing_buffer;
+	float rate_change_amplifier;
+	uint64_t rate_change_proportion_allowance;
+	QuicBandwidth previous_change;
+	FixedRateControlState fixed_rate_control;
+	uint64_t fixed_gradient_sample_size;
+	uint64_t fixed_num_gradient_samples;
+	uint64_t fixed_oldest_gradient_sample;
+	uint64_t fixed_swing_buffer;
+	uint64_t fixed_rate_change_proportion_allowance;
+	uint64_t random_state;
+	QuicTime min_rtt;
+	QuicTime latest_event_time;
+	GradientEstimator gradient_estimator(config_->gradient_window, config_->gradient_sample_decay);
+	float gradient_confidence;
+	bool ok = controller.ReadUint8(&mode)
+		&& controller.ReadDouble(&sending_rate)
+		&& controller.ReadDouble(&latest_utility_info.sending_rate)
+		&& controller.ReadFloat(&latest_utility_info.utility)
+		&& controller.ReadInt64(&monitor_duration)
+		&& controller.ReadUint8(&direction)
+		&& controller.ReadUint64(&rounds)
+		&& controller.ReadFloat(&avg_gradient)
+		&& controller.ReadUint64(&gradient_sample_size)
+		&& gradient_sample_size == kAvgGradientSampleSize;
+	for (size_t i = 0; ok && i < kAvgGradientSampleSize; ++i)
+		ok = controller.ReadFloat(&gradient_samples[i]);
+	ok = ok
+		&& controller.ReadUint64(&num_gradient_samples)
+		&& controller.ReadUint64(&oldest_gradient_sample)
+		&& controller.ReadInt64(&initial_rtt)
+		&& controller.ReadInt64(&avg_rtt)
+		&& controller.ReadUint64(&swing_buffer)
+		&& controller.ReadFloat(&rate_change_amplifier)
+		&& controller.ReadUint64(&rate_change_proportion_allowance)
+		&& controller.ReadDouble(&previous_change)
+		&& controller.ReadInt64(&fixed_rate_control.avg_gradient)
+		&& controller.ReadUint64(&fixed_gradient_sample_size)
+		&& fixed_gradient_sample_size == FixedRateControlState::kAvgGradientSampleSize;
+	for (size_t i = 0; ok && i < FixedRateControlState::kAvgGradientSampleSize; ++i)
+		ok = controller.ReadInt64(&fixed_rate_control.gradient_samples[i]);
+	ok = ok
+		&& controller.ReadUint64(&fixed_num_gradient_samples)
+		&& controller.ReadUint64(&fixed_oldest_gradient_sample)
+		&& controller.ReadInt64(&fixed_rate_control.rate_change_amplifier_halves)
+		&& controller.ReadUint64(&fixed_swing_buffer)
+		&& controller.ReadUint64(&fixed_rate_change_proportion_allowance)
+		&& controller.ReadUint64(&random_state)
+		&& controller.ReadInt64(&min_rtt)
+		&& controller.ReadInt64(&latest_event_time)
+		&& gradient_estimator.RestoreSnapshot(&controller)
+		&& controller.ReadFloat(&gradient_confidence)
+		&& controller.remaining() == 0
+		&& mode <= DECISION_MADE
+		&& direction <= DECREASE
+		&& num_gradient_samples <= kAvgGradientSampleSize
+		&& oldest_gradient_sample < kAvgGradientSampleSize
+		&& fixed_num_gradient_samples <= FixedRateControlState::kAvgGradientSampleSize
+		&& fixed_oldest_gradient_sample < FixedRateControlState::kAvgGradientSampleSize
+		&& sending_rate > 0;
+	if (!ok)
+		return fail("malformed controller state");
+	if (!interval_queue_.RestoreSnapshot(&queue))
+		return fail("malformed or too many monitor intervals");
+
+	mode_ = static_cast<SenderMode> (mode);
+	sending_rate_ = sending_rate;
+	latest_utility_info_ = latest_utility_info;
+	monitor_duration_ = monitor_duration;
+	direction_ = static_cast<RateChangeDirection> (direction);
+	rounds_ = static_cast<size_t> (rounds);
+	avg_gradient_ = avg_gradient;
+	for (size_t i = 0; i < kAvgGradientSampleSize; ++i)
+		gradient_samples_[i] = gradient_samples[i];
+	num_gradient_samples_ = static_cast<size_t> (num_gradient_samples);
+	oldest_gradient_sample_ = static_cast<size_t> (oldest_gradient_sample);
+	initial_rtt_ = initial_rtt;
+	avg_rtt_ = avg_rtt;
+	swing_buffer_ = static_cast<size_t> (swing_buffer);
+	rate_change_amplifier_ = rate_change_amplifier;
+	rate_change_proportion_allowance_ = static_cast<size_t> (rate_change_proportion_allowance);
+	previous_change_ = previous_change;
+	fixed_rate_control.num_gradient_samples = static_cast<size_t> (fixed_num_gradient_samples);
+	fixed_rate_control.oldest_gradient_sample = static_cast<size_t> (fixed_oldest_gradient_sample);
+	fixed_rate_control.swing_buffer = static_cast<size_t> (fixed_swing_buffer);
+	fixed_rate_control.rate_change_proportion_allowance = static_cast<size_t> (fixed_rate_change_proportion_allowance);
+	fixed_rate_control_ = fixed_rate_control;
+	random_state_ = random_state;
+	min_rtt_ = min_rtt;
+	latest_event_time_ = latest_event_time;
+	gradient_estimator_ = gradient_estimator;
+	gradient_confidence_ = gradient_confidence;
+	// The snapshot may come from another host's clock.
+	stats_time_ = -1;
+	quiescent_ = false;
+	quiescent_interval_state_ = NO_QUIESCENT_INTERVAL;
+	steady_gradient_rounds_ = 0;
+	mode_entry_rounds_ = stats_.mode_rounds[mode_];
+	NotifyPacingRateObserver();
+	return true;
+}
+
+template <class UtilityFunction>
+QuicBandwidth BasicCongestionController<UtilityFunction>::PacingRate() const
 {
 	QuicBandwidth result =
 		interval_queue_.empty() ? sending_rate_
@@ -122,14 +611,18 @@ QuicBandwidth CongestionController::PacingRate() const
 	return result;
 }
 
-QuicByteCount CongestionController::GetCongestionWindow() const
+template <class UtilityFunction>
+QuicByteCount BasicCongestionController<UtilityFunction>::GetCongestionWindow() const
 {
 	// Use smoothed_rtt to calculate expected congestion window except when it
 	// equals 0, which happens when the connection just starts.
-	int64_t rtt_us = avg_rtt_ == 0
-		? initial_rtt_
-		: avg_rtt_;
-	return static_cast<QuicByteCount> (sending_rate_ * rtt_us / kNumMicrosPerSecond);
+	return static_cast<QuicByteCount> (sending_rate_ * SmoothedRtt() / kNumMicrosPerSecond);
+}
+
+template <class UtilityFunction>
+QuicTime BasicCongestionController<UtilityFunction>::SmoothedRtt() const
+{
+	return avg_rtt_ == 0 ? initial_rtt_ : avg_rtt_;
 }
 
 /*
@@ -156,16 +649,37 @@ std::string CongestionController::GetDebugState() const
 }
  */
 
-QuicBandwidth CongestionController::ComputeRateChange(const UtilityInfo& utility_sample_1, const UtilityInfo& utility_sample_2)
+template <class UtilityFunction>
+QuicBandwidth BasicCongestionController<UtilityFunction>::ComputeRateChange(const UtilityInfo& utility_sample_1, const UtilityInfo& utility_sample_2)
 {
+	// A PROBING decision fits all the samples of the round, which lie around
+	// one rate. The steps of DECISION_MADE follow the local slope between the
+	// two samples, as a fit over the whole trajectory lags behind it, and
+	// keep the confidence of the decision that started them.
+	double fitted_gradient = 0.0;
+	float confidence = 1.0f;
+	bool is_fitted = config_->gradient_estimator == GRADIENT_WEIGHTED_LEAST_SQUARES
+		&& mode_ == PROBING
+		&& gradient_estimator_.Estimate(&fitted_gradient, &confidence);
+	if (!is_fitted && utility_sample_1.sending_rate == utility_sample_2.sending_rate)
+		return config_->minimum_rate_change;
+	if (config_->fixed_point_arithmetic)
+		return ComputeRateChangeFixedPoint(utility_sample_1, utility_sample_2);
 
-	if (utility_sample_1.sending_rate == utility_sample_2.sending_rate)
-		return kMinimumRateChange;
-
-	float utility_gradient = kMegabit * (utility_sample_1.utility - utility_sample_2.utility) /
-		static_cast<float> (utility_sample_1.sending_rate - utility_sample_2.sending_rate);
+	float utility_gradient;
+	if (is_fitted)
+	{
+		utility_gradient = static_cast<float> (kMegabit * fitted_gradient);
+		gradient_confidence_ = std::max(confidence, config_->min_gradient_confidence);
+	} else {
+		utility_gradient = kMegabit * (utility_sample_1.utility - utility_sample_2.utility) /
+			static_cast<float> (utility_sample_1.sending_rate - utility_sample_2.sending_rate);
+		if (mode_ == PROBING || config_->gradient_estimator == GRADIENT_PAIR)
+			gradient_confidence_ = 1.0f;
+	}
 	UpdateAverageGradient(utility_gradient);
-	QuicBandwidth change = avg_gradient_ * kUtilityGradientToRateChangeFactor;
+	// Uncertain gradients move the rate less.
+	QuicBandwidth change = avg_gradient_ * config_->utility_gradient_to_rate_change_factor * gradient_confidence_;
 
 	if ((change > 0) != (previous_change_ > 0))
 	{
@@ -197,7 +711,7 @@ QuicBandwidth CongestionController::ComputeRateChange(const UtilityInfo& utility
 			--swing_buffer_;
 	}
 
-	float max_allowed_change_ratio = kInitialMaximumProportionalChange + rate_change_proportion_allowance_ * kMaximumProportionalChangeStepSize;
+	float max_allowed_change_ratio = config_->initial_maximum_proportional_change + rate_change_proportion_allowance_ * config_->maximum_proportional_change_step_size;
 
 	float change_ratio = (float) change / (float) sending_rate_;
 	change_ratio = change_ratio > 0 ? change_ratio : -1 * change_ratio;
@@ -221,48 +735,93 @@ QuicBandwidth CongestionController::ComputeRateChange(const UtilityInfo& utility
 		rate_change_proportion_allowance_ = 0;
 	}
 
-	if (change < 0 && change > -1 * kMinimumRateChange)
-		change = -1 * kMinimumRateChange;
-	else if (change > 0 && change < kMinimumRateChange)
-		change = kMinimumRateChange;
-
-#if defined(DEBUG_RATE_CONTROL)
-	std::cerr << "CalculateRateChange:" << std::endl;
-	std::cerr << "\tUtility 1    = " << utility_sample_1.utility << std::endl;
-	std::cerr << "\tRate 1       = " << utility_sample_1.sending_rate << "mbps" << std::endl;
-	std::cerr << "\tUtility 2    = " << utility_sample_2.utility << std::endl;
-	std::cerr << "\tRate 2       = " << utility_sample_2.sending_rate << "mbps" << std::endl;
-	std::cerr << "\tGradient     = " << utility_gradient << std::endl;
-	std::cerr << "\tAvg Gradient = " << avg_gradient_ << std::endl;
-	std::cerr << "\tRate Change  = " << change << "mbps" << std::endl;
-#endif
+	if (change < 0 && change > -1 * config_->minimum_rate_change)
+		change = -1 * config_->minimum_rate_change;
+	else if (change > 0 && change < config_->minimum_rate_change)
+		change = config_->minimum_rate_change;
+
+	if (Trace::enabled())
+		Trace::Record(TRACE_GRADIENT,
+			trace_id_,
+			utility_sample_1.sending_rate,
+			utility_sample_1.utility,
+			utility_sample_2.sending_rate,
+			utility_sample_2.utility,
+			utility_gradient,
+			avg_gradient_);
 
 	return change;
 }
 
-void CongestionController::UpdateAverageGradient(float new_gradient)
+template <class UtilityFunction>
+QuicBandwidth BasicCongestionController<UtilityFunction>::ComputeRateChangeFixedPoint(const UtilityInfo& utility_sample_1, const UtilityInfo& utility_sample_2)
+{
+	// The utilities came from CalculateVivaceUtilityFixedPoint and convert
+	// back exactly, up to the rounding to float.
+	FixedUtilitySample sample_1;
+	sample_1.sending_rate = static_cast<int64_t> (utility_sample_1.sending_rate);
+	sample_1.utility = ToFixedPoint(utility_sample_1.utility);
+	FixedUtilitySample sample_2;
+	sample_2.sending_rate = static_cast<int64_t> (utility_sample_2.sending_rate);
+	sample_2.utility = ToFixedPoint(utility_sample_2.utility);
+
+	FixedPoint utility_gradient = 0;
+	int64_t change = ::ComputeRateChangeFixedPoint(sample_1,
+		sample_2,
+		static_cast<int64_t> (sending_rate_),
+		static_cast<int64_t> (previous_change_),
+		fixed_rate_control_coefficients_,
+		&fixed_rate_control_,
+		&utility_gradient);
+
+	if (Trace::enabled())
+		Trace::Record(TRACE_GRADIENT,
+			trace_id_,
+			utility_sample_1.sending_rate,
+			utility_sample_1.utility,
+			utility_sample_2.sending_rate,
+			utility_sample_2.utility,
+			FromFixedPoint(utility_gradient),
+			FromFixedPoint(fixed_rate_control_.avg_gradient));
+
+	return static_cast<QuicBandwidth> (change);
+}
+
+template <class UtilityFunction>
+double BasicCongestionController<UtilityFunction>::LatestGradient() const
+{
+	return config_->fixed_point_arithmetic ? FromFixedPoint(fixed_rate_control_.avg_gradient) : avg_gradient_;
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::UpdateAverageGradient(float new_gradient)
 {
-	if (gradient_samples_.empty())
+	if (num_gradient_samples_ == 0)
 	{
 		avg_gradient_ = new_gradient;
-	} else if (gradient_samples_.size() < kAvgGradientSampleSize){
-		avg_gradient_ *= gradient_samples_.size();
+	} else if (num_gradient_samples_ < kAvgGradientSampleSize){
+		avg_gradient_ *= num_gradient_samples_;
 		avg_gradient_ += new_gradient;
-		avg_gradient_ /= gradient_samples_.size() + 1;
+		avg_gradient_ /= num_gradient_samples_ + 1;
 	} else {
-		float oldest_gradient = gradient_samples_.front();
+		float oldest_gradient = gradient_samples_[oldest_gradient_sample_];
 		avg_gradient_ -= oldest_gradient / kAvgGradientSampleSize;
 		avg_gradient_ += new_gradient / kAvgGradientSampleSize;
-		gradient_samples_.pop();
+		oldest_gradient_sample_ = (oldest_gradient_sample_ + 1) % kAvgGradientSampleSize;
+		--num_gradient_samples_;
 	}
-	gradient_samples_.push(new_gradient);
+	gradient_samples_[(oldest_gradient_sample_ + num_gradient_samples_) % kAvgGradientSampleSize] = new_gradient;
+	++num_gradient_samples_;
 }
 
-void CongestionController::OnUtilityAvailable(const std::vector<UtilityInfo>& utility_info)
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::OnUtilityAvailable(UtilityInfoSpan utility_info)
 {
-#ifdef DEBUG_RATE_CONTROL
-	std::cerr << "OnUtilityAvailable" << std::endl;
-#endif
+	if (config_->gradient_estimator == GRADIENT_WEIGHTED_LEAST_SQUARES && mode_ == PROBING)
+		for (const UtilityInfo& sample : utility_info)
+			gradient_estimator_.AddSample(sample);
+
+	++stats_.mode_rounds[mode_];
 	switch (mode_)
 	{
 		case STARTING:
@@ -270,14 +829,7 @@ void CongestionController::OnUtilityAvailable(const std::vector<UtilityInfo>& ut
 			{
 				// Stay in STARTING mode. Double the sending rate and update
 				// latest_utility.
-				sending_rate_ = sending_rate_ * 2;
-#ifdef DEBUG_RATE_CONTROL
-				std::cerr << "Starting mode rate: "
-					<< sending_rate_ / 2.0
-					<< "-->"
-					<< 
-					<< std::endl;
-#endif
+				SetSendingRate(sending_rate_ * 2, TRACE_RATE_STARTING);
 				latest_utility_info_ = utility_info[0];
 				++rounds_;
 			} else {
@@ -289,54 +841,52 @@ void CongestionController::OnUtilityAvailable(const std::vector<UtilityInfo>& ut
 			if (CanMakeDecision(utility_info))
 			{
 				// Enter DECISION_MADE mode if a decision is made.
+				++stats_.probing_decisions;
 				direction_ = (utility_info[0].utility > utility_info[1].utility) ?
 							((utility_info[0].sending_rate > utility_info[1].sending_rate) ? INCREASE : DECREASE)
 						:
 							((utility_info[0].sending_rate > utility_info[1].sending_rate) ? DECREASE : INCREASE);
 				latest_utility_info_ =
-						utility_info[2 * kNumIntervalGroupsInProbing - 2].utility >
-						utility_info[2 * kNumIntervalGroupsInProbing - 1].utility ?
-						utility_info[2 * kNumIntervalGroupsInProbing - 2] :
-						utility_info[2 * kNumIntervalGroupsInProbing - 1];
+						utility_info[2 * config_->num_interval_groups_in_probing - 2].utility >
+						utility_info[2 * config_->num_interval_groups_in_probing - 1].utility ?
+						utility_info[2 * config_->num_interval_groups_in_probing - 2] :
+						utility_info[2 * config_->num_interval_groups_in_probing - 1];
 
 				QuicBandwidth rate_change = ComputeRateChange(utility_info[0], utility_info[1]);
-				if (sending_rate_ + rate_change < kMinSendingRate)
-					rate_change = kMinSendingRate - sending_rate_;
+				if (sending_rate_ + rate_change < config_->min_sending_rate)
+					rate_change = config_->min_sending_rate - sending_rate_;
 				previous_change_ = rate_change;
 				EnterDecisionMade(sending_rate_ + rate_change);
 			} else {
 				// Stays in PROBING mode.
+				++stats_.inconclusive_probing_rounds;
 				EnterProbing();
 			}
 			break;
 		case DECISION_MADE:
 			QuicBandwidth rate_change = ComputeRateChange(utility_info[0], latest_utility_info_);
-			if (sending_rate_ + rate_change < kMinSendingRate)
-				rate_change = kMinSendingRate - sending_rate_;
+			if (sending_rate_ + rate_change < config_->min_sending_rate)
+				rate_change = config_->min_sending_rate - sending_rate_;
 			// Test if we are adjusting sending rate in the same direction.
 			if ((rate_change > 0) == (previous_change_ > 0))
 			{
 				// Remain in DECISION_MADE mode. Keep increasing or decreasing the
 				// sending rate.
 				previous_change_ = rate_change;
-				sending_rate_ = sending_rate_ + rate_change;
-#ifdef DEBUG_RATE_CONTROL
-				std::cerr << "Decision made rate: "
-					<< sending_rate_ - rate_change
-					<< "-->"
-					<< sending_rate_ 
-					<< std::endl;
-#endif
+				SetSendingRate(sending_rate_ + rate_change, TRACE_RATE_DECISION);
 				latest_utility_info_ = utility_info[0];
+				UpdateQuiescence();
 			} else {
 				// Enter PROBING if our old rate change is no longer best.
 				EnterProbing();
 			}
 			break;
 	}
+	NotifyPacingRateObserver();
 }
 
-bool CongestionController::CreateUsefulInterval() const
+template <class UtilityFunction>
+bool BasicCongestionController<UtilityFunction>::CreateUsefulInterval() const
 {
 	if (avg_rtt_ == 0)
 		// Create non useful intervals upon starting a connection, until there is
@@ -345,17 +895,18 @@ bool CongestionController::CreateUsefulInterval() const
 	
 	// In STARTING and DECISION_MADE mode, there should be at most one useful
 	// intervals in the queue; while in PROBING mode, there should be at most
-	// 2 * kNumIntervalGroupsInProbing.
-	size_t max_num_useful = (mode_ == PROBING) ? 2 * kNumIntervalGroupsInProbing : 1;
+	// 2 * num_interval_groups_in_probing.
+	size_t max_num_useful = (mode_ == PROBING) ? 2 * config_->num_interval_groups_in_probing : 1;
 	return interval_queue_.num_useful_intervals() < max_num_useful;
 }
 
-void CongestionController::MaybeSetSendingRate()
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::MaybeSetSendingRate()
 {
-	if (mode_ != PROBING || (interval_queue_.num_useful_intervals() == 2 * kNumIntervalGroupsInProbing && !interval_queue_.current().is_useful))
+	if (mode_ != PROBING || (interval_queue_.num_useful_intervals() == 2 * config_->num_interval_groups_in_probing && !interval_queue_.current().is_useful))
 		// Do not change sending rate when (1) current mode is STARTING or
 		// DECISION_MADE (since sending rate is already changed in
-		// OnUtilityAvailable), or (2) more than 2 * kNumIntervalGroupsInProbing
+		// OnUtilityAvailable), or (2) more than 2 * num_interval_groups_in_probing
 		// intervals have been created in PROBING mode.
 		return;
 
@@ -364,26 +915,12 @@ void CongestionController::MaybeSetSendingRate()
 		// Restore central sending rate.
 		if (direction_ == INCREASE)
 		{
-			sending_rate_ = sending_rate_ * (1.0 / (1 + kProbingStepSize));
-#ifdef DEBUG_RATE_CONTROL
-			std::cerr << "Maybe undo increase: "
-				<< sending_rate_ * (1.0 + kProbingStepSize)
-				<< "-->"
-				<< sending_rate_
-				<< std::endl;
-#endif
+			SetSendingRate(sending_rate_ * (1.0 / (1 + config_->probing_step_size)), TRACE_RATE_RESTORE);
 		} else {
-			sending_rate_ = sending_rate_ * (1.0 / (1 - kProbingStepSize));
-#ifdef DEBUG_RATE_CONTROL
-			std::cerr << "Maybe undo decrease: "
-				<< sending_rate_ * (1.0 - kProbingStepSize)
-				<< "-->"
-				<< sending_rate_
-				<< std::endl;
-#endif
+			SetSendingRate(sending_rate_ * (1.0 / (1 - config_->probing_step_size)), TRACE_RATE_RESTORE);
 		}
 
-		if (interval_queue_.num_useful_intervals() == 2 * kNumIntervalGroupsInProbing)
+		if (interval_queue_.num_useful_intervals() == 2 * config_->num_interval_groups_in_probing)
 			// This is the first not useful monitor interval, its sending rate is the
 			// central rate.
 			return;
@@ -393,45 +930,32 @@ void CongestionController::MaybeSetSendingRate()
 	// interval with increased sending rate and an interval with decreased sending
 	// rate. Which interval goes first is randomly decided.
 	if (interval_queue_.num_useful_intervals() % 2 == 0)
-		direction_ = (rand() % 2 == 1) ? INCREASE : DECREASE;
+		direction_ = (NextRandom() & 1) == 1 ? INCREASE : DECREASE;
 	else
 		direction_ = (direction_ == INCREASE) ? DECREASE : INCREASE;
 
 	if (direction_ == INCREASE)
 	{
-		sending_rate_ = sending_rate_ * (1 + kProbingStepSize);
-#ifdef DEBUG_RATE_CONTROL
-		std::cerr << "Maybe probe increase: " 
-			<< sending_rate_ / (1.0 + kProbingStepSize)
-			<< "-->"
-			<< sending_rate_ 
-			<< std::endl;
-#endif
+		SetSendingRate(sending_rate_ * (1 + config_->probing_step_size), TRACE_RATE_PROBE);
 	} else {
-		sending_rate_ = sending_rate_ * (1 - kProbingStepSize);
-#ifdef DEBUG_RATE_CONTROL
-		std::cerr << "Maybe probe decrease: " 
-			<< sending_rate_ / (1.0 - kProbingStepSize)
-			<< "-->"
-			<< sending_rate_
-			<< std::endl;
-#endif
+		SetSendingRate(sending_rate_ * (1 - config_->probing_step_size), TRACE_RATE_PROBE);
 	}
 }
 
-bool CongestionController::CanMakeDecision(const std::vector<UtilityInfo>& utility_info) const
+template <class UtilityFunction>
+bool BasicCongestionController<UtilityFunction>::CanMakeDecision(UtilityInfoSpan utility_info) const
 {
 	// Determine whether increased or decreased probing rate has better utility.
 	// Cannot make decision if number of utilities are less than
-	// 2 * kNumIntervalGroupsInProbing. This happens when sender does not have
+	// 2 * num_interval_groups_in_probing. This happens when sender does not have
 	// enough data to send.
-	if (utility_info.size() < 2 * kNumIntervalGroupsInProbing)
+	if (utility_info.size() < 2 * config_->num_interval_groups_in_probing)
 		return false;
 
 	bool increase = false;
 	// All the probing groups should have consistent decision. If not, directly
 	// return false.
-	for (size_t i = 0; i < kNumIntervalGroupsInProbing; ++i)
+	for (size_t i = 0; i < config_->num_interval_groups_in_probing; ++i)
 	{
 		bool increase_i = utility_info[2 * i].utility > utility_info[2 * i + 1].utility 
 			? utility_info[2 * i].sending_rate > utility_info[2 * i + 1].sending_rate
@@ -447,96 +971,147 @@ bool CongestionController::CanMakeDecision(const std::vector<UtilityInfo>& utili
 	return true;
 }
 
-void CongestionController::EnterProbing()
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::EnterProbing()
 {
 	switch (mode_)
 	{
 		case STARTING:
 			// Use half sending_rate_ as central probing rate.
-			sending_rate_ = sending_rate_ * 0.5;
-#ifdef DEBUG_RATE_CONTROL
-			std::cerr << "Probing after starting: " 
-				<< sending_rate_ * 2.0 
-				<< "-->" << sending_rate_
-				<< std::endl;
-#endif
+			SetSendingRate(sending_rate_ * 0.5, TRACE_RATE_RESTORE);
 			break;
 		case DECISION_MADE:
 			// Use sending rate right before utility decreases as central probing
 			// rate.
 			if (direction_ == INCREASE)
 			{
-				sending_rate_ = sending_rate_ * (1.0 / (1 + std::min(rounds_ * kDecisionMadeStepSize, kMaxDecisionMadeStepSize)));
-#ifdef DEBUG_RATE_CONTROL
-				std::cerr << "Decision made resotore: " 
-					<< sending_rate_ * (1.0 + std::min(rounds_ * kDecisionMadeStepSize, kMaxDecisionMadeStepSize)
-					)<< "-->" 
-					<< sending_rate_ 
-					<< std::endl;
-#endif
+				SetSendingRate(sending_rate_ * (1.0 / (1 + std::min(rounds_ * config_->decision_made_step_size, config_->max_decision_made_step_size))), TRACE_RATE_RESTORE);
 			} else {
-				sending_rate_ = sending_rate_ * (1.0 / (1 - std::min(rounds_ * kDecisionMadeStepSize,kMaxDecisionMadeStepSize)));
-#ifdef DEBUG_RATE_CONTROL
-				std::cerr << "Decision made resotore: " 
-					<< sending_rate_ * (1.0 - std::min(rounds_ * kDecisionMadeStepSize, kMaxDecisionMadeStepSize)) 
-					<< "-->"
-					<< sending_rate_
-					<< std::endl;
-#endif
+				SetSendingRate(sending_rate_ * (1.0 / (1 - std::min(rounds_ * config_->decision_made_step_size,config_->max_decision_made_step_size))), TRACE_RATE_RESTORE);
 			}
 			break;
 		case PROBING:
 			// Reset sending rate to central rate when sender does not have enough
-			// data to send more than 2 * kNumIntervalGroupsInProbing intervals.
+			// data to send more than 2 * num_interval_groups_in_probing intervals.
 			if (interval_queue_.current().is_useful)
 			{
 				if (direction_ == INCREASE)
 				{
-					sending_rate_ = sending_rate_ * (1.0 / (1 + kProbingStepSize));
-#ifdef DEBUG_RATE_CONTROL
-					std::cerr << "Probing restore: " 
-						<< sending_rate_ * (1.0 + kProbingStepSize) 
-						<< "-->" 
-						<< sending_rate_ 
-						<< std::endl;
-#endif
+					SetSendingRate(sending_rate_ * (1.0 / (1 + config_->probing_step_size)), TRACE_RATE_RESTORE);
 				} else
 				{
-					sending_rate_ = sending_rate_ * (1.0 / (1 - kProbingStepSize));
-#ifdef DEBUG_RATE_CONTROL
-					std::cerr << "Probing restore: "
-						<< sending_rate_ * (1.0 - kProbingStepSize)
-						<< "-->"
-						<< sending_rate_
-						<< std::endl;
-#endif
+					SetSendingRate(sending_rate_ * (1.0 / (1 - config_->probing_step_size)), TRACE_RATE_RESTORE);
 				}
 			}
 			break;
 	}
 
+	if (mode_ == DECISION_MADE)
+		// The rate restored to is the one the sender converged to.
+		RecordPath(latest_event_time_);
 	if (mode_ == PROBING)
 	{
+		// The rounds of a stint of probing lie around the same central rate,
+		// so the fit keeps their samples until gradient_window and
+		// gradient_sample_decay age them out.
 		++rounds_;
-		return;
+	} else {
+		// The samples of an earlier stint lie around a rate the sender has
+		// since moved away from.
+		gradient_estimator_.Clear();
+		SetMode(PROBING);
+		rounds_ = 1;
 	}
+	NotifyPacingRateObserver();
+}
 
-	mode_ = PROBING;
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::EnterDecisionMade(QuicBandwidth new_rate)
+{
+	SetSendingRate(new_rate, TRACE_RATE_DECISION);
+	SetMode(DECISION_MADE);
 	rounds_ = 1;
 }
 
-void CongestionController::EnterDecisionMade(QuicBandwidth new_rate)
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::SetSendingRate(QuicBandwidth new_rate, TraceRateChangeReason reason)
 {
-#ifdef DEBUG_RATE_CONTROL
-	std::cerr << "Made decision: " 
-		<< sending_rate_ 
-		<< "-->" 
-		<< new_rate
-		<< std::endl;
-#endif
+	if (Trace::enabled())
+		Trace::Record(TRACE_RATE_CHANGE,
+			trace_id_,
+			sending_rate_,
+			new_rate,
+			reason,
+			mode_,
+			static_cast<double> (rounds_),
+			static_cast<double> (rate_change_proportion_allowance_));
 	sending_rate_ = new_rate;
-	mode_ = DECISION_MADE;
-	rounds_ = 1;
 }
 
+template <class UtilityFunction>
+uint64_t BasicCongestionController<UtilityFunction>::NextRandom()
+{
+	// splitmix64, whose output is well mixed even for consecutive seeds.
+	uint64_t value = (random_state_ += 0x9E3779B97F4A7C15ULL);
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+	return value ^ (value >> 31);
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::SetMode(SenderMode new_mode)
+{
+	if (Trace::enabled())
+		Trace::Record(TRACE_MODE_CHANGE, trace_id_, mode_, new_mode, sending_rate_, static_cast<double> (rounds_));
+	mode_ = new_mode;
+	mode_entry_rounds_ = stats_.mode_rounds[mode_];
+	steady_gradient_rounds_ = 0;
+	if (quiescent_)
+		ExitQuiescence();
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::CountModeTime(QuicTime now)
+{
+	if (stats_time_ >= 0 && now > stats_time_)
+		stats_.mode_time_us[mode_] += static_cast<uint64_t> (now - stats_time_);
+	stats_time_ = std::max(stats_time_, now);
+}
+
+template <class UtilityFunction>
+ControllerStats BasicCongestionController<UtilityFunction>::stats() const
+{
+	// Those of the quiescent intervals are kept by the controller, on top of
+	// the queue's.
+	ControllerStats stats = stats_;
+	stats.intervals_created += interval_queue_.num_intervals_created();
+	stats.useful_intervals_created = interval_queue_.num_useful_intervals_created() + stats_.quiescent_intervals;
+	stats.discarded_intervals += interval_queue_.num_discarded_intervals();
+	stats.invalid_utilities += interval_queue_.num_invalid_utilities();
+	stats.interval_overflows = interval_queue_.num_overflows();
+	stats.num_flows = 1;
+	stats.flows_in_mode[mode_] = 1;
+	stats.max_rounds_in_mode[mode_] = stats_.mode_rounds[mode_] - mode_entry_rounds_;
+	stats.quiescent_flows = quiescent_ ? 1 : 0;
+	stats.sending_rate = sending_rate_;
+	stats.utility_gradient = LatestGradient();
+	stats.gradient_confidence = gradient_confidence_;
+	return stats;
+}
+
+template <class UtilityFunction>
+void BasicCongestionController<UtilityFunction>::NotifyPacingRateObserver()
+{
+	if (pacing_rate_observer_ == nullptr)
+		return;
+
+	QuicBandwidth pacing_rate = PacingRate();
+	if (pacing_rate == observed_pacing_rate_)
+		return;
+	observed_pacing_rate_ = pacing_rate;
+	pacing_rate_observer_->OnPacingRateChanged(pacing_rate);
+}
 
+template class BasicCongestionController<VivaceLatencyUtility>;
+template class BasicCongestionController<VivaceLossUtility>;
+template class BasicCongestionController<ScavengerUtility>;
@@ -3,16 +3,21 @@
 #ifndef NET_QUIC_CORE_CONGESTION_CONTROL_PCC_SENDER_H_
 #define NET_QUIC_CORE_CONGESTION_CONTROL_PCC_SENDER_H_
 
+#include <memory>
+#include <string>
 #include <vector>
-#include <queue>
 
+#include "ControllerStats.h"
+#include "FixedPoint.h"
+#include "GradientEstimator.h"
 #include "MonitorIntervalQueue.h"
+#include "PathCache.h"
+#include "PccConfig.h"
+#include "Trace.h"
 
-// CongestionController implements the PCC congestion control algorithm.
-// CongestionController evaluates the benefits of different sending rates by 
-// comparing their utilities, and adjusts the sending rate towards the direction
-// of  higher utility.
-class CongestionController : public MonitorIntervalQueueDelegateInterface
+// CongestionControllerBase holds the types shared by every
+// BasicCongestionController, whatever its utility function.
+class CongestionControllerBase
 {
 public:
 	// Sender's mode during a connection.
@@ -38,24 +43,134 @@ public:
 	{
 		INCREASE, DECREASE
 	};
+};
 
-	CongestionController(QuicTime initial_rtt_us, QuicPacketCount initial_congestion_window, QuicPacketCount max_congestion_window);
-	CongestionController(const CongestionController&) = delete;
-	CongestionController& operator=(const CongestionController&) = delete;
-	CongestionController(CongestionController&&) = delete;
-	CongestionController& operator=(CongestionController&&) = delete;
+// Observes the pacing rate of a BasicCongestionController.
+class PacingRateObserverInterface
+{
+public:
+	virtual ~PacingRateObserverInterface() = default;
+	// Called from within the controller call that changes PacingRate().
+	virtual void OnPacingRateChanged(QuicBandwidth pacing_rate) = 0;
+};
+
+// BasicCongestionController implements the PCC congestion control algorithm.
+// BasicCongestionController evaluates the benefits of different sending rates by 
+// comparing their utilities, and adjusts the sending rate towards the direction
+// of  higher utility, as computed by |UtilityFunction| (see UtilityFunctions.h).
+template <class UtilityFunction>
+class BasicCongestionController : public CongestionControllerBase
+{
+public:
+
+	// Tuned by |config|, which must be valid (see PccConfig::Create) and is
+	// shared with any other controllers that use it.
+	BasicCongestionController(QuicTime initial_rtt_us,
+		QuicPacketCount initial_congestion_window,
+		QuicPacketCount max_congestion_window,
+		std::shared_ptr<const PccConfig> config = PccConfig::Default());
+	// Keeps the monitor intervals in |interval_storage|, which is not owned and
+	// must hold MonitorIntervalCapacity(*config) intervals.
+	BasicCongestionController(QuicTime initial_rtt_us,
+		QuicPacketCount initial_congestion_window,
+		QuicPacketCount max_congestion_window,
+		std::shared_ptr<const PccConfig> config,
+		MonitorInterval* interval_storage);
+	BasicCongestionController(const BasicCongestionController&) = delete;
+	BasicCongestionController& operator=(const BasicCongestionController&) = delete;
+	BasicCongestionController(BasicCongestionController&&) = delete;
+	BasicCongestionController& operator=(BasicCongestionController&&) = delete;
 
 	
 	void OnCongestionEvent(QuicTime event_time,
 		QuicTime rtt,
 		const AckedPacketVector& acked_packets,
 		const LostPacketVector& lost_packets);
+	// Same as above for ranges of packets, such as the ranges of a QUIC ACK
+	// frame or TCP SACK blocks, which need not be expanded to single packets.
+	void OnCongestionEvent(QuicTime event_time,
+		QuicTime rtt,
+		const PacketNumberRangeVector& acked_ranges,
+		const PacketNumberRangeVector& lost_ranges);
 	
 	void OnPacketSent(QuicTime sent_time,
 		QuicPacketNumber packet_number,
 		QuicByteCount bytes,
 		bool is_retransmittable);
 
+	// NextTimerDeadline() when no timer is needed.
+	static constexpr QuicTime kNoTimerDeadline = BasicMonitorIntervalQueue<UtilityFunction, BasicCongestionController>::kNoDeadline;
+	// Returns the time at which OnTimer() should be called next, or
+	// kNoTimerDeadline. Changes with every call to the controller.
+	QuicTime NextTimerDeadline() const;
+	// Completes the monitor intervals of the current decision at |now| if the
+	// ACKs that would complete them are overdue, such as on sparse-ACK or
+	// tail-loss paths, counting their outstanding packets as lost after
+	// config().monitor_interval_timeout_rtts RTTs. Does nothing before
+	// NextTimerDeadline().
+	void OnTimer(QuicTime now);
+
+	// Number of monitor intervals a controller tuned by |config| keeps at most.
+	static size_t MonitorIntervalCapacity(const PccConfig& config);
+
+	// The tuning of this controller.
+	const PccConfig& config() const { return *config_; }
+
+	// Current mode of the sender.
+	SenderMode mode() const { return mode_; }
+	// Utility of the rate the latest decision was based on.
+	const UtilityInfo& latest_utility_info() const { return latest_utility_info_; }
+	// Confidence in the latest utility gradient, from 0 to 1, which scales
+	// the rate changes. Always 1 with GRADIENT_PAIR.
+	float gradient_confidence() const { return gradient_confidence_; }
+	// The samples PROBING decisions fit the gradient to, with
+	// GRADIENT_WEIGHTED_LEAST_SQUARES.
+	const GradientEstimator& gradient_estimator() const { return gradient_estimator_; }
+	// True while the controller measures its intervals on the quiescent fast
+	// path, see PccConfig::quiescent_rounds.
+	bool is_quiescent() const { return quiescent_; }
+
+	// The counters and gauges of the controller as of the latest call, for
+	// the owner thread to export or publish (see ControllerStatsPublisher).
+	// Counters start from zero in a controller resumed from a snapshot.
+	ControllerStats stats() const;
+
+	// Seeds the random order in which PROBING tries the higher and the lower
+	// rate. Controllers seeded alike make the same decisions given the same
+	// events. Unseeded controllers are seeded by the order of their creation.
+	void set_random_seed(uint64_t seed) { random_state_ = seed; }
+
+	// Notifies |observer|, which is not owned and may be null, of every change
+	// of PacingRate() from now on.
+	void set_pacing_rate_observer(PacingRateObserverInterface* observer);
+
+	// Shares what the controller learns about the path to |destination| with
+	// later connections through |cache|, which is not owned and may be null.
+	// The controller records its rate and min RTT there whenever it leaves
+	// DECISION_MADE, and on OnConnectionClosed(). Called before the first
+	// packet is sent, it also starts from the info |cache| has on
+	// |destination| at |now|, if any: in PROBING around the decayed rate
+	// rather than in STARTING. A decayed rate below the initial one counts
+	// as no info, and the controller stays in STARTING.
+	void set_path_cache(PathCache* cache, uint64_t destination, QuicTime now);
+	// Records the path in the path cache, if any, at |now| unless the
+	// controller is still STARTING.
+	void OnConnectionClosed(QuicTime now);
+
+	// Replaces |snapshot| with the state of the controller and its monitor
+	// intervals, for another controller to resume the connection from with
+	// RestoreSnapshot(), e.g. after the connection migrates to another process
+	// or host. Snapshots are versioned and checksummed. They leave out the
+	// quiescent fast path and its interval in progress, so the resumed
+	// controller goes through the queue until its gradient is steady again.
+	void SaveSnapshot(std::vector<uint8_t>* snapshot) const;
+	// Resumes from the |size| bytes of snapshot at |data|, which a controller
+	// with the same UtilityFunction and config saved, at the rate and in the
+	// mode it had. The pacing rate observer and path cache are kept. Returns false, and
+	// leaves the controller as it was, if the snapshot is malformed or of
+	// another version, storing the reason in |error| if it is not null.
+	bool RestoreSnapshot(const uint8_t* data, size_t size, std::string* error);
+
 	QuicBandwidth PacingRate() const;
 	QuicByteCount GetCongestionWindow() const;
 	QuicTime ComputeMonitorDuration(QuicBandwidth sending_rate, QuicTime rtt);
@@ -63,10 +178,10 @@ public:
 
 	void UpdateAverageGradient(float new_gradient);
 
-	// Implementation of MonitorIntervalQueueDelegate.
+	// Delegate of |interval_queue_|, which calls it without virtual dispatch.
 	// Called when all useful intervals' utilities are available,
 	// so the sender can make a decision.
-	void OnUtilityAvailable(const std::vector<UtilityInfo>& utility_info) override;
+	void OnUtilityAvailable(UtilityInfoSpan utility_info);
 
 private:
 	// Returns true if next created monitor interval is useful,
@@ -75,14 +190,57 @@ private:
 	// Maybe set sending_rate_ for next created monitor interval.
 	void MaybeSetSendingRate();
 
+	// Updates the average RTT with the |rtt| of a congestion event. Returns
+	// false if the RTT inflation made the sender enter PROBING, in which case
+	// the event's packets are of no use.
+	bool OnRttSample(QuicTime rtt);
 	// Returns true if the sender can enter DECISION_MADE from PROBING mode.
-	bool CanMakeDecision(const std::vector<UtilityInfo>& utility_info) const;
+	bool CanMakeDecision(UtilityInfoSpan utility_info) const;
 	// Set the sending rate to the central rate used in PROBING mode.
 	void EnterProbing();
 	// Set the sending rate when entering DECISION_MADE from PROBING mode.
 	void EnterDecisionMade(QuicBandwidth new_rate);
+	// Counts the time in the current mode up to |now|.
+	void CountModeTime(QuicTime now);
+	// Notifies the pacing rate observer if PacingRate() has changed.
+	void NotifyPacingRateObserver();
+	// Change sending_rate_ and mode_, tracing the change.
+	void SetSendingRate(QuicBandwidth new_rate, TraceRateChangeReason reason);
+	void SetMode(SenderMode new_mode);
+	// Returns the next number of the probing order generator.
+	uint64_t NextRandom();
+	// The smoothed RTT, or the initial one before there are samples.
+	QuicTime SmoothedRtt() const;
+	// Records the rate and min RTT in the path cache, if any, at |now|.
+	void RecordPath(QuicTime now);
+	// ComputeRateChange with config_->fixed_point_arithmetic.
+	QuicBandwidth ComputeRateChangeFixedPoint(const UtilityInfo& utility_sample_1, const UtilityInfo& utility_sample_2);
+	// The average utility gradient in utility per Mbit/s, in floating or
+	// fixed point as the config selects.
+	double LatestGradient() const;
+
+	// The quiescent fast path, see PccConfig::quiescent_rounds. It measures
+	// the one useful interval of each DECISION_MADE round as OnPacketSent()
+	// would create it, without the non-useful ones in between.
+	void OnQuiescentPacketSent(QuicTime sent_time, QuicPacketNumber packet_number, QuicByteCount bytes);
+	// Counts the packets of a congestion event in the quiescent interval, and
+	// completes it if that was its last report or its ACKs are overdue.
+	template <class Reports>
+	void OnQuiescentCongestionEvent(QuicTime event_time, QuicTime rtt, const Reports& acked, const Reports& lost);
+	// Reports the utility of the completed quiescent interval, or drops it if
+	// it is invalid or too inexact, the latter ending the fast path.
+	void CompleteQuiescentInterval();
+	// NextTimerDeadline() on the fast path.
+	QuicTime QuiescentDeadline() const;
+	// Counts the DECISION_MADE round just decided toward the fast path, and
+	// enters or leaves it.
+	void UpdateQuiescence();
+	void ExitQuiescence();
 
-	// Current mode of CongestionController.
+	// Tuning shared with other controllers. Declared before |interval_queue_|,
+	// which keeps a reference to it.
+	std::shared_ptr<const PccConfig> config_;
+	// Current mode of BasicCongestionController.
 	SenderMode mode_ = STARTING;
 	// Sending rate in Mbit/s for the next monitor intervals.
 	QuicBandwidth sending_rate_;
@@ -95,13 +253,18 @@ private:
 	// Number of rounds sender remains in current mode.
 	size_t rounds_ = 1;
 	// Queue of monitor intervals with pending utilities.
-	MonitorIntervalQueue interval_queue_;
+	BasicMonitorIntervalQueue<UtilityFunction, BasicCongestionController> interval_queue_;
 	// Maximum congestion window in bits, used to cap sending rate.
 	uint32_t max_cwnd_bits_;
 	// The current average of several utility gradients.
 	float avg_gradient_ = 0.0f;
-	// The gradient samples that have been averaged.
-	std::queue<float> gradient_samples_;
+	// Number of gradients to average.
+	static const size_t kAvgGradientSampleSize = 1;
+	// The gradient samples that have been averaged, oldest first starting at
+	// |oldest_gradient_sample_|.
+	float gradient_samples_[kAvgGradientSampleSize] = {};
+	size_t num_gradient_samples_ = 0;
+	size_t oldest_gradient_sample_ = 0;
 
 	QuicTime initial_rtt_ = 0;
 	QuicTime avg_rtt_ = 0;
@@ -115,6 +278,58 @@ private:
 	size_t rate_change_proportion_allowance_ = 0;
 	// The most recent change made to the sending rate.
 	QuicBandwidth previous_change_ = 0;
+	// The rate control tuning and state in fixed point, which replace the
+	// float state above with config_->fixed_point_arithmetic.
+	FixedRateControlCoefficients fixed_rate_control_coefficients_;
+	FixedRateControlState fixed_rate_control_;
+	// The utility samples of the probing round, with
+	// GRADIENT_WEIGHTED_LEAST_SQUARES.
+	GradientEstimator gradient_estimator_;
+	float gradient_confidence_ = 1.0f;
+	// Identifies this controller's records in a Trace.
+	uint32_t trace_id_ = Trace::NewId();
+	// State of the probing order generator.
+	uint64_t random_state_ = trace_id_;
+	// Smallest RTT sampled so far, or 0.
+	QuicTime min_rtt_ = 0;
+	// Time of the latest congestion event or timer.
+	QuicTime latest_event_time_ = 0;
+	// The counters of stats() kept by the controller itself, the time up to
+	// which the mode times count, or -1 before the first event, and the
+	// rounds completed in the current mode before it was entered.
+	ControllerStats stats_;
+	QuicTime stats_time_ = -1;
+	uint64_t mode_entry_rounds_ = 0;
+	// Not owned, may be null. Shares the path to |path_destination_|.
+	PathCache* path_cache_ = nullptr;
+	uint64_t path_destination_ = 0;
+	// Observer of PacingRate(), and the rate it was last told of.
+	PacingRateObserverInterface* pacing_rate_observer_ = nullptr;
+	QuicBandwidth observed_pacing_rate_ = 0;
+
+	// State of the quiescent interval: none until the next packet opens one,
+	// then taking packets until its monitor duration is over, then waiting
+	// for their ACKs.
+	enum QuiescentIntervalState
+	{
+		NO_QUIESCENT_INTERVAL,
+		QUIESCENT_INTERVAL_SENDING,
+		QUIESCENT_INTERVAL_PENDING
+	};
+	// Whether the controller is on the quiescent fast path, and the
+	// DECISION_MADE rounds in a row whose gradient stayed within tolerance of
+	// the one before, the latest of which is |steady_gradient_|.
+	bool quiescent_ = false;
+	size_t steady_gradient_rounds_ = 0;
+	double steady_gradient_ = 0.0;
+	AggregateMonitorInterval quiescent_interval_;
+	QuiescentIntervalState quiescent_interval_state_ = NO_QUIESCENT_INTERVAL;
+	// Highest packet number sent on the fast path, which the queue catches up
+	// with at each quiescent interval.
+	int64_t largest_sent_packet_number_ = -1;
 };
 
+// The controller of the Vivace latency-based utility, the default.
+typedef BasicCongestionController<VivaceLatencyUtility> CongestionController;
+
 #endif
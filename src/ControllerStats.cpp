@@ -0,0 +1,211 @@
+#include "ControllerStats.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<ControllerStats>::value, "ControllerStats is copied word by word");
+static_assert(sizeof(ControllerStats) % sizeof(uint64_t) == 0, "ControllerStats is made of whole words");
+
+namespace
+{
+	// Label values of the modes, by SenderMode.
+	const char* const kModeNames[ControllerStats::kNumModes] = { "starting", "probing", "decision_made" };
+
+	enum MetricType
+	{
+		COUNTER,
+		GAUGE
+	};
+
+	typedef std::vector<std::pair<std::string, ControllerStats> > StatsSeries;
+
+	void AppendHeader(const char* name, const char* help, MetricType type, std::string* text)
+	{
+		*text += "# HELP ";
+		*text += name;
+		*text += ' ';
+		*text += help;
+		*text += "\n# TYPE ";
+		*text += name;
+		*text += type == COUNTER ? " counter\n" : " gauge\n";
+	}
+
+	void AppendSample(const char* name, const std::string& labels, const char* mode, double value, std::string* text)
+	{
+		char number[32];
+		snprintf(number, sizeof(number), "%.15g", value);
+		*text += name;
+		if (!labels.empty() || mode != nullptr)
+		{
+			*text += '{';
+			*text += labels;
+			if (mode != nullptr)
+			{
+				if (!labels.empty())
+					*text += ',';
+				*text += "mode=\"";
+				*text += mode;
+				*text += '"';
+			}
+			*text += '}';
+		}
+		*text += ' ';
+		*text += number;
+		*text += '\n';
+	}
+
+	// Appends the metric |name| with the value |get| returns for the stats of
+	// every series.
+	template <class Get>
+	void AppendMetric(const char* name, const char* help, MetricType type, const StatsSeries& series, Get get, std::string* text)
+	{
+		AppendHeader(name, help, type, text);
+		for (const std::pair<std::string, ControllerStats>& entry : series)
+			AppendSample(name, entry.first, nullptr, get(entry.second), text);
+	}
+
+	// Same as above for a metric with a value per mode, labelled by mode.
+	template <class Get>
+	void AppendModeMetric(const char* name, const char* help, MetricType type, const StatsSeries& series, Get get, std::string* text)
+	{
+		AppendHeader(name, help, type, text);
+		for (const std::pair<std::string, ControllerStats>& entry : series)
+			for (size_t mode = 0; mode < ControllerStats::kNumModes; ++mode)
+				AppendSample(name, entry.first, kModeNames[mode], get(entry.second, mode), text);
+	}
+} // namespace
+
+void ControllerStats::Add(const ControllerStats& other)
+{
+	AddCounters(other);
+	num_flows += other.num_flows;
+	for (size_t mode = 0; mode < kNumModes; ++mode)
+	{
+		flows_in_mode[mode] += other.flows_in_mode[mode];
+		max_rounds_in_mode[mode] = std::max(max_rounds_in_mode[mode], other.max_rounds_in_mode[mode]);
+	}
+	quiescent_flows += other.quiescent_flows;
+	sending_rate += other.sending_rate;
+	utility_gradient += other.utility_gradient;
+	gradient_confidence += other.gradient_confidence;
+}
+
+void ControllerStats::AddCounters(const ControllerStats& other)
+{
+	for (size_t mode = 0; mode < kNumModes; ++mode)
+	{
+		mode_time_us[mode] += other.mode_time_us[mode];
+		mode_rounds[mode] += other.mode_rounds[mode];
+	}
+	intervals_created += other.intervals_created;
+	useful_intervals_created += other.useful_intervals_created;
+	discarded_intervals += other.discarded_intervals;
+	invalid_utilities += other.invalid_utilities;
+	interval_overflows += other.interval_overflows;
+	probing_decisions += other.probing_decisions;
+	inconclusive_probing_rounds += other.inconclusive_probing_rounds;
+	rtt_inflation_exits += other.rtt_inflation_exits;
+	quiescent_intervals += other.quiescent_intervals;
+	quiescent_fallbacks += other.quiescent_fallbacks;
+}
+
+void ControllerStatsPublisher::Publish(const ControllerStats& stats)
+{
+	uint64_t words[kNumWords];
+	memcpy(words, &stats, sizeof(words));
+
+	uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+	sequence_.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (size_t i = 0; i < kNumWords; ++i)
+		words_[i].store(words[i], std::memory_order_relaxed);
+	sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+ControllerStats ControllerStatsPublisher::Read() const
+{
+	uint64_t words[kNumWords];
+	for (;;)
+	{
+		uint64_t before = sequence_.load(std::memory_order_acquire);
+		for (size_t i = 0; i < kNumWords; ++i)
+			words[i] = words_[i].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = sequence_.load(std::memory_order_relaxed);
+		if (before == after && (before & 1) == 0)
+			break;
+	}
+	ControllerStats stats;
+	memcpy(&stats, words, sizeof(words));
+	return stats;
+}
+
+void AppendPrometheusStats(const StatsSeries& series, std::string* text)
+{
+	AppendModeMetric("pcc_mode_seconds_total", "Time spent in each sender mode.", COUNTER, series,
+		[](const ControllerStats& stats, size_t mode) { return stats.mode_time_us[mode] / 1e6; }, text);
+	AppendModeMetric("pcc_mode_rounds_total", "Rounds of monitor intervals completed in each sender mode.", COUNTER, series,
+		[](const ControllerStats& stats, size_t mode) { return static_cast<double> (stats.mode_rounds[mode]); }, text);
+	AppendMetric("pcc_intervals_created_total", "Monitor intervals created.", COUNTER, series,
+		[](const ControllerStats& stats) { return static_cast<double> (stats.intervals_created); }, text);
+	AppendMetric("pcc_useful_intervals_created_total", "Useful monitor intervals created.", COUNTER, series,
+		[](const ControllerStats& stats) { return static_cast<double> (stats.useful_intervals_created); }, text);
+	AppendMetric("pcc_discarded_intervals_total", "Useful monitor intervals dropped before their utilities were used.", COUNTER, series,
+		[](const ControllerStats& stats) { return static_cast<double> (stats.discarded_intervals); }, text);
+	AppendMetric("pcc_invalid_utilities_total", "Monitor intervals whose utility was invalid.", COUNTER, series,
+		[](const ControllerStats& stats) { return static_cast<double> (stats.invalid_utilities); }, text);
+	AppendMetric("pcc_interval_overflows_total", "Monitor intervals not created because the queue was full.", COUNTER, series,
+		[](const ControllerStats& stats) { return static_cast<double> (stats.interval_overflows); }, text);
+	AppendMetric("pcc_probing_decisions_total", "Probing rounds that led to a decision.", COUNTER, series,
+		[](const ControllerStats& stats) { return static_cast<double> (stats.probing_decisions); }, text);
+	AppendMetric("pcc_inconclusive_probing_rounds_total", "Probing rounds that led to probing again.", COUNTER, series,
+		[](const ControllerStats& stats) { return static_cast<double> (stats.inconclusive_probing_rounds); }, text);
+	AppendMetric("pcc_rtt_inflation_exits_total", "Times RTT inflation ended the starting mode.", COUNTER, series,
+		[](const ControllerStats& stats) { return static_cast<double> (stats.rtt_inflation_exits); }, text);
+	AppendMetric("pcc_quiescent_intervals_total", "Useful monitor intervals measured on the quiescent fast path.", COUNTER, series,
+		[](const ControllerStats& stats) { return static_cast<double> (stats.quiescent_intervals); }, text);
+	AppendMetric("pcc_quiescent_fallbacks_total", "Quiescent monitor intervals dropped as too inexact, ending the fast path.", COUNTER, series,
+		[](const ControllerStats& stats) { return static_cast<double> (stats.quiescent_fallbacks); }, text);
+	AppendMetric("pcc_flows", "Controllers.", GAUGE, series,
+		[](const ControllerStats& stats) { return static_cast<double> (stats.num_flows); }, text);
+	AppendModeMetric("pcc_flows_in_mode", "Controllers in each sender mode.", GAUGE, series,
+		[](const ControllerStats& stats, size_t mode) { return static_cast<double> (stats.flows_in_mode[mode]); }, text);
+	AppendModeMetric("pcc_max_rounds_in_mode", "Most rounds a controller has spent in each sender mode since entering it.", GAUGE, series,
+		[](const ControllerStats& stats, size_t mode) { return static_cast<double> (stats.max_rounds_in_mode[mode]); }, text);
+	AppendMetric("pcc_quiescent_flows", "Controllers on the quiescent fast path.", GAUGE, series,
+		[](const ControllerStats& stats) { return static_cast<double> (stats.quiescent_flows); }, text);
+	AppendMetric("pcc_sending_rate_bits_per_second", "Sending rate of the controllers.", GAUGE, series,
+		[](const ControllerStats& stats) { return stats.sending_rate; }, text);
+	AppendMetric("pcc_utility_gradient", "Average utility gradient of the controllers, in utility per Mbit/s.", GAUGE, series,
+		[](const ControllerStats& stats) { return stats.utility_gradient; }, text);
+	AppendMetric("pcc_gradient_confidence", "Confidence in the utility gradient of the controllers.", GAUGE, series,
+		[](const ControllerStats& stats) { return stats.gradient_confidence; }, text);
+}
+
+bool WritePrometheusStats(const std::string& path, const StatsSeries& series, std::string* error)
+{
+	std::string text;
+	AppendPrometheusStats(series, &text);
+
+	std::string temporary_path = path + ".tmp";
+	FILE* file = fopen(temporary_path.c_str(), "wb");
+	if (file == nullptr)
+	{
+		if (error != nullptr)
+			*error = "cannot create " + temporary_path + ": " + strerror(errno);
+		return false;
+	}
+	bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+	ok = fclose(file) == 0 && ok;
+	if (!ok || rename(temporary_path.c_str(), path.c_str()) != 0)
+	{
+		if (error != nullptr)
+			*error = "cannot write " + path + ": " + strerror(errno);
+		remove(temporary_path.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,113 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_CONTROLLER_STATS_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_CONTROLLER_STATS_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ControllerStats, the counters and gauges of a BasicCongestionController
+// (see BasicCongestionController::stats()), or of many controllers added up
+// with Add(). Arrays indexed by mode follow CongestionControllerBase's
+// SenderMode.
+
+struct ControllerStats
+{
+	// One per SenderMode.
+	static const size_t kNumModes = 3;
+
+	// Counters, which only grow over the life of a controller.
+
+	// Time spent in each mode in microseconds, as of the latest congestion
+	// event or timer.
+	uint64_t mode_time_us[kNumModes] = {};
+	// Rounds of monitor intervals completed in each mode.
+	uint64_t mode_rounds[kNumModes] = {};
+	uint64_t intervals_created = 0;
+	uint64_t useful_intervals_created = 0;
+	// Useful intervals dropped before their utilities were used, on RTT
+	// inflation in STARTING or along with an invalid utility.
+	uint64_t discarded_intervals = 0;
+	uint64_t invalid_utilities = 0;
+	// Intervals that could not be created because the queue was full of
+	// useful ones.
+	uint64_t interval_overflows = 0;
+	// PROBING rounds that led to a decision, and those whose interval groups
+	// disagreed or were too few, after which the sender probes again.
+	uint64_t probing_decisions = 0;
+	uint64_t inconclusive_probing_rounds = 0;
+	// Times RTT inflation ended STARTING.
+	uint64_t rtt_inflation_exits = 0;
+	// Useful intervals measured on the quiescent fast path (see
+	// PccConfig::quiescent_rounds), also counted above, and those of them
+	// dropped as too inexact, each of which ended the fast path.
+	uint64_t quiescent_intervals = 0;
+	uint64_t quiescent_fallbacks = 0;
+
+	// Gauges, as of the latest call to the controller. Added up over the
+	// controllers, except the maxima.
+
+	// Number of controllers, in total and in each mode.
+	uint64_t num_flows = 0;
+	uint64_t flows_in_mode[kNumModes] = {};
+	// Most rounds any controller has spent in each mode since it entered it.
+	// A flow stuck in PROBING shows as a growing maximum there.
+	uint64_t max_rounds_in_mode[kNumModes] = {};
+	// Number of controllers on the quiescent fast path.
+	uint64_t quiescent_flows = 0;
+	// Sending rates in bit/s.
+	double sending_rate = 0.0;
+	// Average utility gradients in utility per Mbit/s and their confidences.
+	// Divide by num_flows for the mean.
+	double utility_gradient = 0.0;
+	double gradient_confidence = 0.0;
+
+	// Adds the counters and gauges of |other|.
+	void Add(const ControllerStats& other);
+	// Adds only the counters of |other|, such as those of a controller that
+	// is gone, so that the totals keep growing.
+	void AddCounters(const ControllerStats& other);
+};
+
+// ControllerStatsPublisher, a seqlock over a ControllerStats, for a thread
+// that aggregates the stats of controllers run by other threads. One thread
+// publishes; any number of threads read without locks or writes to shared
+// memory, retrying only while a publish is in progress.
+
+class ControllerStatsPublisher
+{
+public:
+	ControllerStatsPublisher() = default;
+	ControllerStatsPublisher(const ControllerStatsPublisher&) = delete;
+	ControllerStatsPublisher& operator=(const ControllerStatsPublisher&) = delete;
+
+	// Writer only.
+	void Publish(const ControllerStats& stats);
+	// Any thread. A consistent copy of the last published stats.
+	ControllerStats Read() const;
+
+private:
+	static const size_t kNumWords = sizeof(ControllerStats) / sizeof(uint64_t);
+
+	// Odd while a publish is in progress.
+	alignas(64) std::atomic<uint64_t> sequence_{0};
+	std::atomic<uint64_t> words_[kNumWords] = {};
+};
+
+// Appends |stats| to |text| in the Prometheus text exposition format. Each
+// entry of |series| is a label set, such as flow="42" or empty, and the
+// stats of that series; every metric lists the series in order.
+void AppendPrometheusStats(const std::vector<std::pair<std::string, ControllerStats> >& series,
+	std::string* text);
+// Writes AppendPrometheusStats() of |series| to |path|, e.g. for the
+// textfile collector of the Prometheus node exporter. The file is written
+// next to |path| and renamed over it, so readers never see half of it.
+// Returns false, storing the reason in |error| if it is not null, on
+// failure.
+bool WritePrometheusStats(const std::string& path,
+	const std::vector<std::pair<std::string, ControllerStats> >& series,
+	std::string* error);
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_CONTROLLER_STATS_H_
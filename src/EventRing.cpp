@@ -0,0 +1,204 @@
+#include "EventRing.h"
+
+#include <algorithm>
+
+namespace
+{
+	size_t RoundUpToPowerOfTwo(size_t value)
+	{
+		size_t result = 1;
+		while (result < value)
+			result <<= 1;
+		return result;
+	}
+} // namespace
+
+EventRing::EventRing(size_t capacity) :
+	mask_(RoundUpToPowerOfTwo(capacity < 2 ? 2 : capacity) - 1),
+	slots_(new Slot[mask_ + 1]),
+	enqueue_position_(0)
+{
+	for (size_t i = 0; i <= mask_; ++i)
+		slots_[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool EventRing::TryClaim(size_t count, uint64_t* position)
+{
+	if (count == 0 || count > capacity())
+		return false;
+
+	uint64_t first = enqueue_position_.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		// The consumer frees slots in order, so the claimed slots are all free
+		// once the last of them is.
+		uint64_t last = first + count - 1;
+		uint64_t sequence = slots_[last & mask_].sequence.load(std::memory_order_acquire);
+		int64_t lag = static_cast<int64_t> (sequence - last);
+		if (lag == 0)
+		{
+			if (enqueue_position_.compare_exchange_weak(first, first + count, std::memory_order_relaxed))
+			{
+				*position = first;
+				return true;
+			}
+		}
+		else if (lag < 0)
+		{
+			// The consumer has not freed the slot from the previous lap.
+			return false;
+		}
+		else
+		{
+			first = enqueue_position_.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void EventRing::Publish(uint64_t position)
+{
+	slots_[position & mask_].sequence.store(position + 1, std::memory_order_release);
+}
+
+const RingEvent* EventRing::Front() const
+{
+	const Slot& slot = slots_[dequeue_position_ & mask_];
+	if (slot.sequence.load(std::memory_order_acquire) != dequeue_position_ + 1)
+		return nullptr;
+	return &slot.event;
+}
+
+void EventRing::PopFront()
+{
+	slots_[dequeue_position_ & mask_].sequence.store(dequeue_position_ + capacity(), std::memory_order_release);
+	++dequeue_position_;
+}
+
+size_t EventRing::PostPacketSent(uint64_t flow,
+	QuicTime sent_time,
+	QuicPacketNumber packet_number,
+	QuicByteCount bytes,
+	bool is_retransmittable)
+{
+	uint64_t position;
+	if (!TryClaim(1, &position))
+		return 0;
+
+	RingEvent& event = at(position);
+	event.type = RingEvent::PACKET_SENT;
+	event.continued = false;
+	event.is_retransmittable = is_retransmittable;
+	event.num_acked = 0;
+	event.num_lost = 0;
+	event.flow = flow;
+	event.time = sent_time;
+	event.rtt = 0;
+	event.packets[0].packet_number = packet_number;
+	event.packets[0].bytes_acked = static_cast<int32_t> (bytes);
+	event.packets[0].bytes_lost = 0;
+	event.packets[0].time = static_cast<uint64_t> (sent_time);
+	Publish(position);
+	return 1;
+}
+
+size_t EventRing::PostCongestionEvent(uint64_t flow,
+	QuicTime event_time,
+	QuicTime rtt,
+	const AckedPacketVector& acked_packets,
+	const LostPacketVector& lost_packets)
+{
+	const size_t kChunkSize = RingEvent::kPacketsPerChunk;
+	size_t num_packets = acked_packets.size() + lost_packets.size();
+	size_t num_chunks = std::max<size_t>(1, (num_packets + kChunkSize - 1) / kChunkSize);
+	uint64_t position;
+	if (!TryClaim(num_chunks, &position))
+		return 0;
+
+	// Packet |next| of the acked packets followed by the lost packets goes
+	// next.
+	size_t next = 0;
+	for (size_t chunk = 0; chunk < num_chunks; ++chunk)
+	{
+		RingEvent& event = at(position + chunk);
+		event.type = RingEvent::CONGESTION_EVENT;
+		event.continued = chunk + 1 < num_chunks;
+		event.num_acked = 0;
+		event.num_lost = 0;
+		event.flow = flow;
+		event.time = event_time;
+		event.rtt = rtt;
+		for (size_t i = 0; i < kChunkSize && next < num_packets; ++i, ++next)
+		{
+			if (next < acked_packets.size())
+			{
+				event.packets[i] = acked_packets[next];
+				++event.num_acked;
+			}
+			else
+			{
+				event.packets[i] = lost_packets[next - acked_packets.size()];
+				++event.num_lost;
+			}
+		}
+		Publish(position + chunk);
+	}
+	return num_chunks;
+}
+
+size_t EventRing::PostFlowAdded(uint64_t flow,
+	QuicTime initial_rtt_us,
+	QuicPacketCount initial_congestion_window,
+	QuicPacketCount max_congestion_window)
+{
+	uint64_t position;
+	if (!TryClaim(1, &position))
+		return 0;
+
+	RingEvent& event = at(position);
+	event.type = RingEvent::FLOW_ADDED;
+	event.continued = false;
+	event.num_acked = 0;
+	event.num_lost = 0;
+	event.flow = flow;
+	event.time = 0;
+	event.rtt = initial_rtt_us;
+	event.packets[0].packet_number = initial_congestion_window;
+	event.packets[0].bytes_acked = max_congestion_window;
+	Publish(position);
+	return 1;
+}
+
+size_t EventRing::PostFlowRemoved(uint64_t flow)
+{
+	uint64_t position;
+	if (!TryClaim(1, &position))
+		return 0;
+
+	RingEvent& event = at(position);
+	event.type = RingEvent::FLOW_REMOVED;
+	event.continued = false;
+	event.num_acked = 0;
+	event.num_lost = 0;
+	event.flow = flow;
+	Publish(position);
+	return 1;
+}
+
+bool CongestionEventAssembler::Add(const RingEvent& event)
+{
+	if (!has_partial_event_)
+	{
+		has_partial_event_ = true;
+		flow_ = event.flow;
+		event_time_ = event.time;
+		rtt_ = event.rtt;
+		acked_packets_.clear();
+		lost_packets_.clear();
+	}
+	acked_packets_.insert(acked_packets_.end(), event.packets, event.packets + event.num_acked);
+	lost_packets_.insert(lost_packets_.end(),
+		event.packets + event.num_acked,
+		event.packets + event.num_acked + event.num_lost);
+	has_partial_event_ = event.continued;
+	return !event.continued;
+}
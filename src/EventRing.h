@@ -0,0 +1,139 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_EVENT_RING_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_EVENT_RING_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "MonitorIntervalQueue.h"
+
+// RingEvent, a sent packet, a chunk of a congestion event or a change of
+// the flows as posted to an EventRing. A congestion event with more packets
+// than fit in one chunk takes consecutive chunks, all but the last marked
+// |continued|. The acked packets of a chunk come first in |packets|,
+// followed by the lost ones.
+
+struct RingEvent
+{
+	enum Type : uint8_t
+	{
+		PACKET_SENT,
+		CONGESTION_EVENT,
+		// A flow starts, with its initial RTT in |rtt| and its initial and
+		// maximum congestion windows in packets[0].packet_number and
+		// packets[0].bytes_acked.
+		FLOW_ADDED,
+		FLOW_REMOVED
+	};
+
+	// Packets held by one chunk of a congestion event.
+	static const size_t kPacketsPerChunk = 4;
+
+	Type type = PACKET_SENT;
+	// True if the next chunk continues this congestion event.
+	bool continued = false;
+	// Whether the sent packet is retransmittable.
+	bool is_retransmittable = true;
+	uint8_t num_acked = 0;
+	uint8_t num_lost = 0;
+	// Flow of the event, if the ring is shared by several.
+	uint64_t flow = 0;
+	// Sent time or event time.
+	QuicTime time = 0;
+	// RTT sample of a congestion event.
+	QuicTime rtt = 0;
+	// The sent packet in packets[0], with its size in bytes_acked, or the
+	// acked and lost packets.
+	CongestionEvent packets[kPacketsPerChunk];
+};
+
+// EventRing, a bounded lock-free queue of RingEvents from any number of
+// producer threads to one consumer thread. Producers claim consecutive
+// slots, fill them in place and publish each; the consumer sees the slots in
+// claim order, each once it is published. A full ring fails the claim
+// rather than blocking the producer.
+
+class EventRing
+{
+public:
+	// Creates a ring of |capacity| slots, rounded up to a power of two.
+	explicit EventRing(size_t capacity);
+	EventRing(const EventRing&) = delete;
+	EventRing& operator=(const EventRing&) = delete;
+
+	// Producers. Claims |count| consecutive slots and stores the position of
+	// the first in |position|. Returns false if they are not free.
+	bool TryClaim(size_t count, uint64_t* position);
+	// The slot at |position|, which the caller has claimed.
+	RingEvent& at(uint64_t position) { return slots_[position & mask_].event; }
+	// Hands the claimed slot at |position| to the consumer.
+	void Publish(uint64_t position);
+	// Claim, fill and publish the slots of an event of |flow|. Return the
+	// number of slots used, or 0 if the event does not fit in the ring now.
+	size_t PostPacketSent(uint64_t flow,
+		QuicTime sent_time,
+		QuicPacketNumber packet_number,
+		QuicByteCount bytes,
+		bool is_retransmittable);
+	size_t PostCongestionEvent(uint64_t flow,
+		QuicTime event_time,
+		QuicTime rtt,
+		const AckedPacketVector& acked_packets,
+		const LostPacketVector& lost_packets);
+	size_t PostFlowAdded(uint64_t flow,
+		QuicTime initial_rtt_us,
+		QuicPacketCount initial_congestion_window,
+		QuicPacketCount max_congestion_window);
+	size_t PostFlowRemoved(uint64_t flow);
+
+	// Consumer. The oldest claimed slot if it is published, otherwise null.
+	const RingEvent* Front() const;
+	// Frees the slot returned by Front().
+	void PopFront();
+
+	size_t capacity() const { return mask_ + 1; }
+
+private:
+	// A slot is free for position p when |sequence| is p, and published for
+	// position p when it is p + 1.
+	struct alignas(64) Slot
+	{
+		std::atomic<uint64_t> sequence;
+		RingEvent event;
+	};
+
+	size_t mask_;
+	std::unique_ptr<Slot[]> slots_;
+	// Position of the next slot to claim, shared by the producers.
+	alignas(64) std::atomic<uint64_t> enqueue_position_;
+	// Position of the next slot to consume, owned by the consumer.
+	alignas(64) uint64_t dequeue_position_ = 0;
+};
+
+// CongestionEventAssembler, reassembles the congestion events a consumer
+// takes from an EventRing from their chunks.
+
+class CongestionEventAssembler
+{
+public:
+	// Adds the chunk |event|. Returns true if it completes a congestion event,
+	// which the accessors then describe until the next call.
+	bool Add(const RingEvent& event);
+
+	uint64_t flow() const { return flow_; }
+	QuicTime event_time() const { return event_time_; }
+	QuicTime rtt() const { return rtt_; }
+	const AckedPacketVector& acked_packets() const { return acked_packets_; }
+	const LostPacketVector& lost_packets() const { return lost_packets_; }
+
+private:
+	// True once the first chunk of an event has been added, until its last.
+	bool has_partial_event_ = false;
+	uint64_t flow_ = 0;
+	QuicTime event_time_ = 0;
+	QuicTime rtt_ = 0;
+	AckedPacketVector acked_packets_;
+	LostPacketVector lost_packets_;
+};
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_EVENT_RING_H_
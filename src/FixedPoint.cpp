@@ -0,0 +1,426 @@
+#include "FixedPoint.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	// Largest magnitude of a result; results saturate symmetrically, so that
+	// they can always be negated.
+	const int64_t kMaxFixedPoint = std::numeric_limits<int64_t>::max();
+	// Fractional bits of the logarithms passed from FixedLog2 to FixedExp2
+	// within FixedPow, and of the tables.
+	const int kTableFractionBits = 30;
+	// The tables have 2^kTableIndexBits segments.
+	const int kTableIndexBits = 8;
+	// Bits per byte times microseconds per second, over the bits per Mbit and
+	// times kFixedPointOne: bytes per microsecond to Mbit/s in fixed point.
+	const int64_t kBytesPerMicrosecondToMbps = 8 * 1000000 / 16;
+	// Bits per second to Mbit/s in fixed point: 2^20 / kFixedPointOne.
+	const int64_t kBitsPerMbpsInFixedPoint = 16;
+	// Latency inflation beyond which the RTT penalty stops growing, in
+	// hundredths.
+	const int64_t kMaxLatencyInflationPercent = 1000;
+
+	// log2(1 + i / 256) with 30 fractional bits, for i from 0 to 256.
+	const int32_t kLog2Table[] = {
+		0, 6039314, 12055174, 18047761, 24017256, 29963836,
+		35887675, 41788947, 47667823, 53524472, 59359063, 65171760,
+		70962728, 76732128, 82480119, 88206862, 93912511, 99597222,
+		105261148, 110904440, 116527248, 122129721, 127712004, 133274244,
+		138816582, 144339162, 149842124, 155325606, 160789745, 166234679,
+		171660541, 177067464, 182455581, 187825021, 193175914, 198508388,
+		203822568, 209118580, 214396548, 219656594, 224898839, 230123404,
+		235330407, 240519966, 245692198, 250847218, 255985140, 261106077,
+		266210141, 271297442, 276368092, 281422197, 286459867, 291481207,
+		296486323, 301475319, 306448299, 311405366, 316346620, 321272163,
+		326182095, 331076513, 335955515, 340819199, 345667660, 350500993,
+		355319292, 360122651, 364911162, 369684916, 374444004, 379188517,
+		383918542, 388634168, 393335482, 398022572, 402695523, 407354420,
+		411999347, 416630388, 421247625, 425851141, 430441017, 435017334,
+		439580170, 444129607, 448665721, 453188592, 457698295, 462194908,
+		466678506, 471149164, 475606957, 480051959, 484484242, 488903880,
+		493310944, 497705506, 502087636, 506457405, 510814882, 515160136,
+		519493235, 523814248, 528123241, 532420281, 536705435, 540978767,
+		545240343, 549490228, 553728485, 557955178, 562170370, 566374123,
+		570566499, 574747559, 578917365, 583075977, 587223455, 591359858,
+		595485245, 599599675, 603703206, 607795895, 611877800, 615948977,
+		620009483, 624059373, 628098702, 632127527, 636145900, 640153876,
+		644151509, 648138853, 652115959, 656082880, 660039669, 663986377,
+		667923055, 671849754, 675766525, 679673418, 683570481, 687457766,
+		691335320, 695203192, 699061430, 702910083, 706749198, 710578822,
+		714399001, 718209783, 722011213, 725803337, 729586201, 733359850,
+		737124328, 740879680, 744625951, 748363183, 752091421, 755810707,
+		759521085, 763222597, 766915285, 770599192, 774274358, 777940826,
+		781598637, 785247830, 788888448, 792520529, 796144114, 799759243,
+		803365955, 806964289, 810554283, 814135978, 817709409, 821274617,
+		824831638, 828380510, 831921271, 835453956, 838978604, 842495250,
+		846003931, 849504683, 852997541, 856482542, 859959719, 863429109,
+		866890747, 870344666, 873790901, 877229486, 880660455, 884083842,
+		887499680, 890908003, 894308843, 897702233, 901088206, 904466794,
+		907838029, 911201944, 914558569, 917907937, 921250079, 924585025,
+		927912807, 931233456, 934547002, 937853475, 941152905, 944445323,
+		947730758, 951009239, 954280797, 957545460, 960803257, 964054218,
+		967298370, 970535742, 973766362, 976990259, 980207461, 983417995,
+		986621888, 989819169, 993009864, 996194001, 999371606, 1002542707,
+		1005707329, 1008865499, 1012017244, 1015162589, 1018301561, 1021434185,
+		1024560487, 1027680492, 1030794226, 1033901713, 1037002979, 1040098049,
+		1043186948, 1046269699, 1049346328, 1052416858, 1055481314, 1058539720,
+		1061592099, 1064638476, 1067678873, 1070713315, 1073741824
+	};
+
+	// 2^(i / 256) with 30 fractional bits, for i from 0 to 256.
+	const uint32_t kExp2Table[] = {
+		1073741824, 1076653033, 1079572136, 1082499153, 1085434106, 1088377016,
+		1091327906, 1094286796, 1097253708, 1100228665, 1103211687, 1106202798,
+		1109202018, 1112209370, 1115224875, 1118248556, 1121280436, 1124320536,
+		1127368878, 1130425485, 1133490379, 1136563583, 1139645120, 1142735011,
+		1145833280, 1148939949, 1152055042, 1155178580, 1158310587, 1161451085,
+		1164600099, 1167757650, 1170923762, 1174098458, 1177281762, 1180473697,
+		1183674286, 1186883552, 1190101520, 1193328213, 1196563654, 1199807867,
+		1203060876, 1206322705, 1209593378, 1212872918, 1216161350, 1219458698,
+		1222764986, 1226080238, 1229404479, 1232737732, 1236080024, 1239431376,
+		1242791816, 1246161366, 1249540052, 1252927899, 1256324931, 1259731174,
+		1263146652, 1266571390, 1270005413, 1273448747, 1276901417, 1280363448,
+		1283834865, 1287315695, 1290805962, 1294305692, 1297814910, 1301333643,
+		1304861917, 1308399756, 1311947188, 1315504238, 1319070932, 1322647296,
+		1326233356, 1329829140, 1333434672, 1337049980, 1340675091, 1344310030,
+		1347954824, 1351609500, 1355274085, 1358948606, 1362633090, 1366327563,
+		1370032052, 1373746586, 1377471191, 1381205894, 1384950723, 1388705706,
+		1392470869, 1396246240, 1400031848, 1403827719, 1407633882, 1411450365,
+		1415277195, 1419114401, 1422962010, 1426820052, 1430688553, 1434567544,
+		1438457051, 1442357104, 1446267730, 1450188960, 1454120821, 1458063343,
+		1462016553, 1465980482, 1469955159, 1473940611, 1477936870, 1481943963,
+		1485961921, 1489990772, 1494030547, 1498081275, 1502142985, 1506215708,
+		1510299473, 1514394310, 1518500250, 1522617322, 1526745556, 1530884983,
+		1535035634, 1539197537, 1543370725, 1547555228, 1551751076, 1555958300,
+		1560176931, 1564406999, 1568648537, 1572901575, 1577166143, 1581442275,
+		1585730000, 1590029350, 1594340357, 1598663052, 1602997467, 1607343634,
+		1611701585, 1616071351, 1620452965, 1624846459, 1629251865, 1633669214,
+		1638098541, 1642539877, 1646993254, 1651458706, 1655936265, 1660425963,
+		1664927835, 1669441912, 1673968228, 1678506817, 1683057710, 1687620943,
+		1692196547, 1696784557, 1701385007, 1705997930, 1710623359, 1715261330,
+		1719911875, 1724575029, 1729250827, 1733939301, 1738640488, 1743354420,
+		1748081133, 1752820662, 1757573041, 1762338305, 1767116489, 1771907628,
+		1776711757, 1781528911, 1786359126, 1791202437, 1796058879, 1800928489,
+		1805811301, 1810707353, 1815616678, 1820539314, 1825475297, 1830424663,
+		1835387448, 1840363688, 1845353420, 1850356681, 1855373507, 1860403934,
+		1865448001, 1870505744, 1875577199, 1880662405, 1885761398, 1890874216,
+		1896000896, 1901141476, 1906295993, 1911464486, 1916646992, 1921843549,
+		1927054196, 1932278970, 1937517909, 1942771053, 1948038440, 1953320108,
+		1958616096, 1963926443, 1969251188, 1974590370, 1979944027, 1985312200,
+		1990694927, 1996092249, 2001504204, 2006930832, 2012372174, 2017828268,
+		2023299156, 2028784876, 2034285470, 2039800978, 2045331439, 2050876895,
+		2056437387, 2062012954, 2067603638, 2073209480, 2078830522, 2084466803,
+		2090118366, 2095785251, 2101467502, 2107165158, 2112878262, 2118606857,
+		2124350982, 2130110682, 2135885998, 2141676973, 2147483648
+	};
+
+	int64_t Saturate(uint64_t magnitude, bool negative)
+	{
+		if (magnitude > static_cast<uint64_t> (kMaxFixedPoint))
+			magnitude = static_cast<uint64_t> (kMaxFixedPoint);
+		return negative ? -static_cast<int64_t> (magnitude) : static_cast<int64_t> (magnitude);
+	}
+
+	uint64_t Magnitude(int64_t value)
+	{
+		return value < 0 ? 0 - static_cast<uint64_t> (value) : static_cast<uint64_t> (value);
+	}
+
+	int64_t SaturatingAdd(int64_t a, int64_t b)
+	{
+		if (b > 0 && a > kMaxFixedPoint - b)
+			return kMaxFixedPoint;
+		if (b < 0 && a < -kMaxFixedPoint - b)
+			return -kMaxFixedPoint;
+		return a + b;
+	}
+
+	// (|a| * |b|) >> |shift|, truncated toward zero and saturated. The product
+	// is formed exactly in 128 bits from 32-bit halves.
+	int64_t MultiplyShift(int64_t a, int64_t b, int shift)
+	{
+		bool negative = (a < 0) != (b < 0);
+		uint64_t x = Magnitude(a);
+		uint64_t y = Magnitude(b);
+		uint64_t x_low = x & 0xFFFFFFFFu;
+		uint64_t x_high = x >> 32;
+		uint64_t y_low = y & 0xFFFFFFFFu;
+		uint64_t y_high = y >> 32;
+
+		uint64_t low_low = x_low * y_low;
+		uint64_t high_low = x_high * y_low;
+		uint64_t low_high = x_low * y_high;
+		uint64_t middle = (low_low >> 32) + (high_low & 0xFFFFFFFFu) + low_high;
+		uint64_t high = x_high * y_high + (high_low >> 32) + (middle >> 32);
+		uint64_t low = (middle << 32) | (low_low & 0xFFFFFFFFu);
+
+		if (shift > 0)
+		{
+			low = (low >> shift) | (high << (64 - shift));
+			high >>= shift;
+		}
+		if (high != 0)
+			return negative ? -kMaxFixedPoint : kMaxFixedPoint;
+		return Saturate(low, negative);
+	}
+
+	// log2(|x|) for |x| > 0 with kTableFractionBits fractional bits.
+	int64_t Log2(uint64_t x)
+	{
+#if defined(__GNUC__)
+		int msb = 63 - __builtin_clzll(x);
+#else
+		int msb = 0;
+		for (int step = 32; step > 0; step /= 2)
+		{
+			if ((x >> (msb + step)) != 0)
+				msb += step;
+		}
+#endif
+		// The 32 bits below the most significant one.
+		uint64_t fraction = (msb >= 32 ? x >> (msb - 32) : x << (32 - msb)) & 0xFFFFFFFFu;
+		size_t index = static_cast<size_t> (fraction >> (32 - kTableIndexBits));
+		int64_t weight = static_cast<int64_t> (fraction & ((1u << (32 - kTableIndexBits)) - 1));
+		int64_t low = kLog2Table[index];
+		int64_t high = kLog2Table[index + 1];
+		return (static_cast<int64_t> (msb) << kTableFractionBits) + low + (((high - low) * weight) >> (32 - kTableIndexBits));
+	}
+
+	// 2^|x|, where |x| has kTableFractionBits fractional bits, as a FixedPoint.
+	FixedPoint Exp2(int64_t x)
+	{
+		// Floor of |x| and the fraction above it.
+		int64_t integer = x >= 0 ? x >> kTableFractionBits : -((-x + (1ll << kTableFractionBits) - 1) >> kTableFractionBits);
+		uint64_t fraction = static_cast<uint64_t> (x - integer * (1ll << kTableFractionBits));
+		const int kWeightBits = kTableFractionBits - kTableIndexBits;
+		size_t index = static_cast<size_t> (fraction >> kWeightBits);
+		int64_t weight = static_cast<int64_t> (fraction & ((1u << kWeightBits) - 1));
+		int64_t low = kExp2Table[index];
+		int64_t high = kExp2Table[index + 1];
+		uint64_t mantissa = static_cast<uint64_t> (low + (((high - low) * weight) >> kWeightBits));
+
+		int64_t shift = integer + kFixedPointFractionBits - kTableFractionBits;
+		if (shift >= 0)
+			return shift > 32 ? kMaxFixedPoint : Saturate(mantissa << shift, false);
+		return shift < -63 ? 0 : static_cast<FixedPoint> (mantissa >> -shift);
+	}
+} // namespace
+
+FixedPoint ToFixedPoint(double value)
+{
+	const double kLimit = std::ldexp(1.0, 62 - kFixedPointFractionBits);
+	if (std::isnan(value))
+		return 0;
+	if (value >= kLimit)
+		return kMaxFixedPoint;
+	if (value <= -kLimit)
+		return -kMaxFixedPoint;
+	// Rounds half away from zero.
+	double scaled = value * kFixedPointOne;
+	return static_cast<FixedPoint> (scaled >= 0 ? scaled + 0.5 : scaled - 0.5);
+}
+
+double FromFixedPoint(FixedPoint value)
+{
+	return static_cast<double> (value) / kFixedPointOne;
+}
+
+FixedPoint FixedMultiply(FixedPoint a, FixedPoint b)
+{
+	return MultiplyShift(a, b, kFixedPointFractionBits);
+}
+
+FixedPoint FixedDivide(FixedPoint a, FixedPoint b)
+{
+	bool negative = (a < 0) != (b < 0);
+	uint64_t dividend = Magnitude(a);
+	uint64_t divisor = Magnitude(b);
+	if (dividend <= (std::numeric_limits<uint64_t>::max() >> kFixedPointFractionBits))
+		return Saturate((dividend << kFixedPointFractionBits) / divisor, negative);
+	uint64_t quotient = dividend / divisor;
+	if (quotient > (static_cast<uint64_t> (kMaxFixedPoint) >> kFixedPointFractionBits))
+		return negative ? -kMaxFixedPoint : kMaxFixedPoint;
+
+	uint64_t remainder = dividend % divisor;
+	if (divisor <= (std::numeric_limits<uint64_t>::max() >> kFixedPointFractionBits))
+		return Saturate((quotient << kFixedPointFractionBits) + (remainder << kFixedPointFractionBits) / divisor, negative);
+	// Long division for the fractional bits, which cannot overflow whatever
+	// the size of the divisor.
+	for (int i = 0; i < kFixedPointFractionBits; ++i)
+	{
+		remainder <<= 1;
+		quotient <<= 1;
+		if (remainder >= divisor)
+		{
+			remainder -= divisor;
+			quotient |= 1;
+		}
+	}
+	return Saturate(quotient, negative);
+}
+
+FixedPoint FixedLog2(FixedPoint x)
+{
+	if (x <= 0)
+		return -kMaxFixedPoint;
+	int64_t log2 = Log2(static_cast<uint64_t> (x)) - (static_cast<int64_t> (kFixedPointFractionBits) << kTableFractionBits);
+	const int kShift = kTableFractionBits - kFixedPointFractionBits;
+	// Rounds toward minus infinity, as an arithmetic shift would.
+	return log2 >= 0 ? log2 >> kShift : -((-log2 + (1ll << kShift) - 1) >> kShift);
+}
+
+FixedPoint FixedExp2(FixedPoint x)
+{
+	const FixedPoint kLimit = static_cast<FixedPoint> (64) << kFixedPointFractionBits;
+	x = std::max(-kLimit, std::min(kLimit, x));
+	return Exp2(x * (1ll << (kTableFractionBits - kFixedPointFractionBits)));
+}
+
+FixedPoint FixedPow(FixedPoint base, FixedPoint exponent)
+{
+	if (base <= 0)
+		return 0;
+	int64_t log2 = Log2(static_cast<uint64_t> (base)) - (static_cast<int64_t> (kFixedPointFractionBits) << kTableFractionBits);
+	const int64_t kLimit = static_cast<int64_t> (64) << kTableFractionBits;
+	int64_t power_log2 = MultiplyShift(log2, exponent, kFixedPointFractionBits);
+	return Exp2(std::max(-kLimit, std::min(kLimit, power_log2)));
+}
+
+FixedVivaceUtilityCoefficients ToFixedPoint(const VivaceUtilityCoefficients& coefficients)
+{
+	FixedVivaceUtilityCoefficients fixed;
+	fixed.alpha = ToFixedPoint(coefficients.alpha);
+	fixed.exponent = ToFixedPoint(coefficients.exponent);
+	fixed.latency_coefficient = ToFixedPoint(coefficients.latency_coefficient);
+	fixed.loss_tolerance = ToFixedPoint(coefficients.loss_tolerance);
+	fixed.loss_coefficient = ToFixedPoint(coefficients.loss_coefficient);
+	return fixed;
+}
+
+FixedPoint CalculateVivaceUtilityFixedPoint(QuicByteCount bytes_sent, QuicByteCount bytes_lost, QuicTime mi_duration_us, int32_t n_packets, int32_t latency_inflation_percent, const FixedVivaceUtilityCoefficients& coefficients)
+{
+	if (bytes_sent <= 0 || mi_duration_us <= 0 || n_packets <= 0)
+		return 0;
+
+	// In Mbit/s.
+	FixedPoint sending_rate = MultiplyShift(bytes_sent, kBytesPerMicrosecondToMbps, 0) / mi_duration_us;
+	FixedPoint sending_factor = FixedMultiply(coefficients.alpha, FixedPow(sending_rate, coefficients.exponent));
+
+	// Whole percents, rounded toward zero to even ones.
+	int64_t rtt_penalty_percent = std::max(-kMaxLatencyInflationPercent,
+		std::min(kMaxLatencyInflationPercent, static_cast<int64_t> (latency_inflation_percent))) / 2 * 2;
+	FixedPoint bytes_per_packet = MultiplyShift(bytes_sent, kFixedPointOne, 0) / n_packets;
+	FixedPoint rtt_contribution = MultiplyShift(FixedMultiply(coefficients.latency_coefficient, bytes_per_packet), rtt_penalty_percent, 0) / 100;
+
+	// The loss term is the loss rate times the sending rate, which is the
+	// rate of the lost bytes. Taken directly, it keeps the precision that a
+	// 16-bit loss rate times a rate of thousands of Mbit/s would lose.
+	FixedPoint loss_rate = FixedDivide(bytes_lost, bytes_sent);
+	FixedPoint lost_rate = MultiplyShift(bytes_lost, kBytesPerMicrosecondToMbps, 0) / mi_duration_us;
+	FixedPoint loss_term = lost_rate;
+	if (loss_rate > coefficients.loss_tolerance)
+		loss_term = FixedMultiply(coefficients.loss_coefficient, lost_rate);
+
+	return SaturatingAdd(sending_factor, -SaturatingAdd(loss_term, FixedMultiply(rtt_contribution, sending_rate)));
+}
+
+FixedRateControlCoefficients ToFixedPoint(const PccConfig& config)
+{
+	FixedRateControlCoefficients fixed;
+	fixed.minimum_rate_change = static_cast<int64_t> (std::llround(config.minimum_rate_change));
+	fixed.utility_gradient_to_rate_change_factor = ToFixedPoint(config.utility_gradient_to_rate_change_factor);
+	fixed.initial_maximum_proportional_change = ToFixedPoint(config.initial_maximum_proportional_change);
+	fixed.maximum_proportional_change_step_size = ToFixedPoint(config.maximum_proportional_change_step_size);
+	return fixed;
+}
+
+void UpdateAverageGradientFixedPoint(FixedPoint new_gradient, FixedRateControlState* state)
+{
+	const int64_t kSampleSize = static_cast<int64_t> (FixedRateControlState::kAvgGradientSampleSize);
+	if (state->num_gradient_samples == 0)
+	{
+		state->avg_gradient = new_gradient;
+	} else if (state->num_gradient_samples < FixedRateControlState::kAvgGradientSampleSize) {
+		int64_t num_samples = static_cast<int64_t> (state->num_gradient_samples);
+		state->avg_gradient = SaturatingAdd(MultiplyShift(state->avg_gradient, num_samples, 0), new_gradient) / (num_samples + 1);
+	} else {
+		FixedPoint oldest_gradient = state->gradient_samples[state->oldest_gradient_sample];
+		state->avg_gradient = SaturatingAdd(state->avg_gradient, -(oldest_gradient / kSampleSize));
+		state->avg_gradient = SaturatingAdd(state->avg_gradient, new_gradient / kSampleSize);
+		state->oldest_gradient_sample = (state->oldest_gradient_sample + 1) % FixedRateControlState::kAvgGradientSampleSize;
+		--state->num_gradient_samples;
+	}
+	state->gradient_samples[(state->oldest_gradient_sample + state->num_gradient_samples) % FixedRateControlState::kAvgGradientSampleSize] = new_gradient;
+	++state->num_gradient_samples;
+}
+
+int64_t ComputeRateChangeFixedPoint(const FixedUtilitySample& sample_1, const FixedUtilitySample& sample_2, int64_t sending_rate, int64_t previous_change, const FixedRateControlCoefficients& coefficients, FixedRateControlState* state, FixedPoint* utility_gradient)
+{
+	// In Mbit/s. Rates within a fraction of a bit per second count as equal.
+	FixedPoint rate_difference = (sample_1.sending_rate - sample_2.sending_rate) / kBitsPerMbpsInFixedPoint;
+	if (rate_difference == 0)
+		return coefficients.minimum_rate_change;
+
+	FixedPoint gradient = FixedDivide(SaturatingAdd(sample_1.utility, -sample_2.utility), rate_difference);
+	UpdateAverageGradientFixedPoint(gradient, state);
+	int64_t change = MultiplyShift(state->avg_gradient, coefficients.utility_gradient_to_rate_change_factor, 2 * kFixedPointFractionBits);
+
+	if ((change > 0) != (previous_change > 0))
+	{
+		state->rate_change_amplifier_halves = 0;
+		state->rate_change_proportion_allowance = 0;
+		if (state->swing_buffer < 2)
+			++state->swing_buffer;
+	}
+
+	// Twice the float version's factor, which is a multiple of 0.5.
+	int64_t amplifier = state->rate_change_amplifier_halves;
+	int64_t factor;
+	if (amplifier < 6)
+		factor = amplifier + 2;
+	else if (amplifier < 12)
+		factor = 2 * amplifier - 4;
+	else if (amplifier < 18)
+		factor = 4 * amplifier - 28;
+	else
+		factor = 9 * amplifier - 100;
+	change = MultiplyShift(change, factor, 1);
+
+	if ((change > 0) == (previous_change > 0))
+	{
+		if (state->swing_buffer == 0)
+			state->rate_change_amplifier_halves += amplifier < 6 ? 1 : 2;
+		if (state->swing_buffer > 0)
+			--state->swing_buffer;
+	}
+
+	FixedPoint max_allowed_change_ratio = SaturatingAdd(coefficients.initial_maximum_proportional_change,
+		MultiplyShift(static_cast<int64_t> (state->rate_change_proportion_allowance), coefficients.maximum_proportional_change_step_size, 0));
+	int64_t max_allowed_change = FixedMultiply(max_allowed_change_ratio, sending_rate);
+	if (static_cast<int64_t> (Magnitude(change)) > max_allowed_change)
+	{
+		++state->rate_change_proportion_allowance;
+		change = change < 0 ? -max_allowed_change : max_allowed_change;
+	} else {
+		if (state->rate_change_proportion_allowance > 0)
+			--state->rate_change_proportion_allowance;
+	}
+
+	if ((change > 0) != (previous_change > 0))
+	{
+		state->rate_change_amplifier_halves = 0;
+		state->rate_change_proportion_allowance = 0;
+	}
+
+	if (change < 0 && change > -coefficients.minimum_rate_change)
+		change = -coefficients.minimum_rate_change;
+	else if (change > 0 && change < coefficients.minimum_rate_change)
+		change = coefficients.minimum_rate_change;
+
+	if (utility_gradient != nullptr)
+		*utility_gradient = gradient;
+	return change;
+}
@@ -0,0 +1,140 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_FIXED_POINT_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_FIXED_POINT_H_
+
+// Fixed-point arithmetic for the Vivace utility and rate control, for
+// datapaths where floating point is slow or not allowed, such as kernels,
+// eBPF-style programs and SmartNIC cores, and wherever decisions must match
+// bit for bit across compilers, flags and CPUs. The functions below only use
+// 64-bit integer arithmetic with fixed rounding: power functions are
+// interpolated from constant tables rather than computed by pow(), products
+// are exact before they are shifted and results saturate instead of
+// overflowing. Only the ToFixedPoint() conversions use floating point, and
+// they are meant to run once, at setup.
+//
+// PccConfig::fixed_point_arithmetic makes BasicCongestionController use
+// them for the Vivace utility and its rate changes.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "PccConfig.h"
+
+// A signed fixed-point number with kFixedPointFractionBits fractional bits.
+typedef int64_t FixedPoint;
+
+const int kFixedPointFractionBits = 16;
+const FixedPoint kFixedPointOne = static_cast<FixedPoint> (1) << kFixedPointFractionBits;
+
+// Converts |value| to the nearest FixedPoint, saturating.
+FixedPoint ToFixedPoint(double value);
+double FromFixedPoint(FixedPoint value);
+
+// |a| * |b| and |a| / |b|, truncated toward zero and saturated. |b| must
+// not be 0 for FixedDivide.
+FixedPoint FixedMultiply(FixedPoint a, FixedPoint b);
+FixedPoint FixedDivide(FixedPoint a, FixedPoint b);
+// log2(|x|) for |x| > 0, and 2^|x|. Both are interpolated from 256-entry
+// tables, within 3e-6 of the exact result relative to 1 for FixedLog2 and to
+// the result for FixedExp2, before the last bit of rounding.
+FixedPoint FixedLog2(FixedPoint x);
+FixedPoint FixedExp2(FixedPoint x);
+// |base| to the power |exponent| for |base| > 0, or 0 otherwise. Keeps
+// 30 fractional bits between the log2 and the exp2, so the error is mostly
+// that of |exponent| itself, which is off by up to 2^-17 from the exponent it
+// was converted from: 5e-6 relative per doubling of |base|.
+FixedPoint FixedPow(FixedPoint base, FixedPoint exponent);
+
+// FixedVivaceUtilityCoefficients, VivaceUtilityCoefficients in fixed point.
+
+struct FixedVivaceUtilityCoefficients
+{
+	FixedPoint alpha = 0;
+	FixedPoint exponent = 0;
+	FixedPoint latency_coefficient = 0;
+	FixedPoint loss_tolerance = 0;
+	FixedPoint loss_coefficient = 0;
+};
+
+FixedVivaceUtilityCoefficients ToFixedPoint(const VivaceUtilityCoefficients& coefficients);
+
+// Fixed-point CalculateVivaceUtility, for an interval that sent |bytes_sent|
+// bytes over |mi_duration_us| microseconds in |n_packets| packets and lost
+// |bytes_lost| of them. The latency inflation is given in hundredths,
+// truncated, and is clamped to +-1000%. Follows the float formula, including
+// its 2% steps of RTT penalty, to within 3e-4 of the largest of the utility,
+// its sending rate term and 1 for rates up to 100 Gbit/s: where the loss and
+// RTT terms cancel most of the sending rate term, the error of that term
+// remains. Returns 0 for intervals that sent nothing.
+FixedPoint CalculateVivaceUtilityFixedPoint(QuicByteCount bytes_sent,
+	QuicByteCount bytes_lost,
+	QuicTime mi_duration_us,
+	int32_t n_packets,
+	int32_t latency_inflation_percent,
+	const FixedVivaceUtilityCoefficients& coefficients);
+
+// FixedRateControlCoefficients, the rate control tuning of a PccConfig in
+// fixed point. Rates are in bits per second.
+
+struct FixedRateControlCoefficients
+{
+	int64_t minimum_rate_change = 0;
+	FixedPoint utility_gradient_to_rate_change_factor = 0;
+	FixedPoint initial_maximum_proportional_change = 0;
+	FixedPoint maximum_proportional_change_step_size = 0;
+};
+
+FixedRateControlCoefficients ToFixedPoint(const PccConfig& config);
+
+// FixedRateControlState, the state BasicCongestionController keeps between
+// rate changes, in fixed point.
+
+struct FixedRateControlState
+{
+	// Number of gradients to average, as in BasicCongestionController.
+	static const size_t kAvgGradientSampleSize = 1;
+
+	// The current average of the utility gradients, in utility per Mbit/s.
+	FixedPoint avg_gradient = 0;
+	// The gradient samples that have been averaged, oldest first starting at
+	// |oldest_gradient_sample|.
+	FixedPoint gradient_samples[kAvgGradientSampleSize] = {};
+	size_t num_gradient_samples = 0;
+	size_t oldest_gradient_sample = 0;
+	// The acceleration factor of the rate changes in halves, as the float
+	// factor moves in steps of 0.5 up to 3.
+	int64_t rate_change_amplifier_halves = 0;
+	// The number of rate changes in a single direction before they
+	// accelerate.
+	size_t swing_buffer = 0;
+	// The steps of maximum proportional change allowed on top of the initial
+	// one.
+	size_t rate_change_proportion_allowance = 0;
+};
+
+// FixedUtilitySample, a <sending_rate, utility> pair in fixed point, with the
+// rate in bits per second.
+
+struct FixedUtilitySample
+{
+	int64_t sending_rate = 0;
+	FixedPoint utility = 0;
+};
+
+// Fixed-point UpdateAverageGradient: adds |new_gradient| to the average in
+// |state|.
+void UpdateAverageGradientFixedPoint(FixedPoint new_gradient, FixedRateControlState* state);
+
+// Fixed-point ComputeRateChange: returns the change in bits per second from
+// |sending_rate| that the utilities of |sample_1| and |sample_2| call for,
+// given the |previous_change|, and updates |state| as the float version
+// updates the controller. Stores the utility gradient in |utility_gradient|
+// if it is not null.
+int64_t ComputeRateChangeFixedPoint(const FixedUtilitySample& sample_1,
+	const FixedUtilitySample& sample_2,
+	int64_t sending_rate,
+	int64_t previous_change,
+	const FixedRateControlCoefficients& coefficients,
+	FixedRateControlState* state,
+	FixedPoint* utility_gradient);
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_FIXED_POINT_H_
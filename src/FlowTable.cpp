@@ -0,0 +1,220 @@
+#include "FlowTable.h"
+
+#include <algorithm>
+#include <new>
+
+namespace
+{
+	// Size of a cache line in bytes.
+	const size_t kCacheLineSize = 64;
+	// Items of a batch ordered by flow at once, at least.
+	const size_t kMinOrderCapacity = 256;
+	const uint64_t kOrderIndexMask = 0xFFFFFFFFULL;
+} // namespace
+
+FlowTable::FlowTable(size_t max_flows, std::shared_ptr<const PccConfig> config) :
+	max_flows_(max_flows),
+	config_(std::move(config)),
+	intervals_per_flow_(CongestionController::MonitorIntervalCapacity(*config_)),
+	intervals_(max_flows * intervals_per_flow_),
+	controllers_(controller_allocator_.allocate(max_flows)),
+	active_(max_flows, false),
+	modes_(max_flows, CongestionController::STARTING),
+	pacing_rates_(max_flows, 0),
+	congestion_windows_(max_flows, 0),
+	timer_deadlines_(max_flows, CongestionController::kNoTimerDeadline)
+{
+	free_flows_.reserve(max_flows);
+	for (size_t i = max_flows; i > 0; --i)
+		free_flows_.push_back(static_cast<FlowId> (i - 1));
+	order_.reserve(std::max(max_flows, kMinOrderCapacity));
+}
+
+FlowTable::~FlowTable()
+{
+	for (size_t i = 0; i < max_flows_; ++i)
+	{
+		if (active_[i])
+			controllers_[i].~CongestionController();
+	}
+	controller_allocator_.deallocate(controllers_, max_flows_);
+}
+
+bool FlowTable::AddFlow(QuicTime initial_rtt_us, QuicPacketCount initial_congestion_window, QuicPacketCount max_congestion_window, FlowId* flow)
+{
+	if (free_flows_.empty())
+		return false;
+
+	FlowId id = free_flows_.back();
+	free_flows_.pop_back();
+	new (&controllers_[id]) CongestionController(initial_rtt_us,
+		initial_congestion_window,
+		max_congestion_window,
+		config_,
+		&intervals_[id * intervals_per_flow_]);
+	active_[id] = true;
+	++num_flows_;
+	UpdateOutputs(id);
+	*flow = id;
+	return true;
+}
+
+void FlowTable::RemoveFlow(FlowId flow)
+{
+	if (!is_active(flow))
+		return;
+
+	removed_stats_.AddCounters(controllers_[flow].stats());
+	controllers_[flow].~CongestionController();
+	active_[flow] = false;
+	modes_[flow] = CongestionController::STARTING;
+	pacing_rates_[flow] = 0;
+	congestion_windows_[flow] = 0;
+	timer_deadlines_[flow] = CongestionController::kNoTimerDeadline;
+	--num_flows_;
+	free_flows_.push_back(flow);
+}
+
+ControllerStats FlowTable::Stats() const
+{
+	ControllerStats stats = removed_stats_;
+	for (FlowId flow = 0; flow < max_flows_; ++flow)
+		if (active_[flow])
+			stats.Add(controllers_[flow].stats());
+	return stats;
+}
+
+void FlowTable::OnPacketSent(const FlowPacketSent* packets, size_t count)
+{
+	ApplyByFlow(packets, count, [](CongestionController& controller, const FlowPacketSent& packet) {
+		controller.OnPacketSent(packet.sent_time,
+			packet.packet_number,
+			packet.bytes,
+			packet.is_retransmittable);
+	});
+}
+
+void FlowTable::OnCongestionEvent(const FlowCongestionEvent* events, size_t count)
+{
+	static const AckedPacketVector kNoPackets;
+
+	ApplyByFlow(events, count, [](CongestionController& controller, const FlowCongestionEvent& event) {
+		controller.OnCongestionEvent(event.event_time,
+			event.rtt,
+			event.acked_packets != nullptr ? *event.acked_packets : kNoPackets,
+			event.lost_packets != nullptr ? *event.lost_packets : kNoPackets);
+	});
+}
+
+void FlowTable::OnCongestionEvent(const FlowRangeEvent* events, size_t count)
+{
+	static const PacketNumberRangeVector kNoRanges;
+
+	ApplyByFlow(events, count, [](CongestionController& controller, const FlowRangeEvent& event) {
+		controller.OnCongestionEvent(event.event_time,
+			event.rtt,
+			event.acked_ranges != nullptr ? *event.acked_ranges : kNoRanges,
+			event.lost_ranges != nullptr ? *event.lost_ranges : kNoRanges);
+	});
+}
+
+void FlowTable::OnTimer(const FlowTimer* timers, size_t count)
+{
+	ApplyByFlow(timers, count, [](CongestionController& controller, const FlowTimer& timer) {
+		controller.OnTimer(timer.now);
+	});
+}
+
+void FlowTable::PacingRate(const FlowId* flows, size_t count, QuicBandwidth* rates) const
+{
+	for (size_t i = 0; i < count; ++i)
+		rates[i] = flows[i] < max_flows_ ? pacing_rates_[flows[i]] : 0;
+}
+
+size_t FlowTable::DueTimers(QuicTime now, FlowId* flows, size_t max_count) const
+{
+	// Inactive flows hold kNoTimerDeadline, so the scan reads one column.
+	size_t count = 0;
+	for (size_t flow = 0; flow < max_flows_ && count < max_count; ++flow)
+		if (timer_deadlines_[flow] <= now)
+			flows[count++] = static_cast<FlowId> (flow);
+	return count;
+}
+
+void FlowTable::set_random_seed(FlowId flow, uint64_t seed)
+{
+	if (is_active(flow))
+		controllers_[flow].set_random_seed(seed);
+}
+
+template <class Item>
+bool FlowTable::OrderByFlow(const Item* items, size_t count)
+{
+	bool ordered = true;
+	for (size_t i = 1; i < count && ordered; ++i)
+		ordered = items[i - 1].flow <= items[i].flow;
+	if (ordered)
+		return false;
+
+	// Keys unique by their index sort stably with std::sort, which unlike
+	// std::stable_sort needs no buffer.
+	order_.resize(count);
+	for (size_t i = 0; i < count; ++i)
+		order_[i] = static_cast<uint64_t> (items[i].flow) << 32 | i;
+	std::sort(order_.begin(), order_.end());
+	return true;
+}
+
+template <class Item, class Apply>
+void FlowTable::ApplyByFlow(const Item* items, size_t count, Apply apply)
+{
+	size_t max_chunk = order_.capacity();
+	for (size_t first = 0; first < count; first += max_chunk)
+		ApplyChunkByFlow(items + first, std::min(count - first, max_chunk), apply);
+}
+
+template <class Item, class Apply>
+void FlowTable::ApplyChunkByFlow(const Item* items, size_t count, Apply apply)
+{
+	bool reordered = OrderByFlow(items, count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Item& item = items[reordered ? order_[i] & kOrderIndexMask : i];
+		const Item* next = nullptr;
+		if (i + 1 < count)
+		{
+			next = &items[reordered ? order_[i + 1] & kOrderIndexMask : i + 1];
+			Prefetch(next->flow);
+		}
+		if (!is_active(item.flow))
+			continue;
+
+		apply(controllers_[item.flow], item);
+		if (next == nullptr || next->flow != item.flow)
+			UpdateOutputs(item.flow);
+	}
+}
+
+void FlowTable::UpdateOutputs(FlowId flow)
+{
+	const CongestionController& controller = controllers_[flow];
+	modes_[flow] = controller.mode();
+	pacing_rates_[flow] = controller.PacingRate();
+	congestion_windows_[flow] = controller.GetCongestionWindow();
+	timer_deadlines_[flow] = controller.NextTimerDeadline();
+}
+
+void FlowTable::Prefetch(FlowId flow) const
+{
+#if defined(__GNUC__)
+	if (flow >= max_flows_)
+		return;
+
+	const char* controller = reinterpret_cast<const char*> (&controllers_[flow]);
+	for (size_t offset = 0; offset < sizeof(CongestionController); offset += kCacheLineSize)
+		__builtin_prefetch(controller + offset);
+	__builtin_prefetch(&intervals_[flow * intervals_per_flow_]);
+#else
+	(void) flow;
+#endif
+}
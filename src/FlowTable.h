@@ -0,0 +1,227 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_FLOW_TABLE_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_FLOW_TABLE_H_
+
+#include <memory>
+#include <vector>
+
+#include "CongestionController.h"
+
+typedef uint32_t FlowId;
+
+// FlowPacketSent, a packet sent by one of the flows of a FlowTable.
+
+struct FlowPacketSent
+{
+	FlowId flow = 0;
+	QuicTime sent_time = 0;
+	QuicPacketNumber packet_number = 0;
+	QuicByteCount bytes = 0;
+	bool is_retransmittable = true;
+};
+
+// FlowCongestionEvent, the acked and lost packets reported to one of the
+// flows of a FlowTable at once. The packet vectors are not owned.
+
+struct FlowCongestionEvent
+{
+	FlowId flow = 0;
+	QuicTime event_time = 0;
+	QuicTime rtt = 0;
+	const AckedPacketVector* acked_packets = nullptr;
+	const LostPacketVector* lost_packets = nullptr;
+};
+
+// FlowRangeEvent, the ranges of acked and lost packets reported to one of
+// the flows of a FlowTable at once. The range vectors are not owned.
+
+struct FlowRangeEvent
+{
+	FlowId flow = 0;
+	QuicTime event_time = 0;
+	QuicTime rtt = 0;
+	const PacketNumberRangeVector* acked_ranges = nullptr;
+	const PacketNumberRangeVector* lost_ranges = nullptr;
+};
+
+// FlowTimer, the timer of one of the flows of a FlowTable firing at |now|.
+
+struct FlowTimer
+{
+	FlowId flow = 0;
+	QuicTime now = 0;
+};
+
+class FlowTable;
+
+// FlowView, one flow of a FlowTable as seen through the table's columns. It
+// reads the hot fields without touching the flow's controller, and is only
+// valid until the flow is removed or the table destroyed.
+
+class FlowView
+{
+public:
+	FlowView(const FlowTable& table, FlowId flow) : table_(&table), flow_(flow) {}
+
+	FlowId id() const { return flow_; }
+	bool is_active() const;
+	CongestionController::SenderMode mode() const;
+	QuicBandwidth PacingRate() const;
+	QuicByteCount GetCongestionWindow() const;
+	// CongestionController::kNoTimerDeadline when the flow needs no timer or
+	// is not active.
+	QuicTime NextTimerDeadline() const;
+	// The controller of the flow, or null if it is not active.
+	const CongestionController* controller() const;
+
+private:
+	const FlowTable* table_;
+	FlowId flow_;
+};
+
+// FlowTable runs the congestion controllers of many flows. Controllers are
+// constructed in place in one contiguous pool and their monitor intervals
+// share one contiguous slab. The hot fields of each flow, those polled
+// between batches, are kept as separate columns, a structure of arrays
+// refreshed after each flow's last item of a batch, so scans such as
+// DueTimers() read one dense array rather than every controller. Batched
+// calls visit the flows in table order and prefetch the state of the next
+// flow, so a batch touches memory linearly.
+
+class FlowTable
+{
+public:
+	// Creates a table with room for |max_flows| flows, whose controllers are
+	// all tuned by |config|.
+	explicit FlowTable(size_t max_flows, std::shared_ptr<const PccConfig> config = PccConfig::Default());
+	~FlowTable();
+	FlowTable(const FlowTable&) = delete;
+	FlowTable& operator=(const FlowTable&) = delete;
+	FlowTable(FlowTable&&) = delete;
+	FlowTable& operator=(FlowTable&&) = delete;
+
+	// Adds a flow and stores its id in |flow|. Returns false if the table is
+	// full.
+	bool AddFlow(QuicTime initial_rtt_us,
+		QuicPacketCount initial_congestion_window,
+		QuicPacketCount max_congestion_window,
+		FlowId* flow);
+	// Removes |flow|, whose id may then be reused by AddFlow.
+	void RemoveFlow(FlowId flow);
+
+	// Feeds |count| sent packets to their flows. Packets of the same flow are
+	// applied in the order given.
+	void OnPacketSent(const FlowPacketSent* packets, size_t count);
+	// Feeds |count| congestion events to their flows. Events of the same flow
+	// are applied in the order given.
+	void OnCongestionEvent(const FlowCongestionEvent* events, size_t count);
+	void OnCongestionEvent(const FlowRangeEvent* events, size_t count);
+	// Fires |count| timers of their flows, as OnTimer() of their controllers.
+	// Timers of the same flow fire in the order given.
+	void OnTimer(const FlowTimer* timers, size_t count);
+	// Stores the pacing rate of each of the |count| |flows| in |rates|.
+	void PacingRate(const FlowId* flows, size_t count, QuicBandwidth* rates) const;
+	// Stores the ids of the active flows whose timers are due at |now|, in
+	// table order, in |flows|, up to |max_count| of them. Returns how many
+	// were stored.
+	size_t DueTimers(QuicTime now, FlowId* flows, size_t max_count) const;
+
+	FlowView flow(FlowId flow) const { return FlowView(*this, flow); }
+	QuicBandwidth PacingRate(FlowId flow) const { return flow < max_flows_ ? pacing_rates_[flow] : 0; }
+	QuicByteCount GetCongestionWindow(FlowId flow) const { return flow < max_flows_ ? congestion_windows_[flow] : 0; }
+	bool is_active(FlowId flow) const { return flow < max_flows_ && active_[flow]; }
+	size_t num_flows() const { return num_flows_; }
+	size_t max_flows() const { return max_flows_; }
+
+	// The stats of the active flows added up, with the counters of the
+	// removed ones.
+	ControllerStats Stats() const;
+
+	// Seeds the random choices of |flow|, as set_random_seed() of its
+	// controller. Does nothing if |flow| is not active.
+	void set_random_seed(FlowId flow, uint64_t seed);
+
+	// The controller of |flow|, or null if it is not active, for queries
+	// that have no column, such as stats(). Calls that change a controller go
+	// through the table, which keeps the columns in step with them.
+	const CongestionController* controller(FlowId flow) const { return is_active(flow) ? &controllers_[flow] : nullptr; }
+
+private:
+	friend class FlowView;
+
+	// Fills |order_| with the indices of |count| items, at most
+	// |order_.capacity()|, ordered by flow, keeping the given order within a
+	// flow. Returns false if the items are already ordered by flow, in which
+	// case |order_| is left untouched.
+	template <class Item>
+	bool OrderByFlow(const Item* items, size_t count);
+	// Calls |apply| with the controller of each of the |count| |items| of an
+	// active flow, ordered by flow, and refreshes the columns of each flow
+	// after its last item. Batches larger than |order_| can hold are applied
+	// in chunks that fit, in the order given.
+	template <class Item, class Apply>
+	void ApplyByFlow(const Item* items, size_t count, Apply apply);
+	template <class Item, class Apply>
+	void ApplyChunkByFlow(const Item* items, size_t count, Apply apply);
+	// Refreshes the columns of |flow| from its controller.
+	void UpdateOutputs(FlowId flow);
+	void Prefetch(FlowId flow) const;
+
+	size_t max_flows_;
+	size_t num_flows_ = 0;
+	// Tuning of every flow.
+	std::shared_ptr<const PccConfig> config_;
+	// Monitor intervals per flow.
+	size_t intervals_per_flow_;
+	// Monitor intervals of all flows, |intervals_per_flow_| per flow.
+	std::vector<MonitorInterval> intervals_;
+	// Uninitialized storage for |max_flows_| controllers, constructed in place
+	// for the active flows.
+	std::allocator<CongestionController> controller_allocator_;
+	CongestionController* controllers_;
+	// Per-flow columns of the hot fields. Inactive flows hold STARTING, 0 and
+	// kNoTimerDeadline.
+	std::vector<bool> active_;
+	std::vector<CongestionController::SenderMode> modes_;
+	std::vector<QuicBandwidth> pacing_rates_;
+	std::vector<QuicByteCount> congestion_windows_;
+	std::vector<QuicTime> timer_deadlines_;
+	// Ids of removed flows, reused before the never used ones.
+	std::vector<FlowId> free_flows_;
+	// Counters of the removed flows.
+	ControllerStats removed_stats_;
+	// Reusable storage for ordering batches by flow: the flow of an item in
+	// the high half, its index in the low one. Never grows past its reserve.
+	std::vector<uint64_t> order_;
+};
+
+inline bool FlowView::is_active() const
+{
+	return table_->is_active(flow_);
+}
+
+inline CongestionController::SenderMode FlowView::mode() const
+{
+	return flow_ < table_->max_flows_ ? table_->modes_[flow_] : CongestionController::STARTING;
+}
+
+inline QuicBandwidth FlowView::PacingRate() const
+{
+	return table_->PacingRate(flow_);
+}
+
+inline QuicByteCount FlowView::GetCongestionWindow() const
+{
+	return table_->GetCongestionWindow(flow_);
+}
+
+inline QuicTime FlowView::NextTimerDeadline() const
+{
+	return flow_ < table_->max_flows_ ? table_->timer_deadlines_[flow_] : CongestionController::kNoTimerDeadline;
+}
+
+inline const CongestionController* FlowView::controller() const
+{
+	return table_->controller(flow_);
+}
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_FLOW_TABLE_H_
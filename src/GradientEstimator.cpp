@@ -0,0 +1,106 @@
+#include "GradientEstimator.h"
+
+#include <algorithm>
+
+#include "Snapshot.h"
+
+GradientEstimator::GradientEstimator(size_t window, float decay) :
+	window_(std::min(std::max<size_t>(window, 1), kMaxSamples)),
+	decay_(decay)
+{
+}
+
+void GradientEstimator::AddSample(const UtilityInfo& sample)
+{
+	if (num_samples_ == window_)
+	{
+		oldest_sample_ = (oldest_sample_ + 1) % window_;
+		--num_samples_;
+	}
+	samples_[(oldest_sample_ + num_samples_) % window_] = sample;
+	++num_samples_;
+}
+
+void GradientEstimator::Clear()
+{
+	num_samples_ = 0;
+	oldest_sample_ = 0;
+}
+
+bool GradientEstimator::Estimate(double* gradient, float* confidence) const
+{
+	if (num_samples_ < 2)
+		return false;
+
+	// Weighted means first, then the centered sums, which keep their
+	// precision at rates far from 0.
+	double weights[kMaxSamples];
+	double weight = 1.0;
+	for (size_t i = num_samples_; i-- > 0;)
+	{
+		weights[i] = weight;
+		weight *= decay_;
+	}
+	double sum_w = 0.0;
+	double sum_x = 0.0;
+	double sum_y = 0.0;
+	for (size_t i = 0; i < num_samples_; ++i)
+	{
+		const UtilityInfo& sample = samples_[(oldest_sample_ + i) % window_];
+		sum_w += weights[i];
+		sum_x += weights[i] * sample.sending_rate;
+		sum_y += weights[i] * sample.utility;
+	}
+	double mean_x = sum_x / sum_w;
+	double mean_y = sum_y / sum_w;
+
+	double sxx = 0.0;
+	double sxy = 0.0;
+	double syy = 0.0;
+	for (size_t i = 0; i < num_samples_; ++i)
+	{
+		const UtilityInfo& sample = samples_[(oldest_sample_ + i) % window_];
+		double dx = sample.sending_rate - mean_x;
+		double dy = sample.utility - mean_y;
+		sxx += weights[i] * dx * dx;
+		sxy += weights[i] * dx * dy;
+		syy += weights[i] * dy * dy;
+	}
+	if (!(sxx > 0.0))
+		return false;
+
+	*gradient = sxy / sxx;
+	// Utilities that do not vary are explained perfectly, by a flat line.
+	*confidence = syy > 0.0 ? static_cast<float> (sxy * sxy / (sxx * syy)) : 1.0f;
+	return true;
+}
+
+void GradientEstimator::SaveSnapshot(SnapshotWriter* writer) const
+{
+	writer->WriteUint64(num_samples_);
+	for (size_t i = 0; i < num_samples_; ++i)
+	{
+		const UtilityInfo& sample = samples_[(oldest_sample_ + i) % window_];
+		writer->WriteDouble(sample.sending_rate);
+		writer->WriteFloat(sample.utility);
+	}
+}
+
+bool GradientEstimator::RestoreSnapshot(SnapshotReader* reader)
+{
+	uint64_t num_samples;
+	if (!reader->ReadUint64(&num_samples))
+		return false;
+	if (num_samples > window_)
+		return reader->Fail();
+
+	Clear();
+	for (uint64_t i = 0; i < num_samples; ++i)
+	{
+		UtilityInfo sample;
+		if (!reader->ReadDouble(&sample.sending_rate) || !reader->ReadFloat(&sample.utility))
+			return false;
+		AddSample(sample);
+	}
+	return true;
+}
@@ -0,0 +1,62 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_GRADIENT_ESTIMATOR_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_GRADIENT_ESTIMATOR_H_
+
+#include <cstddef>
+
+#include "MonitorIntervalQueue.h"
+
+// How BasicCongestionController derives the utility gradient its rate
+// changes follow.
+enum GradientEstimatorMode
+{
+	// Difference quotient of the two samples of a decision, as in Vivace.
+	GRADIENT_PAIR,
+	// Weighted least-squares fit over the samples of a probing round, see
+	// GradientEstimator. The rate changes up to the next round scale with
+	// the confidence of the fit.
+	GRADIENT_WEIGHTED_LEAST_SQUARES
+};
+
+// GradientEstimator fits a line to the latest <sending_rate, utility>
+// samples by weighted least squares and reports its slope, the utility
+// gradient, with its confidence. The samples are kept in a fixed ring, and
+// each weighs less than the next newer one, so the fit follows a changing
+// path.
+
+class GradientEstimator
+{
+public:
+	// Samples kept at most.
+	static constexpr size_t kMaxSamples = 16;
+
+	// Fits the latest |window| samples, at most kMaxSamples, each weighing
+	// |decay| times the next newer one.
+	GradientEstimator(size_t window, float decay);
+
+	void AddSample(const UtilityInfo& sample);
+	void Clear();
+
+	// Stores the slope of the fit, in utility per bit/s, in |gradient| and
+	// the weighted fraction of the utility variance it explains, from 0 to 1,
+	// in |confidence|. Returns false if the samples do not span two rates.
+	bool Estimate(double* gradient, float* confidence) const;
+
+	size_t num_samples() const { return num_samples_; }
+	size_t window() const { return window_; }
+
+	// Appends the samples to |writer|, and reads samples so written back from
+	// |reader|. RestoreSnapshot returns false if they are malformed or more
+	// than the window.
+	void SaveSnapshot(SnapshotWriter* writer) const;
+	bool RestoreSnapshot(SnapshotReader* reader);
+
+private:
+	size_t window_;
+	float decay_;
+	// The samples, oldest first starting at |oldest_sample_|.
+	UtilityInfo samples_[kMaxSamples];
+	size_t num_samples_ = 0;
+	size_t oldest_sample_ = 0;
+};
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_GRADIENT_ESTIMATOR_H_
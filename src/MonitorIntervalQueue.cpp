@@ -1,51 +1,731 @@
 #include "MonitorIntervalQueue.h"
-#include <iostream>
+#include "CongestionController.h"
+#include "PccConfig.h"
+#include "Snapshot.h"
+#include "Trace.h"
+#include "UtilityFunctions.h"
 
-//#define DEBUG_UTILITY_CALC
-//#define DEBUG_MONITOR_INTERVAL_QUEUE_ACKS
-//#define DEBUG_MONITOR_INTERVAL_QUEUE_LOSS
-//#define DEBUG_INTERVAL_SIZE
+#include <algorithm>
+#include <limits>
 
 namespace
 {
 	// Number of probing MonitorIntervals necessary for Probing.
 	//const size_t kRoundsPerProbing = 4;
-	// Tolerance of loss rate by utility function.
-	const float kLossTolerance = 0.05f;
-	// Coefficeint of the loss rate term in utility function.
-	const float kLossCoefficient = -1000.0f;
-	// Coefficient of RTT term in utility function.
-	const float kRTTCoefficient = -200.0f;
-	// Number of microseconds per second.
-	const float kNumMicrosPerSecond = 1000000.0f;
-	// Coefficienty of the latency term in the utility function.
-	const float kLatencyCoefficient = 1;
-	// Alpha factor in the utility function.
-	const float kAlpha = 1;
-	// An exponent in the utility function.
-	const float kExponent = 0.9;
-	// An exponent in the utility function.
-	const size_t kMegabit = 1024 * 1024;
+
+	bool PacketNumberLess(const CongestionEvent& event, QuicPacketNumber packet_number)
+	{
+		return event.packet_number < packet_number;
+	}
+
+	bool PacketNumberGreater(QuicPacketNumber packet_number, const CongestionEvent& event)
+	{
+		return packet_number < event.packet_number;
+	}
+
+	bool ComparePacketNumbers(const CongestionEvent& lhs, const CongestionEvent& rhs)
+	{
+		return lhs.packet_number < rhs.packet_number;
+	}
+
+	bool CompareRanges(const PacketNumberRange& lhs, const PacketNumberRange& rhs)
+	{
+		return lhs.first_packet_number < rhs.first_packet_number;
+	}
+
+	// Out-of-order acks, losses or ranges sorted at a time, per kind. A
+	// congestion event with more is taken as consecutive events of that many,
+	// as MonitorIntervalQueue.h states.
+	const size_t kMaxSortedEvents = 256;
+
+	// Sorting space of the thread, so that no queue keeps its own.
+	struct SortScratch
+	{
+		CongestionEvent acks[kMaxSortedEvents];
+		CongestionEvent losses[kMaxSortedEvents];
+		PacketNumberRange acked_ranges[kMaxSortedEvents];
+		PacketNumberRange lost_ranges[kMaxSortedEvents];
+	};
+
+	SortScratch& ThreadSortScratch()
+	{
+		thread_local SortScratch scratch;
+		return scratch;
+	}
+
+	// Returns [begin, end) in order by |less|, as is or sorted into |scratch|,
+	// which holds kMaxSortedEvents. A list in strictly descending order, as
+	// QUIC lists its ACK ranges, is reversed; any other is insertion sorted,
+	// which keeps repeated packets in order and takes little for the few
+	// events a reordering moves.
+	template <class T, class Less>
+	const T* SortedByPacketNumber(const T* begin, const T* end, T* scratch, Less less)
+	{
+		if (std::is_sorted(begin, end, less))
+			return begin;
+
+		size_t size = end - begin;
+		if (std::adjacent_find(begin, end, [&](const T& lhs, const T& rhs) { return !less(rhs, lhs); }) == end)
+		{
+			std::reverse_copy(begin, end, scratch);
+			return scratch;
+		}
+
+		for (size_t i = 0; i < size; ++i)
+		{
+			size_t j = i;
+			for (; j > 0 && less(begin[i], scratch[j - 1]); --j)
+				scratch[j] = scratch[j - 1];
+			scratch[j] = begin[i];
+		}
+		return scratch;
+	}
+
+	const size_t kPacketsPerStateWord = 64;
+
+	// Bits of word |word| of MonitorInterval::packet_states that stand for
+	// the packets from offset |begin| up to offset |end|, exclusive.
+	uint64_t PacketStateMask(size_t word, size_t begin, size_t end)
+	{
+		size_t base = word * kPacketsPerStateWord;
+		size_t first = std::max(begin, base) - base;
+		size_t last = std::min(end, base + kPacketsPerStateWord) - base;
+		uint64_t below_last = last == kPacketsPerStateWord ? ~0ULL : (1ULL << last) - 1;
+		return below_last & (~0ULL << first);
+	}
+
+	// Words of MonitorInterval::packet_states that track the first
+	// |max_tracked_packets| packet numbers of an interval.
+	size_t TrackedStateWords(size_t max_tracked_packets)
+	{
+		return (max_tracked_packets + kPacketsPerStateWord - 1) / kPacketsPerStateWord;
+	}
+
+	QuicPacketCount CountPackets(uint64_t bits)
+	{
+		return static_cast<QuicPacketCount> (__builtin_popcountll(bits));
+	}
+
+	// Marks the packet of |ack| acked in |interval|, with its bytes, unless it
+	// was acked before.
+	void AckPacket(MonitorInterval* interval, const CongestionEvent& ack, int64_t rtt_us, QuicTime event_time)
+	{
+		bool was_lost;
+		if (!interval->OnPacketAcked(ack.packet_number, rtt_us, event_time, &was_lost))
+			return;
+		interval->bytes_acked += ack.bytes_acked;
+		if (was_lost)
+			// The loss was spurious, the packet arrived after all.
+			interval->bytes_lost = std::max<QuicByteCount>(interval->bytes_lost - ack.bytes_acked, 0);
+	}
+
+	// Bytes of the packets of |range| before |packet_number|, splitting the
+	// range's bytes evenly so that the parts of a range add up to its bytes.
+	QuicByteCount RangeBytesBefore(const PacketNumberRange& range, QuicPacketNumber packet_number)
+	{
+		int64_t num_packets = static_cast<int64_t> (range.last_packet_number) - range.first_packet_number + 1;
+		int64_t num_before = static_cast<int64_t> (packet_number) - range.first_packet_number;
+		return range.bytes * num_before / num_packets;
+	}
 } // namespace
 
-PacketRttSample::PacketRttSample(QuicPacketNumber packet_number, QuicTime rtt) : 
-	packet_number(packet_number),
-	sample_rtt(rtt) 
+void RttSampleAccumulator::Reset(bool keep_history, size_t max_runs)
+{
+	num_samples_ = 0;
+	base_rtt_ = 0;
+	base_sent_time_ = 0;
+	sum_x_ = 0.0;
+	sum_y_ = 0.0;
+	sum_xx_ = 0.0;
+	sum_xy_ = 0.0;
+	sum_yy_ = 0.0;
+	keep_history_ = keep_history;
+	max_runs_ = keep_history ? std::max<size_t>(max_runs, 1) : 0;
+	runs_.clear();
+	// A no-op once the storage was reserved, as the queue does up front.
+	runs_.reserve(max_runs_);
+}
+
+void RttSampleAccumulator::OnSample(QuicTime sent_time, QuicTime sample_rtt)
+{
+	OnSamples(1, sent_time, sample_rtt);
+}
+
+void RttSampleAccumulator::OnSamples(QuicPacketCount count, QuicTime sent_time, QuicTime sample_rtt)
+{
+	if (count <= 0)
+		return;
+	if (num_samples_ == 0)
+	{
+		base_rtt_ = sample_rtt;
+		base_sent_time_ = sent_time;
+	}
+	num_samples_ += static_cast<size_t> (count);
+
+	double n = static_cast<double> (count);
+	double x = static_cast<double> (sent_time - base_sent_time_);
+	double y = static_cast<double> (sample_rtt - base_rtt_);
+	sum_x_ += n * x;
+	sum_y_ += n * y;
+	sum_xx_ += n * x * x;
+	sum_xy_ += n * x * y;
+	sum_yy_ += n * y * y;
+
+	if (keep_history_)
+		AddToHistory(count, sample_rtt);
+}
+
+void RttSampleAccumulator::AddToHistory(QuicPacketCount count, QuicTime sample_rtt)
+{
+	// Offsets past 2^31 microseconds, over half an hour, are clamped.
+	QuicTime offset = std::min<QuicTime>(sample_rtt - base_rtt_, std::numeric_limits<int32_t>::max());
+	int32_t rtt_offset = static_cast<int32_t> (std::max<QuicTime>(offset, std::numeric_limits<int32_t>::min()));
+	if (!runs_.empty() && (runs_.back().rtt_offset == rtt_offset || runs_.size() == max_runs_))
+	{
+		runs_.back().count += count;
+		return;
+	}
+	RttSampleRun run;
+	run.rtt_offset = rtt_offset;
+	run.count = count;
+	runs_.push_back(run);
+}
+
+double RttSampleAccumulator::MeanRtt() const
+{
+	if (num_samples_ == 0)
+		return 0.0;
+	return static_cast<double> (base_rtt_) + sum_y_ / num_samples_;
+}
+
+double RttSampleAccumulator::Slope() const
+{
+	double n = static_cast<double> (num_samples_);
+	double denominator = n * sum_xx_ - sum_x_ * sum_x_;
+	if (num_samples_ < 2 || denominator <= 0.0)
+		return 0.0;
+	return (n * sum_xy_ - sum_x_ * sum_y_) / denominator;
+}
+
+double RttSampleAccumulator::RttDeviation() const
+{
+	if (num_samples_ == 0)
+		return 0.0;
+	double mean = sum_y_ / num_samples_;
+	return std::sqrt(std::max(0.0, sum_yy_ / num_samples_ - mean * mean));
+}
+
+void RttSampleAccumulator::HalfSplitSums(float* first_half_sum, float* second_half_sum) const
+{
+	// Replays the samples in arrival order with the same float accumulation as
+	// the per-packet sample vector this replaces, so the sums are bit-identical.
+	size_t half_samples = num_samples_ / 2;
+	*first_half_sum = 0.0;
+	*second_half_sum = 0.0;
+	size_t index = 0;
+	for (const RttSampleRun& run : runs_)
+	{
+		float sample_rtt = static_cast<float> (base_rtt_ + run.rtt_offset);
+		for (int32_t i = 0; i < run.count && index < 2 * half_samples; ++i, ++index)
+		{
+			if (index < half_samples)
+				*first_half_sum += sample_rtt;
+			else
+				*second_half_sum += sample_rtt;
+		}
+	}
+}
+
+void RttSampleAccumulator::SaveSnapshot(SnapshotWriter* writer) const
+{
+	writer->WriteUint64(num_samples_);
+	writer->WriteInt64(base_rtt_);
+	writer->WriteInt64(base_sent_time_);
+	writer->WriteDouble(sum_x_);
+	writer->WriteDouble(sum_y_);
+	writer->WriteDouble(sum_xx_);
+	writer->WriteDouble(sum_xy_);
+	writer->WriteDouble(sum_yy_);
+	writer->WriteBool(keep_history_);
+	writer->WriteUint64(runs_.size());
+	for (const RttSampleRun& run : runs_)
+	{
+		writer->WriteInt32(run.rtt_offset);
+		writer->WriteInt32(run.count);
+	}
+}
+
+bool RttSampleAccumulator::RestoreSnapshot(SnapshotReader* reader, size_t max_runs)
+{
+	uint64_t num_samples;
+	uint64_t num_runs;
+	bool keep_history;
+	if (!reader->ReadUint64(&num_samples)
+		|| !reader->ReadInt64(&base_rtt_)
+		|| !reader->ReadInt64(&base_sent_time_)
+		|| !reader->ReadDouble(&sum_x_)
+		|| !reader->ReadDouble(&sum_y_)
+		|| !reader->ReadDouble(&sum_xx_)
+		|| !reader->ReadDouble(&sum_xy_)
+		|| !reader->ReadDouble(&sum_yy_)
+		|| !reader->ReadBool(&keep_history)
+		|| !reader->ReadUint64(&num_runs))
+		return false;
+	// Every run holds at least one sample, and the runs fit the storage
+	// kept for them.
+	keep_history_ = keep_history;
+	max_runs_ = keep_history ? std::max<size_t>(max_runs, 1) : 0;
+	if (num_runs > num_samples || num_runs > max_runs_
+		|| num_runs > reader->remaining() / (2 * sizeof(int32_t)))
+		return reader->Fail();
+
+	num_samples_ = static_cast<size_t> (num_samples);
+	runs_.reserve(max_runs_);
+	runs_.resize(static_cast<size_t> (num_runs));
+	uint64_t num_run_samples = 0;
+	for (RttSampleRun& run : runs_)
+	{
+		if (!reader->ReadInt32(&run.rtt_offset) || !reader->ReadInt32(&run.count))
+			return false;
+		if (run.count <= 0)
+			return reader->Fail();
+		num_run_samples += static_cast<uint64_t> (run.count);
+	}
+	// The runs hold every sample taken.
+	if (keep_history_ && num_run_samples != num_samples)
+		return reader->Fail();
+	return true;
+}
+
+void MonitorInterval::Reset(QuicBandwidth sending_rate,
+			    bool is_useful,
+			    float rtt_fluctuation_tolerance_ratio,
+			    int64_t rtt_us,
+			    QuicTime end_time,
+			    RttStatsMode rtt_stats_mode,
+			    size_t max_tracked_packets)
+{
+	this->sending_rate = sending_rate;
+	this->is_useful = is_useful;
+	this->rtt_fluctuation_tolerance_ratio = rtt_fluctuation_tolerance_ratio;
+	this->end_time = end_time;
+	first_packet_sent_time = 0;
+	last_packet_sent_time = 0;
+	first_packet_number = 0;
+	last_packet_number = 0;
+	bytes_sent = 0;
+	bytes_acked = 0;
+	bytes_lost = 0;
+	rtt_on_monitor_start_us = rtt_us;
+	rtt_on_monitor_end_us = rtt_us;
+	utility = 0.0f;
+	n_packets = 0;
+	packets_acked = 0;
+	packets_lost = 0;
+	rtt_samples.Reset(rtt_stats_mode == RTT_STATS_HALF_SPLIT, max_tracked_packets);
+	packet_states.clear();
+	num_tracked_packets = TrackedStateWords(max_tracked_packets) * kPacketsPerStateWord;
+}
+
+void MonitorInterval::OnPacketSent(QuicTime sent_time, QuicPacketNumber packet_number, QuicByteCount bytes)
+{
+	if (n_packets == 0)
+	{
+		// This is the first packet of this interval.
+		first_packet_sent_time = sent_time;
+		first_packet_number = packet_number;
+	}
+
+	last_packet_sent_time = sent_time;
+	last_packet_number = packet_number;
+	bytes_sent += bytes;
+	++n_packets;
+
+	size_t offset = static_cast<size_t> (packet_number - first_packet_number);
+	if (offset >= num_tracked_packets)
+		return;
+	// Within the storage the queue reserved.
+	size_t word = offset / kPacketsPerStateWord;
+	if (word >= packet_states.size())
+		packet_states.resize(word + 1);
+	packet_states[word].sent |= 1ULL << (offset % kPacketsPerStateWord);
+}
+
+bool MonitorInterval::OnPacketAcked(QuicPacketNumber packet_number, int64_t rtt_us, QuicTime event_time, bool* was_lost)
+{
+	if (n_packets == 0 || packet_number < first_packet_number || packet_number > last_packet_number)
+		return false;
+	size_t offset = static_cast<size_t> (packet_number - first_packet_number);
+	if (offset >= num_tracked_packets)
+	{
+		*was_lost = false;
+		++packets_acked;
+		rtt_samples.OnSample(event_time - rtt_us, rtt_us);
+		return true;
+	}
+	if (offset / kPacketsPerStateWord >= packet_states.size())
+		return false;
+	PacketStateWord& state = packet_states[offset / kPacketsPerStateWord];
+	uint64_t bit = 1ULL << (offset % kPacketsPerStateWord);
+	if ((state.sent & ~state.acked & bit) == 0)
+		return false;
+
+	state.acked |= bit;
+	*was_lost = (state.lost & bit) != 0;
+	if (*was_lost)
+	{
+		state.lost &= ~bit;
+		--packets_lost;
+	}
+	++packets_acked;
+	rtt_samples.OnSample(event_time - rtt_us, rtt_us);
+	return true;
+}
+
+bool MonitorInterval::OnPacketLost(QuicPacketNumber packet_number)
+{
+	if (n_packets == 0 || packet_number < first_packet_number || packet_number > last_packet_number)
+		return false;
+	size_t offset = static_cast<size_t> (packet_number - first_packet_number);
+	if (offset >= num_tracked_packets)
+	{
+		++packets_lost;
+		return true;
+	}
+	if (offset / kPacketsPerStateWord >= packet_states.size())
+		return false;
+	PacketStateWord& state = packet_states[offset / kPacketsPerStateWord];
+	uint64_t bit = 1ULL << (offset % kPacketsPerStateWord);
+	if ((state.sent & ~state.acked & ~state.lost & bit) == 0)
+		return false;
+
+	state.lost |= bit;
+	++packets_lost;
+	return true;
+}
+
+QuicPacketCount MonitorInterval::OnPacketsAcked(QuicPacketNumber first, QuicPacketNumber last, int64_t rtt_us, QuicTime event_time, QuicPacketCount* num_reversed)
+{
+	*num_reversed = 0;
+	first = std::max(first, first_packet_number);
+	last = std::min(last, last_packet_number);
+	if (n_packets == 0 || first > last)
+		return 0;
+
+	size_t begin = static_cast<size_t> (first - first_packet_number);
+	size_t end = static_cast<size_t> (last - first_packet_number) + 1;
+	size_t state_end = std::min(end, packet_states.size() * kPacketsPerStateWord);
+	QuicPacketCount num_acked = 0;
+	for (size_t word = begin / kPacketsPerStateWord; word * kPacketsPerStateWord < state_end; ++word)
+	{
+		PacketStateWord& state = packet_states[word];
+		uint64_t acked = state.sent & ~state.acked & PacketStateMask(word, begin, state_end);
+		state.acked |= acked;
+		*num_reversed += CountPackets(acked & state.lost);
+		state.lost &= ~acked;
+		num_acked += CountPackets(acked);
+	}
+	// The untracked packets, all taken as newly acked.
+	size_t untracked_begin = std::max(begin, num_tracked_packets);
+	if (untracked_begin < end)
+		num_acked += static_cast<QuicPacketCount> (end - untracked_begin);
+	// The packets share the sample, so one OnSamples() call adds them all.
+	rtt_samples.OnSamples(num_acked, event_time - rtt_us, rtt_us);
+
+	packets_acked += num_acked;
+	packets_lost -= *num_reversed;
+	return num_acked;
+}
+
+QuicPacketCount MonitorInterval::OnPacketsLost(QuicPacketNumber first, QuicPacketNumber last)
+{
+	first = std::max(first, first_packet_number);
+	last = std::min(last, last_packet_number);
+	if (n_packets == 0 || first > last)
+		return 0;
+
+	size_t begin = static_cast<size_t> (first - first_packet_number);
+	size_t end = static_cast<size_t> (last - first_packet_number) + 1;
+	size_t state_end = std::min(end, packet_states.size() * kPacketsPerStateWord);
+	QuicPacketCount num_lost = 0;
+	for (size_t word = begin / kPacketsPerStateWord; word * kPacketsPerStateWord < state_end; ++word)
+	{
+		PacketStateWord& state = packet_states[word];
+		uint64_t lost = state.sent & ~state.acked & ~state.lost & PacketStateMask(word, begin, state_end);
+		state.lost |= lost;
+		num_lost += CountPackets(lost);
+	}
+	size_t untracked_begin = std::max(begin, num_tracked_packets);
+	if (untracked_begin < end)
+		num_lost += static_cast<QuicPacketCount> (end - untracked_begin);
+	packets_lost += num_lost;
+	return num_lost;
+}
+
+bool MonitorInterval::ArePacketsOutstanding(QuicPacketNumber first, QuicPacketNumber last) const
+{
+	if (n_packets == 0 || first < first_packet_number || last > last_packet_number || first > last)
+		return false;
+
+	// Untracked packets are taken as outstanding.
+	size_t begin = static_cast<size_t> (first - first_packet_number);
+	size_t end = std::min(static_cast<size_t> (last - first_packet_number) + 1, num_tracked_packets);
+	if (begin < end && end > packet_states.size() * kPacketsPerStateWord)
+		return false;
+	for (size_t word = begin / kPacketsPerStateWord; word * kPacketsPerStateWord < end; ++word)
+	{
+		const PacketStateWord& state = packet_states[word];
+		uint64_t mask = PacketStateMask(word, begin, end);
+		if ((state.sent & ~state.acked & ~state.lost & mask) != mask)
+			return false;
+	}
+	return true;
+}
+
+float MonitorInterval::LatencyInflation() const
+{
+	float latency_inflation = 0.0f;
+	if (rtt_samples.keeps_history())
+	{
+		// Approximate the derivative at each point by computing the slope of RTT
+		// to the following point and average these values.
+		float rtt_first_half_sum = 0.0;
+		float rtt_second_half_sum = 0.0;
+		rtt_samples.HalfSplitSums(&rtt_first_half_sum, &rtt_second_half_sum);
+		latency_inflation = 2.0 * (rtt_second_half_sum - rtt_first_half_sum) / (rtt_first_half_sum + rtt_second_half_sum);
+	} else if (rtt_samples.MeanRtt() > 0.0) {
+		// The interval's packets were sent over |send_span| microseconds. Along
+		// the fitted RTT trend, the second half of the interval averages
+		// slope * send_span / 2 more RTT than the first half.
+		double send_span = static_cast<double> (last_packet_sent_time - first_packet_sent_time);
+		latency_inflation = static_cast<float> (rtt_samples.Slope() * send_span / 2.0 / rtt_samples.MeanRtt());
+	}
+	return latency_inflation;
+}
+
+void MonitorInterval::SaveSnapshot(SnapshotWriter* writer) const
+{
+	writer->WriteDouble(sending_rate);
+	writer->WriteBool(is_useful);
+	writer->WriteFloat(rtt_fluctuation_tolerance_ratio);
+	writer->WriteInt64(end_time);
+	writer->WriteInt64(first_packet_sent_time);
+	writer->WriteInt64(last_packet_sent_time);
+	writer->WriteInt32(first_packet_number);
+	writer->WriteInt32(last_packet_number);
+	writer->WriteInt64(bytes_sent);
+	writer->WriteInt64(bytes_acked);
+	writer->WriteInt64(bytes_lost);
+	writer->WriteInt64(rtt_on_monitor_start_us);
+	writer->WriteInt64(rtt_on_monitor_end_us);
+	writer->WriteFloat(utility);
+	writer->WriteInt32(n_packets);
+	writer->WriteInt32(packets_acked);
+	writer->WriteInt32(packets_lost);
+	rtt_samples.SaveSnapshot(writer);
+	writer->WriteUint64(packet_states.size());
+	for (const PacketStateWord& state : packet_states)
+	{
+		writer->WriteUint64(state.sent);
+		writer->WriteUint64(state.acked);
+		writer->WriteUint64(state.lost);
+	}
+}
+
+bool MonitorInterval::RestoreSnapshot(SnapshotReader* reader, size_t max_tracked_packets)
+{
+	int32_t num_packets;
+	if (!reader->ReadDouble(&sending_rate)
+		|| !reader->ReadBool(&is_useful)
+		|| !reader->ReadFloat(&rtt_fluctuation_tolerance_ratio)
+		|| !reader->ReadInt64(&end_time)
+		|| !reader->ReadInt64(&first_packet_sent_time)
+		|| !reader->ReadInt64(&last_packet_sent_time)
+		|| !reader->ReadInt32(&first_packet_number)
+		|| !reader->ReadInt32(&last_packet_number)
+		|| !reader->ReadInt64(&bytes_sent)
+		|| !reader->ReadInt64(&bytes_acked)
+		|| !reader->ReadInt64(&bytes_lost)
+		|| !reader->ReadInt64(&rtt_on_monitor_start_us)
+		|| !reader->ReadInt64(&rtt_on_monitor_end_us)
+		|| !reader->ReadFloat(&utility)
+		|| !reader->ReadInt32(&num_packets)
+		|| !reader->ReadInt32(&packets_acked)
+		|| !reader->ReadInt32(&packets_lost)
+		|| !rtt_samples.RestoreSnapshot(reader, max_tracked_packets))
+		return false;
+	n_packets = num_packets;
+
+	// The states cover the tracked packets sent exactly, up to the last one,
+	// and their counts balance. Each state word takes 24 bytes, so a word
+	// count the snapshot cannot hold is rejected before any is allocated.
+	num_tracked_packets = TrackedStateWords(max_tracked_packets) * kPacketsPerStateWord;
+	uint64_t num_words;
+	if (!reader->ReadUint64(&num_words))
+		return false;
+	int64_t num_numbers = static_cast<int64_t> (last_packet_number) - first_packet_number + 1;
+	int64_t num_untracked = n_packets == 0 ? 0 : std::max<int64_t>(num_numbers - static_cast<int64_t> (num_tracked_packets), 0);
+	uint64_t max_words = n_packets == 0 ? 0 : static_cast<uint64_t> ((num_numbers - num_untracked + kPacketsPerStateWord - 1) / kPacketsPerStateWord);
+	if (n_packets < 0 || (n_packets > 0 && num_numbers < n_packets)
+		|| packets_acked < 0 || packets_lost < 0 || packets_acked + packets_lost > n_packets
+		|| num_words > max_words || (num_untracked == 0 && num_words != max_words)
+		|| (n_packets > 0 && num_words == 0)
+		|| num_words > reader->remaining() / (3 * sizeof(uint64_t)))
+		return reader->Fail();
+	packet_states.resize(static_cast<size_t> (num_words));
+	QuicPacketCount num_sent = 0;
+	for (PacketStateWord& state : packet_states)
+	{
+		if (!reader->ReadUint64(&state.sent) || !reader->ReadUint64(&state.acked) || !reader->ReadUint64(&state.lost))
+			return false;
+		num_sent += CountPackets(state.sent);
+	}
+	if (num_sent > n_packets || n_packets - num_sent > num_untracked)
+		return reader->Fail();
+	return true;
+}
+
+void AggregateMonitorInterval::Reserve(RttStatsMode rtt_stats_mode, size_t max_rtt_runs)
+{
+	interval_.rtt_samples.Reset(rtt_stats_mode == RTT_STATS_HALF_SPLIT, max_rtt_runs);
+}
+
+void AggregateMonitorInterval::Reset(QuicBandwidth sending_rate,
+				     float rtt_fluctuation_tolerance_ratio,
+				     int64_t rtt_us,
+				     QuicTime end_time,
+				     RttStatsMode rtt_stats_mode,
+				     size_t max_rtt_runs)
+{
+	interval_.Reset(sending_rate, true, rtt_fluctuation_tolerance_ratio, rtt_us, end_time, rtt_stats_mode, 0);
+	interval_.rtt_samples.Reset(rtt_stats_mode == RTT_STATS_HALF_SPLIT, max_rtt_runs);
+	next_reported_packet_number_ = 0;
+	num_inexact_packets_ = 0;
+}
+
+void AggregateMonitorInterval::OnPacketSent(QuicTime sent_time, QuicPacketNumber packet_number, QuicByteCount bytes)
+{
+	if (interval_.n_packets == 0)
+	{
+		interval_.first_packet_sent_time = sent_time;
+		interval_.first_packet_number = packet_number;
+		next_reported_packet_number_ = packet_number;
+	} else {
+		num_inexact_packets_ += packet_number - interval_.last_packet_number - 1;
+	}
+	interval_.last_packet_sent_time = sent_time;
+	interval_.last_packet_number = packet_number;
+	interval_.bytes_sent += bytes;
+	++interval_.n_packets;
+}
+
+void AggregateMonitorInterval::OnCongestionEvent(const AckedPacketVector& acked_packets, const LostPacketVector& lost_packets, int64_t rtt_us, QuicTime event_time)
+{
+	if (interval_.n_packets == 0)
+		return;
+
+	// Reports normally arrive in packet number order, and then the ones of
+	// the interval are found by binary search.
+	AckedPacketVector::const_iterator next_ack = acked_packets.begin();
+	AckedPacketVector::const_iterator acks_end = acked_packets.end();
+	LostPacketVector::const_iterator next_loss = lost_packets.begin();
+	LostPacketVector::const_iterator losses_end = lost_packets.end();
+	if (std::is_sorted(next_ack, acks_end, ComparePacketNumbers) && std::is_sorted(next_loss, losses_end, ComparePacketNumbers))
+	{
+		next_ack = std::lower_bound(next_ack, acks_end, interval_.first_packet_number, PacketNumberLess);
+		acks_end = std::upper_bound(next_ack, acks_end, interval_.last_packet_number, PacketNumberGreater);
+		next_loss = std::lower_bound(next_loss, losses_end, interval_.first_packet_number, PacketNumberLess);
+		losses_end = std::upper_bound(next_loss, losses_end, interval_.last_packet_number, PacketNumberGreater);
+	}
+
+	// Acks and losses are merged in packet number order, losses first, so
+	// that a loss between two acks is still in order. A run of acks of
+	// consecutive packets is sampled at once, as the queue samples it.
+	while (next_ack != acks_end || next_loss != losses_end)
+	{
+		if (next_loss != losses_end && (next_ack == acks_end || next_loss->packet_number <= next_ack->packet_number))
+		{
+			const LostPacket& loss = *next_loss++;
+			if (loss.packet_number >= interval_.first_packet_number && loss.packet_number <= interval_.last_packet_number)
+				OnPacketsLost(loss.packet_number, loss.packet_number, loss.bytes_lost);
+			continue;
+		}
+
+		const AckedPacket& ack = *next_ack++;
+		if (ack.packet_number < interval_.first_packet_number || ack.packet_number > interval_.last_packet_number)
+			continue;
+		QuicPacketNumber last = ack.packet_number;
+		QuicByteCount bytes = ack.bytes_acked;
+		for (; next_ack != acks_end && next_ack->packet_number == last + 1 && last < interval_.last_packet_number; ++next_ack)
+		{
+			++last;
+			bytes += next_ack->bytes_acked;
+		}
+		OnPacketsAcked(ack.packet_number, last, bytes, rtt_us, event_time);
+	}
+}
+
+void AggregateMonitorInterval::OnCongestionEvent(const PacketNumberRangeVector& acked_ranges, const PacketNumberRangeVector& lost_ranges, int64_t rtt_us, QuicTime event_time)
+{
+	if (interval_.n_packets == 0)
+		return;
+
+	size_t next_ack = 0;
+	size_t next_loss = 0;
+	while (next_ack < acked_ranges.size() || next_loss < lost_ranges.size())
+	{
+		bool is_loss = next_loss < lost_ranges.size() && (next_ack == acked_ranges.size()
+			|| lost_ranges[next_loss].first_packet_number <= acked_ranges[next_ack].first_packet_number);
+		const PacketNumberRange& range = is_loss ? lost_ranges[next_loss++] : acked_ranges[next_ack++];
+		QuicPacketNumber first = std::max(range.first_packet_number, interval_.first_packet_number);
+		QuicPacketNumber last = std::min(range.last_packet_number, interval_.last_packet_number);
+		if (first > last)
+			continue;
+		QuicByteCount bytes = RangeBytesBefore(range, last + 1) - RangeBytesBefore(range, first);
+		if (is_loss)
+			OnPacketsLost(first, last, bytes);
+		else
+			OnPacketsAcked(first, last, bytes, rtt_us, event_time);
+	}
+}
+
+void AggregateMonitorInterval::OnTimeout(int64_t rtt_us)
+{
+	QuicPacketCount packets_outstanding = interval_.packets_outstanding();
+	if (packets_outstanding <= 0)
+		return;
+	interval_.bytes_lost += std::max<QuicByteCount>(interval_.bytes_sent - interval_.bytes_acked - interval_.bytes_lost, 0);
+	interval_.packets_lost += packets_outstanding;
+	interval_.rtt_on_monitor_end_us = rtt_us;
+}
+
+bool AggregateMonitorInterval::IsComplete(QuicTime now) const
+{
+	// Repeated reports may count more packets than were sent.
+	return now >= interval_.end_time && interval_.packets_outstanding() <= 0;
+}
+
+void AggregateMonitorInterval::OnPacketsAcked(QuicPacketNumber first, QuicPacketNumber last, QuicByteCount bytes, int64_t rtt_us, QuicTime event_time)
+{
+	OnPacketsReported(first, last);
+	QuicPacketCount count = last - first + 1;
+	interval_.packets_acked += count;
+	interval_.bytes_acked += bytes;
+	interval_.rtt_samples.OnSamples(count, event_time - rtt_us, rtt_us);
+}
+
+void AggregateMonitorInterval::OnPacketsLost(QuicPacketNumber first, QuicPacketNumber last, QuicByteCount bytes)
 {
+	OnPacketsReported(first, last);
+	interval_.packets_lost += last - first + 1;
+	interval_.bytes_lost += bytes;
 }
 
-MonitorInterval::MonitorInterval(QuicBandwidth sending_rate,
-				 bool is_useful,
-				 float rtt_fluctuation_tolerance_ratio,
-				 int64_t rtt_us,
-				 QuicTime end_time) :
-	sending_rate(sending_rate),
-	is_useful(is_useful),
-	rtt_fluctuation_tolerance_ratio(rtt_fluctuation_tolerance_ratio),
-	end_time(end_time),
-	rtt_on_monitor_start_us(rtt_us),
-	rtt_on_monitor_end_us(rtt_us)
+void AggregateMonitorInterval::OnPacketsReported(QuicPacketNumber first, QuicPacketNumber last)
 {
+	if (first < next_reported_packet_number_)
+		num_inexact_packets_ += last - first + 1;
+	next_reported_packet_number_ = std::max(next_reported_packet_number_, last + 1);
 }
 
 UtilityInfo::UtilityInfo(QuicBandwidth rate, float utility) :
@@ -54,55 +734,286 @@ UtilityInfo::UtilityInfo(QuicBandwidth rate, float utility) :
 {
 }
 
-MonitorIntervalQueue::MonitorIntervalQueue(MonitorIntervalQueueDelegateInterface& delegate) :
+template <class UtilityFunction, class Delegate>
+BasicMonitorIntervalQueue<UtilityFunction, Delegate>::BasicMonitorIntervalQueue(Delegate& delegate, size_t capacity) :
+	BasicMonitorIntervalQueue(delegate, *PccConfig::Default(), capacity)
+{
+}
+
+template <class UtilityFunction, class Delegate>
+BasicMonitorIntervalQueue<UtilityFunction, Delegate>::BasicMonitorIntervalQueue(Delegate& delegate, const PccConfig& config, size_t capacity) :
+	owned_intervals_(std::max<size_t>(capacity, 1)),
+	intervals_(owned_intervals_.data()),
+	capacity_(owned_intervals_.size()),
+	utility_info_(capacity_),
+	config_(config),
+	rtt_stats_mode_(config.rtt_stats_mode),
+	delegate_(delegate) 
+{
+	ReserveIntervalStorage();
+}
+
+template <class UtilityFunction, class Delegate>
+BasicMonitorIntervalQueue<UtilityFunction, Delegate>::BasicMonitorIntervalQueue(Delegate& delegate, const PccConfig& config, MonitorInterval* storage, size_t capacity) :
+	intervals_(storage),
+	capacity_(capacity),
+	utility_info_(capacity_),
+	config_(config),
+	rtt_stats_mode_(config.rtt_stats_mode),
 	delegate_(delegate) 
 {
+	ReserveIntervalStorage();
+}
+
+template <class UtilityFunction, class Delegate>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::ReserveIntervalStorage()
+{
+	size_t num_words = TrackedStateWords(config_.max_tracked_packets_per_interval);
+	for (size_t i = 0; i < capacity_; ++i)
+	{
+		intervals_[i].packet_states.reserve(num_words);
+		intervals_[i].rtt_samples.Reset(rtt_stats_mode_ == RTT_STATS_HALF_SPLIT, config_.max_tracked_packets_per_interval);
+	}
 }
 
-void MonitorIntervalQueue::EnqueueNewMonitorInterval(QuicBandwidth sending_rate,bool is_useful, float rtt_fluctuation_tolerance_ratio, int64_t rtt_us, QuicTime end_time)
+template <class UtilityFunction, class Delegate>
+bool BasicMonitorIntervalQueue<UtilityFunction, Delegate>::EnqueueNewMonitorInterval(QuicBandwidth sending_rate,bool is_useful, float rtt_fluctuation_tolerance_ratio, int64_t rtt_us, QuicTime end_time)
 {
+	if (size_ == capacity_)
+	{
+		if (!at(0).is_useful)
+			PopFront();
+		else if (!at(size_ - 1).is_useful)
+			--size_;
+		else
+		{
+			++num_overflows_;
+			return false;
+		}
+	}
+
 	if (is_useful)
+	{
+		useful_end_time_ = num_useful_intervals_ == 0 ? end_time : std::max(useful_end_time_, end_time);
 		++num_useful_intervals_;
+		++num_useful_intervals_created_;
+	}
+	++num_intervals_created_;
 
-	monitor_intervals_.emplace_back(sending_rate, is_useful, rtt_fluctuation_tolerance_ratio, rtt_us, end_time);
+	++size_;
+	at(size_ - 1).Reset(sending_rate, is_useful, rtt_fluctuation_tolerance_ratio, rtt_us, end_time, rtt_stats_mode_, config_.max_tracked_packets_per_interval);
+	return true;
 }
 
-void MonitorIntervalQueue::OnPacketSent(QuicTime sent_time, QuicPacketNumber packet_number, QuicByteCount bytes)
+template <class UtilityFunction, class Delegate>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::OnPacketSent(QuicTime sent_time, QuicPacketNumber packet_number, QuicByteCount bytes)
 {
-	if (monitor_intervals_.empty())
+	if (packet_number <= largest_sent_packet_number_)
+		return;
+	largest_sent_packet_number_ = packet_number;
+	if (size_ == 0)
 		return;
 
-	if (monitor_intervals_.back().bytes_sent == 0)
-	{
-		// This is the first packet of this interval.
-		monitor_intervals_.back().first_packet_sent_time = sent_time;
-		monitor_intervals_.back().first_packet_number = packet_number;
-	}
+	at(size_ - 1).OnPacketSent(sent_time, packet_number, bytes);
+}
 
-	monitor_intervals_.back().last_packet_sent_time = sent_time;
-	monitor_intervals_.back().last_packet_number = packet_number;
-	monitor_intervals_.back().bytes_sent += bytes;
-	++monitor_intervals_.back().n_packets;
-#if ! defined(QUIC_PORT) && defined(DEBUG_INTERVAL_SIZE)
-	if (monitor_intervals_.back().is_useful)
+template <class UtilityFunction, class Delegate>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::OnCongestionEvent( const AckedPacketVector& acked_packets, const LostPacketVector& lost_packets, int64_t rtt_us, QuicTime event_time)
+{
+	// Out-of-order events, which the merge pass needs sorted, are sorted
+	// kMaxSortedEvents at a time.
+	bool sorted = std::is_sorted(acked_packets.begin(), acked_packets.end(), ComparePacketNumbers)
+		&& std::is_sorted(lost_packets.begin(), lost_packets.end(), ComparePacketNumbers);
+	size_t batch_size = sorted ? std::max(acked_packets.size(), lost_packets.size()) : kMaxSortedEvents;
+	size_t offset = 0;
+	do
 	{
-		std::cerr << "Added packet " << packet_number
-			<< " to monitor interval, now "
-			<< monitor_intervals_.back().bytes_sent << " bytes " << std::endl;
-	}
-#endif
+		size_t num_acks = offset < acked_packets.size() ? std::min(batch_size, acked_packets.size() - offset) : 0;
+		size_t num_losses = offset < lost_packets.size() ? std::min(batch_size, lost_packets.size() - offset) : 0;
+		const CongestionEvent* acks = acked_packets.data() + std::min(offset, acked_packets.size());
+		const CongestionEvent* losses = lost_packets.data() + std::min(offset, lost_packets.size());
+		if (!sorted)
+		{
+			SortScratch& scratch = ThreadSortScratch();
+			acks = SortedByPacketNumber(acks, acks + num_acks, scratch.acks, ComparePacketNumbers);
+			losses = SortedByPacketNumber(losses, losses + num_losses, scratch.losses, ComparePacketNumbers);
+		}
+		OnSortedPackets(acks, num_acks, losses, num_losses, rtt_us, event_time);
+		offset += batch_size;
+	} while (offset < acked_packets.size() || offset < lost_packets.size());
 }
 
-void MonitorIntervalQueue::OnCongestionEvent( const AckedPacketVector& acked_packets, const LostPacketVector& lost_packets, int64_t rtt_us, QuicTime event_time)
+template <class UtilityFunction, class Delegate>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::OnSortedPackets(const CongestionEvent* acks, size_t num_acks, const CongestionEvent* losses, size_t num_losses, int64_t rtt_us, QuicTime event_time)
 {
 	num_available_intervals_ = 0;
 	if (num_useful_intervals_ == 0)
 		// Skip all the received packets if no intervals are useful.
 		return;
 
+	// Intervals cover contiguous, increasing packet number ranges, so a single
+	// merge pass over packet-number-ordered events attributes every event to
+	// its interval in O(events + intervals).
+	const CongestionEvent* acks_end = acks + num_acks;
+	const CongestionEvent* losses_end = losses + num_losses;
+	const CongestionEvent* next_ack = acks;
+	const CongestionEvent* next_loss = losses;
+
+	ProcessCongestionEvent(rtt_us, event_time, [&](MonitorInterval& interval)
+	{
+		// Skip events of the intervals in front of this one.
+		next_loss = std::lower_bound(next_loss, losses_end, interval.first_packet_number, PacketNumberLess);
+		next_ack = std::lower_bound(next_ack, acks_end, interval.first_packet_number, PacketNumberLess);
+
+		const CongestionEvent* first_ack = next_ack;
+		const CongestionEvent* first_loss = next_loss;
+		for (; next_loss != losses_end && IntervalContainsPacket(interval, next_loss->packet_number); ++next_loss)
+		{
+			if (interval.OnPacketLost(next_loss->packet_number))
+				interval.bytes_lost += next_loss->bytes_lost;
+		}
+
+		while (next_ack != acks_end && IntervalContainsPacket(interval, next_ack->packet_number))
+		{
+			// Packets are mostly acked in a row, once each, and such a run is
+			// marked at once.
+			const CongestionEvent* run_end = next_ack + 1;
+			QuicByteCount run_bytes = next_ack->bytes_acked;
+			for (; run_end != acks_end && run_end->packet_number == (run_end - 1)->packet_number + 1
+				&& run_end->packet_number <= interval.last_packet_number; ++run_end)
+				run_bytes += run_end->bytes_acked;
+			QuicPacketNumber last = (run_end - 1)->packet_number;
+			if (run_end - next_ack > 1 && interval.ArePacketsOutstanding(next_ack->packet_number, last))
+			{
+				QuicPacketCount num_reversed;
+				interval.OnPacketsAcked(next_ack->packet_number, last, rtt_us, event_time, &num_reversed);
+				interval.bytes_acked += run_bytes;
+				next_ack = run_end;
+				continue;
+			}
+
+			for (; next_ack != run_end; ++next_ack)
+				AckPacket(&interval, *next_ack, rtt_us, event_time);
+		}
+
+		TraceIntervalPackets(interval, next_ack - first_ack, next_loss - first_loss);
+	});
+}
+
+template <class UtilityFunction, class Delegate>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::OnCongestionEvent(const PacketNumberRangeVector& acked_ranges, const PacketNumberRangeVector& lost_ranges, int64_t rtt_us, QuicTime event_time)
+{
+	// QUIC lists ACK ranges from the highest packet number down. Such ranges
+	// are reversed, and others out of order sorted, kMaxSortedEvents at a
+	// time, for the merge pass.
+	bool sorted = std::is_sorted(acked_ranges.begin(), acked_ranges.end(), CompareRanges)
+		&& std::is_sorted(lost_ranges.begin(), lost_ranges.end(), CompareRanges);
+	size_t batch_size = sorted ? std::max(acked_ranges.size(), lost_ranges.size()) : kMaxSortedEvents;
+	size_t offset = 0;
+	do
+	{
+		size_t num_acks = offset < acked_ranges.size() ? std::min(batch_size, acked_ranges.size() - offset) : 0;
+		size_t num_losses = offset < lost_ranges.size() ? std::min(batch_size, lost_ranges.size() - offset) : 0;
+		const PacketNumberRange* acks = acked_ranges.data() + std::min(offset, acked_ranges.size());
+		const PacketNumberRange* losses = lost_ranges.data() + std::min(offset, lost_ranges.size());
+		if (!sorted)
+		{
+			SortScratch& scratch = ThreadSortScratch();
+			acks = SortedByPacketNumber(acks, acks + num_acks, scratch.acked_ranges, CompareRanges);
+			losses = SortedByPacketNumber(losses, losses + num_losses, scratch.lost_ranges, CompareRanges);
+		}
+		OnSortedRanges(acks, num_acks, losses, num_losses, rtt_us, event_time);
+		offset += batch_size;
+	} while (offset < acked_ranges.size() || offset < lost_ranges.size());
+}
+
+template <class UtilityFunction, class Delegate>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::OnSortedRanges(const PacketNumberRange* acks, size_t num_acks, const PacketNumberRange* losses, size_t num_losses, int64_t rtt_us, QuicTime event_time)
+{
+	num_available_intervals_ = 0;
+	if (num_useful_intervals_ == 0)
+		return;
+
+	// The same merge pass as for single packets, except that a range may span
+	// several intervals and is only passed once the intervals reach its end.
+	size_t next_ack = 0;
+	size_t next_loss = 0;
+
+	ProcessCongestionEvent(rtt_us, event_time, [&](MonitorInterval& interval)
+	{
+		QuicPacketCount packets_lost = 0;
+		for (; next_loss < num_losses && losses[next_loss].first_packet_number <= interval.last_packet_number; ++next_loss)
+		{
+			packets_lost += LoseRange(&interval, losses[next_loss]);
+			if (losses[next_loss].last_packet_number > interval.last_packet_number)
+				break;
+		}
+
+		QuicPacketCount packets_acked = 0;
+		for (; next_ack < num_acks && acks[next_ack].first_packet_number <= interval.last_packet_number; ++next_ack)
+		{
+			packets_acked += AckRange(&interval, acks[next_ack], rtt_us, event_time);
+			if (acks[next_ack].last_packet_number > interval.last_packet_number)
+				break;
+		}
+
+		TraceIntervalPackets(interval, packets_acked, packets_lost);
+	});
+}
+
+template <class UtilityFunction, class Delegate>
+QuicPacketCount BasicMonitorIntervalQueue<UtilityFunction, Delegate>::LoseRange(MonitorInterval* interval, const PacketNumberRange& range)
+{
+	QuicPacketNumber first = std::max(range.first_packet_number, interval->first_packet_number);
+	QuicPacketNumber last = std::min(range.last_packet_number, interval->last_packet_number);
+	if (first > last)
+		return 0;
+	QuicByteCount bytes = RangeBytesBefore(range, last + 1) - RangeBytesBefore(range, first);
+	QuicPacketCount num_packets = last - first + 1;
+	QuicPacketCount num_lost = interval->OnPacketsLost(first, last);
+	interval->bytes_lost += num_lost == num_packets ? bytes : bytes * num_lost / num_packets;
+	return num_lost;
+}
+
+template <class UtilityFunction, class Delegate>
+QuicPacketCount BasicMonitorIntervalQueue<UtilityFunction, Delegate>::AckRange(MonitorInterval* interval, const PacketNumberRange& range, int64_t rtt_us, QuicTime event_time)
+{
+	QuicPacketNumber first = std::max(range.first_packet_number, interval->first_packet_number);
+	QuicPacketNumber last = std::min(range.last_packet_number, interval->last_packet_number);
+	if (first > last)
+		return 0;
+	QuicByteCount bytes = RangeBytesBefore(range, last + 1) - RangeBytesBefore(range, first);
+	QuicPacketCount num_packets = last - first + 1;
+	QuicPacketCount num_reversed;
+	QuicPacketCount num_acked = interval->OnPacketsAcked(first, last, rtt_us, event_time, &num_reversed);
+	interval->bytes_acked += num_acked == num_packets ? bytes : bytes * num_acked / num_packets;
+	if (num_reversed > 0)
+		interval->bytes_lost = std::max<QuicByteCount>(interval->bytes_lost - bytes * num_reversed / num_packets, 0);
+	return num_acked;
+}
+
+template <class UtilityFunction, class Delegate>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::TraceIntervalPackets(const MonitorInterval& interval, size_t num_acked, size_t num_lost) const
+{
+	if (Trace::enabled() && (num_acked > 0 || num_lost > 0))
+		Trace::Record(TRACE_INTERVAL_PACKETS,
+			trace_id_,
+			interval.first_packet_number,
+			static_cast<double> (num_acked),
+			static_cast<double> (num_lost),
+			static_cast<double> (interval.bytes_acked),
+			static_cast<double> (interval.bytes_lost),
+			static_cast<double> (interval.bytes_sent));
+}
+
+template <class UtilityFunction, class Delegate>
+template <class AttributePackets>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::ProcessCongestionEvent(int64_t rtt_us, QuicTime event_time, AttributePackets attribute_packets)
+{
 	bool has_invalid_utility = false;
-	for (MonitorInterval& interval : monitor_intervals_)
+	for (size_t i = 0; i < size_; ++i)
 	{
+		MonitorInterval& interval = at(i);
 		if (!interval.is_useful)
 			// Skips useless monitor intervals.
 			continue;
@@ -114,41 +1025,7 @@ void MonitorIntervalQueue::OnCongestionEvent( const AckedPacketVector& acked_pac
 			continue;
 		}
 
-		for (const LostPacket& lost_packet : lost_packets)
-		{
-			if (IntervalContainsPacket(interval, lost_packet.packet_number))
-			{
-				interval.bytes_lost += lost_packet.bytes_lost;
-#if (! defined(QUIC_PORT)) && defined(DEBUG_MONITOR_INTERVAL_QUEUE_LOSS)
-				std::cerr << "\tattributed bytes to an interval" << std::endl;
-				std::cerr << "\tacked " << interval.bytes_acked << "/"
-					<< interval.bytes_sent << std::endl;
-				std::cerr << "\tlost " << interval.bytes_lost << "/"
-					<< interval.bytes_sent << std::endl;
-				std::cerr << "\ttotal " << interval.bytes_lost + interval.bytes_acked
-					<< "/" << interval.bytes_sent << std::endl;
-#endif
-			}
-		}
-
-		for (const AckedPacket& acked_packet : acked_packets)
-		{
-			if (IntervalContainsPacket(interval, acked_packet.packet_number))
-			{
-				interval.bytes_acked += acked_packet.bytes_acked;
-				interval.packet_rtt_samples.push_back(PacketRttSample(acked_packet.packet_number, rtt_us));
-
-#if (! defined(QUIC_PORT)) && defined(DEBUG_MONITOR_INTERVAL_QUEUE_ACKS)
-				std::cerr << "\tattributed bytes to an interval" << std::endl;
-				std::cerr << "\tacked " << interval.bytes_acked << "/"
-					<< interval.bytes_sent << std::endl;
-				std::cerr << "\tlost " << interval.bytes_lost << "/"
-					<< interval.bytes_sent << std::endl;
-				std::cerr << "\ttotal " << interval.bytes_lost + interval.bytes_acked
-					<< "/" << interval.bytes_sent << std::endl;
-#endif
-			}
-		}
+		attribute_packets(interval);
 
 		if (IsUtilityAvailable(interval, event_time))
 		{
@@ -160,117 +1037,229 @@ void MonitorIntervalQueue::OnCongestionEvent( const AckedPacketVector& acked_pac
 		}
 	}
 
-#if (!defined(QUIC_PORT)) && defined(DEBUG_INTERVAL_SIZE)
-	std::cerr << "Num useful = " << num_useful_intervals_ << ", num avail = "
-		<< num_available_intervals_ << std::endl;
-#endif
 
 	if (num_useful_intervals_ > num_available_intervals_ && !has_invalid_utility)
 		return;
 
+	ReportUtilities(has_invalid_utility);
+}
+
+template <class UtilityFunction, class Delegate>
+QuicTime BasicMonitorIntervalQueue<UtilityFunction, Delegate>::NextDeadline(int64_t rtt_us) const
+{
+	if (num_useful_intervals_ == 0)
+		return kNoDeadline;
+
+	QuicTime timeout = static_cast<QuicTime> (config_.monitor_interval_timeout_rtts * rtt_us);
+	QuicTime deadline = 0;
+	for (size_t i = 0; i < size_; ++i)
+	{
+		const MonitorInterval& interval = at(i);
+		if (!interval.is_useful)
+			continue;
+		bool is_outstanding = interval.packets_outstanding() > 0;
+		deadline = std::max(deadline, is_outstanding ? interval.end_time + timeout : interval.end_time);
+	}
+	return deadline;
+}
+
+template <class UtilityFunction, class Delegate>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::OnTimer(QuicTime now, int64_t rtt_us)
+{
+	// Completes all the useful intervals at once, so that no ACK arrives for
+	// an interval whose outstanding bytes were counted as lost.
+	if (now < EarliestDeadline() || now < NextDeadline(rtt_us))
+		return;
+
+	bool has_invalid_utility = false;
+	for (size_t i = 0; i < size_; ++i)
+	{
+		MonitorInterval& interval = at(i);
+		if (!interval.is_useful)
+			continue;
+		QuicPacketCount packets_outstanding = interval.packets_outstanding();
+		if (packets_outstanding > 0)
+		{
+			interval.bytes_lost += std::max<QuicByteCount>(interval.bytes_sent - interval.bytes_acked - interval.bytes_lost, 0);
+			interval.packets_lost += packets_outstanding;
+			interval.rtt_on_monitor_end_us = rtt_us;
+		}
+		// Intervals complete since an earlier event get the same utility
+		// again.
+		has_invalid_utility = !CalculateUtility(&interval);
+		if (has_invalid_utility)
+			break;
+	}
+	ReportUtilities(has_invalid_utility);
+}
+
+template <class UtilityFunction, class Delegate>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::ReportUtilities(bool has_invalid_utility)
+{
 	if (!has_invalid_utility)
 	{
-		std::vector<UtilityInfo> utility_info;
-		for (const MonitorInterval& interval : monitor_intervals_)
+		size_t num_utilities = 0;
+		for (size_t i = 0; i < size_; ++i)
 		{
+			const MonitorInterval& interval = at(i);
 			if (!interval.is_useful)
 				continue;
 			// All the useful intervals should have available utilities now.
-			utility_info.push_back(UtilityInfo(interval.sending_rate, interval.utility));
+			utility_info_[num_utilities++] = UtilityInfo(interval.sending_rate, interval.utility);
 		}
 
-		delegate_.OnUtilityAvailable(utility_info);
+		delegate_.OnUtilityAvailable(UtilityInfoSpan(utility_info_.data(), num_utilities));
+	} else {
+		++num_invalid_utilities_;
+		num_discarded_intervals_ += num_useful_intervals_;
 	}
 
 	// Remove MonitorIntervals from the head of the queue,
 	// until all useful intervals are removed.
 	while (num_useful_intervals_ > 0)
 	{
-		if (monitor_intervals_.front().is_useful)
+		if (at(0).is_useful)
 			--num_useful_intervals_;
-		monitor_intervals_.pop_front();
+		PopFront();
 	}
 	num_available_intervals_ = 0;
 }
 
-const MonitorInterval& MonitorIntervalQueue::current() const
+template <class UtilityFunction, class Delegate>
+const MonitorInterval& BasicMonitorIntervalQueue<UtilityFunction, Delegate>::current() const
 {
-	return monitor_intervals_.back();
+	return at(size_ - 1);
 }
 
-bool MonitorIntervalQueue::empty() const
+template <class UtilityFunction, class Delegate>
+bool BasicMonitorIntervalQueue<UtilityFunction, Delegate>::empty() const
 {
-	return monitor_intervals_.empty();
+	return size_ == 0;
 }
 
-size_t MonitorIntervalQueue::size() const
+template <class UtilityFunction, class Delegate>
+size_t BasicMonitorIntervalQueue<UtilityFunction, Delegate>::size() const
 {
-	return monitor_intervals_.size();
+	return size_;
 }
 
-void MonitorIntervalQueue::OnRttInflationInStarting()
+template <class UtilityFunction, class Delegate>
+MonitorInterval& BasicMonitorIntervalQueue<UtilityFunction, Delegate>::at(size_t index)
 {
-	monitor_intervals_.clear();
+	size_t slot = head_ + index;
+	return intervals_[slot < capacity_ ? slot : slot - capacity_];
+}
+
+template <class UtilityFunction, class Delegate>
+const MonitorInterval& BasicMonitorIntervalQueue<UtilityFunction, Delegate>::at(size_t index) const
+{
+	size_t slot = head_ + index;
+	return intervals_[slot < capacity_ ? slot : slot - capacity_];
+}
+
+template <class UtilityFunction, class Delegate>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::PopFront()
+{
+	head_ = (head_ + 1 == capacity_) ? 0 : head_ + 1;
+	--size_;
+}
+
+template <class UtilityFunction, class Delegate>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::AdvanceLargestSentPacketNumber(int64_t packet_number)
+{
+	largest_sent_packet_number_ = std::max(largest_sent_packet_number_, packet_number);
+}
+
+template <class UtilityFunction, class Delegate>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::OnRttInflationInStarting()
+{
+	num_discarded_intervals_ += num_useful_intervals_;
+	head_ = 0;
+	size_ = 0;
 	num_useful_intervals_ = 0;
 	num_available_intervals_ = 0;
 }
 
-bool MonitorIntervalQueue::IsUtilityAvailable(const MonitorInterval& interval, QuicTime event_time) const
+template <class UtilityFunction, class Delegate>
+bool BasicMonitorIntervalQueue<UtilityFunction, Delegate>::IsUtilityAvailable(const MonitorInterval& interval, QuicTime event_time) const
 {
-	return (event_time >= interval.end_time && interval.bytes_acked + interval.bytes_lost == interval.bytes_sent);
+	// Counted in packets, which stay balanced when bytes are reported
+	// differently from how they were sent. Repeated reports of untracked
+	// packets may count past n_packets.
+	return (event_time >= interval.end_time && interval.packets_outstanding() <= 0);
 }
 
-bool MonitorIntervalQueue::IntervalContainsPacket(const MonitorInterval& interval, QuicPacketNumber packet_number) const
+template <class UtilityFunction, class Delegate>
+bool BasicMonitorIntervalQueue<UtilityFunction, Delegate>::IntervalContainsPacket(const MonitorInterval& interval, QuicPacketNumber packet_number) const
 {
-#if ! defined(QUIC_PORT) && (defined(DEBUG_MONITOR_INTERVAL_QUEUE_LOSS) || defined(DEBUG_MONITOR_INTERVAL_QUEUE_ACKS))
-	std::cerr << "Checking for packet " << packet_number << " in interval: ["
-		<< interval.first_packet_number << ", "
-		<< interval.last_packet_number << "]" << std::endl;
-#endif
 	return (packet_number >= interval.first_packet_number && packet_number <= interval.last_packet_number);
 }
 
-/*
-bool MonitorIntervalQueue::CalculateUtility(MonitorInterval* interval)
+template <class UtilityFunction, class Delegate>
+void BasicMonitorIntervalQueue<UtilityFunction, Delegate>::SaveSnapshot(SnapshotWriter* writer) const
 {
-	if (interval->last_packet_sent_time == interval->first_packet_sent_time)
-	{
-		// Cannot get valid utility if interval only contains one packet.
+	writer->WriteUint8(static_cast<uint8_t> (rtt_stats_mode_));
+	writer->WriteUint64(num_overflows_);
+	writer->WriteInt64(largest_sent_packet_number_);
+	writer->WriteUint64(num_useful_intervals_);
+	writer->WriteUint64(num_available_intervals_);
+	writer->WriteUint64(size_);
+	for (size_t i = 0; i < size_; ++i)
+		at(i).SaveSnapshot(writer);
+}
+
+template <class UtilityFunction, class Delegate>
+bool BasicMonitorIntervalQueue<UtilityFunction, Delegate>::RestoreSnapshot(SnapshotReader* reader)
+{
+	uint8_t rtt_stats_mode;
+	uint64_t num_overflows;
+	int64_t largest_sent_packet_number;
+	uint64_t num_useful_intervals;
+	uint64_t num_available_intervals;
+	uint64_t size;
+	if (!reader->ReadUint8(&rtt_stats_mode)
+		|| !reader->ReadUint64(&num_overflows)
+		|| !reader->ReadInt64(&largest_sent_packet_number)
+		|| !reader->ReadUint64(&num_useful_intervals)
+		|| !reader->ReadUint64(&num_available_intervals)
+		|| !reader->ReadUint64(&size))
 		return false;
-	}
-	const int64_t kMinTransmissionTime = 1l;
-	int64_t mi_duration = std::max(
-				       kMinTransmissionTime,
-				       (interval->last_packet_sent_time - interval->first_packet_sent_time)
-				       .ToMicroseconds());
+	if (rtt_stats_mode > RTT_STATS_HALF_SPLIT || size > capacity_ || largest_sent_packet_number < -1)
+		return reader->Fail();
 
-	float rtt_ratio = static_cast<float> (interval->rtt_on_monitor_start_us) /
-		static_cast<float> (interval->rtt_on_monitor_end_us);
-	if (rtt_ratio > 1.0 - interval->rtt_fluctuation_tolerance_ratio &&
-		rtt_ratio < 1.0 + interval->rtt_fluctuation_tolerance_ratio)
+	// Read into scratch intervals first, so that the queue stays as it was if
+	// the snapshot turns out to be malformed.
+	std::vector<MonitorInterval> intervals(static_cast<size_t> (size));
+	size_t num_useful = 0;
+	QuicTime useful_end_time = 0;
+	for (MonitorInterval& interval : intervals)
 	{
-		rtt_ratio = 1.0;
+		if (!interval.RestoreSnapshot(reader, config_.max_tracked_packets_per_interval))
+			return false;
+		if (interval.is_useful)
+		{
+			useful_end_time = num_useful == 0 ? interval.end_time : std::max(useful_end_time, interval.end_time);
+			++num_useful;
+		}
 	}
-	float latency_penalty =
-		1.0 - 1.0 / (1.0 + exp(kRTTCoefficient * (1.0 - rtt_ratio)));
-
-	float bytes_acked = static_cast<float> (interval->bytes_acked);
-	float bytes_lost = static_cast<float> (interval->bytes_lost);
-	float bytes_sent = static_cast<float> (interval->bytes_sent);
-	float loss_rate = bytes_lost / bytes_sent;
-	float loss_penalty =
-		1.0 - 1.0 / (1.0 + exp(kLossCoefficient * (loss_rate - kLossTolerance)));
-
-	interval->utility = (bytes_acked / static_cast<float> (mi_duration) *
-		loss_penalty * latency_penalty -
-		bytes_lost / static_cast<float> (mi_duration)) *
-		1000.0;
+	if (num_useful != num_useful_intervals || num_available_intervals > num_useful_intervals || reader->remaining() != 0)
+		return reader->Fail();
 
+	for (size_t i = 0; i < intervals.size(); ++i)
+		intervals_[i] = intervals[i];
+	head_ = 0;
+	size_ = intervals.size();
+	rtt_stats_mode_ = static_cast<RttStatsMode> (rtt_stats_mode);
+	num_overflows_ = static_cast<size_t> (num_overflows);
+	largest_sent_packet_number_ = largest_sent_packet_number;
+	useful_end_time_ = useful_end_time;
+	num_useful_intervals_ = num_useful;
+	num_available_intervals_ = static_cast<size_t> (num_available_intervals);
 	return true;
 }
- */
 
-bool MonitorIntervalQueue::CalculateUtility(MonitorInterval* interval)
+template <class UtilityFunction, class Delegate>
+bool BasicMonitorIntervalQueue<UtilityFunction, Delegate>::CalculateUtility(MonitorInterval* interval)
 {
 	if (interval->last_packet_sent_time == interval->first_packet_sent_time)
 		// Cannot get valid utility if interval only contains one packet.
@@ -279,55 +1268,26 @@ bool MonitorIntervalQueue::CalculateUtility(MonitorInterval* interval)
 	const int64_t kMinTransmissionTime = 1l;
 	int64_t mi_duration = std::max(kMinTransmissionTime, (interval->last_packet_sent_time - interval->first_packet_sent_time));
 
-	float mi_time_seconds = static_cast<float> (mi_duration) / kNumMicrosPerSecond;
-	float bytes_lost = static_cast<float> (interval->bytes_lost);
-	float bytes_sent = static_cast<float> (interval->bytes_sent);
-
-	float sending_rate_bps = bytes_sent * 8.0f / mi_time_seconds;
-	float sending_factor = kAlpha * pow(sending_rate_bps / kMegabit, kExponent);
-
-	// Approximate the derivative at each point by computing the slope of RTT to
-	// the following point and average these values.
-	float rtt_first_half_sum = 0.0;
-	float rtt_second_half_sum = 0.0;
-	int half_samples = interval->packet_rtt_samples.size() / 2;
-	for (int i = 0; i < half_samples; ++i)
-	{
-		rtt_first_half_sum += static_cast<float> (interval->packet_rtt_samples[i].sample_rtt);
-		rtt_second_half_sum += static_cast<float> (interval->packet_rtt_samples[i + half_samples].sample_rtt);
-	}
-	float latency_inflation = 2.0 * (rtt_second_half_sum - rtt_first_half_sum) / (rtt_first_half_sum + rtt_second_half_sum);
-
-	float rtt_penalty = int(int(latency_inflation * 100) / 100.0 * 100) / 2 * 2 / 100.0;
-	float rtt_contribution = kLatencyCoefficient * 11330 * bytes_sent * (pow(rtt_penalty, 1));
-
-	float loss_rate = bytes_lost / bytes_sent;
-	float loss_contribution = interval->n_packets * (11.35 * (pow((1 + loss_rate), 1) - 1));
-	if (loss_rate <= 0.03)
-		loss_contribution = interval->n_packets * (1 * (pow((1 + loss_rate), 1) - 1));
-	float current_utility = sending_factor - (loss_contribution + rtt_contribution) * (sending_rate_bps / kMegabit) / static_cast<float> (interval->n_packets);
-
-#if !defined(QUIC_PORT) && defined(DEBUG_UTILITY_CALC)
-	std::cerr << "Calculate utility:" << std::endl;
-	std::cerr << "\tutility           = " << current_utility << std::endl;
-	std::cerr << "\tn_packets         = " << interval->n_packets << std::endl;
-	std::cerr << "\ttarget send_rate  = " << interval->sending_rate / 1000000.0f
-		<< std::endl;
-	std::cerr << "\tactual send_rate  = "
-		<< bytes_sent * 8.0f / (mi_time_seconds * 1000000.0f) << std::endl;
-	std::cerr << "\tthroughput        = "
-		<< (bytes_sent - bytes_lost) * 8.0f / (mi_time_seconds * 1000000.0f)
-		<< std::endl;
-	std::cerr << "\tthroughput factor = " << sending_factor << std::endl;
-	std::cerr << "\tavg_rtt           = "
-		<< (rtt_first_half_sum + rtt_second_half_sum) / (2 * half_samples)
-		<< std::endl;
-	std::cerr << "\tlatency_infla.    = " << latency_inflation << std::endl;
-	std::cerr << "\trtt_contribution  = " << rtt_contribution << std::endl;
-	std::cerr << "\tloss_rate         = " << loss_rate << std::endl;
-	std::cerr << "\tloss_contribution = " << loss_contribution << std::endl;
-#endif
+	float current_utility = UtilityFunction::Utility(*interval, static_cast<float> (mi_duration), config_);
+
+	if (Trace::enabled())
+		Trace::Record(TRACE_UTILITY,
+			trace_id_,
+			interval->sending_rate,
+			static_cast<double> (interval->bytes_sent),
+			static_cast<double> (interval->bytes_lost),
+			static_cast<double> (mi_duration),
+			interval->LatencyInflation(),
+			current_utility);
 
 	interval->utility = current_utility;
 	return true;
 }
+
+template class BasicMonitorIntervalQueue<VivaceLatencyUtility>;
+template class BasicMonitorIntervalQueue<VivaceLossUtility>;
+template class BasicMonitorIntervalQueue<ScavengerUtility>;
+// The queues of the controllers, which call them without virtual dispatch.
+template class BasicMonitorIntervalQueue<VivaceLatencyUtility, BasicCongestionController<VivaceLatencyUtility> >;
+template class BasicMonitorIntervalQueue<VivaceLossUtility, BasicCongestionController<VivaceLossUtility> >;
+template class BasicMonitorIntervalQueue<ScavengerUtility, BasicCongestionController<ScavengerUtility> >;
@@ -1,7 +1,6 @@
 #ifndef THIRD_PARTY_PCC_QUIC_PCC_MONITOR_QUEUE_H_
 #define THIRD_PARTY_PCC_QUIC_PCC_MONITOR_QUEUE_H_
 
-#include <deque>
 #include <utility>
 #include <vector>
 
@@ -28,16 +27,119 @@ typedef CongestionEvent LostPacket;
 typedef std::vector<CongestionEvent> AckedPacketVector;
 typedef std::vector<CongestionEvent> LostPacketVector;
 
+// PacketNumberRange, consecutive packets acked or lost together, such as a
+// QUIC ACK range or a TCP SACK block, with their bytes in total.
 
-// PacketRttSample, stores the packet number and its corresponding RTT
+struct PacketNumberRange
+{
+	QuicPacketNumber first_packet_number = 0;
+	// Inclusive.
+	QuicPacketNumber last_packet_number = 0;
+	QuicByteCount bytes = 0;
+};
+
+typedef std::vector<PacketNumberRange> PacketNumberRangeVector;
 
-struct PacketRttSample
+// Defined in Snapshot.h.
+class SnapshotReader;
+class SnapshotWriter;
+
+
+// How MonitorIntervalQueue derives the latency inflation of an interval
+// from its RTT samples.
+enum RttStatsMode
 {
-	PacketRttSample(QuicPacketNumber packet_number, QuicTime rtt);
+	// Least-squares RTT gradient over the send time of the interval, kept in
+	// constant space.
+	RTT_STATS_REGRESSION,
+	// Difference between the first and second half of the samples, exactly
+	// as the original per-packet sample vector computed it. Keeps one entry
+	// per run of equal samples, within storage reserved per interval for as
+	// many runs as the interval tracks packets.
+	RTT_STATS_HALF_SPLIT
+};
+
+// RttSampleRun, a run of consecutive RTT samples with the same value, kept
+// relative to the first sample of the interval.
+
+struct RttSampleRun
+{
+	int32_t rtt_offset = 0;
+	int32_t count = 0;
+};
+
+// RttSampleAccumulator, streams the per-packet RTT samples of a
+// MonitorInterval into the running sums of a least-squares fit of RTT over
+// send time, and optionally keeps their run-length encoded history.
+
+class RttSampleAccumulator
+{
+public:
+	// Drops all samples. |keep_history| selects whether the samples are also
+	// recorded for HalfSplitSums(), in at most |max_runs| runs. Their storage
+	// is reserved on the first such Reset() and retained after, so the
+	// history never grows past it: once it holds |max_runs| runs, later
+	// samples join the last run, and HalfSplitSums() is approximate.
+	void Reset(bool keep_history, size_t max_runs);
+
+	// Adds the RTT sample |sample_rtt| of a packet, measured on a packet sent
+	// at |sent_time|.
+	void OnSample(QuicTime sent_time, QuicTime sample_rtt);
+	// Adds the same sample for |count| packets, as |count| calls of OnSample()
+	// would.
+	void OnSamples(QuicPacketCount count, QuicTime sent_time, QuicTime sample_rtt);
+
+	size_t num_samples() const { return num_samples_; }
+	bool keeps_history() const { return keep_history_; }
+	// Runs of equal samples kept for HalfSplitSums().
+	size_t num_runs() const { return runs_.size(); }
+	// Average of all samples, or 0 without samples.
+	double MeanRtt() const;
+	// Least-squares slope of the samples in microseconds of RTT per
+	// microsecond of send time, or 0 without samples at two send times.
+	double Slope() const;
+	// Standard deviation of the samples, or 0 without samples.
+	double RttDeviation() const;
+	// Sums of the first and second half of the samples in arrival order. An odd
+	// sample out at the end is ignored. Requires keep_history.
+	void HalfSplitSums(float* first_half_sum, float* second_half_sum) const;
+
+	// Appends the samples to |writer|, and reads samples so written back from
+	// |reader|, in at most |max_runs| runs. RestoreSnapshot returns false if
+	// they are malformed.
+	void SaveSnapshot(SnapshotWriter* writer) const;
+	bool RestoreSnapshot(SnapshotReader* reader, size_t max_runs);
+
+private:
+	// Appends |count| samples of |sample_rtt| to the history.
+	void AddToHistory(QuicPacketCount count, QuicTime sample_rtt);
+
+	size_t num_samples_ = 0;
+	// Sample values and send times are taken relative to the first sample
+	// to keep the sums small.
+	QuicTime base_rtt_ = 0;
+	QuicTime base_sent_time_ = 0;
+	double sum_x_ = 0.0;
+	double sum_y_ = 0.0;
+	double sum_xx_ = 0.0;
+	double sum_xy_ = 0.0;
+	double sum_yy_ = 0.0;
+
+	bool keep_history_ = false;
+	size_t max_runs_ = 0;
+	std::vector<RttSampleRun> runs_;
+};
+
+// PacketStateWord, the state of 64 consecutive packets of a MonitorInterval,
+// bit i standing for the i-th of them.
 
-	// Packet number of the sampled packet.
-	QuicPacketNumber packet_number = 0;
-	QuicTime sample_rtt = 0;
+struct PacketStateWord
+{
+	// Sent and counted in the interval.
+	uint64_t sent = 0;
+	uint64_t acked = 0;
+	// Considered as lost and not acked since.
+	uint64_t lost = 0;
 };
 
 // MonitorInterval, as the queue's entry struct, stores the information
@@ -47,11 +149,64 @@ struct PacketRttSample
 
 struct MonitorInterval
 {
-	MonitorInterval(QuicBandwidth sending_rate,
+	// Reinitializes a recycled MonitorInterval for a new monitor interval,
+	// whose first |max_tracked_packets| packet numbers are tracked in
+	// packet_states. In RTT_STATS_HALF_SPLIT, as many runs of RTT samples
+	// are kept. The storage of both is retained.
+	void Reset(QuicBandwidth sending_rate,
 		bool is_useful,
 		float rtt_fluctuation_tolerance_ratio,
 		int64_t rtt_us,
-		QuicTime end_time);
+		QuicTime end_time,
+		RttStatsMode rtt_stats_mode,
+		size_t max_tracked_packets);
+
+	// Relative RTT growth over the interval, derived from |rtt_samples| as
+	// their RttStatsMode selects.
+	float LatencyInflation() const;
+
+	// Adds |packet_number|, which must be above the interval's packets, and
+	// its |bytes| sent at |sent_time|.
+	void OnPacketSent(QuicTime sent_time, QuicPacketNumber packet_number, QuicByteCount bytes);
+	// Marks |packet_number| acked and adds |rtt_us|, measured by an ack at
+	// |event_time|, as its RTT sample, unless it was acked before or never
+	// sent. The sample is fitted at the send time of the packet it was
+	// measured on, |event_time| - |rtt_us|. Returns whether it marked it,
+	// with whether it had been considered as lost in |was_lost|. The common
+	// case of OnPacketsAcked(), kept apart as it runs for every acked packet.
+	bool OnPacketAcked(QuicPacketNumber packet_number, int64_t rtt_us, QuicTime event_time, bool* was_lost);
+	// Marks |packet_number| lost, unless it was acked or lost before or never
+	// sent. Returns whether it marked it.
+	bool OnPacketLost(QuicPacketNumber packet_number);
+	// Marks the packets of the interval from |first_packet_number| to
+	// |last_packet_number| acked and adds |rtt_us|, measured at |event_time|,
+	// as their RTT samples, except packets acked before or never sent.
+	// Returns how many it marked, with how many of them had been considered
+	// as lost in |num_reversed|.
+	QuicPacketCount OnPacketsAcked(QuicPacketNumber first_packet_number,
+		QuicPacketNumber last_packet_number,
+		int64_t rtt_us,
+		QuicTime event_time,
+		QuicPacketCount* num_reversed);
+	// Marks the packets of the interval from |first_packet_number| to
+	// |last_packet_number| lost, except packets acked or lost before or never
+	// sent. Returns how many it marked.
+	QuicPacketCount OnPacketsLost(QuicPacketNumber first_packet_number,
+		QuicPacketNumber last_packet_number);
+	// Returns true if the packets from |first_packet_number| to
+	// |last_packet_number| were all sent in the interval and are neither
+	// acked nor lost. Packets past num_tracked_packets are taken as such.
+	bool ArePacketsOutstanding(QuicPacketNumber first_packet_number,
+		QuicPacketNumber last_packet_number) const;
+	// Number of packets neither acked nor lost.
+	QuicPacketCount packets_outstanding() const { return n_packets - packets_acked - packets_lost; }
+
+	// Appends the interval, with its RTT samples, to |writer|, and reads an
+	// interval so written back from |reader|, tracking |max_tracked_packets|
+	// and keeping RTT sample runs as Reset() does. RestoreSnapshot returns
+	// false if it is malformed.
+	void SaveSnapshot(SnapshotWriter* writer) const;
+	bool RestoreSnapshot(SnapshotReader* reader, size_t max_tracked_packets);
 
 	// Sending rate.
 	QuicBandwidth sending_rate = 0;
@@ -90,8 +245,101 @@ struct MonitorInterval
 
 	// The number of packets in this monitor interval.
 	int n_packets = 0;
-	// A sample of the RTT for each packet.
-	std::vector<PacketRttSample> packet_rtt_samples;
+	// Number of the packets which have been acked, and which are considered
+	// as lost. An ACK of a lost packet moves it from one to the other, and
+	// repeated ACKs and losses are not counted again.
+	QuicPacketCount packets_acked = 0;
+	QuicPacketCount packets_lost = 0;
+	// The RTT samples of the acked packets.
+	RttSampleAccumulator rtt_samples;
+	// State of the packets from first_packet_number on, 64 to a word, for the
+	// first |num_tracked_packets| packet numbers. Packet numbers the sender
+	// skipped are never sent. The storage is retained across Reset(), and
+	// the queue reserves it up front, so it never grows past that.
+	std::vector<PacketStateWord> packet_states;
+	// Packet numbers covered by packet_states, a multiple of 64. The packets
+	// after them are counted as they are reported, like the packets of an
+	// AggregateMonitorInterval: an ack is not told apart from a repeated one
+	// or from the ack of a packet counted as lost.
+	size_t num_tracked_packets = 0;
+};
+
+// AggregateMonitorInterval, a useful MonitorInterval measured with counters
+// alone, without per-packet state, for the quiescent fast path of a
+// BasicCongestionController (see PccConfig::quiescent_rounds). Acks and
+// losses above every packet reported before are counted exactly as the
+// queue counts them, down to the RTT samples. Those below may repeat an
+// earlier report, or ack a packet counted as lost, which the counters cannot
+// tell; they are counted as they come, and as inexact, as are packet
+// numbers the sender skipped, which a range may cover.
+
+class AggregateMonitorInterval
+{
+public:
+	// Reserves the storage Reset() keeps RTT sample runs in, so that the
+	// interval never allocates.
+	void Reserve(RttStatsMode rtt_stats_mode, size_t max_rtt_runs);
+	// As MonitorInterval::Reset() for a useful interval, which keeps up to
+	// |max_rtt_runs| runs of RTT samples in RTT_STATS_HALF_SPLIT.
+	void Reset(QuicBandwidth sending_rate,
+		float rtt_fluctuation_tolerance_ratio,
+		int64_t rtt_us,
+		QuicTime end_time,
+		RttStatsMode rtt_stats_mode,
+		size_t max_rtt_runs);
+
+	// Adds |packet_number|, which must be above the interval's packets, and
+	// its |bytes| sent at |sent_time|.
+	void OnPacketSent(QuicTime sent_time, QuicPacketNumber packet_number, QuicByteCount bytes);
+	// Adds the acked and lost packets of a congestion event that belong to
+	// the interval at |event_time|. Each list is taken in packet number
+	// order.
+	void OnCongestionEvent(const AckedPacketVector& acked_packets,
+		const LostPacketVector& lost_packets,
+		int64_t rtt_us,
+		QuicTime event_time);
+	// Same as above for ranges of packets, whose bytes are split as the queue
+	// splits them.
+	void OnCongestionEvent(const PacketNumberRangeVector& acked_ranges,
+		const PacketNumberRangeVector& lost_ranges,
+		int64_t rtt_us,
+		QuicTime event_time);
+	// Counts the packets neither acked nor lost as lost, with |rtt_us| as the
+	// RTT at the end, as BasicMonitorIntervalQueue::OnTimer() does.
+	void OnTimeout(int64_t rtt_us);
+
+	// Returns true if the interval has ended by |now| and as many packets
+	// were acked or lost as were sent.
+	bool IsComplete(QuicTime now) const;
+	// Packets sent, whose packet_states stay empty, and counters.
+	const MonitorInterval& interval() const { return interval_; }
+	MonitorInterval* mutable_interval() { return &interval_; }
+	// Packets reported out of order and packet numbers skipped, which the
+	// counters may be off by.
+	QuicPacketCount num_inexact_packets() const { return num_inexact_packets_; }
+
+private:
+	// Counts the packets from |first_packet_number| to |last_packet_number|,
+	// all of the interval, as acked with |bytes| in total and |rtt_us|,
+	// measured at |event_time|, as their RTT sample, or as lost.
+	void OnPacketsAcked(QuicPacketNumber first_packet_number,
+		QuicPacketNumber last_packet_number,
+		QuicByteCount bytes,
+		int64_t rtt_us,
+		QuicTime event_time);
+	void OnPacketsLost(QuicPacketNumber first_packet_number,
+		QuicPacketNumber last_packet_number,
+		QuicByteCount bytes);
+	// Counts the packets from |first_packet_number| to |last_packet_number|
+	// as reported, and as inexact if any was at or below a packet reported
+	// before.
+	void OnPacketsReported(QuicPacketNumber first_packet_number,
+		QuicPacketNumber last_packet_number);
+
+	MonitorInterval interval_;
+	// One above the highest packet reported so far.
+	QuicPacketNumber next_reported_packet_number_ = 0;
+	QuicPacketCount num_inexact_packets_ = 0;
 };
 
 // UtilityInfo is used to store <sending_rate, utility> pairs
@@ -104,89 +352,286 @@ struct UtilityInfo
 	float utility = 0.0f;
 };
 
+// UtilityInfoSpan, a read-only view of consecutive UtilityInfos, such as
+// the utilities a queue reports from its own storage. Valid only as long as
+// the storage it views.
+
+class UtilityInfoSpan
+{
+public:
+	UtilityInfoSpan() = default;
+	UtilityInfoSpan(const UtilityInfo* data, size_t size) :
+		data_(data),
+		size_(size)
+	{
+	}
+	UtilityInfoSpan(const std::vector<UtilityInfo>& utility_info) :
+		data_(utility_info.data()),
+		size_(utility_info.size())
+	{
+	}
+
+	const UtilityInfo& operator[](size_t index) const { return data_[index]; }
+	const UtilityInfo* begin() const { return data_; }
+	const UtilityInfo* end() const { return data_ + size_; }
+	const UtilityInfo* data() const { return data_; }
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+
+private:
+	const UtilityInfo* data_ = nullptr;
+	size_t size_ = 0;
+};
+
+// Receives the utilities of a queue's useful intervals once all of them are
+// available. A queue calls any class with a matching OnUtilityAvailable()
+// directly, given as its Delegate; this interface is its default, for
+// delegates chosen at run time.
+
 class MonitorIntervalQueueDelegateInterface
 {
 public:
 	virtual ~MonitorIntervalQueueDelegateInterface() = default;
-	virtual void OnUtilityAvailable(const std::vector<UtilityInfo>& utility_info) = 0;
+	virtual void OnUtilityAvailable(UtilityInfoSpan utility_info) = 0;
 	
 };
 
-// MonitorIntervalQueue contains a queue of MonitorIntervals.
+// The Vivace latency-based utility, defined in UtilityFunctions.h with the
+// other utility functions.
+struct VivaceLatencyUtility;
+// Defined in PccConfig.h.
+struct PccConfig;
+
+// BasicMonitorIntervalQueue contains a queue of MonitorIntervals.
 // New MonitorIntervals are added to the tail of the queue.
 // Existing MonitorIntervals are removed from the queue when all
 // 'useful' intervals' utilities are available.
-
-class MonitorIntervalQueue
+// The queue is a fixed-capacity ring whose slots, including their sample
+// storage, are recycled, so it does not allocate once warmed up.
+//
+// |UtilityFunction| computes the utility of a completed interval, see
+// UtilityFunctions.h. |Delegate| receives the utilities through a
+// non-virtual OnUtilityAvailable(UtilityInfoSpan). The queue is instantiated
+// for the utility functions declared there, with the virtual
+// MonitorIntervalQueueDelegateInterface and with the BasicCongestionController
+// of the same utility function as delegates.
+
+template <class UtilityFunction, class Delegate = MonitorIntervalQueueDelegateInterface>
+class BasicMonitorIntervalQueue
 {
 public:
-	explicit MonitorIntervalQueue(MonitorIntervalQueueDelegateInterface& delegate);
-	MonitorIntervalQueue(const MonitorIntervalQueue&) = delete;
-	MonitorIntervalQueue& operator=(const MonitorIntervalQueue&) = delete;
-	MonitorIntervalQueue(MonitorIntervalQueue&&) = delete;
-	MonitorIntervalQueue& operator=(MonitorIntervalQueue&&) = delete;
+	// Number of intervals held by default.
+	static const size_t kDefaultCapacity = 16;
+	// NextDeadline() of a queue without useful intervals.
+	static constexpr QuicTime kNoDeadline = INT64_MAX;
+
+	// Uses PccConfig::Default().
+	BasicMonitorIntervalQueue(Delegate& delegate,
+		size_t capacity = kDefaultCapacity);
+	// Uses |config|, which must outlive the queue.
+	BasicMonitorIntervalQueue(Delegate& delegate,
+		const PccConfig& config,
+		size_t capacity = kDefaultCapacity);
+	// Keeps the intervals in |storage|, which is not owned and must hold
+	// |capacity| intervals, so many queues can share one contiguous slab.
+	BasicMonitorIntervalQueue(Delegate& delegate,
+		const PccConfig& config,
+		MonitorInterval* storage,
+		size_t capacity);
+	BasicMonitorIntervalQueue(const BasicMonitorIntervalQueue&) = delete;
+	BasicMonitorIntervalQueue& operator=(const BasicMonitorIntervalQueue&) = delete;
+	BasicMonitorIntervalQueue(BasicMonitorIntervalQueue&&) = delete;
+	BasicMonitorIntervalQueue& operator=(BasicMonitorIntervalQueue&&) = delete;
 
 	// Creates a new MonitorInterval and add it to the tail of the
 	// monitor interval queue, provided the necessary variables
 	// for MonitorInterval initialization.
-	void EnqueueNewMonitorInterval(QuicBandwidth sending_rate,
+	// When the queue is full, the slot of a non-useful interval is reused
+	// since its packets are never evaluated. Returns false, and keeps
+	// attributing packets to the current interval, when every slot holds a
+	// useful interval.
+	bool EnqueueNewMonitorInterval(QuicBandwidth sending_rate,
 		bool is_useful,
 		float rtt_fluctuation_tolerance_ratio,
 		int64_t rtt_us,
 		QuicTime end_time);
 
 	// Called when a packet belonging to current monitor interval is sent.
+	// A packet numbered no higher than one sent before is a retransmission
+	// under the original's number, and left to the original's interval.
 	void OnPacketSent(QuicTime sent_time,
 		QuicPacketNumber packet_number,
 		QuicByteCount bytes);
 
-	// Called when packets are acked or considered as lost.
+	// Called when packets are acked or considered as lost. Packets may be
+	// reported out of order, more than once, or acked after they were
+	// considered as lost, in which case they count as acked. More than 256
+	// acks or losses out of order are taken as consecutive events of 256.
 	void OnCongestionEvent(const AckedPacketVector& acked_packets,
 		const LostPacketVector& lost_packets,
 		int64_t rtt_us,
 		QuicTime event_time);
+	// Called when ranges of packets are acked or considered as lost. Their
+	// bytes are split among the intervals the ranges overlap in proportion to
+	// the packets of the range in each. Ranges may come in any order, such as
+	// from the highest packet number down as in a QUIC ACK frame, and more
+	// than 256 out of order are taken as consecutive events of 256.
+	void OnCongestionEvent(const PacketNumberRangeVector& acked_ranges,
+		const PacketNumberRangeVector& lost_ranges,
+		int64_t rtt_us,
+		QuicTime event_time);
+
+	// Returns the time from which OnTimer() completes the useful intervals,
+	// given the smoothed |rtt_us|, or kNoDeadline if there are none. That is
+	// the latest of their end times, or of their end times plus the config's
+	// monitor_interval_timeout_rtts for those with packets neither acked nor
+	// lost. Changes with every call to the queue.
+	QuicTime NextDeadline(int64_t rtt_us) const;
+	// Returns a time no later than NextDeadline(), whatever the RTT, without
+	// going through the intervals.
+	QuicTime EarliestDeadline() const { return num_useful_intervals_ == 0 ? kNoDeadline : useful_end_time_; }
+	// Called when no ACK may come in time, such as after the last packets of
+	// an interval were lost silently. From NextDeadline() on, counts the
+	// outstanding bytes of the useful intervals as lost and reports their
+	// utilities, as OnCongestionEvent() would once every useful interval is
+	// complete. Does nothing before.
+	void OnTimer(QuicTime now, int64_t rtt_us);
 
 	// Called when RTT inflation ratio is greater than
 	// max_rtt_fluctuation_tolerance_ratio_in_starting.
 	void OnRttInflationInStarting();
 
+	// Selects how latency inflation is computed for the intervals enqueued
+	// from now on, initially the config's rtt_stats_mode.
+	void set_rtt_stats_mode(RttStatsMode mode) { rtt_stats_mode_ = mode; }
+	RttStatsMode rtt_stats_mode() const { return rtt_stats_mode_; }
+
+	// Identifies the queue's records in a Trace, normally with the id of its
+	// controller.
+	void set_trace_id(uint32_t trace_id) { trace_id_ = trace_id; }
+
 	// Returns the most recent MonitorInterval in the tail of the queue
 	const MonitorInterval& current() const;
+	// Returns the |index|-th interval counted from the head of the queue.
+	const MonitorInterval& interval(size_t index) const { return at(index); }
 	size_t num_useful_intervals() const { return num_useful_intervals_; }
 	size_t num_available_intervals() const { return num_available_intervals_; }
 	bool empty() const;
 	size_t size() const;
+	size_t capacity() const { return capacity_; }
+	// Number of intervals that could not be enqueued for lack of space.
+	size_t num_overflows() const { return num_overflows_; }
+	// Highest packet number sent, or -1 before the first packet.
+	int64_t largest_sent_packet_number() const { return largest_sent_packet_number_; }
+	// Takes the packets up to |packet_number| as sent, for packets measured
+	// outside the queue, so that it keeps taking any packet numbered no
+	// higher for a retransmission.
+	void AdvanceLargestSentPacketNumber(int64_t packet_number);
+	// Counts since the queue was created, which snapshots leave out.
+	uint64_t num_intervals_created() const { return num_intervals_created_; }
+	uint64_t num_useful_intervals_created() const { return num_useful_intervals_created_; }
+	// Useful intervals removed before their utilities were reported.
+	uint64_t num_discarded_intervals() const { return num_discarded_intervals_; }
+	uint64_t num_invalid_utilities() const { return num_invalid_utilities_; }
+
+	// Appends the intervals and counters of the queue to |writer|.
+	void SaveSnapshot(SnapshotWriter* writer) const;
+	// Replaces the intervals and counters with those SaveSnapshot() wrote to
+	// |reader|, which must hold nothing else. Returns false, and leaves the
+	// queue as it was, if they are malformed or do not fit in the queue.
+	bool RestoreSnapshot(SnapshotReader* reader);
+
+	// Calculates utility for |interval| with |UtilityFunction|. Returns true if
+	// |interval| has valid utility, false otherwise.
+	bool CalculateUtility(MonitorInterval* interval);
 
 private:
+	// Returns the |index|-th interval counted from the head of the queue.
+	MonitorInterval& at(size_t index);
+	const MonitorInterval& at(size_t index) const;
+	// Removes the interval at the head of the queue.
+	void PopFront();
+	// Reserves the packet_states and RTT sample runs of every interval slot,
+	// so that tracking packets never allocates.
+	void ReserveIntervalStorage();
+
 	// Returns true if the utility of |interval| is available, i.e.,
-	// when all the interval's packets are either acked or lost.
+	// when all the interval's packets are either acked or lost, once it has
+	// ended.
 	bool IsUtilityAvailable(const MonitorInterval& interval,
 		QuicTime cur_time) const;
 
+	// Finishes a congestion event: calls |attribute_packets| with every useful
+	// interval whose utility is not yet available, in packet number order, to
+	// add the event's packets to it, then reports the utilities if all are
+	// available.
+	template <class AttributePackets>
+	void ProcessCongestionEvent(int64_t rtt_us, QuicTime event_time, AttributePackets attribute_packets);
+	// Reports the utilities of the useful intervals, unless one of them is
+	// invalid, and removes the intervals up to the last useful one.
+	void ReportUtilities(bool has_invalid_utility);
+
 	// Retruns true if |packet_number| belongs to |interval|.
 	bool IntervalContainsPacket(const MonitorInterval& interval,
 		QuicPacketNumber packet_number) const;
 
-#ifdef QUIC_PORT
-	// Calculates utility for |interval|. Returns true if |interval| has valid
-	// utility, false otherwise.
-	bool CalculateUtility(MonitorInterval* interval);
-	// Calculates utility for |interval| using version-2 utility function. Returns
-	// true if |interval| has valid utility, false otherwise.
-	bool CalculateUtility2(MonitorInterval* interval);
-#else
-	// Calculates utility for |interval|. Returns true if |interval| has valid
-	// utility, false otherwise.
-	bool CalculateUtility(MonitorInterval* interval);
-#endif
-
-	std::deque<MonitorInterval> monitor_intervals_;
+	// OnCongestionEvent() with acks and losses, or acked and lost ranges, each
+	// in packet number order.
+	void OnSortedPackets(const CongestionEvent* acks,
+		size_t num_acks,
+		const CongestionEvent* losses,
+		size_t num_losses,
+		int64_t rtt_us,
+		QuicTime event_time);
+	void OnSortedRanges(const PacketNumberRange* acks,
+		size_t num_acks,
+		const PacketNumberRange* losses,
+		size_t num_losses,
+		int64_t rtt_us,
+		QuicTime event_time);
+	// Marks the packets of |range| within |interval| lost or acked, with
+	// their share of its bytes. Returns how many it marked.
+	QuicPacketCount LoseRange(MonitorInterval* interval, const PacketNumberRange& range);
+	QuicPacketCount AckRange(MonitorInterval* interval, const PacketNumberRange& range, int64_t rtt_us, QuicTime event_time);
+	// Traces the packets attributed to |interval| by a congestion event.
+	void TraceIntervalPackets(const MonitorInterval& interval, size_t num_acked, size_t num_lost) const;
+
+	// Storage of the ring when the queue owns it.
+	std::vector<MonitorInterval> owned_intervals_;
+	// Ring of |size_| intervals starting at slot |head_|.
+	MonitorInterval* intervals_;
+	size_t capacity_;
+	size_t head_ = 0;
+	size_t size_ = 0;
+	// Number of intervals dropped because the ring was full.
+	size_t num_overflows_ = 0;
+	// Highest packet number sent, or -1 before the first packet.
+	int64_t largest_sent_packet_number_ = -1;
+	// Latest end time of the useful intervals, before which no deadline
+	// passes.
+	QuicTime useful_end_time_ = 0;
+	// Storage for the utilities reported to the delegate, one per slot,
+	// allocated with the queue.
+	std::vector<UtilityInfo> utility_info_;
+	// Tuning of the utility function, not owned.
+	const PccConfig& config_;
+	// How latency inflation is derived from the RTT samples.
+	RttStatsMode rtt_stats_mode_;
 	// Number of useful intervals in the queue.
 	size_t num_useful_intervals_ = 0;
 	// Number of useful intervals in the queue with available utilities.
 	size_t num_available_intervals_ = 0;
-	// Delegate interface, not owned.
-	MonitorIntervalQueueDelegateInterface& delegate_;
+	uint64_t num_intervals_created_ = 0;
+	uint64_t num_useful_intervals_created_ = 0;
+	uint64_t num_discarded_intervals_ = 0;
+	uint64_t num_invalid_utilities_ = 0;
+	// Controller id the queue's trace records carry.
+	uint32_t trace_id_ = 0;
+	// Not owned.
+	Delegate& delegate_;
 };
 
+// The queue of the Vivace latency-based utility, the default.
+typedef BasicMonitorIntervalQueue<VivaceLatencyUtility> MonitorIntervalQueue;
+
 #endif  // THIRD_PARTY_PCC_QUIC_PCC_MONITOR_QUEUE_H_
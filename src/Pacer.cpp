@@ -0,0 +1,130 @@
+#include "Pacer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Number of microseconds per second.
+	const double kNumMicrosPerSecond = 1000000.0;
+	// Number of bits per byte.
+	const double kBitsPerByte = 8.0;
+} // namespace
+
+Pacer::Pacer(size_t max_flows, QuicTime granularity_us) :
+	granularity_us_(std::max<QuicTime>(granularity_us, 1)),
+	flows_(max_flows),
+	wheel_(max_flows)
+{
+	for (size_t i = 0; i < max_flows; ++i)
+	{
+		flows_[i].observer.pacer = this;
+		flows_[i].observer.flow = static_cast<FlowId> (i);
+	}
+}
+
+void Pacer::AddFlow(FlowId flow, QuicBandwidth pacing_rate, QuicTime now, QuicByteCount max_burst_bytes)
+{
+	Advance(now);
+	FlowState& state = flows_[flow];
+	state.active = true;
+	state.application_limited = false;
+	state.pacing_rate = pacing_rate;
+	state.max_burst_bytes = max_burst_bytes;
+	// Start with the full burst allowance banked.
+	state.next_send_time_us = static_cast<double> (now_) - TransmissionTimeUs(max_burst_bytes, pacing_rate);
+	Schedule(flow);
+}
+
+void Pacer::RemoveFlow(FlowId flow)
+{
+	flows_[flow].active = false;
+	wheel_.Cancel(flow);
+}
+
+void Pacer::SetPacingRate(FlowId flow, QuicBandwidth pacing_rate)
+{
+	FlowState& state = flows_[flow];
+	if (pacing_rate == state.pacing_rate)
+		return;
+
+	// Keep the bytes owed, or banked, rather than the time.
+	double now = static_cast<double> (now_);
+	if (state.pacing_rate > 0 && pacing_rate > 0)
+		state.next_send_time_us = now + (state.next_send_time_us - now) * state.pacing_rate / pacing_rate;
+	else
+		state.next_send_time_us = now;
+	state.pacing_rate = pacing_rate;
+	Schedule(flow);
+}
+
+void Pacer::SetApplicationLimited(FlowId flow, bool application_limited)
+{
+	flows_[flow].application_limited = application_limited;
+	Schedule(flow);
+}
+
+void Pacer::OnPacketSent(FlowId flow, QuicTime sent_time, QuicByteCount bytes)
+{
+	Advance(sent_time);
+	FlowState& state = flows_[flow];
+	if (state.pacing_rate <= 0)
+		return;
+
+	// Credit beyond the burst allowance is lost while the flow is idle.
+	double earliest = static_cast<double> (sent_time) - TransmissionTimeUs(state.max_burst_bytes, state.pacing_rate);
+	state.next_send_time_us = std::max(state.next_send_time_us, earliest) + TransmissionTimeUs(bytes, state.pacing_rate);
+	Schedule(flow);
+}
+
+bool Pacer::NextFlowToSend(QuicTime now, FlowId* flow)
+{
+	Advance(now);
+	if (!wheel_.has_expired())
+		return false;
+	*flow = wheel_.first_expired();
+	return true;
+}
+
+QuicTime Pacer::TimeUntilNextSend(QuicTime now)
+{
+	Advance(now);
+	uint64_t tick = wheel_.NextDeadlineBound();
+	if (tick == TimingWheel::kNever)
+		return kNoSendPending;
+	return std::max<QuicTime>(0, static_cast<QuicTime> (tick) * granularity_us_ - now_);
+}
+
+QuicTime Pacer::NextSendTime(FlowId flow) const
+{
+	return static_cast<QuicTime> (std::ceil(flows_[flow].next_send_time_us));
+}
+
+void Pacer::Schedule(FlowId flow)
+{
+	const FlowState& state = flows_[flow];
+	if (!state.active || state.application_limited || state.pacing_rate <= 0)
+	{
+		wheel_.Cancel(flow);
+		return;
+	}
+
+	double tick = std::ceil(state.next_send_time_us / static_cast<double> (granularity_us_));
+	wheel_.Set(flow, tick <= 0 ? 0 : static_cast<uint64_t> (tick));
+}
+
+void Pacer::Advance(QuicTime now)
+{
+	now_ = std::max(now_, now);
+	wheel_.Advance(static_cast<uint64_t> (now_ / granularity_us_));
+}
+
+double Pacer::TransmissionTimeUs(QuicByteCount bytes, QuicBandwidth pacing_rate)
+{
+	return static_cast<double> (bytes) * kBitsPerByte * kNumMicrosPerSecond / pacing_rate;
+}
+
+void Pacer::FlowRateObserver::OnPacingRateChanged(QuicBandwidth pacing_rate)
+{
+	pacer->SetPacingRate(flow, pacing_rate);
+}
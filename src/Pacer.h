@@ -0,0 +1,107 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_PACER_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_PACER_H_
+
+#include <vector>
+
+#include "CongestionController.h"
+#include "FlowTable.h"
+#include "TimingWheel.h"
+
+// Pacer turns the pacing rates of many flows into send times. Each flow may
+// send a packet once its next send time has passed, which each packet pushes
+// back by the packet's duration at the flow's rate. A flow that has been
+// idle may run up to its burst allowance ahead of that schedule, so it sends
+// the allowance in addition to the packet that is due. The flows wait in a
+// TimingWheel, so the event loop can ask for the next flow due to send and
+// how long to sleep until one is.
+//
+// Flows that have nothing to send should be marked application limited, so
+// that they do not appear as due. Idle flows bank no credit beyond the burst
+// allowance.
+
+class Pacer
+{
+public:
+	// Burst allowance of a flow by default, one full sized packet, so an idle
+	// flow sends two back to back.
+	static constexpr QuicByteCount kDefaultMaxBurstBytes = 1400;
+	// Returned by TimeUntilNextSend() when no flow is waiting to send.
+	static constexpr QuicTime kNoSendPending = INT64_MAX;
+
+	// Creates a pacer for flows with ids below |max_flows|, whose send times
+	// are rounded up to multiples of |granularity_us| microseconds.
+	explicit Pacer(size_t max_flows, QuicTime granularity_us = 1);
+	Pacer(const Pacer&) = delete;
+	Pacer& operator=(const Pacer&) = delete;
+
+	// Starts pacing |flow| at |pacing_rate| in bits per second, with a burst
+	// allowance of |max_burst_bytes|, which it may use right away.
+	void AddFlow(FlowId flow,
+		QuicBandwidth pacing_rate,
+		QuicTime now,
+		QuicByteCount max_burst_bytes = kDefaultMaxBurstBytes);
+	void RemoveFlow(FlowId flow);
+
+	// Changes the rate of |flow|. The time the flow still owes for the packets
+	// it has sent is rescaled to the new rate at once.
+	void SetPacingRate(FlowId flow, QuicBandwidth pacing_rate);
+	// An observer that calls SetPacingRate() for |flow|, for
+	// BasicCongestionController::set_pacing_rate_observer.
+	PacingRateObserverInterface* rate_observer(FlowId flow) { return &flows_[flow].observer; }
+	// Whether |flow| has nothing to send.
+	void SetApplicationLimited(FlowId flow, bool application_limited);
+
+	// Charges |flow| for a packet of |bytes| sent at |sent_time|.
+	void OnPacketSent(FlowId flow, QuicTime sent_time, QuicByteCount bytes);
+
+	// Stores a flow that may send at |now| in |flow|, or returns false if none
+	// may. Flows due at once are returned in the order they became due, and a
+	// flow stays due until it sends.
+	bool NextFlowToSend(QuicTime now, FlowId* flow);
+	// Time from |now| until a flow may send, 0 if one may now, or
+	// kNoSendPending. Never later than the next send, and exact within 64
+	// ticks of the granularity.
+	QuicTime TimeUntilNextSend(QuicTime now);
+
+	// Earliest time |flow| may send.
+	QuicTime NextSendTime(FlowId flow) const;
+	QuicBandwidth pacing_rate(FlowId flow) const { return flows_[flow].pacing_rate; }
+
+private:
+	class FlowRateObserver : public PacingRateObserverInterface
+	{
+	public:
+		void OnPacingRateChanged(QuicBandwidth pacing_rate) override;
+
+		Pacer* pacer = nullptr;
+		FlowId flow = 0;
+	};
+
+	struct FlowState
+	{
+		bool active = false;
+		bool application_limited = false;
+		QuicBandwidth pacing_rate = 0;
+		QuicByteCount max_burst_bytes = 0;
+		// Time the flow may send next in microseconds, kept fractional so that
+		// rounding does not accumulate.
+		double next_send_time_us = 0.0;
+		FlowRateObserver observer;
+	};
+
+	// Files |flow| in the wheel by its next send time, or removes it if it
+	// cannot send.
+	void Schedule(FlowId flow);
+	// Moves the wheel to |now|.
+	void Advance(QuicTime now);
+	// Microseconds |bytes| take to send at |pacing_rate|.
+	static double TransmissionTimeUs(QuicByteCount bytes, QuicBandwidth pacing_rate);
+
+	QuicTime granularity_us_;
+	// Latest time passed to the pacer, used for rate changes.
+	QuicTime now_ = 0;
+	std::vector<FlowState> flows_;
+	TimingWheel wheel_;
+};
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_PACER_H_
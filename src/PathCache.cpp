@@ -0,0 +1,127 @@
+#include "PathCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Stripes of a cache large enough to need them all.
+	const size_t kMaxStripes = 16;
+	// Entries of a stripe at least, so that small caches are not split
+	// finer than their keys spread.
+	const size_t kMinEntriesPerStripe = 64;
+
+	// Spreads the bits of |destination|, which may be a poorly mixed key
+	// such as an address, over all of the result (splitmix64's finalizer).
+	uint64_t MixKey(uint64_t destination)
+	{
+		destination = (destination ^ (destination >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		destination = (destination ^ (destination >> 27)) * 0x94D049BB133111EBULL;
+		return destination ^ (destination >> 31);
+	}
+} // namespace
+
+PathCache::PathCache(const PathCacheConfig& config) :
+	config_(config)
+{
+	size_t max_entries = std::max<size_t>(config_.max_entries, 1);
+	num_stripes_ = std::min(kMaxStripes, std::max<size_t>(max_entries / kMinEntriesPerStripe, 1));
+	max_entries_per_stripe_ = (max_entries + num_stripes_ - 1) / num_stripes_;
+	stripes_.reset(new Stripe[num_stripes_]);
+	for (size_t i = 0; i < num_stripes_; ++i)
+		stripes_[i].entries.reserve(max_entries_per_stripe_ + 1);
+}
+
+void PathCache::Record(uint64_t destination, const PathInfo& info)
+{
+	Stripe& stripe = StripeOf(destination);
+	std::lock_guard<std::mutex> lock(stripe.mutex);
+	auto entry = stripe.entries.find(destination);
+	if (entry != stripe.entries.end())
+	{
+		entry->second = info;
+		return;
+	}
+	if (stripe.entries.size() >= max_entries_per_stripe_)
+		MakeRoom(&stripe, info.record_time);
+	stripe.entries.emplace(destination, info);
+}
+
+bool PathCache::Lookup(uint64_t destination, QuicTime now, PathInfo* info)
+{
+	Stripe& stripe = StripeOf(destination);
+	std::unique_lock<std::mutex> lock(stripe.mutex);
+	auto entry = stripe.entries.find(destination);
+	if (entry == stripe.entries.end())
+	{
+		lock.unlock();
+		num_misses_.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	QuicTime age = std::max<QuicTime>(now - entry->second.record_time, 0);
+	if (age > config_.expiry_us)
+	{
+		stripe.entries.erase(entry);
+		lock.unlock();
+		num_expirations_.fetch_add(1, std::memory_order_relaxed);
+		num_misses_.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	*info = entry->second;
+	lock.unlock();
+
+	if (config_.rate_half_life_us > 0)
+		info->sending_rate *= std::exp2(-static_cast<double> (age) / config_.rate_half_life_us);
+	num_hits_.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+void PathCache::Remove(uint64_t destination)
+{
+	Stripe& stripe = StripeOf(destination);
+	std::lock_guard<std::mutex> lock(stripe.mutex);
+	stripe.entries.erase(destination);
+}
+
+size_t PathCache::size() const
+{
+	size_t size = 0;
+	for (size_t i = 0; i < num_stripes_; ++i)
+	{
+		std::lock_guard<std::mutex> lock(stripes_[i].mutex);
+		size += stripes_[i].entries.size();
+	}
+	return size;
+}
+
+PathCache::Stripe& PathCache::StripeOf(uint64_t destination)
+{
+	return stripes_[MixKey(destination) % num_stripes_];
+}
+
+void PathCache::MakeRoom(Stripe* stripe, QuicTime now)
+{
+	// Expired entries go first, then the least recently recorded one. Stripes
+	// are small, so a scan is cheaper than keeping them in order.
+	size_t num_expired = 0;
+	auto oldest = stripe->entries.end();
+	for (auto entry = stripe->entries.begin(); entry != stripe->entries.end();)
+	{
+		if (now - entry->second.record_time > config_.expiry_us)
+		{
+			entry = stripe->entries.erase(entry);
+			++num_expired;
+			continue;
+		}
+		if (oldest == stripe->entries.end() || entry->second.record_time < oldest->second.record_time)
+			oldest = entry;
+		++entry;
+	}
+	if (num_expired > 0)
+	{
+		num_expirations_.fetch_add(num_expired, std::memory_order_relaxed);
+		return;
+	}
+	stripe->entries.erase(oldest);
+	num_evictions_.fetch_add(1, std::memory_order_relaxed);
+}
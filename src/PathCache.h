@@ -0,0 +1,92 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_PATH_CACHE_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_PATH_CACHE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "MonitorIntervalQueue.h"
+
+// PathCacheConfig, the tuning of a PathCache.
+
+struct PathCacheConfig
+{
+	// Destinations kept at most. The least recently recorded one is evicted to
+	// make room for a new one.
+	size_t max_entries = 4096;
+	// Entries older than this, in microseconds, are dropped as stale.
+	QuicTime expiry_us = 60000000;
+	// Age in microseconds at which the rate of an entry counts half, as the
+	// path may have changed since.
+	QuicTime rate_half_life_us = 10000000;
+};
+
+// PathInfo, what a controller learned about the path to a destination.
+
+struct PathInfo
+{
+	// Rate the controller converged to.
+	QuicBandwidth sending_rate = 0;
+	// Smallest RTT the controller saw, in microseconds.
+	QuicTime min_rtt = 0;
+	// Time the info was recorded.
+	QuicTime record_time = 0;
+};
+
+// PathCache, what the controllers of past connections learned about the paths
+// to their destinations, for new connections to the same destinations to
+// start from (see BasicCongestionController::set_path_cache). Destinations
+// are 64-bit keys of the caller's choosing, such as a hash of the peer's
+// address. Any thread may call any method: the entries are split over
+// stripes that are locked on their own, so threads rarely contend.
+
+class PathCache
+{
+public:
+	explicit PathCache(const PathCacheConfig& config = PathCacheConfig());
+	PathCache(const PathCache&) = delete;
+	PathCache& operator=(const PathCache&) = delete;
+
+	// Records |info| for |destination|, replacing what was there.
+	void Record(uint64_t destination, const PathInfo& info);
+	// Stores the info on |destination| in |info|, with its rate decayed by its
+	// age at |now|, and returns true, unless there is none or it expired.
+	bool Lookup(uint64_t destination, QuicTime now, PathInfo* info);
+	// Forgets |destination|.
+	void Remove(uint64_t destination);
+
+	const PathCacheConfig& config() const { return config_; }
+	// Number of destinations cached.
+	size_t size() const;
+	uint64_t num_hits() const { return num_hits_.load(std::memory_order_relaxed); }
+	// Lookups that found no entry, including expired ones.
+	uint64_t num_misses() const { return num_misses_.load(std::memory_order_relaxed); }
+	uint64_t num_expirations() const { return num_expirations_.load(std::memory_order_relaxed); }
+	uint64_t num_evictions() const { return num_evictions_.load(std::memory_order_relaxed); }
+
+private:
+	struct Stripe
+	{
+		std::mutex mutex;
+		std::unordered_map<uint64_t, PathInfo> entries;
+	};
+
+	Stripe& StripeOf(uint64_t destination);
+	// Makes room for one more entry in |stripe|, which is locked, at |now|.
+	void MakeRoom(Stripe* stripe, QuicTime now);
+
+	PathCacheConfig config_;
+	// Entries kept in each stripe at most.
+	size_t max_entries_per_stripe_;
+	size_t num_stripes_;
+	std::unique_ptr<Stripe[]> stripes_;
+	std::atomic<uint64_t> num_hits_{0};
+	std::atomic<uint64_t> num_misses_{0};
+	std::atomic<uint64_t> num_expirations_{0};
+	std::atomic<uint64_t> num_evictions_{0};
+};
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_PATH_CACHE_H_
@@ -0,0 +1,175 @@
+#include "PccConfig.h"
+
+#include <cmath>
+
+namespace
+{
+	// Number of bits per Mbit.
+	const double kMegabit = 1024 * 1024;
+	// Most probing groups; the queue holds four intervals per group.
+	const size_t kMaxIntervalGroupsInProbing = 8;
+	// Largest coefficient the fixed-point arithmetic takes, so that products
+	// of coefficients and rates stay in range.
+	const double kMaxFixedPointCoefficient = 2147483648.0;
+	// Most packets per interval with tracked state, 3 MiB of state per
+	// interval.
+	const size_t kMaxTrackedPacketsPerInterval = 1 << 23;
+
+	bool Fail(const char* reason, std::string* error)
+	{
+		if (error != nullptr)
+			*error = reason;
+		return false;
+	}
+
+	bool IsFinite(double value)
+	{
+		return std::isfinite(value);
+	}
+
+	std::shared_ptr<const PccConfig> MakeDatacenter()
+	{
+		PccConfig config;
+		// RTT noise from interrupt coalescing and batching is large relative
+		// to microsecond RTTs.
+		config.max_rtt_fluctuation_tolerance_ratio_in_decision_made = 0.1f;
+		config.min_sending_rate = 100.0 * kMegabit;
+		config.minimum_rate_change = 10.0 * kMegabit;
+		config.minimum_packets_per_interval = 50;
+		// A 1% probe is still hundreds of Mbit/s on a 100G link.
+		config.probing_step_size = 0.01f;
+		config.decision_made_step_size = 0.01f;
+		config.max_decision_made_step_size = 0.05f;
+		// Utility gradients per Mbit/s are tiny at these rates.
+		config.utility_gradient_to_rate_change_factor = 100.0f * 1024 * 1024;
+		return std::make_shared<const PccConfig>(config);
+	}
+
+	std::shared_ptr<const PccConfig> MakeSatellite()
+	{
+		PccConfig config;
+		// Link-layer retransmissions and scheduling make the RTT jitter by
+		// tens of milliseconds.
+		config.max_rtt_fluctuation_tolerance_ratio_in_starting = 0.5f;
+		config.max_rtt_fluctuation_tolerance_ratio_in_decision_made = 0.1f;
+		config.min_sending_rate = 0.5 * kMegabit;
+		config.minimum_rate_change = 0.25 * kMegabit;
+		// Averages out the noise with more, and longer, probes, since each
+		// round costs seconds.
+		config.minimum_packets_per_interval = 20;
+		// Acks of a tail held up by link-layer retransmissions are late, not
+		// lost.
+		config.monitor_interval_timeout_rtts = 3.0f;
+		config.num_interval_groups_in_probing = 3;
+		// Random losses are common and not a sign of congestion.
+		config.vivace_utility.loss_tolerance = 0.05;
+		config.loss_utility.loss_tolerance = 0.1f;
+		return std::make_shared<const PccConfig>(config);
+	}
+} // namespace
+
+bool PccConfig::Validate(std::string* error) const
+{
+	if (!(max_rtt_fluctuation_tolerance_ratio_in_starting >= 0.0f && max_rtt_fluctuation_tolerance_ratio_in_starting < 1.0f))
+		return Fail("max_rtt_fluctuation_tolerance_ratio_in_starting must be in [0, 1)", error);
+	if (!(max_rtt_fluctuation_tolerance_ratio_in_decision_made >= 0.0f && max_rtt_fluctuation_tolerance_ratio_in_decision_made < 1.0f))
+		return Fail("max_rtt_fluctuation_tolerance_ratio_in_decision_made must be in [0, 1)", error);
+	if (!(min_sending_rate > 0.0 && IsFinite(min_sending_rate)))
+		return Fail("min_sending_rate must be positive", error);
+	if (!(minimum_rate_change > 0.0 && IsFinite(minimum_rate_change)))
+		return Fail("minimum_rate_change must be positive", error);
+	if (max_segment_size == 0)
+		return Fail("max_segment_size must be positive", error);
+	// A utility needs the send times of two packets.
+	if (minimum_packets_per_interval < 2)
+		return Fail("minimum_packets_per_interval must be at least 2", error);
+	// An interval's packets take an RTT to be acked after it ends.
+	if (!(monitor_interval_timeout_rtts >= 1.0f && IsFinite(monitor_interval_timeout_rtts)))
+		return Fail("monitor_interval_timeout_rtts must be at least 1", error);
+	if (max_tracked_packets_per_interval < 1 || max_tracked_packets_per_interval > kMaxTrackedPacketsPerInterval)
+		return Fail("max_tracked_packets_per_interval must be in [1, 2^23]", error);
+	if (!(probing_step_size > 0.0f && probing_step_size < 1.0f))
+		return Fail("probing_step_size must be in (0, 1)", error);
+	if (num_interval_groups_in_probing < 1 || num_interval_groups_in_probing > kMaxIntervalGroupsInProbing)
+		return Fail("num_interval_groups_in_probing must be in [1, 8]", error);
+	if (!(decision_made_step_size > 0.0f && decision_made_step_size <= max_decision_made_step_size))
+		return Fail("decision_made_step_size must be in (0, max_decision_made_step_size]", error);
+	if (!(max_decision_made_step_size < 1.0f))
+		return Fail("max_decision_made_step_size must be below 1", error);
+	if (!(utility_gradient_to_rate_change_factor > 0.0f && IsFinite(utility_gradient_to_rate_change_factor)))
+		return Fail("utility_gradient_to_rate_change_factor must be positive", error);
+	if (!(initial_maximum_proportional_change > 0.0f && initial_maximum_proportional_change <= 1.0f))
+		return Fail("initial_maximum_proportional_change must be in (0, 1]", error);
+	if (!(maximum_proportional_change_step_size >= 0.0f && IsFinite(maximum_proportional_change_step_size)))
+		return Fail("maximum_proportional_change_step_size must not be negative", error);
+	if (gradient_estimator != GRADIENT_PAIR && gradient_estimator != GRADIENT_WEIGHTED_LEAST_SQUARES)
+		return Fail("gradient_estimator is unknown", error);
+	// A fit needs two samples.
+	if (gradient_window < 2 || gradient_window > GradientEstimator::kMaxSamples)
+		return Fail("gradient_window must be in [2, 16]", error);
+	if (!(gradient_sample_decay > 0.0f && gradient_sample_decay <= 1.0f))
+		return Fail("gradient_sample_decay must be in (0, 1]", error);
+	if (!(min_gradient_confidence > 0.0f && min_gradient_confidence <= 1.0f))
+		return Fail("min_gradient_confidence must be in (0, 1]", error);
+	if (rtt_stats_mode != RTT_STATS_REGRESSION && rtt_stats_mode != RTT_STATS_HALF_SPLIT)
+		return Fail("rtt_stats_mode is unknown", error);
+	if (!(vivace_utility.exponent > 0.0f && vivace_utility.exponent <= 1.0f))
+		return Fail("vivace_utility.exponent must be in (0, 1]", error);
+	if (!(vivace_utility.alpha > 0.0f && IsFinite(vivace_utility.alpha)))
+		return Fail("vivace_utility.alpha must be positive", error);
+	if (!(vivace_utility.latency_coefficient >= 0.0f && IsFinite(vivace_utility.latency_coefficient)))
+		return Fail("vivace_utility.latency_coefficient must not be negative", error);
+	if (!(vivace_utility.loss_tolerance >= 0.0 && vivace_utility.loss_tolerance < 1.0))
+		return Fail("vivace_utility.loss_tolerance must be in [0, 1)", error);
+	if (!(vivace_utility.loss_coefficient >= 0.0 && IsFinite(vivace_utility.loss_coefficient)))
+		return Fail("vivace_utility.loss_coefficient must not be negative", error);
+	if (!(loss_utility.loss_tolerance >= 0.0f && loss_utility.loss_tolerance < 1.0f))
+		return Fail("loss_utility.loss_tolerance must be in [0, 1)", error);
+	if (!(loss_utility.loss_coefficient <= 0.0f && IsFinite(loss_utility.loss_coefficient)))
+		return Fail("loss_utility.loss_coefficient must not be positive", error);
+	if (!(loss_utility.rtt_coefficient <= 0.0f && IsFinite(loss_utility.rtt_coefficient)))
+		return Fail("loss_utility.rtt_coefficient must not be positive", error);
+	if (!(scavenger_rtt_deviation_coefficient >= 0.0f && IsFinite(scavenger_rtt_deviation_coefficient)))
+		return Fail("scavenger_rtt_deviation_coefficient must not be negative", error);
+	if (fixed_point_arithmetic && !(vivace_utility.latency_coefficient < kMaxFixedPointCoefficient
+		&& vivace_utility.loss_coefficient < kMaxFixedPointCoefficient
+		&& utility_gradient_to_rate_change_factor < kMaxFixedPointCoefficient))
+		return Fail("fixed_point_arithmetic requires coefficients below 2^31", error);
+	if (fixed_point_arithmetic && gradient_estimator != GRADIENT_PAIR)
+		return Fail("fixed_point_arithmetic requires the GRADIENT_PAIR gradient_estimator", error);
+	if (!(quiescent_gradient_tolerance >= 0.0f && IsFinite(quiescent_gradient_tolerance)))
+		return Fail("quiescent_gradient_tolerance must not be negative", error);
+	if (!(quiescent_inexact_tolerance >= 0.0f && quiescent_inexact_tolerance <= 1.0f))
+		return Fail("quiescent_inexact_tolerance must be in [0, 1]", error);
+	return true;
+}
+
+std::shared_ptr<const PccConfig> PccConfig::Create(const PccConfig& config, std::string* error)
+{
+	if (!config.Validate(error))
+		return nullptr;
+	return std::make_shared<const PccConfig>(config);
+}
+
+std::shared_ptr<const PccConfig> PccConfig::Default()
+{
+	static const std::shared_ptr<const PccConfig> config = std::make_shared<const PccConfig>();
+	return config;
+}
+
+std::shared_ptr<const PccConfig> PccConfig::Datacenter()
+{
+	static const std::shared_ptr<const PccConfig> config = MakeDatacenter();
+	return config;
+}
+
+std::shared_ptr<const PccConfig> PccConfig::Wan()
+{
+	return Default();
+}
+
+std::shared_ptr<const PccConfig> PccConfig::Satellite()
+{
+	static const std::shared_ptr<const PccConfig> config = MakeSatellite();
+	return config;
+}
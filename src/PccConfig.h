@@ -0,0 +1,138 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_CONFIG_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_CONFIG_H_
+
+#include <memory>
+#include <string>
+
+#include "GradientEstimator.h"
+#include "MonitorIntervalQueue.h"
+#include "VivaceUtility.h"
+
+// LossUtilityCoefficients, the constants of VivaceLossUtility.
+
+struct LossUtilityCoefficients
+{
+	// Tolerance of loss rate by utility function.
+	float loss_tolerance = 0.05f;
+	// Coefficeint of the loss rate term in utility function.
+	float loss_coefficient = -1000.0f;
+	// Coefficient of RTT term in utility function.
+	float rtt_coefficient = -200.0f;
+};
+
+// PccConfig, the tuning of a PCC sender. A controller keeps a shared pointer
+// to an immutable PccConfig, so any number of connections can share one.
+// Obtain valid configs from Create() or the presets; the defaults are the
+// Vivace constants, which the WAN preset uses as they are.
+
+struct PccConfig
+{
+	// Ignore RTT fluctuation within this ratio in STARTING mode.
+	float max_rtt_fluctuation_tolerance_ratio_in_starting = 0.3f;
+	// Ignore RTT fluctuation within this ratio in DECISION_MADE mode.
+	float max_rtt_fluctuation_tolerance_ratio_in_decision_made = 0.05f;
+
+	// Lowest sending rate in bits per second.
+	QuicBandwidth min_sending_rate = 2.0 * 1024 * 1024;
+	// The smallest amount in bits per second that the rate can be changed by
+	// at a time.
+	QuicBandwidth minimum_rate_change = 0.5 * 1024 * 1024;
+	// Size of the packets sent, used for the initial rate and the minimum
+	// interval duration.
+	size_t max_segment_size = 1400;
+	// Minimum number of packets per interval.
+	size_t minimum_packets_per_interval = 10;
+	// RTTs after the end of an interval that OnTimer() waits for its packets
+	// to be acked or lost before it counts the rest as lost.
+	float monitor_interval_timeout_rtts = 2.0f;
+	// Packets per monitor interval whose state is tracked, so that repeated
+	// acks, and acks of packets counted as lost, are told apart. The queue
+	// reserves the state of this many packets for each of its intervals up
+	// front; packets past them are counted as they are reported. In
+	// RTT_STATS_HALF_SPLIT, it also reserves as many runs of RTT samples.
+	size_t max_tracked_packets_per_interval = 4096;
+
+	// Step size for rate change in PROBING mode.
+	float probing_step_size = 0.05f;
+	// Groups of useful monitor intervals each time in PROBING mode. Each group
+	// probes one higher and one lower rate.
+	size_t num_interval_groups_in_probing = 2;
+	// Base step size for rate change in DECISION_MADE mode.
+	float decision_made_step_size = 0.02f;
+	// Maximum step size for rate change in DECISION_MADE mode.
+	float max_decision_made_step_size = 0.10f;
+
+	// The factor that converts average utility gradient to a rate change in
+	// bits per second.
+	float utility_gradient_to_rate_change_factor = 1.0f * 1024 * 1024;
+	// The initial maximum proportional rate change.
+	float initial_maximum_proportional_change = 0.05f;
+	// The additional maximum proportional change each time it is incremented.
+	float maximum_proportional_change_step_size = 0.06f;
+
+	// How the utility gradient is derived from the utility samples.
+	GradientEstimatorMode gradient_estimator = GRADIENT_PAIR;
+	// With GRADIENT_WEIGHTED_LEAST_SQUARES: the number of latest samples of
+	// the probing rounds in a row that a decision fits, each weighing
+	// gradient_sample_decay times the next newer one, and the least
+	// confidence a rate change is scaled by.
+	size_t gradient_window = 8;
+	float gradient_sample_decay = 0.8f;
+	float min_gradient_confidence = 0.25f;
+
+	// How latency inflation is derived from the RTT samples. The default
+	// computes it as the original Vivace did, from runs of samples kept in
+	// storage reserved per interval. RTT_STATS_REGRESSION keeps each interval
+	// in constant space instead, but its utilities, and so the rate
+	// decisions, differ from those of the original.
+	RttStatsMode rtt_stats_mode = RTT_STATS_HALF_SPLIT;
+	// Coefficients of VivaceLatencyUtility, which ScavengerUtility builds on.
+	VivaceUtilityCoefficients vivace_utility;
+	// Coefficients of VivaceLossUtility.
+	LossUtilityCoefficients loss_utility;
+	// Coefficient of the RTT deviation term of ScavengerUtility, per Mbit/s of
+	// sending rate and second of RTT deviation.
+	float scavenger_rtt_deviation_coefficient = 1500.0f;
+	// Computes the Vivace latency utility, which ScavengerUtility builds on,
+	// and the rate changes in fixed point (see FixedPoint.h), so that they
+	// come out the same on every platform. The other utilities and the rest
+	// of the controller keep using floating point. Requires GRADIENT_PAIR.
+	bool fixed_point_arithmetic = false;
+
+	// Quiescent fast path: once this many DECISION_MADE rounds in a row had
+	// utility gradients within quiescent_gradient_tolerance of the round
+	// before, relative to it, the controller measures its intervals with
+	// aggregate counters updated once per ACK batch instead of through the
+	// queue (see AggregateMonitorInterval), until its gradient changes more
+	// or it leaves DECISION_MADE. 0 turns it off. The rates it decides on are
+	// the same as without it when every packet is reported once and in
+	// order.
+	size_t quiescent_rounds = 0;
+	float quiescent_gradient_tolerance = 0.05f;
+	// Fraction of the packets of an interval measured on the quiescent fast
+	// path that may be reported out of order or numbered out of sequence,
+	// which the counters can only approximate. Beyond it the interval is
+	// dropped and the controller goes back to the queue.
+	float quiescent_inexact_tolerance = 0.01f;
+
+	// Returns true if the config is usable, otherwise false with the reason in
+	// |error| if it is not null.
+	bool Validate(std::string* error) const;
+
+	// Returns an immutable copy of |config|, or null, with the reason in
+	// |error| if it is not null, when |config| is invalid.
+	static std::shared_ptr<const PccConfig> Create(const PccConfig& config, std::string* error);
+
+	// The Vivace constants.
+	static std::shared_ptr<const PccConfig> Default();
+	// Short, fast and clean paths: microsecond RTTs at tens to hundreds of
+	// Gbit/s, where a Vivace sized floor and probe step waste capacity.
+	static std::shared_ptr<const PccConfig> Datacenter();
+	// Internet paths, which Vivace was tuned for.
+	static std::shared_ptr<const PccConfig> Wan();
+	// Long, lossy and jittery paths, with RTTs of several hundred
+	// milliseconds.
+	static std::shared_ptr<const PccConfig> Satellite();
+};
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_CONFIG_H_
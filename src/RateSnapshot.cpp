@@ -0,0 +1,29 @@
+#include "RateSnapshot.h"
+
+void RatePublisher::Publish(QuicBandwidth pacing_rate, QuicByteCount congestion_window)
+{
+	uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+	sequence_.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	pacing_rate_.store(pacing_rate, std::memory_order_relaxed);
+	congestion_window_.store(congestion_window, std::memory_order_relaxed);
+	sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+RateSnapshot RatePublisher::Read() const
+{
+	RateSnapshot snapshot;
+	for (;;)
+	{
+		uint64_t before = sequence_.load(std::memory_order_acquire);
+		snapshot.pacing_rate = pacing_rate_.load(std::memory_order_relaxed);
+		snapshot.congestion_window = congestion_window_.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = sequence_.load(std::memory_order_relaxed);
+		if (before == after && (before & 1) == 0)
+		{
+			snapshot.version = before / 2;
+			return snapshot;
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_RATE_SNAPSHOT_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_RATE_SNAPSHOT_H_
+
+#include <atomic>
+
+#include "MonitorIntervalQueue.h"
+
+// RateSnapshot, the outputs of a controller at one point in time.
+
+struct RateSnapshot
+{
+	QuicBandwidth pacing_rate = 0;
+	QuicByteCount congestion_window = 0;
+	// Number of times the outputs have been published.
+	uint64_t version = 0;
+};
+
+// RatePublisher, a seqlock over a RateSnapshot. One thread publishes; any
+// number of threads read without locks or writes to shared memory, retrying
+// only while a publish is in progress.
+
+class RatePublisher
+{
+public:
+	RatePublisher() = default;
+	RatePublisher(const RatePublisher&) = delete;
+	RatePublisher& operator=(const RatePublisher&) = delete;
+
+	// Writer only.
+	void Publish(QuicBandwidth pacing_rate, QuicByteCount congestion_window);
+
+	// Any thread. A consistent copy of the last published outputs.
+	RateSnapshot Read() const;
+	// Any thread. Each of these reads one output on its own.
+	QuicBandwidth pacing_rate() const { return pacing_rate_.load(std::memory_order_relaxed); }
+	QuicByteCount congestion_window() const { return congestion_window_.load(std::memory_order_relaxed); }
+
+private:
+	// Odd while a publish is in progress, otherwise twice the version.
+	alignas(64) std::atomic<uint64_t> sequence_{0};
+	std::atomic<QuicBandwidth> pacing_rate_{0};
+	std::atomic<QuicByteCount> congestion_window_{0};
+};
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_RATE_SNAPSHOT_H_
@@ -0,0 +1,192 @@
+#include "ReplayLog.h"
+
+#include <cerrno>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PCC_REPLAY_MMAP
+#endif
+
+static_assert(sizeof(ReplayRecord) == 32, "a ReplayRecord is 32 bytes");
+static_assert(sizeof(ReplayLogHeader) == 64, "the log header is one cache line");
+
+namespace
+{
+	// Size of the write buffer of a ReplayLogWriter.
+	const size_t kWriteBufferBytes = 1 << 20;
+
+	ReplayRecord PacketRecord(ReplayRecordType type, const CongestionEvent& packet, QuicByteCount bytes)
+	{
+		ReplayRecord record = {};
+		record.type = type;
+		record.time = static_cast<int64_t> (packet.time);
+		record.packet_number = packet.packet_number;
+		record.value = bytes;
+		return record;
+	}
+} // namespace
+
+ReplayLogWriter::~ReplayLogWriter()
+{
+	Close();
+}
+
+bool ReplayLogWriter::Open(const std::string& path,
+	QuicTime initial_rtt_us,
+	QuicPacketCount initial_congestion_window,
+	QuicPacketCount max_congestion_window,
+	std::string* error)
+{
+	Close();
+	file_ = fopen(path.c_str(), "wb");
+	if (file_ == nullptr)
+	{
+		if (error != nullptr)
+			*error = "cannot create " + path + ": " + strerror(errno);
+		return false;
+	}
+	setvbuf(file_, nullptr, _IOFBF, kWriteBufferBytes);
+
+	ReplayLogHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = ReplayLogHeader::kMagic;
+	header.version = ReplayLogHeader::kVersion;
+	header.record_size = sizeof(ReplayRecord);
+	header.initial_rtt_us = initial_rtt_us;
+	header.initial_congestion_window = initial_congestion_window;
+	header.max_congestion_window = max_congestion_window;
+	failed_ = fwrite(&header, sizeof(header), 1, file_) != 1;
+	return true;
+}
+
+bool ReplayLogWriter::Close()
+{
+	if (file_ == nullptr)
+		return true;
+	bool ok = fclose(file_) == 0 && !failed_;
+	file_ = nullptr;
+	return ok;
+}
+
+void ReplayLogWriter::OnPacketSent(QuicTime sent_time,
+	QuicPacketNumber packet_number,
+	QuicByteCount bytes,
+	bool is_retransmittable)
+{
+	ReplayRecord record = {};
+	record.type = REPLAY_PACKET_SENT;
+	record.time = sent_time;
+	record.packet_number = packet_number;
+	record.value = bytes;
+	record.is_retransmittable = is_retransmittable;
+	Write(record);
+}
+
+void ReplayLogWriter::OnCongestionEvent(QuicTime event_time,
+	QuicTime rtt,
+	const AckedPacketVector& acked_packets,
+	const LostPacketVector& lost_packets)
+{
+	ReplayRecord record = {};
+	record.type = REPLAY_CONGESTION_EVENT;
+	record.time = event_time;
+	record.value = rtt;
+	record.num_acked = static_cast<uint32_t> (acked_packets.size());
+	record.num_lost = static_cast<uint32_t> (lost_packets.size());
+	Write(record);
+	for (const AckedPacket& packet : acked_packets)
+		Write(PacketRecord(REPLAY_PACKET_ACKED, packet, packet.bytes_acked));
+	for (const LostPacket& packet : lost_packets)
+		Write(PacketRecord(REPLAY_PACKET_LOST, packet, packet.bytes_lost));
+}
+
+void ReplayLogWriter::OnTimer(QuicTime now)
+{
+	ReplayRecord record = {};
+	record.type = REPLAY_TIMER;
+	record.time = now;
+	Write(record);
+}
+
+void ReplayLogWriter::Write(const ReplayRecord& record)
+{
+	if (file_ != nullptr && fwrite(&record, sizeof(record), 1, file_) != 1)
+		failed_ = true;
+}
+
+ReplayLog::~ReplayLog()
+{
+	Unmap();
+}
+
+bool ReplayLog::Open(const std::string& path, std::string* error)
+{
+	Unmap();
+#if defined(PCC_REPLAY_MMAP)
+	int fd = open(path.c_str(), O_RDONLY);
+	struct stat status;
+	if (fd < 0 || fstat(fd, &status) != 0)
+	{
+		if (error != nullptr)
+			*error = "cannot open " + path + ": " + strerror(errno);
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+	size_t bytes = static_cast<size_t> (status.st_size);
+	if (bytes < sizeof(ReplayLogHeader))
+	{
+		if (error != nullptr)
+			*error = path + " is not an event log";
+		close(fd);
+		return false;
+	}
+	void* base = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		if (error != nullptr)
+			*error = "cannot map " + path + ": " + strerror(errno);
+		return false;
+	}
+	// Replay reads the log once, front to back.
+	madvise(base, bytes, MADV_SEQUENTIAL);
+
+	base_ = base;
+	mapped_bytes_ = bytes;
+	header_ = static_cast<const ReplayLogHeader*> (base);
+	if (header_->magic != ReplayLogHeader::kMagic
+		|| header_->version != ReplayLogHeader::kVersion
+		|| header_->record_size != sizeof(ReplayRecord))
+	{
+		if (error != nullptr)
+			*error = path + " is not an event log of version " + std::to_string(ReplayLogHeader::kVersion);
+		Unmap();
+		return false;
+	}
+	records_ = reinterpret_cast<const ReplayRecord*> (static_cast<const uint8_t*> (base) + sizeof(ReplayLogHeader));
+	num_records_ = (bytes - sizeof(ReplayLogHeader)) / sizeof(ReplayRecord);
+	return true;
+#else
+	if (error != nullptr)
+		*error = "replay needs mmap";
+	return false;
+#endif
+}
+
+void ReplayLog::Unmap()
+{
+#if defined(PCC_REPLAY_MMAP)
+	if (base_ != nullptr)
+		munmap(base_, mapped_bytes_);
+#endif
+	base_ = nullptr;
+	mapped_bytes_ = 0;
+	header_ = nullptr;
+	records_ = nullptr;
+	num_records_ = 0;
+}
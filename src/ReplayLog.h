@@ -0,0 +1,133 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_REPLAY_LOG_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_REPLAY_LOG_H_
+
+// Event logs of a connection, to replay into a controller offline. A log
+// holds the calls a controller received, OnPacketSent, OnCongestionEvent and
+// OnTimer, in order, as fixed-size records after a ReplayLogHeader. A congestion
+// event is one REPLAY_CONGESTION_EVENT record followed by one record per
+// acked and then per lost packet.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "MonitorIntervalQueue.h"
+
+enum ReplayRecordType : uint16_t
+{
+	REPLAY_PACKET_SENT,
+	REPLAY_CONGESTION_EVENT,
+	REPLAY_PACKET_ACKED,
+	REPLAY_PACKET_LOST,
+	REPLAY_TIMER
+};
+
+// ReplayRecord, one record of a log: 32 bytes.
+
+struct ReplayRecord
+{
+	// Sent time of a packet sent, time of a congestion event or timer, or the
+	// time of the CongestionEvent of an acked or lost packet.
+	int64_t time;
+	// Bytes of a packet, or the RTT of a congestion event.
+	int64_t value;
+	QuicPacketNumber packet_number;
+	// Number of acked and lost packets of a congestion event.
+	uint32_t num_acked;
+	uint32_t num_lost;
+	uint16_t type;
+	// Whether a packet sent is retransmittable.
+	uint16_t is_retransmittable;
+};
+
+// ReplayLogHeader, at the start of a log, with the arguments the controller
+// was created with.
+
+struct ReplayLogHeader
+{
+	// "PCCEVLOG" in little-endian byte order.
+	static constexpr uint64_t kMagic = 0x474F4C5645434350ULL;
+	static constexpr uint32_t kVersion = 1;
+
+	uint64_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	QuicTime initial_rtt_us;
+	QuicPacketCount initial_congestion_window;
+	QuicPacketCount max_congestion_window;
+	uint8_t reserved[32];
+};
+
+// ReplayLogWriter, records the calls of a controller to a log. Its calls
+// mirror those of the controller, so it can sit next to one.
+
+class ReplayLogWriter
+{
+public:
+	ReplayLogWriter() = default;
+	~ReplayLogWriter();
+	ReplayLogWriter(const ReplayLogWriter&) = delete;
+	ReplayLogWriter& operator=(const ReplayLogWriter&) = delete;
+
+	// Starts a new log at |path| for a controller created with these
+	// arguments. Returns false, with the reason in |error| if it is not null,
+	// if the file cannot be created.
+	bool Open(const std::string& path,
+		QuicTime initial_rtt_us,
+		QuicPacketCount initial_congestion_window,
+		QuicPacketCount max_congestion_window,
+		std::string* error);
+	// Writes out the log and closes it. Returns false if writing failed.
+	bool Close();
+	bool is_open() const { return file_ != nullptr; }
+
+	void OnPacketSent(QuicTime sent_time,
+		QuicPacketNumber packet_number,
+		QuicByteCount bytes,
+		bool is_retransmittable);
+	void OnCongestionEvent(QuicTime event_time,
+		QuicTime rtt,
+		const AckedPacketVector& acked_packets,
+		const LostPacketVector& lost_packets);
+	void OnTimer(QuicTime now);
+
+private:
+	void Write(const ReplayRecord& record);
+
+	FILE* file_ = nullptr;
+	bool failed_ = false;
+};
+
+// ReplayLog, a log mapped into memory for reading, so that logs need not fit
+// in memory.
+
+class ReplayLog
+{
+public:
+	ReplayLog() = default;
+	~ReplayLog();
+	ReplayLog(const ReplayLog&) = delete;
+	ReplayLog& operator=(const ReplayLog&) = delete;
+
+	// Maps the log at |path|. Returns false, with the reason in |error| if it
+	// is not null, if it cannot be mapped or is not a log.
+	bool Open(const std::string& path, std::string* error);
+
+	const ReplayLogHeader& header() const { return *header_; }
+	// Records of the log. A record cut short at the end, as by a capture that
+	// did not finish, is left out.
+	const ReplayRecord* records() const { return records_; }
+	size_t num_records() const { return num_records_; }
+
+private:
+	void Unmap();
+
+	void* base_ = nullptr;
+	size_t mapped_bytes_ = 0;
+	const ReplayLogHeader* header_ = nullptr;
+	const ReplayRecord* records_ = nullptr;
+	size_t num_records_ = 0;
+};
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_REPLAY_LOG_H_
@@ -0,0 +1,139 @@
+#include "Replayer.h"
+
+#include "UtilityFunctions.h"
+
+namespace
+{
+	CongestionEvent PacketEvent(const ReplayRecord& record)
+	{
+		CongestionEvent packet = {};
+		packet.packet_number = record.packet_number;
+		packet.time = static_cast<uint64_t> (record.time);
+		return packet;
+	}
+
+	bool SameSample(const ReplaySample& lhs, const ReplaySample& rhs)
+	{
+		return lhs.pacing_rate == rhs.pacing_rate
+			&& lhs.mode == rhs.mode
+			&& lhs.utility.sending_rate == rhs.utility.sending_rate
+			&& lhs.utility.utility == rhs.utility.utility;
+	}
+
+	bool Malformed(size_t index, const char* reason, std::string* error)
+	{
+		if (error != nullptr)
+			*error = "record " + std::to_string(index) + ": " + reason;
+		return false;
+	}
+} // namespace
+
+template <class UtilityFunction>
+bool ReplayLogInto(const ReplayLog& log,
+	std::shared_ptr<const PccConfig> config,
+	uint64_t seed,
+	ReplayTimelineInterface* timeline,
+	ReplayResult* result,
+	std::string* error)
+{
+	*result = ReplayResult();
+	const ReplayLogHeader& header = log.header();
+	if (header.initial_rtt_us <= 0 || header.initial_congestion_window <= 0)
+		return Malformed(0, "bad controller arguments in the header", error);
+
+	BasicCongestionController<UtilityFunction> controller(header.initial_rtt_us,
+		header.initial_congestion_window,
+		header.max_congestion_window,
+		std::move(config));
+	controller.set_random_seed(seed);
+
+	AckedPacketVector acked_packets;
+	LostPacketVector lost_packets;
+	ReplaySample last_sample;
+	const ReplayRecord* records = log.records();
+	size_t num_records = log.num_records();
+	size_t i = 0;
+	while (i < num_records)
+	{
+		const ReplayRecord& record = records[i];
+		if (record.type == REPLAY_PACKET_SENT)
+		{
+			controller.OnPacketSent(record.time, record.packet_number, record.value, record.is_retransmittable != 0);
+			++result->packets_sent;
+			++i;
+		}
+		else if (record.type == REPLAY_CONGESTION_EVENT)
+		{
+			size_t num_packets = static_cast<size_t> (record.num_acked) + record.num_lost;
+			if (num_packets > num_records - i - 1)
+				return Malformed(i, "congestion event cut short", error);
+
+			acked_packets.clear();
+			lost_packets.clear();
+			for (size_t j = i + 1; j <= i + num_packets; ++j)
+			{
+				CongestionEvent packet = PacketEvent(records[j]);
+				if (j <= i + record.num_acked && records[j].type == REPLAY_PACKET_ACKED)
+				{
+					packet.bytes_acked = static_cast<int32_t> (records[j].value);
+					acked_packets.push_back(packet);
+				}
+				else if (j > i + record.num_acked && records[j].type == REPLAY_PACKET_LOST)
+				{
+					packet.bytes_lost = static_cast<int32_t> (records[j].value);
+					lost_packets.push_back(packet);
+				}
+				else
+					return Malformed(j, "packet out of place in a congestion event", error);
+			}
+			controller.OnCongestionEvent(record.time, record.value, acked_packets, lost_packets);
+			++result->congestion_events;
+			result->packets_acked += record.num_acked;
+			result->packets_lost += record.num_lost;
+			i += 1 + num_packets;
+		}
+		else if (record.type == REPLAY_TIMER)
+		{
+			controller.OnTimer(record.time);
+			++result->timers;
+			++i;
+		}
+		else
+			return Malformed(i, "unexpected record type", error);
+
+		if (timeline == nullptr)
+			continue;
+		ReplaySample sample;
+		sample.time = record.time;
+		sample.pacing_rate = controller.PacingRate();
+		sample.mode = controller.mode();
+		sample.utility = controller.latest_utility_info();
+		if (result->samples == 0 || !SameSample(sample, last_sample))
+		{
+			sample.congestion_window = controller.GetCongestionWindow();
+			timeline->OnSample(sample);
+			last_sample = sample;
+			++result->samples;
+		}
+	}
+	return true;
+}
+
+template bool ReplayLogInto<VivaceLatencyUtility>(const ReplayLog&,
+	std::shared_ptr<const PccConfig>,
+	uint64_t,
+	ReplayTimelineInterface*,
+	ReplayResult*,
+	std::string*);
+template bool ReplayLogInto<VivaceLossUtility>(const ReplayLog&,
+	std::shared_ptr<const PccConfig>,
+	uint64_t,
+	ReplayTimelineInterface*,
+	ReplayResult*,
+	std::string*);
+template bool ReplayLogInto<ScavengerUtility>(const ReplayLog&,
+	std::shared_ptr<const PccConfig>,
+	uint64_t,
+	ReplayTimelineInterface*,
+	ReplayResult*,
+	std::string*);
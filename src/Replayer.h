@@ -0,0 +1,59 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_REPLAYER_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_REPLAYER_H_
+
+#include <memory>
+#include <string>
+
+#include "CongestionController.h"
+#include "ReplayLog.h"
+
+// ReplaySample, the outputs of the controller after an event of a replay.
+
+struct ReplaySample
+{
+	// Time of the event, from the log.
+	QuicTime time = 0;
+	QuicBandwidth pacing_rate = 0;
+	QuicByteCount congestion_window = 0;
+	CongestionControllerBase::SenderMode mode = CongestionControllerBase::STARTING;
+	// Rate and utility the latest decision was based on.
+	UtilityInfo utility;
+};
+
+// Receives the timeline of a replay.
+class ReplayTimelineInterface
+{
+public:
+	virtual ~ReplayTimelineInterface() = default;
+	// Called after each event that changed the pacing rate, the mode or the
+	// utility, and after the first.
+	virtual void OnSample(const ReplaySample& sample) = 0;
+};
+
+// ReplayResult, counts of the events of a replay.
+
+struct ReplayResult
+{
+	uint64_t packets_sent = 0;
+	uint64_t congestion_events = 0;
+	uint64_t packets_acked = 0;
+	uint64_t packets_lost = 0;
+	uint64_t timers = 0;
+	uint64_t samples = 0;
+};
+
+// Feeds the events of |log| into a new controller tuned by |config| and
+// seeded with |seed|, as fast as it can take them. Given the same log,
+// config and seed, a replay makes the same decisions every time. Reports the
+// timeline to |timeline|, which may be null, and stores the event counts in
+// |result|. Returns false, with the reason in |error| if it is not null, if
+// the log is malformed; the events before are replayed.
+template <class UtilityFunction>
+bool ReplayLogInto(const ReplayLog& log,
+	std::shared_ptr<const PccConfig> config,
+	uint64_t seed,
+	ReplayTimelineInterface* timeline,
+	ReplayResult* result,
+	std::string* error);
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_REPLAYER_H_
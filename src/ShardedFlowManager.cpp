@@ -0,0 +1,367 @@
+#include "ShardedFlowManager.h"
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+	// Shards per worker by default.
+	const size_t kDefaultShardsPerWorker = 16;
+	// Ring slots a worker consumes from a shard before moving to the next.
+	const size_t kSlotsPerDrain = 256;
+	// Sent packets applied to a FlowTable at once.
+	const size_t kSentPacketsPerBatch = 64;
+	// Backlog in ring slots a shard needs before another worker steals it.
+	const uint64_t kMinStealBacklog = 64;
+
+	// Spreads flow keys, which may be sequential, over the shards.
+	uint64_t MixKey(uint64_t key)
+	{
+		key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+		return key ^ (key >> 31);
+	}
+
+	void PinToCpu(std::thread* thread, size_t cpu)
+	{
+#if defined(__linux__)
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu % CPU_SETSIZE, &cpus);
+		pthread_setaffinity_np(thread->native_handle(), sizeof(cpus), &cpus);
+#else
+		(void) thread;
+		(void) cpu;
+#endif
+	}
+} // namespace
+
+// Shard, the flows hashed to one shard and their inbox. Only the worker that
+// holds |claimed| touches anything but the ring's producer side and the
+// counters.
+struct alignas(64) ShardedFlowManager::Shard
+{
+	Shard(const ShardedFlowManagerConfig& config, uint32_t owner) :
+		ring(config.ring_capacity),
+		table(config.max_flows_per_shard, config.pcc_config),
+		keys(config.max_flows_per_shard),
+		reported_rates(config.max_flows_per_shard),
+		owner(owner)
+	{
+		flows.reserve(config.max_flows_per_shard);
+		sent_packets.reserve(kSentPacketsPerBatch);
+	}
+
+	// Backlog in ring slots.
+	uint64_t backlog() const
+	{
+		// A producer counts its slots only after publishing them, so they may
+		// be processed before they are posted.
+		uint64_t posted = num_posted.load(std::memory_order_relaxed);
+		uint64_t processed = num_processed.load(std::memory_order_relaxed);
+		return posted > processed ? posted - processed : 0;
+	}
+
+	EventRing ring;
+	FlowTable table;
+	// Flow ids in |table| by key, and keys by flow id.
+	std::unordered_map<uint64_t, FlowId> flows;
+	std::vector<uint64_t> keys;
+	// Pacing rate last told to the observer, by flow id.
+	std::vector<QuicBandwidth> reported_rates;
+	// Sent packets not yet applied to |table|.
+	std::vector<FlowPacketSent> sent_packets;
+	CongestionEventAssembler pending_event;
+	// Event time of the latest congestion event.
+	QuicTime latest_event_time = 0;
+	// Event time the stats were last published at, or -1 before.
+	QuicTime stats_time = -1;
+
+	// Held by the worker processing the shard.
+	alignas(64) std::atomic<bool> claimed{false};
+	// Worker the shard belongs to.
+	std::atomic<uint32_t> owner;
+	// Ring slots posted by the producers and processed by the workers.
+	alignas(64) std::atomic<uint64_t> num_posted{0};
+	alignas(64) std::atomic<uint64_t> num_processed{0};
+	ControllerStatsPublisher stats;
+};
+
+ShardedFlowManager::ShardedFlowManager(const ShardedFlowManagerConfig& config) :
+	config_(config)
+{
+	config_.num_workers = std::max<size_t>(config_.num_workers, 1);
+	if (config_.num_shards == 0)
+		config_.num_shards = kDefaultShardsPerWorker * config_.num_workers;
+	for (size_t i = 0; i < config_.num_shards; ++i)
+		shards_.emplace_back(new Shard(config_, static_cast<uint32_t> (i % config_.num_workers)));
+}
+
+ShardedFlowManager::~ShardedFlowManager()
+{
+	Stop();
+}
+
+void ShardedFlowManager::Start()
+{
+	if (running_.exchange(true))
+		return;
+	for (size_t i = 0; i < config_.num_workers; ++i)
+	{
+		workers_.emplace_back(&ShardedFlowManager::RunWorker, this, static_cast<uint32_t> (i));
+		if (config_.pin_workers)
+			PinToCpu(&workers_.back(), i);
+	}
+}
+
+void ShardedFlowManager::Stop()
+{
+	running_.store(false);
+	for (std::thread& worker : workers_)
+		worker.join();
+	workers_.clear();
+}
+
+bool ShardedFlowManager::PostFlowAdded(uint64_t flow_key, QuicTime initial_rtt_us, QuicPacketCount initial_congestion_window, QuicPacketCount max_congestion_window)
+{
+	Shard& shard = *shards_[ShardOf(flow_key)];
+	return OnPosted(shard, shard.ring.PostFlowAdded(flow_key, initial_rtt_us, initial_congestion_window, max_congestion_window));
+}
+
+bool ShardedFlowManager::PostFlowRemoved(uint64_t flow_key)
+{
+	Shard& shard = *shards_[ShardOf(flow_key)];
+	return OnPosted(shard, shard.ring.PostFlowRemoved(flow_key));
+}
+
+bool ShardedFlowManager::PostPacketSent(uint64_t flow_key, QuicTime sent_time, QuicPacketNumber packet_number, QuicByteCount bytes, bool is_retransmittable)
+{
+	Shard& shard = *shards_[ShardOf(flow_key)];
+	return OnPosted(shard, shard.ring.PostPacketSent(flow_key, sent_time, packet_number, bytes, is_retransmittable));
+}
+
+bool ShardedFlowManager::PostCongestionEvent(uint64_t flow_key, QuicTime event_time, QuicTime rtt, const AckedPacketVector& acked_packets, const LostPacketVector& lost_packets)
+{
+	Shard& shard = *shards_[ShardOf(flow_key)];
+	return OnPosted(shard, shard.ring.PostCongestionEvent(flow_key, event_time, rtt, acked_packets, lost_packets));
+}
+
+size_t ShardedFlowManager::ShardOf(uint64_t flow_key) const
+{
+	return static_cast<size_t> (MixKey(flow_key) % shards_.size());
+}
+
+uint64_t ShardedFlowManager::num_posted_slots() const
+{
+	uint64_t total = 0;
+	for (const std::unique_ptr<Shard>& shard : shards_)
+		total += shard->num_posted.load(std::memory_order_relaxed);
+	return total;
+}
+
+uint64_t ShardedFlowManager::num_processed_slots() const
+{
+	uint64_t total = 0;
+	for (const std::unique_ptr<Shard>& shard : shards_)
+		total += shard->num_processed.load(std::memory_order_acquire);
+	return total;
+}
+
+ControllerStats ShardedFlowManager::Stats() const
+{
+	ControllerStats stats;
+	for (const std::unique_ptr<Shard>& shard : shards_)
+		stats.Add(shard->stats.Read());
+	return stats;
+}
+
+bool ShardedFlowManager::OnPosted(Shard& shard, size_t slots)
+{
+	if (slots == 0)
+	{
+		num_dropped_events_.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	shard.num_posted.fetch_add(slots, std::memory_order_relaxed);
+	return true;
+}
+
+void ShardedFlowManager::RunWorker(uint32_t worker)
+{
+	// The shards this worker believes it owns. Shards stolen from it are
+	// dropped when it next comes across them.
+	std::vector<size_t> owned_shards;
+	for (size_t i = worker; i < shards_.size(); i += config_.num_workers)
+		owned_shards.push_back(i);
+
+	while (running_.load(std::memory_order_relaxed))
+	{
+		bool did_work = false;
+		for (size_t i = 0; i < owned_shards.size(); )
+		{
+			Shard& shard = *shards_[owned_shards[i]];
+			if (shard.owner.load(std::memory_order_relaxed) != worker)
+			{
+				owned_shards[i] = owned_shards.back();
+				owned_shards.pop_back();
+				continue;
+			}
+			++i;
+			if (shard.backlog() == 0 || shard.claimed.exchange(true, std::memory_order_acquire))
+				continue;
+			did_work |= Drain(shard) > 0;
+			shard.claimed.store(false, std::memory_order_release);
+		}
+
+		if (!did_work && !Steal(worker, &owned_shards))
+			std::this_thread::yield();
+	}
+}
+
+bool ShardedFlowManager::Steal(uint32_t worker, std::vector<size_t>* owned_shards)
+{
+	size_t victim = shards_.size();
+	uint64_t largest_backlog = kMinStealBacklog - 1;
+	for (size_t i = 0; i < shards_.size(); ++i)
+	{
+		// A shard its owner is processing would only fail the claim below,
+		// while the owner's other shards wait.
+		const Shard& shard = *shards_[i];
+		uint64_t backlog = shard.backlog();
+		if (backlog > largest_backlog
+			&& shard.owner.load(std::memory_order_relaxed) != worker
+			&& !shard.claimed.load(std::memory_order_relaxed))
+		{
+			victim = i;
+			largest_backlog = backlog;
+		}
+	}
+	if (victim == shards_.size())
+		return false;
+
+	Shard& shard = *shards_[victim];
+	if (shard.claimed.exchange(true, std::memory_order_acquire))
+		return false;
+	shard.owner.store(worker, std::memory_order_relaxed);
+	// The shard may have come back before this worker dropped it.
+	if (std::find(owned_shards->begin(), owned_shards->end(), victim) == owned_shards->end())
+		owned_shards->push_back(victim);
+	num_steals_.fetch_add(1, std::memory_order_relaxed);
+	Drain(shard);
+	shard.claimed.store(false, std::memory_order_release);
+	return true;
+}
+
+size_t ShardedFlowManager::Drain(Shard& shard)
+{
+	size_t num_slots = 0;
+	for (; num_slots < kSlotsPerDrain; ++num_slots)
+	{
+		const RingEvent* event = shard.ring.Front();
+		if (event == nullptr)
+			break;
+
+		if (event->type == RingEvent::PACKET_SENT)
+		{
+			std::unordered_map<uint64_t, FlowId>::const_iterator flow = shard.flows.find(event->flow);
+			if (flow != shard.flows.end())
+			{
+				FlowPacketSent packet;
+				packet.flow = flow->second;
+				packet.sent_time = event->time;
+				packet.packet_number = event->packets[0].packet_number;
+				packet.bytes = event->packets[0].bytes_acked;
+				packet.is_retransmittable = event->is_retransmittable;
+				shard.sent_packets.push_back(packet);
+				if (shard.sent_packets.size() == kSentPacketsPerBatch)
+					FlushSentPackets(shard);
+			}
+			shard.ring.PopFront();
+			continue;
+		}
+
+		// Everything else must follow the packets sent before it.
+		FlushSentPackets(shard);
+		if (event->type == RingEvent::CONGESTION_EVENT)
+		{
+			bool complete = shard.pending_event.Add(*event);
+			shard.ring.PopFront();
+			if (!complete)
+				continue;
+
+			std::unordered_map<uint64_t, FlowId>::const_iterator flow = shard.flows.find(shard.pending_event.flow());
+			if (flow == shard.flows.end())
+				continue;
+			FlowCongestionEvent congestion_event;
+			congestion_event.flow = flow->second;
+			congestion_event.event_time = shard.pending_event.event_time();
+			congestion_event.rtt = shard.pending_event.rtt();
+			congestion_event.acked_packets = &shard.pending_event.acked_packets();
+			congestion_event.lost_packets = &shard.pending_event.lost_packets();
+			shard.table.OnCongestionEvent(&congestion_event, 1);
+			shard.latest_event_time = std::max(shard.latest_event_time, congestion_event.event_time);
+			ReportRate(shard, flow->second);
+		}
+		else if (event->type == RingEvent::FLOW_ADDED)
+		{
+			FlowId flow;
+			if (shard.flows.count(event->flow) == 0
+				&& shard.table.AddFlow(event->rtt, event->packets[0].packet_number, event->packets[0].bytes_acked, &flow))
+			{
+				// Seeded by key, the flow decides the same however the shards
+				// were scheduled.
+				shard.table.set_random_seed(flow, event->flow);
+				shard.flows[event->flow] = flow;
+				shard.keys[flow] = event->flow;
+				shard.reported_rates[flow] = 0;
+				ReportRate(shard, flow);
+			}
+			else
+				num_rejected_flows_.fetch_add(1, std::memory_order_relaxed);
+			shard.ring.PopFront();
+		}
+		else
+		{
+			std::unordered_map<uint64_t, FlowId>::iterator flow = shard.flows.find(event->flow);
+			if (flow != shard.flows.end())
+			{
+				shard.table.RemoveFlow(flow->second);
+				shard.flows.erase(flow);
+			}
+			shard.ring.PopFront();
+		}
+	}
+	FlushSentPackets(shard);
+	if (config_.stats_period_us > 0
+		&& (shard.stats_time < 0 || shard.latest_event_time >= shard.stats_time + config_.stats_period_us))
+	{
+		shard.stats.Publish(shard.table.Stats());
+		shard.stats_time = shard.latest_event_time;
+	}
+
+	shard.num_processed.fetch_add(num_slots, std::memory_order_release);
+	return num_slots;
+}
+
+void ShardedFlowManager::FlushSentPackets(Shard& shard)
+{
+	if (shard.sent_packets.empty())
+		return;
+	shard.table.OnPacketSent(shard.sent_packets.data(), shard.sent_packets.size());
+	for (const FlowPacketSent& packet : shard.sent_packets)
+		ReportRate(shard, packet.flow);
+	shard.sent_packets.clear();
+}
+
+void ShardedFlowManager::ReportRate(Shard& shard, FlowId flow)
+{
+	QuicBandwidth pacing_rate = shard.table.PacingRate(flow);
+	if (config_.observer == nullptr || pacing_rate == shard.reported_rates[flow])
+		return;
+	shard.reported_rates[flow] = pacing_rate;
+	config_.observer->OnFlowRateChanged(shard.keys[flow], pacing_rate, shard.table.GetCongestionWindow(flow));
+}
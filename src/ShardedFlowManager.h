@@ -0,0 +1,143 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_SHARDED_FLOW_MANAGER_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_SHARDED_FLOW_MANAGER_H_
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "EventRing.h"
+#include "FlowTable.h"
+
+// Observes the outputs of the flows of a ShardedFlowManager.
+class FlowRateObserverInterface
+{
+public:
+	virtual ~FlowRateObserverInterface() = default;
+	// Called on a worker thread after an event changed the pacing rate of the
+	// flow with key |flow_key|. Calls for different flows may come from
+	// different workers at once; calls for one flow come in order.
+	virtual void OnFlowRateChanged(uint64_t flow_key,
+		QuicBandwidth pacing_rate,
+		QuicByteCount congestion_window) = 0;
+};
+
+// ShardedFlowManagerConfig, the layout of a ShardedFlowManager.
+
+struct ShardedFlowManagerConfig
+{
+	// Worker threads, normally one per core.
+	size_t num_workers = 1;
+	// Shards the flows are hashed to, or 0 for 16 per worker. More shards than
+	// workers let idle workers take over part of a busy worker's load.
+	size_t num_shards = 0;
+	// Flows each shard can hold.
+	size_t max_flows_per_shard = 256;
+	// Slots of each shard's event ring.
+	size_t ring_capacity = 4096;
+	// Pins worker i to CPU i where supported.
+	bool pin_workers = false;
+	// Tuning of every flow.
+	std::shared_ptr<const PccConfig> pcc_config = PccConfig::Default();
+	// Told of the rate changes of every flow if not null. Not owned.
+	FlowRateObserverInterface* observer = nullptr;
+	// Event time in microseconds between the publications of a shard's
+	// stats by its worker, or 0 for none (see Stats()).
+	QuicTime stats_period_us = 1000000;
+};
+
+// ShardedFlowManager runs the controllers of many flows on a pool of worker
+// threads. Flows are named by a 64-bit key and hashed to shards, each a
+// FlowTable with an EventRing inbox. A shard is only ever processed by the
+// one worker that has claimed it with an atomic exchange, so its flows need
+// no locks and its events are applied in batches, in the order posted.
+// Each shard belongs to one worker, which processes it in turn with its
+// other shards, so the shard's state stays in that core's caches. A worker
+// that finds no events in its own shards steals the shard with the largest
+// backlog from another worker and keeps it until it is stolen in turn, so a
+// skewed load, such as one elephant flow per shard, spreads over the idle
+// workers.
+//
+// Any thread may post events. Posting never blocks; it fails, and counts
+// the event as dropped, when the shard's ring is full.
+
+class ShardedFlowManager
+{
+public:
+	explicit ShardedFlowManager(const ShardedFlowManagerConfig& config);
+	// Stops the workers.
+	~ShardedFlowManager();
+	ShardedFlowManager(const ShardedFlowManager&) = delete;
+	ShardedFlowManager& operator=(const ShardedFlowManager&) = delete;
+
+	// Starts and stops the workers. Events posted while the workers are
+	// stopped wait in the rings.
+	void Start();
+	void Stop();
+
+	// Any thread. Events of a flow must be posted after its FLOW_ADDED and
+	// before its FLOW_REMOVED, from one thread at a time.
+	bool PostFlowAdded(uint64_t flow_key,
+		QuicTime initial_rtt_us,
+		QuicPacketCount initial_congestion_window,
+		QuicPacketCount max_congestion_window);
+	bool PostFlowRemoved(uint64_t flow_key);
+	bool PostPacketSent(uint64_t flow_key,
+		QuicTime sent_time,
+		QuicPacketNumber packet_number,
+		QuicByteCount bytes,
+		bool is_retransmittable);
+	bool PostCongestionEvent(uint64_t flow_key,
+		QuicTime event_time,
+		QuicTime rtt,
+		const AckedPacketVector& acked_packets,
+		const LostPacketVector& lost_packets);
+
+	// Shard of the flow with key |flow_key|.
+	size_t ShardOf(uint64_t flow_key) const;
+	size_t num_shards() const { return shards_.size(); }
+	size_t num_workers() const { return config_.num_workers; }
+
+	// Ring slots taken and applied so far. All posted events have been applied
+	// once they are equal.
+	uint64_t num_posted_slots() const;
+	uint64_t num_processed_slots() const;
+	uint64_t num_dropped_events() const { return num_dropped_events_.load(std::memory_order_relaxed); }
+	// Flows added to a full shard, which are ignored with their events.
+	uint64_t num_rejected_flows() const { return num_rejected_flows_.load(std::memory_order_relaxed); }
+	// Shards taken over by a worker from another.
+	uint64_t num_steals() const { return num_steals_.load(std::memory_order_relaxed); }
+	// Any thread. The stats of all flows added up, as each shard's worker last
+	// published them: every stats_period_us of event time while the shard
+	// has congestion events. Reading never waits for the workers.
+	ControllerStats Stats() const;
+
+private:
+	struct Shard;
+
+	void RunWorker(uint32_t worker);
+	// Processes up to a batch of the events of |shard|, which the caller has
+	// claimed. Returns the number of ring slots consumed.
+	size_t Drain(Shard& shard);
+	// Applies the sent packets collected in |shard|.
+	void FlushSentPackets(Shard& shard);
+	// Tells the observer if the pacing rate of |flow| in |shard| changed.
+	void ReportRate(Shard& shard, FlowId flow);
+	// Steals and processes the shard with the largest backlog of another
+	// worker, among those not being processed. Returns false if there was
+	// none to steal.
+	bool Steal(uint32_t worker, std::vector<size_t>* owned_shards);
+	// Counts the |slots| an event took, or a dropped event if none.
+	bool OnPosted(Shard& shard, size_t slots);
+
+	ShardedFlowManagerConfig config_;
+	std::vector<std::unique_ptr<Shard> > shards_;
+	std::vector<std::thread> workers_;
+	std::atomic<bool> running_{false};
+	alignas(64) std::atomic<uint64_t> num_dropped_events_{0};
+	std::atomic<uint64_t> num_rejected_flows_{0};
+	std::atomic<uint64_t> num_steals_{0};
+};
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_SHARDED_FLOW_MANAGER_H_
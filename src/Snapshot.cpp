@@ -0,0 +1,197 @@
+#include "Snapshot.h"
+
+#include <cstring>
+
+namespace
+{
+	// Bytes of the size that precedes a section.
+	const size_t kSectionSizeBytes = 4;
+	const uint64_t kFnvOffsetBasis = 0xCBF29CE484222325ULL;
+	const uint64_t kFnvPrime = 0x100000001B3ULL;
+} // namespace
+
+SnapshotWriter::SnapshotWriter(std::vector<uint8_t>* out) :
+	out_(out)
+{
+}
+
+void SnapshotWriter::WriteBool(bool value)
+{
+	WriteBytes(value ? 1 : 0, 1);
+}
+
+void SnapshotWriter::WriteUint8(uint8_t value)
+{
+	WriteBytes(value, 1);
+}
+
+void SnapshotWriter::WriteUint32(uint32_t value)
+{
+	WriteBytes(value, 4);
+}
+
+void SnapshotWriter::WriteUint64(uint64_t value)
+{
+	WriteBytes(value, 8);
+}
+
+void SnapshotWriter::WriteInt32(int32_t value)
+{
+	WriteBytes(static_cast<uint32_t> (value), 4);
+}
+
+void SnapshotWriter::WriteInt64(int64_t value)
+{
+	WriteBytes(static_cast<uint64_t> (value), 8);
+}
+
+void SnapshotWriter::WriteFloat(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	WriteBytes(bits, 4);
+}
+
+void SnapshotWriter::WriteDouble(double value)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	WriteBytes(bits, 8);
+}
+
+size_t SnapshotWriter::BeginSection()
+{
+	size_t section = out_->size();
+	WriteBytes(0, kSectionSizeBytes);
+	return section;
+}
+
+void SnapshotWriter::EndSection(size_t section)
+{
+	uint64_t size = out_->size() - section - kSectionSizeBytes;
+	for (size_t i = 0; i < kSectionSizeBytes; ++i)
+		(*out_)[section + i] = static_cast<uint8_t> (size >> (8 * i));
+}
+
+void SnapshotWriter::WriteBytes(uint64_t value, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		out_->push_back(static_cast<uint8_t> (value >> (8 * i)));
+}
+
+SnapshotReader::SnapshotReader(const uint8_t* data, size_t size) :
+	data_(data),
+	size_(size)
+{
+}
+
+bool SnapshotReader::ReadBool(bool* value)
+{
+	uint64_t bits;
+	if (!ReadBytes(1, &bits))
+		return false;
+	if (bits > 1)
+		return Fail();
+	*value = bits == 1;
+	return true;
+}
+
+bool SnapshotReader::ReadUint8(uint8_t* value)
+{
+	uint64_t bits;
+	if (!ReadBytes(1, &bits))
+		return false;
+	*value = static_cast<uint8_t> (bits);
+	return true;
+}
+
+bool SnapshotReader::ReadUint32(uint32_t* value)
+{
+	uint64_t bits;
+	if (!ReadBytes(4, &bits))
+		return false;
+	*value = static_cast<uint32_t> (bits);
+	return true;
+}
+
+bool SnapshotReader::ReadUint64(uint64_t* value)
+{
+	return ReadBytes(8, value);
+}
+
+bool SnapshotReader::ReadInt32(int32_t* value)
+{
+	uint32_t bits;
+	if (!ReadUint32(&bits))
+		return false;
+	*value = static_cast<int32_t> (bits);
+	return true;
+}
+
+bool SnapshotReader::ReadInt64(int64_t* value)
+{
+	uint64_t bits;
+	if (!ReadBytes(8, &bits))
+		return false;
+	*value = static_cast<int64_t> (bits);
+	return true;
+}
+
+bool SnapshotReader::ReadFloat(float* value)
+{
+	uint32_t bits;
+	if (!ReadUint32(&bits))
+		return false;
+	memcpy(value, &bits, sizeof(bits));
+	return true;
+}
+
+bool SnapshotReader::ReadDouble(double* value)
+{
+	uint64_t bits;
+	if (!ReadBytes(8, &bits))
+		return false;
+	memcpy(value, &bits, sizeof(bits));
+	return true;
+}
+
+bool SnapshotReader::ReadSection(SnapshotReader* section)
+{
+	uint64_t size;
+	if (!ReadBytes(kSectionSizeBytes, &size))
+		return false;
+	if (size > remaining())
+		return Fail();
+	*section = SnapshotReader(data_ + offset_, static_cast<size_t> (size));
+	offset_ += static_cast<size_t> (size);
+	return true;
+}
+
+bool SnapshotReader::Fail()
+{
+	ok_ = false;
+	return false;
+}
+
+bool SnapshotReader::ReadBytes(size_t count, uint64_t* value)
+{
+	if (!ok_ || count > remaining())
+		return Fail();
+	uint64_t result = 0;
+	for (size_t i = 0; i < count; ++i)
+		result |= static_cast<uint64_t> (data_[offset_ + i]) << (8 * i);
+	offset_ += count;
+	*value = result;
+	return true;
+}
+
+uint64_t SnapshotChecksum(const uint8_t* data, size_t size)
+{
+	uint64_t hash = kFnvOffsetBasis;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= data[i];
+		hash *= kFnvPrime;
+	}
+	return hash;
+}
@@ -0,0 +1,86 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_SNAPSHOT_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_SNAPSHOT_H_
+
+// Encoding of controller snapshots, which carry the state of a connection's
+// controller to another process or host. Values are stored in little-endian
+// byte order whatever the host's, floating-point values as their IEEE bit
+// patterns.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// SnapshotWriter appends values to a byte vector.
+
+class SnapshotWriter
+{
+public:
+	// Appends to |out|, which is not owned.
+	explicit SnapshotWriter(std::vector<uint8_t>* out);
+
+	void WriteBool(bool value);
+	void WriteUint8(uint8_t value);
+	void WriteUint32(uint32_t value);
+	void WriteUint64(uint64_t value);
+	void WriteInt32(int32_t value);
+	void WriteInt64(int64_t value);
+	void WriteFloat(float value);
+	void WriteDouble(double value);
+
+	// Starts a section, whose size in bytes precedes it once EndSection()
+	// is called with the returned handle. A SnapshotReader reads it with
+	// ReadSection().
+	size_t BeginSection();
+	void EndSection(size_t section);
+
+	// Bytes written so far, including any before the writer was created.
+	size_t size() const { return out_->size(); }
+
+private:
+	void WriteBytes(uint64_t value, size_t count);
+
+	std::vector<uint8_t>* out_;
+};
+
+// SnapshotReader reads the values of a SnapshotWriter back. A read past the
+// end, or a call to Fail(), makes this and all later reads fail.
+
+class SnapshotReader
+{
+public:
+	// Reads |size| bytes at |data|, which are not owned.
+	SnapshotReader(const uint8_t* data, size_t size);
+
+	bool ReadBool(bool* value);
+	bool ReadUint8(uint8_t* value);
+	bool ReadUint32(uint32_t* value);
+	bool ReadUint64(uint64_t* value);
+	bool ReadInt32(int32_t* value);
+	bool ReadInt64(int64_t* value);
+	bool ReadFloat(float* value);
+	bool ReadDouble(double* value);
+	// Reads a section written between BeginSection() and EndSection() into a
+	// reader of its own.
+	bool ReadSection(SnapshotReader* section);
+
+	// Marks the data as malformed, e.g. when a value is out of range, and
+	// returns false.
+	bool Fail();
+
+	// Whether every read so far succeeded.
+	bool ok() const { return ok_; }
+	size_t remaining() const { return size_ - offset_; }
+
+private:
+	bool ReadBytes(size_t count, uint64_t* value);
+
+	const uint8_t* data_;
+	size_t size_;
+	size_t offset_ = 0;
+	bool ok_ = true;
+};
+
+// Returns the FNV-1a hash of the |size| bytes at |data|.
+uint64_t SnapshotChecksum(const uint8_t* data, size_t size);
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_SNAPSHOT_H_
@@ -0,0 +1,160 @@
+#include "TimingWheel.h"
+
+namespace
+{
+	// Index of the highest set bit of |value|, which is not 0.
+	int HighestBit(uint64_t value)
+	{
+		return 63 - __builtin_clzll(value);
+	}
+
+	int LowestBit(uint64_t value)
+	{
+		return __builtin_ctzll(value);
+	}
+} // namespace
+
+TimingWheel::TimingWheel(size_t max_timers) :
+	timers_(max_timers)
+{ }
+
+void TimingWheel::Set(uint32_t timer, uint64_t deadline_tick)
+{
+	if (timers_[timer].list != kNone)
+		Unlink(timer);
+	timers_[timer].deadline = deadline_tick;
+	Insert(timer);
+}
+
+void TimingWheel::Cancel(uint32_t timer)
+{
+	if (timers_[timer].list != kNone)
+		Unlink(timer);
+}
+
+void TimingWheel::Advance(uint64_t tick)
+{
+	int level;
+	uint64_t slot;
+	while (NextSlot(&level, &slot))
+	{
+		uint64_t start = SlotStart(level, slot);
+		if (start > tick)
+			break;
+
+		// Every timer in the slot now differs from the current tick in a lower
+		// digit, or is due.
+		current_tick_ = start;
+		uint32_t list = level == kNumLevels ? kOverflowList : static_cast<uint32_t> (level * kSlotsPerLevel + slot);
+		uint32_t timer = lists_[list].first;
+		lists_[list] = List();
+		if (level < kNumLevels)
+			occupied_[level] &= ~(1ULL << slot);
+		while (timer != kNone)
+		{
+			uint32_t next = timers_[timer].next;
+			timers_[timer].list = kNone;
+			Insert(timer);
+			timer = next;
+		}
+	}
+	if (tick > current_tick_)
+		current_tick_ = tick;
+}
+
+uint64_t TimingWheel::NextDeadlineBound() const
+{
+	if (has_expired())
+		return current_tick_;
+
+	int level;
+	uint64_t slot;
+	if (!NextSlot(&level, &slot))
+		return kNever;
+	return SlotStart(level, slot);
+}
+
+void TimingWheel::Insert(uint32_t timer)
+{
+	uint64_t deadline = timers_[timer].deadline;
+	if (deadline <= current_tick_)
+	{
+		Append(kExpiredList, timer);
+		return;
+	}
+
+	int level = HighestBit(deadline ^ current_tick_) / kBitsPerLevel;
+	if (level >= kNumLevels)
+	{
+		Append(kOverflowList, timer);
+		return;
+	}
+	uint64_t slot = (deadline >> (level * kBitsPerLevel)) & (kSlotsPerLevel - 1);
+	Append(static_cast<uint32_t> (level * kSlotsPerLevel + slot), timer);
+	occupied_[level] |= 1ULL << slot;
+}
+
+void TimingWheel::Append(uint32_t list, uint32_t timer)
+{
+	Timer& entry = timers_[timer];
+	entry.list = list;
+	entry.next = kNone;
+	entry.previous = lists_[list].last;
+	if (lists_[list].last == kNone)
+		lists_[list].first = timer;
+	else
+		timers_[lists_[list].last].next = timer;
+	lists_[list].last = timer;
+}
+
+void TimingWheel::Unlink(uint32_t timer)
+{
+	Timer& entry = timers_[timer];
+	List& list = lists_[entry.list];
+	if (entry.previous == kNone)
+		list.first = entry.next;
+	else
+		timers_[entry.previous].next = entry.next;
+	if (entry.next == kNone)
+		list.last = entry.previous;
+	else
+		timers_[entry.next].previous = entry.previous;
+
+	if (list.first == kNone && entry.list < kExpiredList)
+		occupied_[entry.list / kSlotsPerLevel] &= ~(1ULL << (entry.list % kSlotsPerLevel));
+	entry.list = kNone;
+	entry.previous = kNone;
+	entry.next = kNone;
+}
+
+bool TimingWheel::NextSlot(int* level, uint64_t* slot) const
+{
+	// Pending timers of a level are in slots after the current tick's digit,
+	// and all of them come before those of higher levels.
+	for (int i = 0; i < kNumLevels; ++i)
+	{
+		uint64_t digit = (current_tick_ >> (i * kBitsPerLevel)) & (kSlotsPerLevel - 1);
+		uint64_t later = digit + 1 == kSlotsPerLevel ? 0 : occupied_[i] & (~0ULL << (digit + 1));
+		if (later != 0)
+		{
+			*level = i;
+			*slot = static_cast<uint64_t> (LowestBit(later));
+			return true;
+		}
+	}
+	if (lists_[kOverflowList].first != kNone)
+	{
+		*level = kNumLevels;
+		*slot = 0;
+		return true;
+	}
+	return false;
+}
+
+uint64_t TimingWheel::SlotStart(int level, uint64_t slot) const
+{
+	int turn_bits = (level + 1) * kBitsPerLevel;
+	if (level == kNumLevels)
+		return ((current_tick_ >> (kNumLevels * kBitsPerLevel)) + 1) << (kNumLevels * kBitsPerLevel);
+	return ((current_tick_ >> turn_bits) << turn_bits) | (slot << (level * kBitsPerLevel));
+}
@@ -0,0 +1,93 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_TIMING_WHEEL_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_TIMING_WHEEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// TimingWheel, a hierarchical timing wheel of timers with ids 0 to
+// max_timers - 1, each either idle, pending until a deadline tick, or
+// expired. A pending timer sits in the slot of the highest base-64 digit in
+// which its deadline differs from the current tick, and cascades to lower
+// levels as the wheel turns. Setting, cancelling and expiring a timer take
+// constant time; turning the wheel costs one step per non-empty slot passed,
+// however far it turns. Deadlines beyond the top level wait in an overflow
+// list that is refiled each time the top level turns over.
+
+class TimingWheel
+{
+public:
+	// Slots per level.
+	static constexpr uint64_t kSlotsPerLevel = 64;
+	// Levels, which cover deadlines within the current block of 64^4 ticks.
+	static constexpr int kNumLevels = 4;
+	// Deadline of a timer that is not set.
+	static constexpr uint64_t kNever = UINT64_MAX;
+
+	explicit TimingWheel(size_t max_timers);
+
+	// Sets |timer| to expire at |deadline_tick|, replacing its previous
+	// deadline. A deadline that is not after the current tick expires at once.
+	void Set(uint32_t timer, uint64_t deadline_tick);
+	// Makes |timer| idle.
+	void Cancel(uint32_t timer);
+
+	// Turns the wheel to |tick|, expiring every timer due by then. The wheel
+	// does not turn back.
+	void Advance(uint64_t tick);
+
+	// Expired timers, in the order they expired, until set or cancelled.
+	bool has_expired() const { return lists_[kExpiredList].first != kNone; }
+	uint32_t first_expired() const { return lists_[kExpiredList].first; }
+
+	// A tick no later than the earliest deadline of the pending timers, exact
+	// for deadlines within 64 ticks, or kNever without pending timers.
+	uint64_t NextDeadlineBound() const;
+
+	// Deadline of |timer|, or kNever if it is idle.
+	uint64_t deadline(uint32_t timer) const { return timers_[timer].list == kNone ? kNever : timers_[timer].deadline; }
+	bool is_expired(uint32_t timer) const { return timers_[timer].list == kExpiredList; }
+	uint64_t current_tick() const { return current_tick_; }
+
+private:
+	static constexpr uint32_t kNone = UINT32_MAX;
+	// Bits of the tick below the digit of each level.
+	static constexpr int kBitsPerLevel = 6;
+	// Indices of the expired and overflow lists, after the slot lists of all
+	// levels.
+	static constexpr uint32_t kExpiredList = kNumLevels * kSlotsPerLevel;
+	static constexpr uint32_t kOverflowList = kExpiredList + 1;
+
+	struct Timer
+	{
+		uint64_t deadline = 0;
+		uint32_t previous = kNone;
+		uint32_t next = kNone;
+		// List holding the timer, or kNone when idle.
+		uint32_t list = kNone;
+	};
+
+	struct List
+	{
+		uint32_t first = kNone;
+		uint32_t last = kNone;
+	};
+
+	// Files |timer|, which is in no list, by its deadline.
+	void Insert(uint32_t timer);
+	void Append(uint32_t list, uint32_t timer);
+	void Unlink(uint32_t timer);
+	// The level and slot of the earliest non-empty slot, if any. The overflow
+	// list is level kNumLevels.
+	bool NextSlot(int* level, uint64_t* slot) const;
+	// First tick of |slot| of |level| on the current turn of that level.
+	uint64_t SlotStart(int level, uint64_t slot) const;
+
+	std::vector<Timer> timers_;
+	List lists_[kOverflowList + 1];
+	// Bit s of occupied_[l] is set if slot s of level l is non-empty.
+	uint64_t occupied_[kNumLevels] = {};
+	uint64_t current_tick_ = 0;
+};
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_TIMING_WHEEL_H_
@@ -0,0 +1,268 @@
+#include "Trace.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define PCC_TRACE_MMAP
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static_assert(sizeof(TraceRecord) == 64, "a TraceRecord is one cache line");
+static_assert(sizeof(TraceFileHeader) == 64, "the file header is one cache line");
+static_assert(sizeof(TraceChunkHeader) == 64, "a chunk header is one cache line");
+
+std::atomic<bool> Trace::enabled_(false);
+
+namespace
+{
+	// Time spent calibrating the time stamp counter when a trace starts.
+	const std::chrono::milliseconds kCalibrationTime(10);
+
+	const char* const kTypeNames[NUM_TRACE_RECORD_TYPES] = {
+		"interval_created",
+		"interval_packets",
+		"utility",
+		"gradient",
+		"rate_change",
+		"mode_change"
+	};
+
+	const char* const kFieldNames[NUM_TRACE_RECORD_TYPES][TraceRecord::kNumValues] = {
+		{ "sending_rate", "is_useful", "rtt_fluctuation_tolerance_ratio", "rtt_us", "end_time_us", "mode" },
+		{ "first_packet_number", "packets_acked", "packets_lost", "bytes_acked", "bytes_lost", "bytes_sent" },
+		{ "sending_rate", "bytes_sent", "bytes_lost", "duration_us", "latency_inflation", "utility" },
+		{ "rate_1", "utility_1", "rate_2", "utility_2", "gradient", "avg_gradient" },
+		{ "old_rate", "new_rate", "reason", "mode", "rounds", "proportion_allowance" },
+		{ "old_mode", "new_mode", "sending_rate", "rounds", "", "" }
+	};
+
+	uint64_t ReadTimestamp()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return static_cast<uint64_t> (std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+	}
+
+	// Estimates the rate of ReadTimestamp() against the steady clock.
+	double MeasureTicksPerSecond()
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		uint64_t start_ticks = ReadTimestamp();
+		std::this_thread::sleep_for(kCalibrationTime);
+		uint64_t end_ticks = ReadTimestamp();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return static_cast<double> (end_ticks - start_ticks) / seconds;
+	}
+
+	// The running trace. Start and Stop hold |mutex|; writers only touch the
+	// mapping between raising and lowering |active_flushes|, which Stop waits
+	// out after disabling tracing.
+	struct TraceSession
+	{
+		std::mutex mutex;
+		int fd = -1;
+		uint8_t* base = nullptr;
+		size_t mapped_bytes = 0;
+		uint64_t num_chunks = 0;
+		std::atomic<uint64_t> next_chunk{0};
+		std::atomic<uint64_t> generation{0};
+		std::atomic<int> active_flushes{0};
+	};
+
+	TraceSession session;
+	std::atomic<uint16_t> num_threads{0};
+	std::atomic<uint32_t> num_ids{0};
+
+	size_t ChunkBytes()
+	{
+		return sizeof(TraceChunkHeader) + Trace::kRecordsPerChunk * sizeof(TraceRecord);
+	}
+
+	// The records of one thread not yet copied to the file.
+	struct ThreadRing
+	{
+		ThreadRing() :
+			thread(num_threads.fetch_add(1, std::memory_order_relaxed))
+		{ }
+
+		~ThreadRing()
+		{
+			Flush();
+		}
+
+		void Flush();
+
+		TraceRecord records[Trace::kRecordsPerChunk];
+		size_t count = 0;
+		// Session the records belong to.
+		uint64_t generation = 0;
+		uint16_t thread;
+	};
+
+	thread_local ThreadRing ring;
+
+	void ThreadRing::Flush()
+	{
+		if (count == 0)
+			return;
+
+		session.active_flushes.fetch_add(1);
+		if (Trace::enabled() && generation == session.generation.load())
+		{
+			uint64_t chunk = session.next_chunk.fetch_add(1, std::memory_order_relaxed);
+			uint8_t* start = session.base + sizeof(TraceFileHeader) + (chunk % session.num_chunks) * ChunkBytes();
+			TraceChunkHeader* header = reinterpret_cast<TraceChunkHeader*> (start);
+			memcpy(start + sizeof(TraceChunkHeader), records, count * sizeof(TraceRecord));
+			header->thread = thread;
+			header->num_records = static_cast<uint32_t> (count);
+			header->sequence = chunk + 1;
+		}
+		session.active_flushes.fetch_sub(1);
+		count = 0;
+	}
+} // namespace
+
+bool Trace::Start(const std::string& path, size_t file_bytes, std::string* error)
+{
+#if defined(PCC_TRACE_MMAP)
+	std::lock_guard<std::mutex> lock(session.mutex);
+	if (session.base != nullptr)
+	{
+		if (error != nullptr)
+			*error = "a trace is already running";
+		return false;
+	}
+
+	uint64_t num_chunks = file_bytes > sizeof(TraceFileHeader) + ChunkBytes()
+		? (file_bytes - sizeof(TraceFileHeader)) / ChunkBytes()
+		: 1;
+	size_t mapped_bytes = sizeof(TraceFileHeader) + num_chunks * ChunkBytes();
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, static_cast<off_t> (mapped_bytes)) != 0)
+	{
+		if (error != nullptr)
+			*error = "cannot create " + path + ": " + strerror(errno);
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+	void* base = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED)
+	{
+		if (error != nullptr)
+			*error = "cannot map " + path + ": " + strerror(errno);
+		close(fd);
+		return false;
+	}
+
+	TraceFileHeader* header = static_cast<TraceFileHeader*> (base);
+	memset(header, 0, sizeof(*header));
+	header->magic = TraceFileHeader::kMagic;
+	header->record_size = sizeof(TraceRecord);
+	header->records_per_chunk = kRecordsPerChunk;
+	header->num_chunks = num_chunks;
+	header->ticks_per_second = MeasureTicksPerSecond();
+	header->start_timestamp = ReadTimestamp();
+
+	session.fd = fd;
+	session.base = static_cast<uint8_t*> (base);
+	session.mapped_bytes = mapped_bytes;
+	session.num_chunks = num_chunks;
+	session.next_chunk.store(0);
+	session.generation.fetch_add(1);
+	enabled_.store(true);
+	return true;
+#else
+	(void) path;
+	(void) file_bytes;
+	if (error != nullptr)
+		*error = "tracing needs mmap";
+	return false;
+#endif
+}
+
+void Trace::Stop()
+{
+#if defined(PCC_TRACE_MMAP)
+	std::lock_guard<std::mutex> lock(session.mutex);
+	if (session.base == nullptr)
+		return;
+
+	Flush();
+	enabled_.store(false);
+	while (session.active_flushes.load() != 0)
+		std::this_thread::yield();
+	munmap(session.base, session.mapped_bytes);
+	close(session.fd);
+	session.base = nullptr;
+	session.fd = -1;
+#endif
+}
+
+void Trace::Flush()
+{
+	ring.Flush();
+}
+
+uint32_t Trace::NewId()
+{
+	return num_ids.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void Trace::Record(TraceRecordType type,
+	uint32_t controller,
+	double value0,
+	double value1,
+	double value2,
+	double value3,
+	double value4,
+	double value5)
+{
+	ThreadRing& local = ring;
+	uint64_t generation = session.generation.load(std::memory_order_relaxed);
+	if (local.generation != generation)
+	{
+		// Drop what is left from an earlier trace.
+		local.count = 0;
+		local.generation = generation;
+	}
+
+	TraceRecord& record = local.records[local.count];
+	record.timestamp = ReadTimestamp();
+	record.controller = controller;
+	record.type = type;
+	record.thread = local.thread;
+	record.values[0] = value0;
+	record.values[1] = value1;
+	record.values[2] = value2;
+	record.values[3] = value3;
+	record.values[4] = value4;
+	record.values[5] = value5;
+	if (++local.count == kRecordsPerChunk)
+		local.Flush();
+}
+
+const char* TraceRecordTypeName(uint16_t type)
+{
+	return type < NUM_TRACE_RECORD_TYPES ? kTypeNames[type] : "unknown";
+}
+
+const char* TraceFieldName(uint16_t type, size_t field)
+{
+	if (type >= NUM_TRACE_RECORD_TYPES || field >= TraceRecord::kNumValues)
+		return "";
+	return kFieldNames[type][field];
+}
@@ -0,0 +1,144 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_TRACE_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_TRACE_H_
+
+// Binary trace of controller decisions. While a trace is running, each
+// thread appends fixed-size records to a ring of its own and copies the ring
+// into the next free chunk of a memory-mapped trace file whenever it fills.
+// The file wraps around, keeping the most recent chunks. Tracing is toggled
+// at runtime; while it is off, a trace point costs one relaxed load and a
+// branch. pcc_trace decodes trace files to text or CSV.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// What a TraceRecord describes. The meaning of its values is listed with
+// each type, in order; TraceFieldName() names them.
+enum TraceRecordType : uint16_t
+{
+	// A monitor interval was started: sending rate, is useful, RTT
+	// fluctuation tolerance ratio, RTT in microseconds, end time in
+	// microseconds and sender mode.
+	TRACE_INTERVAL_CREATED,
+	// Acks and losses were attributed to a useful interval: first packet
+	// number, packets acked, packets lost, bytes acked, bytes lost and bytes
+	// sent.
+	TRACE_INTERVAL_PACKETS,
+	// The utility of an interval was computed: sending rate, bytes sent, bytes
+	// lost, duration in microseconds, latency inflation and utility.
+	TRACE_UTILITY,
+	// A rate change was computed from two utilities: rate 1, utility 1, rate 2,
+	// utility 2, gradient and average gradient.
+	TRACE_GRADIENT,
+	// The sending rate changed: old rate, new rate, TraceRateChangeReason,
+	// sender mode, rounds in the mode and proportional change allowance.
+	TRACE_RATE_CHANGE,
+	// The sender mode changed: old mode, new mode, sending rate and rounds in
+	// the old mode.
+	TRACE_MODE_CHANGE,
+	NUM_TRACE_RECORD_TYPES
+};
+
+// Why a TRACE_RATE_CHANGE happened.
+enum TraceRateChangeReason
+{
+	// Doubled in STARTING mode.
+	TRACE_RATE_STARTING,
+	// Probing a higher or lower rate.
+	TRACE_RATE_PROBE,
+	// Back to the central rate of PROBING mode.
+	TRACE_RATE_RESTORE,
+	// Moved along the utility gradient in DECISION_MADE mode.
+	TRACE_RATE_DECISION,
+	// Started from a PathCache entry.
+	TRACE_RATE_WARM_START
+};
+
+// TraceRecord, one traced event: 64 bytes, one cache line.
+
+struct TraceRecord
+{
+	static const size_t kNumValues = 6;
+
+	// Time stamp counter ticks, see TraceFileHeader::ticks_per_second.
+	uint64_t timestamp;
+	// Trace id of the controller, see Trace::NewId().
+	uint32_t controller;
+	uint16_t type;
+	// Index of the writing thread.
+	uint16_t thread;
+	double values[kNumValues];
+};
+
+// TraceFileHeader, at the start of a trace file. The chunks follow, each a
+// TraceChunkHeader and records_per_chunk records.
+
+struct TraceFileHeader
+{
+	// "PCCTRACE" in little-endian byte order.
+	static const uint64_t kMagic = 0x4543415254434350ULL;
+
+	uint64_t magic;
+	uint32_t record_size;
+	uint32_t records_per_chunk;
+	uint64_t num_chunks;
+	// Rate of TraceRecord::timestamp.
+	double ticks_per_second;
+	// Timestamp when the trace started.
+	uint64_t start_timestamp;
+	uint8_t reserved[24];
+};
+
+struct TraceChunkHeader
+{
+	// Order in which the chunk was written, starting at 1; 0 if unused.
+	uint64_t sequence;
+	uint32_t thread;
+	uint32_t num_records;
+	uint8_t reserved[48];
+};
+
+class Trace
+{
+public:
+	// Records per per-thread ring, and per chunk of the file.
+	static const size_t kRecordsPerChunk = 255;
+	// Size of a trace file by default.
+	static const size_t kDefaultFileBytes = 64 << 20;
+
+	// Starts tracing into a new file at |path| of about |file_bytes|. Returns
+	// false, with the reason in |error| if it is not null, if the file cannot
+	// be mapped or a trace is already running.
+	static bool Start(const std::string& path, size_t file_bytes, std::string* error);
+	// Stops tracing and closes the file. Records still in the rings of other
+	// threads are lost; threads keep theirs with Flush().
+	static void Stop();
+	// Copies the calling thread's ring into the file. Rings are also flushed
+	// when full and when their thread exits.
+	static void Flush();
+
+	static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+	// Returns a new id for a traced controller.
+	static uint32_t NewId();
+
+	// Appends a record. Call only if enabled().
+	static void Record(TraceRecordType type,
+		uint32_t controller,
+		double value0,
+		double value1 = 0,
+		double value2 = 0,
+		double value3 = 0,
+		double value4 = 0,
+		double value5 = 0);
+
+private:
+	static std::atomic<bool> enabled_;
+};
+
+// Name of |type|, and of its value |field|.
+const char* TraceRecordTypeName(uint16_t type);
+const char* TraceFieldName(uint16_t type, size_t field);
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_TRACE_H_
@@ -0,0 +1,106 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_UTILITY_FUNCTIONS_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_UTILITY_FUNCTIONS_H_
+
+// Utility functions for BasicMonitorIntervalQueue and
+// BasicCongestionController. A utility function is a class with a static
+// member
+//   static float Utility(const MonitorInterval& interval,
+//       float mi_duration_us,
+//       const PccConfig& config);
+// that returns the utility of the completed |interval|, whose packets were
+// sent over |mi_duration_us| microseconds, with the coefficients of |config|.
+// It is resolved at compile time, so each controller pays only for its own
+// formula.
+
+#include <algorithm>
+#include <cmath>
+
+#include "FixedPoint.h"
+#include "MonitorIntervalQueue.h"
+#include "PccConfig.h"
+#include "VivaceUtility.h"
+
+// VivaceLatencyUtility, the PCC Vivace utility: the sending rate to the
+// power 0.9, less penalties proportional to the RTT gradient and the loss
+// rate. See CalculateVivaceUtility, or CalculateVivaceUtilityFixedPoint if
+// the config asks for fixed_point_arithmetic.
+
+struct VivaceLatencyUtility
+{
+	static float Utility(const MonitorInterval& interval, float mi_duration_us, const PccConfig& config)
+	{
+		if (config.fixed_point_arithmetic)
+		{
+			// Duration from the send times rather than the rounded float.
+			QuicTime duration_us = std::max<QuicTime>(1, interval.last_packet_sent_time - interval.first_packet_sent_time);
+			float latency_inflation_percent = interval.LatencyInflation() * 100;
+			// Beyond the range CalculateVivaceUtilityFixedPoint clamps to anyway.
+			const float kMaxPercent = 100000.0f;
+			if (!std::isfinite(latency_inflation_percent))
+				latency_inflation_percent = 0.0f;
+			latency_inflation_percent = std::max(-kMaxPercent, std::min(kMaxPercent, latency_inflation_percent));
+			FixedPoint utility = CalculateVivaceUtilityFixedPoint(interval.bytes_sent,
+				interval.bytes_lost,
+				duration_us,
+				interval.n_packets,
+				static_cast<int32_t> (latency_inflation_percent),
+				ToFixedPoint(config.vivace_utility));
+			return static_cast<float> (FromFixedPoint(utility));
+		}
+		return CalculateVivaceUtility(static_cast<float> (interval.bytes_sent),
+			static_cast<float> (interval.bytes_lost),
+			mi_duration_us,
+			interval.n_packets,
+			interval.LatencyInflation(),
+			config.vivace_utility);
+	}
+};
+
+// VivaceLossUtility, the PCC Allegro loss-based utility: the throughput
+// scaled by sigmoids of the loss rate and of the RTT change over the
+// interval, less the rate of lost bytes. Ignores RTT changes within the
+// interval's rtt_fluctuation_tolerance_ratio.
+
+struct VivaceLossUtility
+{
+	static float Utility(const MonitorInterval& interval, float mi_duration_us, const PccConfig& config)
+	{
+		const LossUtilityCoefficients& coefficients = config.loss_utility;
+		float rtt_ratio = interval.rtt_on_monitor_end_us == 0 ? 1.0f :
+			static_cast<float> (interval.rtt_on_monitor_start_us) /
+			static_cast<float> (interval.rtt_on_monitor_end_us);
+		if (rtt_ratio > 1.0f - interval.rtt_fluctuation_tolerance_ratio &&
+			rtt_ratio < 1.0f + interval.rtt_fluctuation_tolerance_ratio)
+			rtt_ratio = 1.0f;
+		float latency_penalty = 1.0f - 1.0f / (1.0f + std::exp(coefficients.rtt_coefficient * (1.0f - rtt_ratio)));
+
+		float bytes_acked = static_cast<float> (interval.bytes_acked);
+		float bytes_lost = static_cast<float> (interval.bytes_lost);
+		float loss_rate = bytes_lost / static_cast<float> (interval.bytes_sent);
+		float loss_penalty = 1.0f - 1.0f / (1.0f + std::exp(coefficients.loss_coefficient * (loss_rate - coefficients.loss_tolerance)));
+
+		return (bytes_acked / mi_duration_us * loss_penalty * latency_penalty -
+			bytes_lost / mi_duration_us) * 1000.0f;
+	}
+};
+
+// ScavengerUtility, a low-priority utility in the style of PCC Proteus-S:
+// the Vivace utility less a penalty proportional to the RTT deviation, so
+// the flow backs off as soon as competing traffic makes the RTT jitter,
+// before a Vivace flow would see inflation.
+
+struct ScavengerUtility
+{
+	// Number of bits per Mbit.
+	static constexpr float kMegabit = 1024.0f * 1024.0f;
+
+	static float Utility(const MonitorInterval& interval, float mi_duration_us, const PccConfig& config)
+	{
+		float sending_rate_mbps = static_cast<float> (interval.bytes_sent) * 8.0f / (mi_duration_us / 1000000.0f) / kMegabit;
+		float rtt_deviation_seconds = static_cast<float> (interval.rtt_samples.RttDeviation()) / 1000000.0f;
+		return VivaceLatencyUtility::Utility(interval, mi_duration_us, config) -
+			config.scavenger_rtt_deviation_coefficient * sending_rate_mbps * rtt_deviation_seconds;
+	}
+};
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_UTILITY_FUNCTIONS_H_
@@ -0,0 +1,36 @@
+#include "VivaceUtility.h"
+
+#include <cmath>
+#include <cstddef>
+
+namespace
+{
+	// Number of microseconds per second.
+	const float kNumMicrosPerSecond = 1000000.0f;
+	// Number of bits per Mbit.
+	const size_t kMegabit = 1024 * 1024;
+	// The Vivace utility constants.
+	const VivaceUtilityCoefficients kVivaceCoefficients;
+} // namespace
+
+float CalculateVivaceUtility(float bytes_sent, float bytes_lost, float mi_duration_us, int32_t n_packets, float latency_inflation)
+{
+	return CalculateVivaceUtility(bytes_sent, bytes_lost, mi_duration_us, n_packets, latency_inflation, kVivaceCoefficients);
+}
+
+float CalculateVivaceUtility(float bytes_sent, float bytes_lost, float mi_duration_us, int32_t n_packets, float latency_inflation, const VivaceUtilityCoefficients& coefficients)
+{
+	float mi_time_seconds = mi_duration_us / kNumMicrosPerSecond;
+
+	float sending_rate_bps = bytes_sent * 8.0f / mi_time_seconds;
+	float sending_factor = coefficients.alpha * pow(sending_rate_bps / kMegabit, coefficients.exponent);
+
+	float rtt_penalty = int(int(latency_inflation * 100) / 100.0 * 100) / 2 * 2 / 100.0;
+	float rtt_contribution = coefficients.latency_coefficient * bytes_sent * (pow(rtt_penalty, 1));
+
+	float loss_rate = bytes_lost / bytes_sent;
+	float loss_contribution = n_packets * (coefficients.loss_coefficient * (pow((1 + loss_rate), 1) - 1));
+	if (loss_rate <= coefficients.loss_tolerance)
+		loss_contribution = n_packets * (1 * (pow((1 + loss_rate), 1) - 1));
+	return sending_factor - (loss_contribution + rtt_contribution) * (sending_rate_bps / kMegabit) / static_cast<float> (n_packets);
+}
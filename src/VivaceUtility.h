@@ -0,0 +1,40 @@
+#ifndef THIRD_PARTY_PCC_QUIC_PCC_VIVACE_UTILITY_H_
+#define THIRD_PARTY_PCC_QUIC_PCC_VIVACE_UTILITY_H_
+
+#include <cstdint>
+
+// VivaceUtilityCoefficients, the constants of the Vivace latency-based
+// utility.
+
+struct VivaceUtilityCoefficients
+{
+	// Alpha factor of the sending rate term.
+	float alpha = 1.0f;
+	// Exponent of the sending rate in Mbit/s.
+	float exponent = 0.9f;
+	// Coefficient of the latency term.
+	float latency_coefficient = 11330.0f;
+	// Loss rate up to which lost packets cost 1 each.
+	double loss_tolerance = 0.03;
+	// Cost of a lost packet beyond |loss_tolerance|.
+	double loss_coefficient = 11.35;
+};
+
+// Returns the Vivace latency-based utility of a monitor interval that sent
+// |bytes_sent| bytes over |mi_duration_us| microseconds in |n_packets|
+// packets, lost |bytes_lost| of them and saw |latency_inflation| relative RTT
+// growth, with the default coefficients.
+float CalculateVivaceUtility(float bytes_sent,
+	float bytes_lost,
+	float mi_duration_us,
+	int32_t n_packets,
+	float latency_inflation);
+// As above with the given |coefficients|.
+float CalculateVivaceUtility(float bytes_sent,
+	float bytes_lost,
+	float mi_duration_us,
+	int32_t n_packets,
+	float latency_inflation,
+	const VivaceUtilityCoefficients& coefficients);
+
+#endif  // THIRD_PARTY_PCC_QUIC_PCC_VIVACE_UTILITY_H_
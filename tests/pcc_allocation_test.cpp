@@ -0,0 +1,327 @@
+// pcc_allocation_test: checks that a controller makes no heap allocations
+// in OnPacketSent, OnCongestionEvent or OnTimer once warmed up, in every
+// sender mode and on the quiescent fast path, with either form of acks.
+//
+// Every operator new of the process is counted, and the count is read
+// around each call to the controller. A first flow warms up a slab of
+// monitor intervals the way a FlowTable slot would be, acked in order; a
+// second flow on the same slab then runs from STARTING on with another
+// seed, reordered acks, spurious losses and gaps in its packet numbers, and
+// may not allocate at all.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "CongestionController.h"
+#include "PccConfig.h"
+
+namespace
+{
+	// Calls to operator new, counted by the replacements below. The test is
+	// single-threaded.
+	uint64_t num_allocations = 0;
+} // namespace
+
+void* operator new(size_t size)
+{
+	++num_allocations;
+	if (void* memory = malloc(size == 0 ? 1 : size))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	++num_allocations;
+	size_t align = static_cast<size_t> (alignment);
+	if (void* memory = aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept
+{
+	free(memory);
+}
+
+namespace
+{
+	const double kBandwidthBps = 100e6;
+	const QuicTime kRttUs = 20000;
+	const QuicByteCount kPacketSize = 1400;
+	// One bandwidth-delay product.
+	const double kBufferBytes = kBandwidthBps / 8 * kRttUs / 1e6;
+	const size_t kAckBatch = 8;
+	// Long enough for many PROBING and DECISION_MADE rounds.
+	const QuicTime kFlowDurationUs = 20000000;
+	// DECISION_MADE rounds with a steady gradient before the quiescent flows
+	// take the fast path.
+	const size_t kQuiescentRounds = 3;
+	// Sender modes, and the quiescent fast path counted apart from
+	// DECISION_MADE.
+	const size_t kNumStates = 4;
+	const size_t kQuiescentState = 3;
+	const char* const kStateNames[] = { "starting", "probing", "decision_made", "quiescent" };
+
+	// How a flow numbers its packets and reports them.
+	struct Pattern
+	{
+		uint64_t random_seed;
+		// Every |reorder_period|th ack batch is reported in reverse, unless 0.
+		size_t reorder_period;
+		// Every |spurious_loss_period|th packet delivered is reported lost and
+		// then acked with the next batch, unless 0.
+		size_t spurious_loss_period;
+		// |gap_size| packet numbers are skipped after every |gap_period|th
+		// packet sent, unless 0.
+		size_t gap_period;
+		QuicPacketNumber gap_size;
+	};
+	const Pattern kWarmUpPattern = { 1, 0, 0, 0, 0 };
+	const Pattern kMeasuredPattern = { 2, 3, 97, 1000, 100 };
+
+	// Allocations and calls seen by the controller in each state.
+	struct AllocationCounts
+	{
+		uint64_t allocations[kNumStates] = {};
+		uint64_t calls[kNumStates] = {};
+	};
+
+	// Paces packets at the controller's rate into a drop-tail bottleneck and
+	// acks them |kAckBatch| at a time, as single packets or as ranges, as
+	// its Pattern says.
+	class Flow
+	{
+	public:
+		Flow(std::shared_ptr<const PccConfig> config, MonitorInterval* interval_storage, bool ranges, const Pattern& pattern) :
+			controller_(kRttUs, 10, 100000, config, interval_storage),
+			ranges_(ranges),
+			pattern_(pattern)
+		{
+			controller_.set_random_seed(pattern.random_seed);
+		}
+
+		// Runs the flow, adding the allocations of its controller to |counts|.
+		void Run(AllocationCounts* counts)
+		{
+			while (now_ < kFlowDurationUs)
+			{
+				SendPackets(counts);
+				DeliverAcks(counts);
+			}
+		}
+
+	private:
+		struct SentPacket
+		{
+			QuicPacketNumber packet_number;
+			QuicTime sent_time;
+			QuicTime ack_time;
+			bool lost;
+		};
+
+		// Counts the allocations of |call| to the controller.
+		template <class Call>
+		void Count(AllocationCounts* counts, Call call)
+		{
+			size_t state = controller_.is_quiescent() ? kQuiescentState : static_cast<size_t> (controller_.mode());
+			uint64_t before = num_allocations;
+			call();
+			counts->allocations[state] += num_allocations - before;
+			++counts->calls[state];
+		}
+
+		// Sends the packets due before the next ack batch arrives.
+		void SendPackets(AllocationCounts* counts)
+		{
+			while (in_flight_.size() - in_flight_head_ < kAckBatch ||
+				next_send_time_us_ <= in_flight_[in_flight_head_ + kAckBatch - 1].ack_time)
+			{
+				QuicTime sent_time = static_cast<QuicTime> (next_send_time_us_);
+				QuicPacketNumber packet_number = next_packet_number_++;
+				if (pattern_.gap_period > 0 && ++num_sent_ % pattern_.gap_period == 0)
+					next_packet_number_ += pattern_.gap_size;
+				Count(counts, [&]() { controller_.OnPacketSent(sent_time, packet_number, kPacketSize, true); });
+
+				double bytes_per_us = kBandwidthBps / 8 / 1e6;
+				queue_bytes_ = std::max(0.0, queue_bytes_ - (sent_time - queue_time_us_) * bytes_per_us);
+				queue_time_us_ = static_cast<double> (sent_time);
+				SentPacket packet;
+				packet.packet_number = packet_number;
+				packet.sent_time = sent_time;
+				packet.lost = queue_bytes_ + kPacketSize > kBufferBytes;
+				if (!packet.lost)
+					queue_bytes_ += kPacketSize;
+				packet.ack_time = sent_time + kRttUs + static_cast<QuicTime> (queue_bytes_ / bytes_per_us);
+				in_flight_.push_back(packet);
+				next_send_time_us_ += kPacketSize * 8 * 1e6 / std::max(controller_.PacingRate(), 1.0);
+			}
+		}
+
+		// Delivers the next ack batch, firing the controller's timer first if
+		// it is due.
+		void DeliverAcks(AllocationCounts* counts)
+		{
+			acked_packets_.clear();
+			lost_packets_.clear();
+			acked_ranges_.clear();
+			lost_ranges_.clear();
+			// The packets the previous batch reported lost arrive after all.
+			for (const SentPacket& packet : spurious_losses_)
+				AddEvent(packet, false);
+			spurious_losses_.clear();
+			QuicTime rtt = 0;
+			for (size_t i = 0; i < kAckBatch; ++i)
+			{
+				const SentPacket& packet = in_flight_[in_flight_head_ + i];
+				bool lost = packet.lost;
+				if (!lost && pattern_.spurious_loss_period > 0 && ++num_delivered_ % pattern_.spurious_loss_period == 0)
+				{
+					spurious_losses_.push_back(packet);
+					lost = true;
+				}
+				AddEvent(packet, lost);
+				if (!packet.lost)
+					rtt = packet.ack_time - packet.sent_time;
+				now_ = std::max(now_, packet.ack_time);
+			}
+			if (pattern_.reorder_period > 0 && ++num_batches_ % pattern_.reorder_period == 0)
+			{
+				std::reverse(acked_packets_.begin(), acked_packets_.end());
+				std::reverse(lost_packets_.begin(), lost_packets_.end());
+				std::reverse(acked_ranges_.begin(), acked_ranges_.end());
+				std::reverse(lost_ranges_.begin(), lost_ranges_.end());
+			}
+			in_flight_head_ += kAckBatch;
+			if (in_flight_head_ * 2 > in_flight_.size())
+			{
+				in_flight_.erase(in_flight_.begin(), in_flight_.begin() + in_flight_head_);
+				in_flight_head_ = 0;
+			}
+
+			QuicTime deadline = controller_.NextTimerDeadline();
+			if (deadline <= now_)
+				Count(counts, [&]() { controller_.OnTimer(deadline); });
+			if (ranges_)
+				Count(counts, [&]() { controller_.OnCongestionEvent(now_, rtt, acked_ranges_, lost_ranges_); });
+			else
+				Count(counts, [&]() { controller_.OnCongestionEvent(now_, rtt, acked_packets_, lost_packets_); });
+		}
+
+		// Reports |packet| acked or lost in the current batch.
+		void AddEvent(const SentPacket& packet, bool lost)
+		{
+			CongestionEvent event;
+			event.packet_number = packet.packet_number;
+			event.bytes_acked = lost ? 0 : static_cast<int32_t> (kPacketSize);
+			event.bytes_lost = lost ? static_cast<int32_t> (kPacketSize) : 0;
+			event.time = static_cast<uint64_t> (packet.ack_time);
+			(lost ? lost_packets_ : acked_packets_).push_back(event);
+			AddToRanges(packet.packet_number, lost ? &lost_ranges_ : &acked_ranges_);
+		}
+
+		static void AddToRanges(QuicPacketNumber packet_number, PacketNumberRangeVector* ranges)
+		{
+			if (ranges->empty() || ranges->back().last_packet_number + 1 != packet_number)
+			{
+				PacketNumberRange range;
+				range.first_packet_number = packet_number;
+				ranges->push_back(range);
+			}
+			ranges->back().last_packet_number = packet_number;
+			ranges->back().bytes += kPacketSize;
+		}
+
+		CongestionController controller_;
+		bool ranges_;
+		Pattern pattern_;
+		size_t num_sent_ = 0;
+		size_t num_delivered_ = 0;
+		size_t num_batches_ = 0;
+		QuicTime now_ = 0;
+		QuicPacketNumber next_packet_number_ = 0;
+		double next_send_time_us_ = 0.0;
+		double queue_bytes_ = 0.0;
+		double queue_time_us_ = 0.0;
+		// Packets not yet acked or declared lost, oldest first from
+		// |in_flight_head_|.
+		std::vector<SentPacket> in_flight_;
+		size_t in_flight_head_ = 0;
+		AckedPacketVector acked_packets_;
+		LostPacketVector lost_packets_;
+		PacketNumberRangeVector acked_ranges_;
+		PacketNumberRangeVector lost_ranges_;
+		// Packets reported lost, to be acked with the next batch.
+		std::vector<SentPacket> spurious_losses_;
+	};
+
+	// Runs a warm-up flow and then a measured flow with another pattern on
+	// the same slab, with the quiescent fast path on if |quiescent|. Returns
+	// false, printing why, if the measured flow allocated or missed a state.
+	bool RunTest(bool ranges, bool quiescent)
+	{
+		const char* name = ranges ? (quiescent ? "quiescent/ranges" : "ranges") : (quiescent ? "quiescent/packets" : "packets");
+		PccConfig config;
+		config.quiescent_rounds = quiescent ? kQuiescentRounds : 0;
+		std::shared_ptr<const PccConfig> pcc_config = PccConfig::Create(config, nullptr);
+		std::vector<MonitorInterval> slab(CongestionController::MonitorIntervalCapacity(*pcc_config));
+
+		AllocationCounts warm_up;
+		std::unique_ptr<Flow> flow(new Flow(pcc_config, slab.data(), ranges, kWarmUpPattern));
+		flow->Run(&warm_up);
+
+		AllocationCounts counts;
+		flow.reset(new Flow(pcc_config, slab.data(), ranges, kMeasuredPattern));
+		flow->Run(&counts);
+
+		bool ok = true;
+		size_t num_states = quiescent ? kNumStates : kQuiescentState;
+		for (size_t state = 0; state < num_states; ++state)
+		{
+			printf("%s/%s: %llu allocations in %llu calls\n", name, kStateNames[state],
+				static_cast<unsigned long long> (counts.allocations[state]),
+				static_cast<unsigned long long> (counts.calls[state]));
+			if (counts.calls[state] == 0)
+			{
+				fprintf(stderr, "FAIL %s: the flow never was in %s\n", name, kStateNames[state]);
+				ok = false;
+			}
+			if (counts.allocations[state] != 0)
+			{
+				fprintf(stderr, "FAIL %s: the controller allocated in %s\n", name, kStateNames[state]);
+				ok = false;
+			}
+		}
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	for (bool quiescent : { false, true })
+	{
+		ok = RunTest(false, quiescent) && ok;
+		ok = RunTest(true, quiescent) && ok;
+	}
+	return ok ? 0 : 1;
+}
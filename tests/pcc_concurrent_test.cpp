@@ -0,0 +1,233 @@
+// pcc_concurrent_test: checks that an EventRing hands the events of many
+// producers to its consumer once each and in each producer's order, wraps
+// and refuses events when full, that a RatePublisher never lets a reader see
+// the outputs of two publishes mixed, and that a ConcurrentController makes
+// the decisions the controller it runs makes when called directly.
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "ConcurrentController.h"
+#include "EventRing.h"
+#include "PccConfig.h"
+#include "RateSnapshot.h"
+
+namespace
+{
+	const QuicTime kRttUs = 20000;
+	const QuicByteCount kPacketSize = 1000;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	CongestionEvent Packet(QuicPacketNumber packet_number, bool is_acked)
+	{
+		CongestionEvent event;
+		event.packet_number = packet_number;
+		event.bytes_acked = is_acked ? static_cast<int32_t> (kPacketSize) : 0;
+		event.bytes_lost = is_acked ? 0 : static_cast<int32_t> (kPacketSize);
+		return event;
+	}
+
+	bool TestRingWrap()
+	{
+		const char* test = "ring wrap";
+		EventRing ring(5);
+		bool ok = Check(ring.capacity() == 8, test, "capacity not a power of two");
+		for (QuicPacketNumber i = 0; i < 8; ++i)
+			ok = Check(ring.PostPacketSent(0, i, i, kPacketSize, true) == 1, test, "event refused") && ok;
+		ok = Check(ring.PostPacketSent(0, 8, 8, kPacketSize, true) == 0, test, "full ring took an event") && ok;
+
+		// Freed slots are claimed again past the end of the ring.
+		QuicPacketNumber next = 0;
+		for (int i = 0; i < 3; ++i, ++next)
+		{
+			ok = Check(ring.Front()->packets[0].packet_number == next, test, "events out of order") && ok;
+			ring.PopFront();
+		}
+		for (QuicPacketNumber i = 8; i < 11; ++i)
+			ok = Check(ring.PostPacketSent(0, i, i, kPacketSize, true) == 1, test, "freed slot refused") && ok;
+		for (; ring.Front() != nullptr; ++next)
+		{
+			ok = Check(ring.Front()->packets[0].packet_number == next, test, "wrapped events out of order") && ok;
+			ring.PopFront();
+		}
+		ok = Check(next == 11, test, "events lost") && ok;
+
+		// 10 acks and 3 losses take 4 chunks, which reassemble to the event.
+		AckedPacketVector acked;
+		LostPacketVector lost;
+		for (QuicPacketNumber i = 0; i < 10; ++i)
+			acked.push_back(Packet(i, true));
+		for (QuicPacketNumber i = 10; i < 13; ++i)
+			lost.push_back(Packet(i, false));
+		ok = Check(ring.PostCongestionEvent(7, kRttUs, kRttUs, acked, lost) == 4, test, "wrong number of chunks") && ok;
+		CongestionEventAssembler assembler;
+		int num_chunks = 0;
+		bool complete = false;
+		for (; ring.Front() != nullptr; ++num_chunks)
+		{
+			complete = assembler.Add(*ring.Front());
+			ring.PopFront();
+		}
+		ok = Check(num_chunks == 4 && complete, test, "event not reassembled") && ok;
+		ok = Check(assembler.flow() == 7 && assembler.acked_packets().size() == 10 && assembler.lost_packets().size() == 3,
+			test, "reassembled event differs") && ok;
+		ok = Check(assembler.acked_packets()[9].packet_number == 9 && assembler.lost_packets()[0].packet_number == 10,
+			test, "reassembled packets differ") && ok;
+
+		// An event larger than the ring never fits.
+		acked.resize(8 * RingEvent::kPacketsPerChunk + 1);
+		ok = Check(ring.PostCongestionEvent(0, kRttUs, kRttUs, acked, LostPacketVector()) == 0, test, "oversized event taken") && ok;
+		return ok;
+	}
+
+	// Producers post numbered packets to a small ring as fast as it frees
+	// slots, while the consumer drains it.
+	bool TestRingProducers()
+	{
+		const char* test = "ring producers";
+		const int kNumProducers = 4;
+		const QuicPacketNumber kEventsPerProducer = 20000;
+		EventRing ring(64);
+		std::vector<std::thread> producers;
+		for (int producer = 0; producer < kNumProducers; ++producer)
+		{
+			producers.emplace_back([&ring, producer]() {
+				for (QuicPacketNumber i = 0; i < kEventsPerProducer; ++i)
+					while (ring.PostPacketSent(producer, i, i, kPacketSize, true) == 0)
+						std::this_thread::yield();
+			});
+		}
+
+		std::vector<QuicPacketNumber> next(kNumProducers, 0);
+		bool in_order = true;
+		QuicPacketNumber num_events = 0;
+		while (num_events < kNumProducers * kEventsPerProducer)
+		{
+			const RingEvent* event = ring.Front();
+			if (event == nullptr)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			QuicPacketNumber& expected = next[event->flow];
+			in_order = in_order && event->packets[0].packet_number == expected;
+			++expected;
+			++num_events;
+			ring.PopFront();
+		}
+		for (std::thread& producer : producers)
+			producer.join();
+		bool ok = Check(in_order, test, "events of a producer out of order");
+		ok = Check(ring.Front() == nullptr, test, "events past the posted ones") && ok;
+		return ok;
+	}
+
+	// Readers check every snapshot against the invariant each publish keeps:
+	// the window is twice the rate, and versions never go back.
+	bool TestSeqlock()
+	{
+		const char* test = "seqlock";
+		const uint64_t kNumPublishes = 200000;
+		const int kNumReaders = 3;
+		RatePublisher publisher;
+		std::atomic<bool> done{false};
+		std::atomic<int> num_torn{0};
+		std::atomic<int> num_reversed{0};
+		std::vector<std::thread> readers;
+		for (int i = 0; i < kNumReaders; ++i)
+		{
+			readers.emplace_back([&]() {
+				uint64_t last_version = 0;
+				while (!done.load(std::memory_order_acquire))
+				{
+					RateSnapshot snapshot = publisher.Read();
+					if (snapshot.congestion_window != 2 * static_cast<QuicByteCount> (snapshot.pacing_rate)
+						|| snapshot.pacing_rate != static_cast<QuicBandwidth> (snapshot.version))
+						++num_torn;
+					if (snapshot.version < last_version)
+						++num_reversed;
+					last_version = snapshot.version;
+				}
+			});
+		}
+		for (uint64_t i = 1; i <= kNumPublishes; ++i)
+			publisher.Publish(static_cast<QuicBandwidth> (i), static_cast<QuicByteCount> (2 * i));
+		done.store(true, std::memory_order_release);
+		for (std::thread& reader : readers)
+			reader.join();
+
+		RateSnapshot last = publisher.Read();
+		bool ok = Check(num_torn.load() == 0, test, "snapshot mixed two publishes");
+		ok = Check(num_reversed.load() == 0, test, "version went back") && ok;
+		ok = Check(last.version == kNumPublishes && last.pacing_rate == kNumPublishes, test, "last publish lost") && ok;
+		return ok;
+	}
+
+	bool TestMatchesDirectController()
+	{
+		const char* test = "matches direct controller";
+		ConcurrentController concurrent(kRttUs, 10, 100000, PccConfig::Default(), 64);
+		CongestionController direct(kRttUs, 10, 100000);
+		concurrent.controller().set_random_seed(1);
+		direct.set_random_seed(1);
+
+		// Packets at a fixed pace, acked in fours an RTT later, posted in
+		// bursts and processed in part between them.
+		bool ok = true;
+		const QuicPacketNumber kNumPackets = 4000;
+		for (QuicPacketNumber i = 0; i < kNumPackets; i += 4)
+		{
+			for (QuicPacketNumber j = i; j < i + 4; ++j)
+			{
+				ok = Check(concurrent.PostPacketSent(j * 200, j, kPacketSize, true), test, "packet refused") && ok;
+				direct.OnPacketSent(j * 200, j, kPacketSize, true);
+			}
+			if (i >= 100)
+			{
+				AckedPacketVector acked;
+				for (QuicPacketNumber j = i - 100; j < i - 96; ++j)
+					acked.push_back(Packet(j, true));
+				QuicTime event_time = i * 200 + kRttUs / 10;
+				ok = Check(concurrent.PostCongestionEvent(event_time, kRttUs, acked, LostPacketVector()), test, "event refused") && ok;
+				direct.OnCongestionEvent(event_time, kRttUs, acked, LostPacketVector());
+			}
+			concurrent.ProcessEvents(i % 3 == 0 ? SIZE_MAX : 2);
+		}
+		while (concurrent.ProcessEvents() > 0)
+		{
+		}
+
+		RateSnapshot snapshot = concurrent.Snapshot();
+		ok = Check(snapshot.pacing_rate == direct.PacingRate() && snapshot.congestion_window == direct.GetCongestionWindow(),
+			test, "outputs differ") && ok;
+		ok = Check(concurrent.PacingRate() == direct.PacingRate(), test, "pacing rate differs") && ok;
+		ok = Check(snapshot.version > 0 && concurrent.num_dropped_events() == 0, test, "outputs not published") && ok;
+		ok = Check(direct.mode() != CongestionController::STARTING, test, "controller never left STARTING") && ok;
+
+		// A full ring drops events and counts them.
+		while (concurrent.PostPacketSent(kNumPackets * 200, kNumPackets, kPacketSize, true))
+		{
+		}
+		ok = Check(concurrent.num_dropped_events() == 1, test, "dropped event not counted") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestRingWrap() && ok;
+	ok = TestRingProducers() && ok;
+	ok = TestSeqlock() && ok;
+	ok = TestMatchesDirectController() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
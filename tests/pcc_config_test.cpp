@@ -0,0 +1,118 @@
+// pcc_config_test: checks that the default config and the presets are valid,
+// that invalid configs are rejected with the reason, and that the default
+// config computes utilities as the original Vivace half split does.
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "MonitorIntervalQueue.h"
+#include "PccConfig.h"
+
+namespace
+{
+	const QuicTime kRttUs = 20000;
+	const QuicByteCount kPacketSize = 1000;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	// Keeps the utilities of the last report.
+	class UtilityRecorder : public MonitorIntervalQueueDelegateInterface
+	{
+	public:
+		void OnUtilityAvailable(UtilityInfoSpan utility_info) override
+		{
+			utilities.assign(utility_info.begin(), utility_info.end());
+		}
+
+		std::vector<UtilityInfo> utilities;
+	};
+
+	// The utility a queue tuned by |config| computes for an interval of 100
+	// packets, acked one at a time, whose RTT steps up by half for the last
+	// 10 of them.
+	float UtilityOfRttStep(const PccConfig& config)
+	{
+		UtilityRecorder recorder;
+		MonitorIntervalQueue queue(recorder, config, 4);
+		queue.EnqueueNewMonitorInterval(1e8, true, 0.1f, kRttUs, 10000);
+		for (QuicPacketNumber i = 0; i < 100; ++i)
+			queue.OnPacketSent(i * 100, i, kPacketSize);
+		for (QuicPacketNumber i = 0; i < 100; ++i)
+		{
+			QuicTime rtt = i < 90 ? kRttUs : kRttUs * 3 / 2;
+			QuicTime event_time = std::max<QuicTime>(i * 100 + rtt, 10000);
+			AckedPacketVector acked(1);
+			acked[0].packet_number = i;
+			acked[0].bytes_acked = static_cast<int32_t> (kPacketSize);
+			acked[0].time = static_cast<uint64_t> (event_time);
+			queue.OnCongestionEvent(acked, LostPacketVector(), rtt, event_time);
+		}
+		return recorder.utilities.size() == 1 ? recorder.utilities[0].utility : 0.0f;
+	}
+
+	bool TestDefaults()
+	{
+		const char* test = "defaults";
+		std::string error;
+		bool ok = Check(PccConfig::Default()->Validate(&error), test, "default config invalid");
+		ok = Check(PccConfig::Datacenter()->Validate(&error), test, "datacenter preset invalid") && ok;
+		ok = Check(PccConfig::Wan()->Validate(&error), test, "wan preset invalid") && ok;
+		ok = Check(PccConfig::Satellite()->Validate(&error), test, "satellite preset invalid") && ok;
+		ok = Check(PccConfig::Default()->rtt_stats_mode == RTT_STATS_HALF_SPLIT, test, "default does not split RTTs in half") && ok;
+		ok = Check(PccConfig::Default() == PccConfig::Default(), test, "default config not shared") && ok;
+		return ok;
+	}
+
+	bool TestInvalid()
+	{
+		const char* test = "invalid";
+		PccConfig config;
+		config.probing_step_size = 1.5f;
+		std::string error;
+		bool ok = Check(PccConfig::Create(config, &error) == nullptr, test, "probing step of 1.5 accepted");
+		ok = Check(error.find("probing_step_size") != std::string::npos, test, "reason does not name the knob") && ok;
+
+		config = PccConfig();
+		config.rtt_stats_mode = static_cast<RttStatsMode> (7);
+		ok = Check(PccConfig::Create(config, nullptr) == nullptr, test, "unknown rtt stats mode accepted") && ok;
+		config = PccConfig();
+		config.max_tracked_packets_per_interval = 0;
+		ok = Check(PccConfig::Create(config, nullptr) == nullptr, test, "no tracked packets accepted") && ok;
+		return ok;
+	}
+
+	// The default config computes the utility the half split does, which
+	// the regression, fitting the same RTTs, does not.
+	bool TestDefaultIsHalfSplit()
+	{
+		const char* test = "default is half split";
+		PccConfig config;
+		config.rtt_stats_mode = RTT_STATS_HALF_SPLIT;
+		float half_split = UtilityOfRttStep(config);
+		config.rtt_stats_mode = RTT_STATS_REGRESSION;
+		float regression = UtilityOfRttStep(config);
+		float defaults = UtilityOfRttStep(*PccConfig::Default());
+
+		bool ok = Check(defaults != 0.0f, test, "no utility reported");
+		ok = Check(defaults == half_split, test, "default utility differs from the half split") && ok;
+		ok = Check(defaults != regression, test, "utility does not depend on the rtt stats mode") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestDefaults() && ok;
+	ok = TestInvalid() && ok;
+	ok = TestDefaultIsHalfSplit() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
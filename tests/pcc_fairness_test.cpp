@@ -0,0 +1,135 @@
+// pcc_fairness_test: checks that a simulation splits into epochs at every
+// arrival, departure and bandwidth step, that each epoch's fair share,
+// Jain's index and utilization follow from the flows' throughput samples,
+// that flows sharing the link get close to even shares, and that a run
+// depends on its config and seed only. The pcc_fairness scenarios gate
+// the flows' behaviour over longer runs.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "Simulator.h"
+
+namespace
+{
+	const double kBandwidthBps = 100e6;
+	const QuicTime kSecondUs = 1000000;
+	const QuicTime kEpochUs = 20 * kSecondUs;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	bool Near(double value, double expected)
+	{
+		return std::fabs(value - expected) <= 1e-9 * std::max(std::fabs(expected), 1.0);
+	}
+
+	// Flow 0 from the start, flow 1 from 20 s to 60 s, and the link down to
+	// half at 40 s: epochs of 1, 2, 2 and 1 flows, long enough for two flows
+	// to converge.
+	SimulationConfig StepsAndChurn(uint64_t seed)
+	{
+		SimulationConfig config;
+		config.link.bandwidth_bps = kBandwidthBps;
+		BandwidthStep step;
+		step.time_us = 2 * kEpochUs;
+		step.bandwidth_bps = kBandwidthBps / 2;
+		config.link.bandwidth_steps.push_back(step);
+		config.duration_us = 4 * kEpochUs;
+		config.sample_interval_us = kSecondUs / 2;
+		config.seed = seed;
+		config.flows.push_back(FlowConfig());
+		FlowConfig second;
+		second.start_time_us = kEpochUs;
+		second.stop_time_us = 3 * kEpochUs;
+		config.flows.push_back(second);
+		return config;
+	}
+
+	bool TestEpochs()
+	{
+		const char* test = "epochs";
+		SimulationConfig config = StepsAndChurn(1);
+		Simulator simulator(config);
+		SimulationResult result = simulator.Run();
+		if (!Check(result.epochs.size() == 4, test, "wrong number of epochs"))
+			return false;
+
+		const size_t kActiveFlows[] = { 1, 2, 2, 1 };
+		const double kFairShares[] = { kBandwidthBps, kBandwidthBps / 2, kBandwidthBps / 4, kBandwidthBps / 2 };
+		bool ok = true;
+		for (size_t e = 0; e < result.epochs.size(); ++e)
+		{
+			const EpochResult& epoch = result.epochs[e];
+			ok = Check(epoch.start_time_us == static_cast<QuicTime> (e) * kEpochUs && epoch.end_time_us == epoch.start_time_us + kEpochUs,
+				test, "epoch not bounded by the changes") && ok;
+			ok = Check(epoch.num_active_flows == kActiveFlows[e], test, "wrong active flows") && ok;
+			ok = Check(Near(epoch.fair_share_bps, kFairShares[e]), test, "wrong fair share") && ok;
+
+			// Jain's index and utilization from the mean throughput of each
+			// active flow over the epoch's samples. A flow that stopped may
+			// still deliver what it had in flight, which does not count.
+			size_t first_sample = static_cast<size_t> (epoch.start_time_us / config.sample_interval_us);
+			size_t end_sample = static_cast<size_t> (epoch.end_time_us / config.sample_interval_us);
+			double sum = 0.0;
+			double sum_of_squares = 0.0;
+			for (size_t f = 0; f < config.flows.size(); ++f)
+			{
+				const FlowConfig& flow = config.flows[f];
+				if (flow.start_time_us > epoch.start_time_us || (flow.stop_time_us != 0 && flow.stop_time_us <= epoch.start_time_us))
+					continue;
+				double mean = 0.0;
+				for (size_t s = first_sample; s < end_sample; ++s)
+					mean += result.flows[f].throughput_samples_bps[s] / (end_sample - first_sample);
+				sum += mean;
+				sum_of_squares += mean * mean;
+			}
+			ok = Check(Near(epoch.jain_fairness_index, sum * sum / (epoch.num_active_flows * sum_of_squares)), test, "wrong fairness index") && ok;
+			ok = Check(Near(epoch.link_utilization, sum / (epoch.fair_share_bps * epoch.num_active_flows)), test, "wrong utilization") && ok;
+			ok = Check(epoch.link_utilization > 0.8, test, "link left idle") && ok;
+			if (epoch.num_active_flows == 1)
+				ok = Check(epoch.jain_fairness_index == 1.0, test, "single flow unfair") && ok;
+			else
+				ok = Check(epoch.jain_fairness_index > 0.85, test, "flows far from even shares") && ok;
+		}
+		size_t start_sample = static_cast<size_t> (kEpochUs / config.sample_interval_us);
+		ok = Check(result.flows[1].throughput_samples_bps[start_sample - 1] == 0.0, test, "flow delivered before its start") && ok;
+		return ok;
+	}
+
+	bool SameResults(const SimulationResult& lhs, const SimulationResult& rhs)
+	{
+		bool same = lhs.flows.size() == rhs.flows.size() && lhs.num_events == rhs.num_events;
+		for (size_t f = 0; same && f < lhs.flows.size(); ++f)
+			same = lhs.flows[f].throughput_samples_bps == rhs.flows[f].throughput_samples_bps
+				&& lhs.flows[f].pacing_rate_samples_bps == rhs.flows[f].pacing_rate_samples_bps;
+		return same;
+	}
+
+	bool TestDeterminism()
+	{
+		const char* test = "determinism";
+		Simulator first(StepsAndChurn(1));
+		Simulator second(StepsAndChurn(1));
+		Simulator other_seed(StepsAndChurn(2));
+		SimulationResult first_result = first.Run();
+		bool ok = Check(SameResults(first_result, second.Run()), test, "same config and seed differ");
+		ok = Check(!SameResults(first_result, other_seed.Run()), test, "seed ignored") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestEpochs() && ok;
+	ok = TestDeterminism() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+// pcc_fixed_point_test: checks that the fixed-point arithmetic saturates and
+// stays within its documented error, that the fixed-point Vivace utility
+// follows the float one over rates, losses and RTT changes, and that a flow
+// controlled in fixed point settles where one controlled in float does.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <memory>
+
+#include "FixedPoint.h"
+#include "Simulator.h"
+#include "VivaceUtility.h"
+
+namespace
+{
+	const FixedPoint kMaxFixedPoint = std::numeric_limits<int64_t>::max();
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	bool TestArithmetic()
+	{
+		const char* test = "arithmetic";
+		bool ok = Check(FixedMultiply(ToFixedPoint(1.5), ToFixedPoint(-2.25)) == ToFixedPoint(-3.375), test, "wrong product");
+		ok = Check(FixedDivide(ToFixedPoint(-3.375), ToFixedPoint(1.5)) == ToFixedPoint(-2.25), test, "wrong quotient") && ok;
+		// One bit below 1/3, truncated toward zero.
+		ok = Check(FixedDivide(kFixedPointOne, 3 * kFixedPointOne) == kFixedPointOne / 3, test, "quotient not truncated") && ok;
+		ok = Check(FixedMultiply(kMaxFixedPoint / 2, ToFixedPoint(3.0)) == kMaxFixedPoint, test, "product not saturated") && ok;
+		ok = Check(FixedMultiply(kMaxFixedPoint / 2, ToFixedPoint(-3.0)) == -kMaxFixedPoint, test, "negative product not saturated") && ok;
+		ok = Check(FixedDivide(kMaxFixedPoint / 2, 1) == kMaxFixedPoint, test, "quotient not saturated") && ok;
+		ok = Check(ToFixedPoint(1e300) == kMaxFixedPoint && ToFixedPoint(-1e300) == -kMaxFixedPoint, test, "conversion not saturated") && ok;
+
+		// log2 within 3e-6 relative to 1, exp2 within 3e-6 relative to its
+		// result, plus a bit of rounding each.
+		double max_log_error = 0.0;
+		double max_exp_error = 0.0;
+		for (double x = 1.0 / 1024; x < 1e6; x *= 1.0137)
+		{
+			double log_error = std::fabs(FromFixedPoint(FixedLog2(ToFixedPoint(x))) - std::log2(FromFixedPoint(ToFixedPoint(x))));
+			max_log_error = std::max(max_log_error, log_error);
+		}
+		for (double x = -10.0; x < 20.0; x += 0.0173)
+		{
+			double exact = std::exp2(FromFixedPoint(ToFixedPoint(x)));
+			double exp_error = std::fabs(FromFixedPoint(FixedExp2(ToFixedPoint(x))) - exact) / std::max(exact, 1.0);
+			max_exp_error = std::max(max_exp_error, exp_error);
+		}
+		ok = Check(max_log_error <= 3e-6 + 2.0 / kFixedPointOne, test, "log2 beyond its error") && ok;
+		ok = Check(max_exp_error <= 3e-6 + 2.0 / kFixedPointOne, test, "exp2 beyond its error") && ok;
+
+		// pow within 5e-6 relative per doubling of the base, as the exponent
+		// is rounded.
+		bool pow_within = true;
+		for (double base = 1.0; base < 1e5; base *= 1.37)
+		{
+			for (double exponent = 0.5; exponent < 1.0; exponent += 0.05)
+			{
+				double exact = std::pow(base, exponent);
+				double error = std::fabs(FromFixedPoint(FixedPow(ToFixedPoint(base), ToFixedPoint(exponent))) - exact) / exact;
+				pow_within = pow_within && error <= 5e-6 * std::max(std::log2(base), 1.0) + 2.0 / kFixedPointOne;
+			}
+		}
+		ok = Check(pow_within, test, "pow beyond its error") && ok;
+		ok = Check(FixedPow(0, kFixedPointOne) == 0 && FixedPow(-kFixedPointOne, kFixedPointOne) == 0, test, "pow of a base below 1") && ok;
+		return ok;
+	}
+
+	bool TestUtilityAgreement()
+	{
+		const char* test = "utility agreement";
+		const QuicTime kDurationUs = 20000;
+		const QuicByteCount kPacketSize = 1400;
+		const double kMegabit = 1024 * 1024;
+		VivaceUtilityCoefficients coefficients;
+		FixedVivaceUtilityCoefficients fixed_coefficients = ToFixedPoint(coefficients);
+		// Rates from 1 Mbit/s to 100 Gbit/s, losses up to 20% and RTT changes
+		// from -50% to +100%, through the tolerance and the 2% steps.
+		double max_error = 0.0;
+		for (double rate = 1e6; rate <= 100e9; rate *= 3.1)
+		{
+			QuicByteCount bytes_sent = static_cast<QuicByteCount> (rate * kDurationUs / 8e6);
+			int32_t n_packets = static_cast<int32_t> (std::max<QuicByteCount>(bytes_sent / kPacketSize, 1));
+			for (double loss : { 0.0, 0.01, 0.03, 0.05, 0.2 })
+			{
+				QuicByteCount bytes_lost = static_cast<QuicByteCount> (loss * bytes_sent);
+				for (int32_t inflation_percent : { -50, -3, 0, 1, 2, 3, 7, 25, 100 })
+				{
+					float expected = CalculateVivaceUtility(static_cast<float> (bytes_sent),
+						static_cast<float> (bytes_lost),
+						static_cast<float> (kDurationUs),
+						n_packets,
+						inflation_percent / 100.0f,
+						coefficients);
+					FixedPoint fixed = CalculateVivaceUtilityFixedPoint(bytes_sent, bytes_lost, kDurationUs, n_packets,
+						inflation_percent, fixed_coefficients);
+					// Relative to the sending rate term too, which the others may
+					// cancel.
+					double sending_term = std::pow(bytes_sent * 8e6 / kDurationUs / kMegabit, static_cast<double> (coefficients.exponent));
+					double scale = std::max({ std::fabs(static_cast<double> (expected)), sending_term, 1.0 });
+					double error = std::fabs(FromFixedPoint(fixed) - expected) / scale;
+					max_error = std::max(max_error, error);
+				}
+			}
+		}
+		bool ok = Check(max_error <= 3e-4, test, "utility beyond its error");
+		ok = Check(CalculateVivaceUtilityFixedPoint(0, 0, kDurationUs, 0, 0, fixed_coefficients) == 0, test, "empty interval has a utility") && ok;
+		return ok;
+	}
+
+	// Mean pacing rate over the last seconds of a 100 Mbit/s link.
+	double SettledRate(bool fixed_point_arithmetic)
+	{
+		SimulationConfig config;
+		config.link.bandwidth_bps = 100e6;
+		config.duration_us = 20000000;
+		FlowConfig flow;
+		std::shared_ptr<PccConfig> pcc_config = std::make_shared<PccConfig>();
+		pcc_config->fixed_point_arithmetic = fixed_point_arithmetic;
+		flow.pcc_config = pcc_config;
+		config.flows.push_back(flow);
+		Simulator simulator(config);
+		SimulationResult result = simulator.Run();
+		const std::vector<double>& rates = result.flows[0].pacing_rate_samples_bps;
+		size_t num_samples = std::min<size_t>(20, rates.size());
+		double mean_rate = 0.0;
+		for (size_t i = rates.size() - num_samples; i < rates.size(); ++i)
+			mean_rate += rates[i] / num_samples;
+		return mean_rate;
+	}
+
+	bool TestControllerAgreement()
+	{
+		const char* test = "controller agreement";
+		double float_rate = SettledRate(false);
+		double fixed_rate = SettledRate(true);
+		printf("settled rate %.1f Mbps in float, %.1f Mbps in fixed point\n", float_rate / 1e6, fixed_rate / 1e6);
+		bool ok = Check(fixed_rate > 50e6 && fixed_rate < 150e6, test, "fixed-point flow did not settle onto the link");
+		ok = Check(std::fabs(fixed_rate - float_rate) <= 0.1 * float_rate, test, "settled rates differ") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestArithmetic() && ok;
+	ok = TestUtilityAgreement() && ok;
+	ok = TestControllerAgreement() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+// pcc_flow_table_test: checks that a FlowTable fed batches interleaving its
+// flows, larger than it orders at once, makes the decisions standalone
+// controllers fed each flow's calls in turn make, that its columns and
+// FlowViews match those controllers, and that removed flows are skipped.
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "FlowTable.h"
+#include "PccConfig.h"
+
+namespace
+{
+	const QuicTime kRttUs = 20000;
+	const QuicByteCount kPacketSize = 1000;
+	const size_t kNumFlows = 3;
+	// Time covered by each batch. Its packets outnumber what the table
+	// orders at once.
+	const QuicTime kStepUs = 10000;
+	const QuicTime kSendIntervalUs = 100;
+	const int kNumSteps = 200;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	// Whether the state and columns of |flow| in |table| match |controller|.
+	bool FlowMatches(const FlowTable& table, FlowId flow, const CongestionController& controller)
+	{
+		std::vector<uint8_t> snapshot;
+		std::vector<uint8_t> expected_snapshot;
+		FlowView view = table.flow(flow);
+		if (view.controller() == nullptr)
+			return false;
+		view.controller()->SaveSnapshot(&snapshot);
+		controller.SaveSnapshot(&expected_snapshot);
+		return snapshot == expected_snapshot
+			&& view.mode() == controller.mode()
+			&& view.PacingRate() == controller.PacingRate()
+			&& view.GetCongestionWindow() == controller.GetCongestionWindow()
+			&& view.NextTimerDeadline() == controller.NextTimerDeadline()
+			&& table.PacingRate(flow) == controller.PacingRate();
+	}
+
+	bool TestMatchesStandaloneControllers()
+	{
+		const char* test = "matches standalone controllers";
+		FlowTable table(kNumFlows + 1);
+		std::vector<std::unique_ptr<CongestionController>> controllers;
+		FlowId flows[kNumFlows];
+		bool ok = true;
+		for (size_t i = 0; i < kNumFlows; ++i)
+		{
+			ok = Check(table.AddFlow(kRttUs, 10, 100000, &flows[i]), test, "flow not added") && ok;
+			table.set_random_seed(flows[i], i + 1);
+			controllers.emplace_back(new CongestionController(kRttUs, 10, 100000, PccConfig::Default()));
+			controllers[i]->set_random_seed(i + 1);
+		}
+
+		std::vector<FlowPacketSent> sent;
+		std::vector<FlowCongestionEvent> events;
+		std::vector<AckedPacketVector> acked;
+		LostPacketVector no_losses;
+		std::vector<FlowTimer> timers;
+		std::vector<FlowId> due(kNumFlows + 1);
+		bool left_starting = false;
+		for (int step = 0; step < kNumSteps; ++step)
+		{
+			// Packets of every flow in the order sent, the later flows first
+			// at each time, so the batch is never ordered by flow.
+			QuicTime step_start = step * kStepUs;
+			sent.clear();
+			for (QuicTime time = step_start; time < step_start + kStepUs; time += kSendIntervalUs)
+			{
+				for (size_t i = kNumFlows; i > 0; --i)
+				{
+					FlowPacketSent packet;
+					packet.flow = flows[i - 1];
+					packet.sent_time = time;
+					packet.packet_number = static_cast<QuicPacketNumber> (time / kSendIntervalUs);
+					packet.bytes = kPacketSize;
+					sent.push_back(packet);
+				}
+			}
+			table.OnPacketSent(sent.data(), sent.size());
+			for (size_t i = 0; i < kNumFlows; ++i)
+				for (const FlowPacketSent& packet : sent)
+					if (packet.flow == flows[i])
+						controllers[i]->OnPacketSent(packet.sent_time, packet.packet_number, packet.bytes, true);
+
+			// The packets sent two steps before are acked one at a time, the
+			// later flows' RTTs growing with their rate.
+			if (step >= 2)
+			{
+				events.clear();
+				acked.assign(sent.size(), AckedPacketVector(1));
+				for (size_t j = 0; j < sent.size(); ++j)
+				{
+					const FlowPacketSent& packet = sent[j];
+					QuicTime sent_time = packet.sent_time - 2 * kStepUs;
+					QuicTime rtt = kRttUs + static_cast<QuicTime> (table.PacingRate(packet.flow) / 1e6) * packet.flow;
+					acked[j][0].packet_number = packet.packet_number - 2 * kStepUs / kSendIntervalUs;
+					acked[j][0].bytes_acked = static_cast<int32_t> (kPacketSize);
+					acked[j][0].time = static_cast<uint64_t> (sent_time + rtt);
+					FlowCongestionEvent event;
+					event.flow = packet.flow;
+					event.event_time = sent_time + rtt;
+					event.rtt = rtt;
+					event.acked_packets = &acked[j];
+					event.lost_packets = &no_losses;
+					events.push_back(event);
+				}
+				table.OnCongestionEvent(events.data(), events.size());
+				for (size_t i = 0; i < kNumFlows; ++i)
+					for (const FlowCongestionEvent& event : events)
+						if (event.flow == flows[i])
+							controllers[i]->OnCongestionEvent(event.event_time, event.rtt, *event.acked_packets, *event.lost_packets);
+			}
+
+			// The timers due by the end of the step fire.
+			QuicTime now = step_start + kStepUs;
+			size_t num_due = table.DueTimers(now, due.data(), due.size());
+			size_t num_expected = 0;
+			for (size_t i = 0; i < kNumFlows; ++i)
+				if (controllers[i]->NextTimerDeadline() <= now)
+					++num_expected;
+			ok = Check(num_due == num_expected, test, "due timers differ") && ok;
+			timers.clear();
+			for (size_t j = 0; j < num_due; ++j)
+			{
+				FlowTimer timer;
+				timer.flow = due[j];
+				timer.now = now;
+				timers.push_back(timer);
+			}
+			table.OnTimer(timers.data(), timers.size());
+			for (size_t i = 0; i < kNumFlows; ++i)
+				controllers[i]->OnTimer(now);
+
+			for (size_t i = 0; i < kNumFlows; ++i)
+			{
+				ok = Check(FlowMatches(table, flows[i], *controllers[i]), test, "flow differs") && ok;
+				left_starting = left_starting || controllers[i]->mode() != CongestionController::STARTING;
+			}
+		}
+		ok = Check(left_starting, test, "no flow left STARTING") && ok;
+		return ok;
+	}
+
+	bool TestRemovedFlow()
+	{
+		const char* test = "removed flow";
+		FlowTable table(2);
+		FlowId first;
+		FlowId second;
+		FlowId third;
+		table.AddFlow(kRttUs, 10, 100000, &first);
+		table.AddFlow(kRttUs, 10, 100000, &second);
+		bool ok = Check(!table.AddFlow(kRttUs, 10, 100000, &third), test, "flow added to a full table");
+		table.RemoveFlow(first);
+		table.set_random_seed(first, 1);
+
+		FlowView view = table.flow(first);
+		ok = Check(!view.is_active() && view.controller() == nullptr, test, "removed flow active") && ok;
+		ok = Check(view.PacingRate() == 0 && view.GetCongestionWindow() == 0, test, "removed flow has outputs") && ok;
+		ok = Check(view.NextTimerDeadline() == CongestionController::kNoTimerDeadline, test, "removed flow has a timer") && ok;
+		ok = Check(table.controller(2) == nullptr && table.PacingRate(2) == 0, test, "flow past the table found") && ok;
+
+		// Packets of the removed flow are skipped, those of the other applied.
+		FlowPacketSent packets[2];
+		packets[0].flow = second;
+		packets[1].flow = first;
+		table.OnPacketSent(packets, 2);
+		ok = Check(table.controller(second)->NextTimerDeadline() == table.flow(second).NextTimerDeadline(), test, "column not refreshed") && ok;
+		FlowId due[2];
+		ok = Check(table.DueTimers(CongestionController::kNoTimerDeadline - 1, due, 2) <= 1, test, "removed flow due") && ok;
+		ok = Check(table.num_flows() == 1, test, "flows miscounted") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestMatchesStandaloneControllers() && ok;
+	ok = TestRemovedFlow() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
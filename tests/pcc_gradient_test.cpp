@@ -0,0 +1,117 @@
+// pcc_gradient_test: checks that GradientEstimator ages samples out by its
+// window and decay, and that a controller fitting gradients keeps the
+// samples of the probing rounds in a row and drops them when it probes
+// anew.
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "CongestionController.h"
+#include "GradientEstimator.h"
+#include "PccConfig.h"
+
+namespace
+{
+	const QuicTime kRttUs = 20000;
+	const QuicBandwidth kRate = 1e7;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	// Adds samples at 4 rates around kRate, along a line of |slope| utility
+	// per bit/s.
+	void AddLine(GradientEstimator* estimator, double slope)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			QuicBandwidth rate = kRate * (1.0 + 0.05 * (i - 1.5));
+			estimator->AddSample(UtilityInfo(rate, static_cast<float> (slope * (rate - kRate))));
+		}
+	}
+
+	bool TestWindowAndDecay()
+	{
+		const char* test = "window and decay";
+		const double kOldSlope = 1e-6;
+		const double kNewSlope = 3e-6;
+		GradientEstimator estimator(8, 0.8f);
+		AddLine(&estimator, kOldSlope);
+		AddLine(&estimator, kNewSlope);
+		double gradient;
+		float confidence;
+		bool ok = Check(estimator.num_samples() == 8, test, "samples miscounted");
+		ok = Check(estimator.Estimate(&gradient, &confidence), test, "no fit") && ok;
+		// Both lines are fit, the newer weighing more.
+		ok = Check(gradient > (kOldSlope + kNewSlope) / 2 && gradient < kNewSlope, test, "newer samples do not weigh more") && ok;
+
+		AddLine(&estimator, kNewSlope);
+		ok = Check(estimator.num_samples() == 8, test, "window exceeded") && ok;
+		ok = Check(estimator.Estimate(&gradient, &confidence), test, "no fit once full") && ok;
+		ok = Check(gradient > kNewSlope * 0.999 && gradient < kNewSlope * 1.001, test, "samples past the window still fit") && ok;
+		ok = Check(confidence > 0.999f, test, "samples on a line not confident") && ok;
+		return ok;
+	}
+
+	// Utilities of a probing round whose two groups disagree, so no decision
+	// is made.
+	std::vector<UtilityInfo> InconclusiveRound(QuicBandwidth rate)
+	{
+		return {
+			UtilityInfo(rate * 1.05, 2.0f),
+			UtilityInfo(rate * 0.95, 1.0f),
+			UtilityInfo(rate * 1.05, 1.0f),
+			UtilityInfo(rate * 0.95, 2.0f),
+		};
+	}
+
+	bool TestSamplesAcrossRounds()
+	{
+		const char* test = "samples across rounds";
+		PccConfig config;
+		config.gradient_estimator = GRADIENT_WEIGHTED_LEAST_SQUARES;
+		config.gradient_window = 8;
+		CongestionController controller(kRttUs, 10, 100000, PccConfig::Create(config, nullptr));
+
+		// STARTING ends at the first utility that does not grow.
+		controller.OnUtilityAvailable(std::vector<UtilityInfo>{ UtilityInfo(kRate, 10.0f) });
+		controller.OnUtilityAvailable(std::vector<UtilityInfo>{ UtilityInfo(2 * kRate, 5.0f) });
+		bool ok = Check(controller.mode() == CongestionController::PROBING, test, "not probing");
+		ok = Check(controller.gradient_estimator().num_samples() == 0, test, "samples before probing") && ok;
+
+		QuicBandwidth rate = controller.PacingRate();
+		controller.OnUtilityAvailable(InconclusiveRound(rate));
+		ok = Check(controller.gradient_estimator().num_samples() == 4, test, "round not sampled") && ok;
+		controller.OnUtilityAvailable(InconclusiveRound(rate));
+		ok = Check(controller.mode() == CongestionController::PROBING, test, "left probing") && ok;
+		ok = Check(controller.gradient_estimator().num_samples() == 8, test, "earlier round dropped") && ok;
+		controller.OnUtilityAvailable(InconclusiveRound(rate));
+		ok = Check(controller.gradient_estimator().num_samples() == 8, test, "window exceeded") && ok;
+
+		// A decision, then a utility that reverses it, starts a new stint.
+		controller.OnUtilityAvailable(std::vector<UtilityInfo>{
+			UtilityInfo(rate * 1.05, 2.0f),
+			UtilityInfo(rate * 0.95, 1.0f),
+			UtilityInfo(rate * 1.05, 2.0f),
+			UtilityInfo(rate * 0.95, 1.0f),
+		});
+		ok = Check(controller.mode() == CongestionController::DECISION_MADE, test, "no decision") && ok;
+		controller.OnUtilityAvailable(std::vector<UtilityInfo>{ UtilityInfo(controller.PacingRate(), -100.0f) });
+		ok = Check(controller.mode() == CongestionController::PROBING, test, "not probing anew") && ok;
+		ok = Check(controller.gradient_estimator().num_samples() == 0, test, "samples of the earlier stint kept") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestWindowAndDecay() && ok;
+	ok = TestSamplesAcrossRounds() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
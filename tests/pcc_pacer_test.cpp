@@ -0,0 +1,175 @@
+// pcc_pacer_test: checks that a Pacer spaces the packets of a flow by their
+// duration at its rate, lets an idle flow burst by its allowance only,
+// rescales what a flow owes when its rate changes, keeps flows due in the
+// order they became due, times sends seconds ahead exactly, and follows a
+// controller's rate through its observer.
+
+#include <cstdio>
+#include <vector>
+
+#include "CongestionController.h"
+#include "Pacer.h"
+
+namespace
+{
+	const QuicByteCount kPacketSize = 1400;
+	// Sends a packet every 1000us.
+	const QuicBandwidth kRate = kPacketSize * 8 * 1000.0;
+	const QuicTime kPacketTimeUs = 1000;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	// Runs an event loop from |start| to |end| that sends a packet for every
+	// flow due, sleeping as TimeUntilNextSend() says in between, and returns
+	// the send times of |flow|.
+	std::vector<QuicTime> SendTimes(Pacer* pacer, FlowId flow, QuicTime start, QuicTime end)
+	{
+		std::vector<QuicTime> times;
+		QuicTime now = start;
+		while (now < end)
+		{
+			FlowId due;
+			while (pacer->NextFlowToSend(now, &due))
+			{
+				if (due == flow)
+					times.push_back(now);
+				pacer->OnPacketSent(due, now, kPacketSize);
+			}
+			QuicTime wait = pacer->TimeUntilNextSend(now);
+			if (wait == Pacer::kNoSendPending)
+				break;
+			now += wait > 0 ? wait : 1;
+		}
+		return times;
+	}
+
+	bool TestSteadyRate()
+	{
+		const char* test = "steady rate";
+		Pacer pacer(4);
+		pacer.AddFlow(2, kRate, 0);
+		std::vector<QuicTime> times = SendTimes(&pacer, 2, 0, 100 * kPacketTimeUs);
+
+		// The allowance of one packet goes with the first, then one per
+		// packet time.
+		bool ok = Check(times.size() == 101, test, "wrong number of packets");
+		ok = Check(times.size() > 2 && times[0] == 0 && times[1] == 0, test, "allowance not sent at once") && ok;
+		bool spaced = true;
+		for (size_t i = 2; i < times.size(); ++i)
+			spaced = spaced && times[i] - times[i - 1] == kPacketTimeUs;
+		ok = Check(spaced, test, "packets not spaced by their duration") && ok;
+		return ok;
+	}
+
+	bool TestBurstAfterIdle()
+	{
+		const char* test = "burst after idle";
+		Pacer pacer(1);
+		pacer.AddFlow(0, kRate, 0);
+		pacer.OnPacketSent(0, 0, kPacketSize);
+		pacer.OnPacketSent(0, 0, kPacketSize);
+		bool ok = Check(pacer.NextSendTime(0) == kPacketTimeUs, test, "wrong next send time");
+
+		// Application limited for 10 packet times, it banks only its allowance.
+		pacer.SetApplicationLimited(0, true);
+		FlowId flow;
+		ok = Check(!pacer.NextFlowToSend(5 * kPacketTimeUs, &flow), test, "limited flow due") && ok;
+		ok = Check(pacer.TimeUntilNextSend(5 * kPacketTimeUs) == Pacer::kNoSendPending, test, "limited flow waited for") && ok;
+		pacer.SetApplicationLimited(0, false);
+		std::vector<QuicTime> times = SendTimes(&pacer, 0, 10 * kPacketTimeUs, 13 * kPacketTimeUs);
+		ok = Check(times.size() == 4 && times[0] == 10 * kPacketTimeUs && times[1] == 10 * kPacketTimeUs && times[2] == 11 * kPacketTimeUs,
+			test, "idle flow burst beyond its allowance") && ok;
+		return ok;
+	}
+
+	bool TestRateChange()
+	{
+		const char* test = "rate change";
+		Pacer pacer(1);
+		pacer.AddFlow(0, kRate, 0, 0);
+		pacer.OnPacketSent(0, 0, kPacketSize);
+		FlowId flow;
+		bool ok = Check(!pacer.NextFlowToSend(kPacketTimeUs / 2, &flow), test, "due early");
+
+		// Half the packet is owed at the half-way point; at twice the rate
+		// that takes a quarter of a packet time.
+		pacer.SetPacingRate(0, 2 * kRate);
+		ok = Check(pacer.NextSendTime(0) == kPacketTimeUs * 3 / 4, test, "owed time not rescaled") && ok;
+		QuicTime wait = pacer.TimeUntilNextSend(kPacketTimeUs / 2);
+		ok = Check(wait > 0 && wait <= kPacketTimeUs / 4, test, "wait past the new time") && ok;
+		ok = Check(pacer.NextFlowToSend(kPacketTimeUs * 3 / 4, &flow) && flow == 0, test, "not due at the new time") && ok;
+
+		// A stopped flow is never due.
+		pacer.SetPacingRate(0, 0);
+		ok = Check(!pacer.NextFlowToSend(10 * kPacketTimeUs, &flow), test, "stopped flow due") && ok;
+		return ok;
+	}
+
+	bool TestDueOrder()
+	{
+		const char* test = "due order";
+		// Ticks of 100us, so the waits are exact.
+		Pacer pacer(3, 100);
+		// Flows 2, 0 and 1 become due at 1000, 1500 and 2000us.
+		pacer.AddFlow(0, kRate * 2 / 3, 0, 0);
+		pacer.AddFlow(1, kRate / 2, 0, 0);
+		pacer.AddFlow(2, kRate, 0, 0);
+		for (FlowId flow = 0; flow < 3; ++flow)
+			pacer.OnPacketSent(flow, 0, kPacketSize);
+		FlowId first;
+		FlowId second;
+		bool ok = Check(pacer.TimeUntilNextSend(0) == kPacketTimeUs, test, "wrong wait for the first");
+		ok = Check(pacer.NextFlowToSend(2 * kPacketTimeUs, &first) && first == 2, test, "first due not first") && ok;
+		// A flow stays due until it sends.
+		ok = Check(pacer.NextFlowToSend(2 * kPacketTimeUs, &second) && second == 2, test, "due flow dropped") && ok;
+		pacer.OnPacketSent(2, 2 * kPacketTimeUs, kPacketSize);
+		ok = Check(pacer.NextFlowToSend(2 * kPacketTimeUs, &second) && second == 0, test, "second due not next") && ok;
+		return ok;
+	}
+
+	bool TestFarDeadline()
+	{
+		const char* test = "far deadline";
+		// A packet takes 20s, past the wheel's 64^4 ticks of 1us.
+		const QuicTime kSlowPacketTimeUs = 20000000;
+		Pacer pacer(2);
+		pacer.AddFlow(1, kRate * kPacketTimeUs / kSlowPacketTimeUs, 0, 0);
+		pacer.OnPacketSent(1, 0, kPacketSize);
+		FlowId flow;
+		bool ok = Check(pacer.TimeUntilNextSend(0) <= kSlowPacketTimeUs, test, "wait past the deadline");
+		ok = Check(!pacer.NextFlowToSend(kSlowPacketTimeUs - 1, &flow), test, "due early") && ok;
+		ok = Check(pacer.TimeUntilNextSend(kSlowPacketTimeUs - 1) == 1, test, "wait not exact near the deadline") && ok;
+		ok = Check(pacer.NextFlowToSend(kSlowPacketTimeUs, &flow) && flow == 1, test, "not due at the deadline") && ok;
+		return ok;
+	}
+
+	bool TestRateObserver()
+	{
+		const char* test = "rate observer";
+		Pacer pacer(1);
+		CongestionController controller(20000, 10, 100000);
+		pacer.AddFlow(0, controller.PacingRate(), 0);
+		controller.set_pacing_rate_observer(pacer.rate_observer(0));
+		// A utility that grows doubles the rate in STARTING.
+		controller.OnUtilityAvailable(std::vector<UtilityInfo>{ UtilityInfo(controller.PacingRate(), 1.0f) });
+		return Check(pacer.pacing_rate(0) == controller.PacingRate(), test, "rate change not observed");
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestSteadyRate() && ok;
+	ok = TestBurstAfterIdle() && ok;
+	ok = TestRateChange() && ok;
+	ok = TestDueOrder() && ok;
+	ok = TestFarDeadline() && ok;
+	ok = TestRateObserver() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
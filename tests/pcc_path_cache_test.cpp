@@ -0,0 +1,150 @@
+// pcc_path_cache_test: checks that PathCache decays, expires and evicts its
+// entries and counts them, and that a controller warm starts from a cached
+// rate above its initial one but not from one below it.
+
+#include <cstdio>
+#include <memory>
+
+#include "CongestionController.h"
+#include "PathCache.h"
+#include "PccConfig.h"
+
+namespace
+{
+	const QuicTime kRttUs = 20000;
+	const QuicTime kHalfLifeUs = 10000000;
+	const uint64_t kDestination = 42;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	PathInfo Info(QuicBandwidth sending_rate, QuicTime record_time)
+	{
+		PathInfo info;
+		info.sending_rate = sending_rate;
+		info.min_rtt = kRttUs / 2;
+		info.record_time = record_time;
+		return info;
+	}
+
+	std::unique_ptr<CongestionController> NewController()
+	{
+		return std::unique_ptr<CongestionController>(new CongestionController(kRttUs, 10, 100000, PccConfig::Default()));
+	}
+
+	bool TestHigherRateHit()
+	{
+		const char* test = "higher rate hit";
+		std::unique_ptr<CongestionController> controller = NewController();
+		QuicBandwidth initial_rate = controller->PacingRate();
+		PathCacheConfig config;
+		config.rate_half_life_us = kHalfLifeUs;
+		PathCache cache(config);
+		cache.Record(kDestination, Info(4 * initial_rate, 0));
+
+		// One half life later the rate counts half.
+		controller->set_path_cache(&cache, kDestination, kHalfLifeUs);
+		bool ok = Check(cache.num_hits() == 1 && cache.num_misses() == 0, test, "hit not counted");
+		ok = Check(controller->mode() == CongestionController::PROBING, test, "not probing") && ok;
+		ok = Check(controller->PacingRate() == 2 * initial_rate, test, "not at the decayed rate") && ok;
+
+		// What it converges to goes back to the cache.
+		controller->OnConnectionClosed(2 * kHalfLifeUs);
+		PathInfo info;
+		ok = Check(cache.Lookup(kDestination, 2 * kHalfLifeUs, &info), test, "path not recorded") && ok;
+		ok = Check(info.sending_rate == 2 * initial_rate && info.record_time == 2 * kHalfLifeUs, test, "recorded path differs") && ok;
+		return ok;
+	}
+
+	bool TestLowerRateHit()
+	{
+		const char* test = "lower rate hit";
+		std::unique_ptr<CongestionController> controller = NewController();
+		QuicBandwidth initial_rate = controller->PacingRate();
+		PathCacheConfig config;
+		config.rate_half_life_us = kHalfLifeUs;
+		PathCache cache(config);
+		cache.Record(kDestination, Info(4 * initial_rate, 0));
+
+		// Three half lives later the rate is half the initial one.
+		controller->set_path_cache(&cache, kDestination, 3 * kHalfLifeUs);
+		bool ok = Check(cache.num_hits() == 1, test, "hit not counted");
+		ok = Check(controller->mode() == CongestionController::STARTING, test, "not starting") && ok;
+		ok = Check(controller->PacingRate() == initial_rate, test, "not at the initial rate") && ok;
+
+		// Still STARTING, the controller records nothing.
+		controller->OnConnectionClosed(3 * kHalfLifeUs);
+		PathInfo info;
+		ok = Check(cache.Lookup(kDestination, 3 * kHalfLifeUs, &info), test, "entry lost") && ok;
+		ok = Check(info.record_time == 0, test, "starting controller recorded its path") && ok;
+		return ok;
+	}
+
+	bool TestExpiry()
+	{
+		const char* test = "expiry";
+		PathCacheConfig config;
+		config.expiry_us = 1000;
+		PathCache cache(config);
+		cache.Record(kDestination, Info(1e7, 0));
+		PathInfo info;
+		bool ok = Check(cache.Lookup(kDestination, 1000, &info), test, "entry expired early");
+		ok = Check(!cache.Lookup(kDestination, 1001, &info), test, "entry not expired") && ok;
+		ok = Check(cache.size() == 0, test, "expired entry kept") && ok;
+		ok = Check(!cache.Lookup(kDestination + 1, 0, &info), test, "unknown destination found") && ok;
+		ok = Check(cache.num_hits() == 1, test, "hits miscounted") && ok;
+		ok = Check(cache.num_misses() == 2, test, "misses miscounted") && ok;
+		ok = Check(cache.num_expirations() == 1, test, "expirations miscounted") && ok;
+
+		// The controller of an expired entry stays in STARTING.
+		cache.Record(kDestination, Info(1e9, 0));
+		std::unique_ptr<CongestionController> controller = NewController();
+		controller->set_path_cache(&cache, kDestination, 2000);
+		ok = Check(controller->mode() == CongestionController::STARTING, test, "started from an expired entry") && ok;
+		ok = Check(cache.num_expirations() == 2, test, "expirations miscounted") && ok;
+		return ok;
+	}
+
+	bool TestEviction()
+	{
+		const char* test = "eviction";
+		PathCacheConfig config;
+		config.max_entries = 2;
+		config.expiry_us = 1000;
+		config.rate_half_life_us = 0;
+		PathCache cache(config);
+		cache.Record(1, Info(1e7, 0));
+		cache.Record(2, Info(1e7, 100));
+		// Replacing an entry needs no room.
+		cache.Record(2, Info(2e7, 200));
+		bool ok = Check(cache.size() == 2 && cache.num_evictions() == 0, test, "replaced entry evicted");
+
+		// The least recently recorded entry makes room.
+		cache.Record(3, Info(1e7, 300));
+		PathInfo info;
+		ok = Check(cache.size() == 2 && cache.num_evictions() == 1, test, "no entry evicted") && ok;
+		ok = Check(!cache.Lookup(1, 300, &info), test, "oldest entry kept") && ok;
+		ok = Check(cache.Lookup(2, 300, &info) && info.sending_rate == 2e7, test, "newer entry evicted") && ok;
+
+		// Expired entries make room before any is evicted.
+		cache.Record(4, Info(1e7, 1250));
+		ok = Check(cache.num_evictions() == 1 && cache.num_expirations() == 1, test, "entry evicted while one expired") && ok;
+		ok = Check(cache.Lookup(3, 1250, &info) && cache.Lookup(4, 1250, &info), test, "live entry dropped") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestHigherRateHit() && ok;
+	ok = TestLowerRateHit() && ok;
+	ok = TestExpiry() && ok;
+	ok = TestEviction() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
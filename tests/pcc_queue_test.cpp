@@ -0,0 +1,463 @@
+// pcc_queue_test: checks that monitor intervals complete with the packets
+// they sent once those are acked or lost, whether the acks come reordered,
+// repeated, as ranges or after a loss they reverse, that the ring of
+// intervals recycles its slots as it wraps and makes room when full, and
+// that the timer completes the intervals whose acks are overdue at its
+// configured deadline and not before, all at once, so that acks arriving
+// after count for none of them.
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "CongestionController.h"
+#include "MonitorIntervalQueue.h"
+#include "PccConfig.h"
+
+namespace
+{
+	const QuicTime kRttUs = 20000;
+	const QuicByteCount kPacketSize = 1000;
+	const QuicBandwidth kSendingRate = 1e8;
+	// End time of the first interval; its packets are sent before it.
+	const QuicTime kEndTime = 10000;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	// Keeps the utilities of every report.
+	class UtilityRecorder : public MonitorIntervalQueueDelegateInterface
+	{
+	public:
+		void OnUtilityAvailable(UtilityInfoSpan utility_info) override
+		{
+			++num_reports;
+			utilities.assign(utility_info.begin(), utility_info.end());
+		}
+
+		int num_reports = 0;
+		std::vector<UtilityInfo> utilities;
+	};
+
+	// A queue tuned by |config| of |num_intervals| useful intervals of
+	// |packets_per_interval| packets each, numbered from 0, the nth ending
+	// n * kEndTime.
+	struct QueueFixture
+	{
+		explicit QueueFixture(int num_intervals, int packets_per_interval = 10, const PccConfig& config = *PccConfig::Default()) :
+			queue(recorder, config)
+		{
+			QuicPacketNumber packet_number = 0;
+			for (int i = 0; i < num_intervals; ++i)
+			{
+				queue.EnqueueNewMonitorInterval(kSendingRate * (i + 1), true, 0.1f, kRttUs, (i + 1) * kEndTime);
+				for (int j = 0; j < packets_per_interval; ++j, ++packet_number)
+					queue.OnPacketSent(i * kEndTime + j * kEndTime / (10 * packets_per_interval), packet_number, kPacketSize);
+			}
+		}
+
+		// Reports the acks and losses of single packets at |event_time|.
+		void OnPackets(const std::vector<QuicPacketNumber>& acked, const std::vector<QuicPacketNumber>& lost, QuicTime event_time)
+		{
+			AckedPacketVector acked_packets;
+			LostPacketVector lost_packets;
+			for (QuicPacketNumber packet_number : acked)
+				acked_packets.push_back(Event(packet_number, true, event_time));
+			for (QuicPacketNumber packet_number : lost)
+				lost_packets.push_back(Event(packet_number, false, event_time));
+			queue.OnCongestionEvent(acked_packets, lost_packets, kRttUs, event_time);
+		}
+
+		static CongestionEvent Event(QuicPacketNumber packet_number, bool is_acked, QuicTime event_time)
+		{
+			CongestionEvent event;
+			event.packet_number = packet_number;
+			event.bytes_acked = is_acked ? static_cast<int32_t> (kPacketSize) : 0;
+			event.bytes_lost = is_acked ? 0 : static_cast<int32_t> (kPacketSize);
+			event.time = static_cast<uint64_t> (event_time);
+			return event;
+		}
+
+		UtilityRecorder recorder;
+		MonitorIntervalQueue queue;
+	};
+
+	PacketNumberRange Range(QuicPacketNumber first, QuicPacketNumber last, QuicByteCount bytes)
+	{
+		PacketNumberRange range;
+		range.first_packet_number = first;
+		range.last_packet_number = last;
+		range.bytes = bytes;
+		return range;
+	}
+
+	// Utilities of |num_intervals| intervals of |packets_per_interval|
+	// packets, all acked in order after they end.
+	std::vector<UtilityInfo> InOrderUtilities(int num_intervals, int packets_per_interval = 10)
+	{
+		QueueFixture fixture(num_intervals, packets_per_interval);
+		std::vector<QuicPacketNumber> acked;
+		for (QuicPacketNumber i = 0; i < num_intervals * packets_per_interval; ++i)
+			acked.push_back(i);
+		fixture.OnPackets(acked, {}, num_intervals * kEndTime);
+		return fixture.recorder.utilities;
+	}
+
+	bool SameUtilities(const std::vector<UtilityInfo>& a, const std::vector<UtilityInfo>& b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			if (a[i].sending_rate != b[i].sending_rate || a[i].utility != b[i].utility)
+				return false;
+		}
+		return true;
+	}
+
+	bool TestReorderedAcks()
+	{
+		const char* test = "reordered acks";
+		QueueFixture fixture(2);
+		// Packet 5 is taken as lost and acked before its interval completes,
+		// and the acks of both intervals come interleaved.
+		fixture.OnPackets({ 12, 3, 19, 0, 7 }, { 5 }, 2 * kEndTime);
+		fixture.OnPackets({ 18, 1, 11, 9, 2, 17, 4 }, {}, 2 * kEndTime);
+		fixture.OnPackets({ 16, 6, 15, 10, 13 }, {}, 2 * kEndTime);
+		bool ok = Check(fixture.recorder.num_reports == 0, test, "reported with packets outstanding");
+		fixture.OnPackets({ 14, 8, 5 }, {}, 2 * kEndTime);
+		ok = Check(fixture.recorder.num_reports == 1, test, "not reported once all packets were acked") && ok;
+		ok = Check(SameUtilities(fixture.recorder.utilities, InOrderUtilities(2)), test,
+			"utilities differ from those of acks in order") && ok;
+		return ok;
+	}
+
+	// Reports of 3 intervals of 200 packets each, every 7th lost, in one
+	// congestion event, with |order| applied to the acks and losses.
+	std::vector<UtilityInfo> UtilitiesOfBatch(void (*order)(std::vector<QuicPacketNumber>*))
+	{
+		QueueFixture fixture(3, 200);
+		std::vector<QuicPacketNumber> acked;
+		std::vector<QuicPacketNumber> lost;
+		for (QuicPacketNumber i = 0; i < 600; ++i)
+			(i % 7 == 3 ? lost : acked).push_back(i);
+		order(&acked);
+		order(&lost);
+		fixture.OnPackets(acked, lost, 3 * kEndTime);
+		if (fixture.recorder.num_reports != 1)
+			return std::vector<UtilityInfo>();
+		return fixture.recorder.utilities;
+	}
+
+	bool TestOutOfOrderBatches()
+	{
+		const char* test = "out of order batches";
+		std::vector<UtilityInfo> in_order = UtilitiesOfBatch([](std::vector<QuicPacketNumber>*) {});
+		bool ok = Check(in_order.size() == 3, test, "in-order batch not reported");
+		// More events than are sorted at a time, as consecutive events.
+		ok = Check(SameUtilities(UtilitiesOfBatch([](std::vector<QuicPacketNumber>* packets)
+		{
+			std::reverse(packets->begin(), packets->end());
+		}), in_order), test, "descending batch differs") && ok;
+		ok = Check(SameUtilities(UtilitiesOfBatch([](std::vector<QuicPacketNumber>* packets)
+		{
+			for (size_t i = 0; i + 1 < packets->size(); i += 2)
+				std::swap((*packets)[i], (*packets)[i + 1]);
+		}), in_order), test, "nearly sorted batch differs") && ok;
+		ok = Check(SameUtilities(UtilitiesOfBatch([](std::vector<QuicPacketNumber>* packets)
+		{
+			std::mt19937 random(1);
+			std::shuffle(packets->begin(), packets->end(), random);
+		}), in_order), test, "shuffled batch differs") && ok;
+		return ok;
+	}
+
+	bool TestDuplicateAcks()
+	{
+		const char* test = "duplicate acks";
+		QueueFixture fixture(1);
+		// Retransmissions under the numbers of earlier packets are not sent
+		// again by the interval.
+		fixture.queue.OnPacketSent(5000, 3, kPacketSize);
+		fixture.OnPackets({ 0, 1, 2, 3, 4, 5, 6, 7, 8 }, {}, kEndTime);
+		fixture.OnPackets({ 0, 1, 2, 3, 4, 5, 6, 7, 8 }, {}, kEndTime);
+		fixture.OnPackets({ 8, 3, 3 }, {}, kEndTime);
+		const MonitorInterval& interval = fixture.queue.current();
+		bool ok = Check(fixture.recorder.num_reports == 0, test, "repeated acks completed the interval");
+		ok = Check(interval.bytes_sent == 10 * kPacketSize && interval.bytes_acked == 9 * kPacketSize
+			&& interval.packets_outstanding() == 1, test, "repeated acks counted") && ok;
+		// A loss reported after the ack does not take it back.
+		fixture.OnPackets({}, { 4 }, kEndTime);
+		ok = Check(interval.bytes_lost == 0 && interval.packets_outstanding() == 1, test, "acked packet counted as lost") && ok;
+		fixture.OnPackets({ 9, 9 }, {}, kEndTime);
+		ok = Check(fixture.recorder.num_reports == 1, test, "not reported once all packets were acked") && ok;
+		ok = Check(SameUtilities(fixture.recorder.utilities, InOrderUtilities(1)), test,
+			"utilities differ from those of single acks") && ok;
+		return ok;
+	}
+
+	bool TestReversedRanges()
+	{
+		const char* test = "reversed ranges";
+		QueueFixture fixture(1);
+		// Packet 9 stays outstanding until the end so that the interval can
+		// be looked at.
+		fixture.queue.OnCongestionEvent({}, { Range(0, 3, 4 * kPacketSize) }, kRttUs, kEndTime);
+		const MonitorInterval& interval = fixture.queue.current();
+		bool ok = Check(interval.bytes_lost == 4 * kPacketSize && interval.packets_lost == 4, test, "range not lost");
+
+		// Acks 2 of the lost packets, packet 5 again and 1 new one, reported
+		// as 1500 bytes each. The lost bytes go down by the reversed packets'
+		// share of the range's bytes.
+		fixture.queue.OnCongestionEvent({ Range(5, 5, kPacketSize) }, {}, kRttUs, kEndTime);
+		fixture.queue.OnCongestionEvent({ Range(2, 5, 4 * 1500) }, {}, kRttUs, kEndTime);
+		ok = Check(interval.bytes_acked == kPacketSize + 4 * 1500 * 3 / 4 && interval.packets_acked == 4, test,
+			"range not acked") && ok;
+		ok = Check(interval.bytes_lost == 4 * kPacketSize - 4 * 1500 * 2 / 4 && interval.packets_lost == 2, test,
+			"losses not reversed in proportion") && ok;
+
+		// Acks the other 2 lost packets, 4 packets again and 3 new ones, from
+		// the highest range down as QUIC lists them, with a range of packets
+		// never sent.
+		fixture.queue.OnCongestionEvent({ Range(30, 31, 2 * kPacketSize), Range(0, 8, 9 * 500) }, {}, kRttUs, kEndTime);
+		ok = Check(interval.bytes_acked == kPacketSize + 4 * 1500 * 3 / 4 + 9 * 500 * 5 / 9 && interval.packets_acked == 9, test,
+			"repeated range counted") && ok;
+		ok = Check(interval.bytes_lost == 0 && interval.packets_lost == 0, test, "losses not reversed") && ok;
+		ok = Check(fixture.recorder.num_reports == 0, test, "reported with a packet outstanding") && ok;
+
+		// Loses 8 and 9, of which only 9 is outstanding.
+		fixture.queue.OnCongestionEvent({}, { Range(8, 9, 2 * kPacketSize) }, kRttUs, kEndTime);
+		ok = Check(fixture.recorder.num_reports == 1, test, "not reported once all packets were acked or lost") && ok;
+		return ok;
+	}
+
+	bool TestDescendingRanges()
+	{
+		const char* test = "descending ranges";
+		// Ranges of an ACK frame from the highest packet number down, over 3
+		// intervals. Packet 29 stays outstanding so that the intervals can be
+		// looked at.
+		const PacketNumberRangeVector acked = { Range(24, 28, 5 * 1200), Range(12, 21, 10 * kPacketSize), Range(0, 9, 10 * 1400) };
+		const PacketNumberRangeVector lost = { Range(22, 23, 2 * 700), Range(10, 11, 2 * 900) };
+		const QuicByteCount kBytesAcked[] = { 10 * 1400, 10 * kPacketSize * 8 / 10, 10 * kPacketSize * 2 / 10 + 5 * 1200 };
+		const QuicByteCount kBytesLost[] = { 0, 2 * 900, 2 * 700 };
+
+		bool ok = true;
+		for (bool descending : { true, false })
+		{
+			QueueFixture fixture(3);
+			PacketNumberRangeVector acks = acked;
+			PacketNumberRangeVector losses = lost;
+			if (!descending)
+			{
+				std::reverse(acks.begin(), acks.end());
+				std::reverse(losses.begin(), losses.end());
+			}
+			fixture.queue.OnCongestionEvent(acks, losses, kRttUs, 3 * kEndTime);
+			for (size_t i = 0; i < 3; ++i)
+			{
+				const MonitorInterval& interval = fixture.queue.interval(i);
+				ok = Check(interval.bytes_acked == kBytesAcked[i] && interval.bytes_lost == kBytesLost[i], test,
+					descending ? "wrong bytes from descending ranges" : "wrong bytes from ascending ranges") && ok;
+			}
+			ok = Check(fixture.queue.interval(1).packets_acked == 8 && fixture.queue.interval(2).packets_outstanding() == 1,
+				test, "wrong packet counts") && ok;
+		}
+
+		// More ranges than are sorted at a time: every other packet of an
+		// interval of 600, from the top down.
+		QueueFixture fixture(1, 600);
+		PacketNumberRangeVector ranges;
+		for (QuicPacketNumber i = 598; i >= 0; i -= 2)
+			ranges.push_back(Range(i, i, kPacketSize));
+		fixture.queue.OnCongestionEvent(ranges, {}, kRttUs, kEndTime);
+		ok = Check(fixture.queue.current().bytes_acked == 300 * kPacketSize && fixture.queue.current().packets_acked == 300,
+			test, "wrong bytes from many descending ranges") && ok;
+		return ok;
+	}
+
+	// Rounds of 2 useful intervals in a ring of 3 slots, so the head wraps
+	// at a different slot every round. Each round reports what the first
+	// did, from the same 3 slots.
+	bool TestRingWrap()
+	{
+		const char* test = "ring wrap";
+		const size_t kCapacity = 3;
+		const int kNumRounds = 10;
+		std::vector<MonitorInterval> storage(kCapacity);
+		UtilityRecorder recorder;
+		MonitorIntervalQueue queue(recorder, *PccConfig::Default(), storage.data(), kCapacity);
+		std::vector<UtilityInfo> first_round;
+		bool ok = true;
+		for (int round = 0; round < kNumRounds; ++round)
+		{
+			QuicTime start = round * 3 * kEndTime;
+			QuicPacketNumber first = round * 20;
+			for (int i = 0; i < 2; ++i)
+			{
+				queue.EnqueueNewMonitorInterval(kSendingRate * (i + 1), true, 0.1f, kRttUs, start + (i + 1) * kEndTime);
+				const MonitorInterval* slot = &queue.current();
+				ok = Check(slot >= storage.data() && slot < storage.data() + kCapacity, test, "interval outside its storage") && ok;
+				for (QuicPacketNumber j = 0; j < 10; ++j)
+					queue.OnPacketSent(start + i * kEndTime + j * kEndTime / 100, first + i * 10 + j, kPacketSize);
+			}
+			AckedPacketVector acked;
+			for (QuicPacketNumber i = first; i < first + 20; ++i)
+				acked.push_back(QueueFixture::Event(i, true, start + 2 * kEndTime));
+			queue.OnCongestionEvent(acked, LostPacketVector(), kRttUs, start + 2 * kEndTime);
+
+			ok = Check(recorder.num_reports == round + 1 && queue.empty(), test, "round not reported") && ok;
+			if (round == 0)
+				first_round = recorder.utilities;
+			ok = Check(SameUtilities(recorder.utilities, first_round), test, "recycled slot changed the utilities") && ok;
+		}
+		ok = Check(queue.num_overflows() == 0, test, "ring overflowed") && ok;
+		return ok;
+	}
+
+	// A full ring makes room by dropping a non-useful interval, at its head or
+	// its tail, and refuses a new interval when every slot is useful.
+	bool TestRingFull()
+	{
+		const char* test = "ring full";
+		UtilityRecorder recorder;
+		MonitorIntervalQueue head(recorder, *PccConfig::Default(), 3);
+		head.EnqueueNewMonitorInterval(kSendingRate, false, 0.1f, kRttUs, kEndTime);
+		head.EnqueueNewMonitorInterval(2 * kSendingRate, true, 0.1f, kRttUs, 2 * kEndTime);
+		head.EnqueueNewMonitorInterval(3 * kSendingRate, true, 0.1f, kRttUs, 3 * kEndTime);
+		bool ok = Check(head.EnqueueNewMonitorInterval(4 * kSendingRate, true, 0.1f, kRttUs, 4 * kEndTime), test, "head not dropped");
+		ok = Check(head.size() == 3 && head.interval(0).sending_rate == 2 * kSendingRate && head.current().sending_rate == 4 * kSendingRate,
+			test, "wrong interval dropped at the head") && ok;
+
+		MonitorIntervalQueue tail(recorder, *PccConfig::Default(), 3);
+		tail.EnqueueNewMonitorInterval(kSendingRate, true, 0.1f, kRttUs, kEndTime);
+		tail.EnqueueNewMonitorInterval(2 * kSendingRate, true, 0.1f, kRttUs, 2 * kEndTime);
+		tail.EnqueueNewMonitorInterval(3 * kSendingRate, false, 0.1f, kRttUs, 3 * kEndTime);
+		ok = Check(tail.EnqueueNewMonitorInterval(4 * kSendingRate, true, 0.1f, kRttUs, 4 * kEndTime), test, "tail not dropped") && ok;
+		ok = Check(tail.size() == 3 && tail.interval(1).sending_rate == 2 * kSendingRate && tail.current().sending_rate == 4 * kSendingRate,
+			test, "wrong interval dropped at the tail") && ok;
+
+		// Every slot useful: the packets stay with the current interval.
+		ok = Check(!tail.EnqueueNewMonitorInterval(5 * kSendingRate, true, 0.1f, kRttUs, 5 * kEndTime), test, "useful interval dropped") && ok;
+		ok = Check(tail.num_overflows() == 1 && tail.current().sending_rate == 4 * kSendingRate, test, "overflow not counted") && ok;
+		tail.OnPacketSent(4 * kEndTime, 0, kPacketSize);
+		ok = Check(tail.current().n_packets == 1, test, "packet not sent in the current interval") && ok;
+		return ok;
+	}
+
+	bool TestTimerCompletion()
+	{
+		const char* test = "timer completion";
+		const PccConfig& config = *PccConfig::Default();
+		QuicTime timeout = static_cast<QuicTime> (config.monitor_interval_timeout_rtts * kRttUs);
+
+		// The last 2 packets are lost silently.
+		QueueFixture fixture(1);
+		fixture.OnPackets({ 0, 1, 2, 3, 4, 5, 6, 7 }, {}, kEndTime);
+		bool ok = Check(fixture.queue.NextDeadline(kRttUs) == kEndTime + timeout, test, "wrong deadline with packets outstanding");
+		ok = Check(fixture.queue.EarliestDeadline() <= fixture.queue.NextDeadline(kRttUs), test, "earliest deadline too late") && ok;
+		fixture.queue.OnTimer(kEndTime + timeout - 1, kRttUs);
+		ok = Check(fixture.recorder.num_reports == 0, test, "completed before the deadline") && ok;
+		fixture.queue.OnTimer(kEndTime + timeout, kRttUs);
+		ok = Check(fixture.recorder.num_reports == 1, test, "not completed at the deadline") && ok;
+		ok = Check(fixture.queue.NextDeadline(kRttUs) == MonitorIntervalQueue::kNoDeadline, test, "deadline left once complete") && ok;
+
+		// The same utility as if the 2 packets had been reported lost.
+		QueueFixture lost(1);
+		lost.OnPackets({ 0, 1, 2, 3, 4, 5, 6, 7 }, { 8, 9 }, kEndTime);
+		ok = Check(SameUtilities(fixture.recorder.utilities, lost.recorder.utilities), test,
+			"utility differs from that of reported losses") && ok;
+
+		// All packets acked before the interval ended, with no ack after.
+		QueueFixture early(1);
+		early.OnPackets({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }, {}, kEndTime - 1);
+		ok = Check(early.recorder.num_reports == 0 && early.queue.NextDeadline(kRttUs) == kEndTime, test,
+			"wrong deadline with every packet acked") && ok;
+		early.queue.OnTimer(kEndTime, kRttUs);
+		ok = Check(SameUtilities(early.recorder.utilities, InOrderUtilities(1)), test,
+			"utility differs from that of acks after the end") && ok;
+		return ok;
+	}
+
+	bool TestTimerSeveralIntervals()
+	{
+		const char* test = "timer several intervals";
+		PccConfig config;
+		config.monitor_interval_timeout_rtts = 4.0f;
+		QuicTime deadline = 2 * kEndTime + 4 * kRttUs;
+
+		// The first interval is acked in full, the last 3 packets of the
+		// second never are.
+		std::vector<QuicPacketNumber> acked;
+		for (QuicPacketNumber i = 0; i < 17; ++i)
+			acked.push_back(i);
+		QueueFixture fixture(2, 10, config);
+		fixture.OnPackets(acked, {}, 2 * kEndTime);
+		bool ok = Check(fixture.queue.NextDeadline(kRttUs) == deadline, test, "deadline not the configured RTTs after the last end");
+		fixture.queue.OnTimer(deadline - 1, kRttUs);
+		ok = Check(fixture.recorder.num_reports == 0, test, "completed before the deadline") && ok;
+		fixture.queue.OnTimer(deadline, kRttUs);
+		ok = Check(fixture.recorder.num_reports == 1 && fixture.recorder.utilities.size() == 2, test, "intervals not completed together") && ok;
+
+		QueueFixture lost(2, 10, config);
+		lost.OnPackets(acked, { 17, 18, 19 }, 2 * kEndTime);
+		ok = Check(SameUtilities(fixture.recorder.utilities, lost.recorder.utilities), test,
+			"utilities differ from those of reported losses") && ok;
+
+		// Acks of the packets counted as lost come too late to count.
+		fixture.OnPackets({ 17, 18, 19 }, {}, deadline + 1);
+		ok = Check(fixture.recorder.num_reports == 1, test, "late acks reported again") && ok;
+		ok = Check(fixture.queue.NextDeadline(kRttUs) == MonitorIntervalQueue::kNoDeadline, test, "deadline left once complete") && ok;
+		return ok;
+	}
+
+	bool TestControllerTimer()
+	{
+		const char* test = "controller timer";
+		CongestionController controller(kRttUs, 10, 100000);
+		// Takes an RTT sample, then sends for 10 RTTs and hears nothing back.
+		controller.OnPacketSent(0, 0, kPacketSize, true);
+		controller.OnCongestionEvent(kRttUs, kRttUs, { QueueFixture::Event(0, true, kRttUs) }, LostPacketVector());
+		QuicTime now = kRttUs;
+		for (QuicPacketNumber packet_number = 1; now < 11 * kRttUs; ++packet_number)
+		{
+			controller.OnPacketSent(now, packet_number, kPacketSize, true);
+			now += static_cast<QuicTime> (kPacketSize * 8 * 1e6 / controller.PacingRate());
+		}
+
+		QuicTime deadline = controller.NextTimerDeadline();
+		if (!Check(deadline != CongestionController::kNoTimerDeadline, test, "no deadline with intervals outstanding"))
+			return false;
+		size_t mode = static_cast<size_t> (controller.mode());
+		uint64_t rounds = controller.stats().mode_rounds[mode];
+		controller.OnTimer(deadline - 1);
+		bool ok = Check(controller.stats().mode_rounds[mode] == rounds, test, "completed before the deadline");
+		controller.OnTimer(deadline);
+		ok = Check(controller.stats().mode_rounds[mode] == rounds + 1, test, "not completed at the deadline") && ok;
+		ok = Check(controller.NextTimerDeadline() > deadline, test, "deadline not moved on") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestReorderedAcks() && ok;
+	ok = TestOutOfOrderBatches() && ok;
+	ok = TestDuplicateAcks() && ok;
+	ok = TestReversedRanges() && ok;
+	ok = TestDescendingRanges() && ok;
+	ok = TestRingWrap() && ok;
+	ok = TestRingFull() && ok;
+	ok = TestTimerCompletion() && ok;
+	ok = TestTimerSeveralIntervals() && ok;
+	ok = TestControllerTimer() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,334 @@
+// pcc_quiescent_test: checks that a controller on the quiescent fast path
+// decides on the rates a controller without it decides on, and that it
+// leaves the fast path when its utility gradient changes, as on an RTT step,
+// when it leaves DECISION_MADE, as on losses, and when too many of its
+// packets are reported out of order. Its timer completes a quiescent interval whose
+// ACKs stop coming.
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "CongestionController.h"
+#include "PccConfig.h"
+
+namespace
+{
+	const double kBandwidthBps = 100e6;
+	const QuicTime kRttUs = 20000;
+	const QuicByteCount kPacketSize = 1400;
+	// One bandwidth-delay product.
+	const double kBufferBytes = kBandwidthBps / 8 * kRttUs / 1e6;
+	const size_t kAckBatch = 8;
+	const size_t kQuiescentRounds = 3;
+	// The path changes the first time the flow is on the fast path after
+	// this long, and the flow runs this long after.
+	const QuicTime kSettleUs = 5000000;
+	const QuicTime kAfterChangeUs = 5000000;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	// How the path changes once the flow is on the fast path.
+	struct PathChange
+	{
+		// Added to the RTT from then on.
+		QuicTime extra_rtt_us;
+		// Every |loss_period|th packet is lost for |change_us|, unless 0.
+		size_t loss_period;
+		// Every ack batch is reported in reverse for |change_us|.
+		bool reorder;
+		// No packet is acked or reported lost for |change_us|.
+		bool blackout;
+		QuicTime change_us;
+	};
+
+	// What a run saw.
+	struct Outcome
+	{
+		// Whether the flow was on the fast path when the path changed, and
+		// when it left the fast path after, if it did.
+		bool changed = false;
+		QuicTime change_time = 0;
+		QuicTime exit_time = 0;
+		// The flow's mode just after it left the fast path.
+		CongestionController::SenderMode exit_mode = CongestionController::STARTING;
+		// Whether the flow and its twin without the fast path ever paced at
+		// different rates.
+		bool rates_differ = false;
+		// Timers fired while the flow was on the fast path that completed a
+		// round.
+		size_t quiescent_timer_rounds = 0;
+		ControllerStats stats;
+	};
+
+	// Paces packets at the rate of a controller on the fast path into a
+	// drop-tail bottleneck and acks them |kAckBatch| at a time, feeding the
+	// same calls to a twin controller without the fast path.
+	class Path
+	{
+	public:
+		explicit Path(const PathChange& change) :
+			change_(change),
+			flow_(kRttUs, 10, 100000, Config(kQuiescentRounds)),
+			twin_(kRttUs, 10, 100000, Config(0))
+		{
+			flow_.set_random_seed(1);
+			twin_.set_random_seed(1);
+		}
+
+		Outcome Run()
+		{
+			while (!outcome_.changed || now_ < outcome_.change_time + kAfterChangeUs)
+			{
+				if (!outcome_.changed && now_ >= kSettleUs && flow_.is_quiescent())
+				{
+					outcome_.changed = true;
+					outcome_.change_time = now_;
+				}
+				if (!outcome_.changed && now_ >= 4 * kSettleUs)
+					break;
+				SendPackets();
+				DeliverAcks();
+			}
+			outcome_.stats = flow_.stats();
+			return outcome_;
+		}
+
+	private:
+		struct SentPacket
+		{
+			QuicPacketNumber packet_number;
+			QuicTime sent_time;
+			QuicTime ack_time;
+			bool lost;
+			bool silent;
+		};
+
+		static std::shared_ptr<const PccConfig> Config(size_t quiescent_rounds)
+		{
+			PccConfig config;
+			config.quiescent_rounds = quiescent_rounds;
+			return PccConfig::Create(config, nullptr);
+		}
+
+		bool InChange(QuicTime time) const
+		{
+			return outcome_.changed && time >= outcome_.change_time && time < outcome_.change_time + change_.change_us;
+		}
+
+		void SendPackets()
+		{
+			while (in_flight_.size() - in_flight_head_ < kAckBatch ||
+				next_send_time_us_ <= in_flight_[in_flight_head_ + kAckBatch - 1].ack_time)
+			{
+				SentPacket packet;
+				packet.packet_number = next_packet_number_++;
+				packet.sent_time = static_cast<QuicTime> (next_send_time_us_);
+				Call([&](CongestionController* controller) { controller->OnPacketSent(packet.sent_time, packet.packet_number, kPacketSize, true); });
+
+				double bytes_per_us = kBandwidthBps / 8 / 1e6;
+				queue_bytes_ = std::max(0.0, queue_bytes_ - (packet.sent_time - queue_time_us_) * bytes_per_us);
+				queue_time_us_ = static_cast<double> (packet.sent_time);
+				packet.lost = queue_bytes_ + kPacketSize > kBufferBytes;
+				if (!packet.lost)
+					queue_bytes_ += kPacketSize;
+				bool in_change = InChange(packet.sent_time);
+				packet.lost = packet.lost || (in_change && change_.loss_period > 0 && packet.packet_number % change_.loss_period == 0);
+				packet.silent = in_change && change_.blackout;
+				QuicTime rtt = kRttUs + (outcome_.changed && packet.sent_time >= outcome_.change_time ? change_.extra_rtt_us : 0);
+				packet.ack_time = packet.sent_time + rtt + static_cast<QuicTime> (queue_bytes_ / bytes_per_us);
+				in_flight_.push_back(packet);
+				next_send_time_us_ += kPacketSize * 8 * 1e6 / std::max(flow_.PacingRate(), 1.0);
+			}
+		}
+
+		// Delivers the next ack batch, firing the controllers' timers first if
+		// they are due. Packets sent in a blackout are never reported.
+		void DeliverAcks()
+		{
+			acked_packets_.clear();
+			lost_packets_.clear();
+			QuicTime rtt = 0;
+			for (size_t i = 0; i < kAckBatch; ++i)
+			{
+				const SentPacket& packet = in_flight_[in_flight_head_ + i];
+				now_ = std::max(now_, packet.ack_time);
+				if (packet.silent)
+					continue;
+				CongestionEvent event = {};
+				event.packet_number = packet.packet_number;
+				event.time = static_cast<uint64_t> (packet.ack_time);
+				if (packet.lost)
+				{
+					event.bytes_lost = static_cast<int32_t> (kPacketSize);
+					lost_packets_.push_back(event);
+				} else {
+					event.bytes_acked = static_cast<int32_t> (kPacketSize);
+					acked_packets_.push_back(event);
+					rtt = packet.ack_time - packet.sent_time;
+				}
+			}
+			if (change_.reorder && InChange(now_))
+			{
+				std::reverse(acked_packets_.begin(), acked_packets_.end());
+				std::reverse(lost_packets_.begin(), lost_packets_.end());
+			}
+			in_flight_head_ += kAckBatch;
+			if (in_flight_head_ * 2 > in_flight_.size())
+			{
+				in_flight_.erase(in_flight_.begin(), in_flight_.begin() + in_flight_head_);
+				in_flight_head_ = 0;
+			}
+
+			bool was_quiescent = flow_.is_quiescent();
+			uint64_t rounds = flow_.stats().mode_rounds[CongestionController::DECISION_MADE];
+			QuicTime deadline = flow_.NextTimerDeadline();
+			if (deadline <= now_)
+				flow_.OnTimer(deadline);
+			if (was_quiescent && flow_.stats().mode_rounds[CongestionController::DECISION_MADE] > rounds)
+				++outcome_.quiescent_timer_rounds;
+			deadline = twin_.NextTimerDeadline();
+			if (deadline <= now_)
+				twin_.OnTimer(deadline);
+			Compare(was_quiescent);
+			if (!acked_packets_.empty() || !lost_packets_.empty())
+				Call([&](CongestionController* controller) { controller->OnCongestionEvent(now_, rtt, acked_packets_, lost_packets_); });
+		}
+
+		// Makes the same call to both controllers.
+		template <class Apply>
+		void Call(Apply apply)
+		{
+			bool was_quiescent = flow_.is_quiescent();
+			apply(&flow_);
+			apply(&twin_);
+			Compare(was_quiescent);
+		}
+
+		// Compares the rates of the controllers after a call, and notes the
+		// first time the flow left the fast path after the change.
+		void Compare(bool was_quiescent)
+		{
+			outcome_.rates_differ = outcome_.rates_differ || flow_.PacingRate() != twin_.PacingRate();
+			if (was_quiescent && !flow_.is_quiescent() && outcome_.changed && outcome_.exit_time == 0)
+			{
+				outcome_.exit_time = now_;
+				outcome_.exit_mode = flow_.mode();
+			}
+		}
+
+		PathChange change_;
+		CongestionController flow_;
+		CongestionController twin_;
+		Outcome outcome_;
+		QuicTime now_ = 0;
+		QuicPacketNumber next_packet_number_ = 0;
+		double next_send_time_us_ = 0.0;
+		double queue_bytes_ = 0.0;
+		double queue_time_us_ = 0.0;
+		// Packets not yet reported, oldest first from |in_flight_head_|.
+		std::vector<SentPacket> in_flight_;
+		size_t in_flight_head_ = 0;
+		AckedPacketVector acked_packets_;
+		LostPacketVector lost_packets_;
+	};
+
+	void Print(const char* name, const Outcome& outcome)
+	{
+		printf("%s: on the fast path at %.3f s, off at %.3f s, %llu quiescent intervals, %llu fallbacks\n",
+			name, outcome.change_time / 1e6, outcome.exit_time / 1e6,
+			static_cast<unsigned long long> (outcome.stats.quiescent_intervals),
+			static_cast<unsigned long long> (outcome.stats.quiescent_fallbacks));
+	}
+
+	// Without a change the flow stays on the fast path until it leaves
+	// DECISION_MADE, deciding on the rates its twin does.
+	bool TestSteady(const Outcome& steady)
+	{
+		const char* test = "steady";
+		bool ok = Check(steady.changed, test, "never took the fast path");
+		ok = Check(steady.exit_time > steady.change_time && steady.exit_mode == CongestionController::PROBING,
+			test, "left the fast path in DECISION_MADE") && ok;
+		ok = Check(!steady.rates_differ, test, "rates differ from the twin's") && ok;
+		ok = Check(steady.stats.quiescent_fallbacks == 0, test, "in-order packets fell back") && ok;
+		return ok;
+	}
+
+	// A longer RTT changes the gradient, which ends the fast path in
+	// DECISION_MADE, earlier than without it.
+	bool TestRttStep(const Outcome& steady)
+	{
+		const char* test = "rtt step";
+		PathChange change = { kRttUs / 2, 0, false, false, 0 };
+		Outcome outcome = Path(change).Run();
+		Print(test, outcome);
+		bool ok = Check(outcome.changed && outcome.exit_time > outcome.change_time && outcome.exit_time < steady.exit_time,
+			test, "stayed on the fast path");
+		ok = Check(outcome.exit_mode == CongestionController::DECISION_MADE, test, "left DECISION_MADE") && ok;
+		ok = Check(!outcome.rates_differ, test, "rates differ from the twin's") && ok;
+		return ok;
+	}
+
+	// Losses lower the utility enough to end the fast path earlier, and the
+	// twin sees the same losses.
+	bool TestLoss(const Outcome& steady)
+	{
+		const char* test = "loss";
+		PathChange change = { 0, 20, false, false, 500000 };
+		Outcome outcome = Path(change).Run();
+		Print(test, outcome);
+		bool ok = Check(outcome.changed && outcome.exit_time > outcome.change_time && outcome.exit_time < steady.exit_time,
+			test, "stayed on the fast path");
+		ok = Check(!outcome.rates_differ, test, "rates differ from the twin's") && ok;
+		return ok;
+	}
+
+	// Acks reported out of order make the counters inexact, so the interval
+	// is dropped and the flow goes back to the queue in DECISION_MADE.
+	bool TestReordering(const Outcome& steady)
+	{
+		const char* test = "reordering";
+		PathChange change = { 0, 0, true, false, 500000 };
+		Outcome outcome = Path(change).Run();
+		Print(test, outcome);
+		bool ok = Check(outcome.stats.quiescent_fallbacks > 0, test, "inexact interval kept");
+		ok = Check(outcome.changed && outcome.exit_time > outcome.change_time && outcome.exit_time < steady.exit_time,
+			test, "stayed on the fast path") && ok;
+		ok = Check(outcome.exit_mode == CongestionController::DECISION_MADE, test, "left DECISION_MADE") && ok;
+		return ok;
+	}
+
+	// When no ACK comes for a while, the timer completes the quiescent
+	// interval as the queue's would, so the rates still match the twin's.
+	bool TestTimer()
+	{
+		const char* test = "timer";
+		PathChange change = { 0, 0, false, true, 200000 };
+		Outcome outcome = Path(change).Run();
+		Print(test, outcome);
+		bool ok = Check(outcome.changed && outcome.quiescent_timer_rounds > 0, test, "timer completed no quiescent interval");
+		ok = Check(!outcome.rates_differ, test, "rates differ from the twin's") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	PathChange none = { 0, 0, false, false, 0 };
+	Outcome steady = Path(none).Run();
+	Print("steady", steady);
+	bool ok = true;
+	ok = TestSteady(steady) && ok;
+	ok = TestRttStep(steady) && ok;
+	ok = TestLoss(steady) && ok;
+	ok = TestReordering(steady) && ok;
+	ok = TestTimer() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
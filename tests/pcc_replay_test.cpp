@@ -0,0 +1,253 @@
+// pcc_replay_test: checks that replaying a log recorded next to a controller
+// makes the decisions that controller made, the same ones on every replay,
+// and that a log cut short or a file that is not a log is refused.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "CongestionController.h"
+#include "PccConfig.h"
+#include "ReplayLog.h"
+#include "Replayer.h"
+#include "UtilityFunctions.h"
+
+namespace
+{
+	const char* const kLogPath = "pcc_replay_test.log";
+	const QuicTime kRttUs = 20000;
+	const QuicByteCount kPacketSize = 1000;
+	const QuicTime kSendIntervalUs = 100;
+	const QuicPacketNumber kNumPackets = 20000;
+	// Packets are acked in groups of this many, and the last of each
+	// kLossPeriod groups is lost.
+	const QuicPacketNumber kAckGroup = 4;
+	const QuicPacketNumber kLossPeriod = 10;
+	// Packets sent in this range are never acked, so that timers complete
+	// their intervals.
+	const QuicPacketNumber kUnackedStart = 12000;
+	const QuicPacketNumber kUnackedEnd = 14000;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	bool SameSample(const ReplaySample& lhs, const ReplaySample& rhs)
+	{
+		return lhs.time == rhs.time
+			&& lhs.pacing_rate == rhs.pacing_rate
+			&& lhs.congestion_window == rhs.congestion_window
+			&& lhs.mode == rhs.mode
+			&& lhs.utility.sending_rate == rhs.utility.sending_rate
+			&& lhs.utility.utility == rhs.utility.utility;
+	}
+
+	class SampleRecorder : public ReplayTimelineInterface
+	{
+	public:
+		void OnSample(const ReplaySample& sample) override { samples.push_back(sample); }
+
+		std::vector<ReplaySample> samples;
+	};
+
+	// Records the outputs of |controller| after an event at |time| the way a
+	// replay reports them: after the first event, and whenever the rate, mode
+	// or utility changed.
+	void Sample(const CongestionController& controller, QuicTime time, SampleRecorder* recorder)
+	{
+		ReplaySample sample;
+		sample.time = time;
+		sample.pacing_rate = controller.PacingRate();
+		sample.mode = controller.mode();
+		sample.utility = controller.latest_utility_info();
+		if (!recorder->samples.empty())
+		{
+			const ReplaySample& last = recorder->samples.back();
+			if (sample.pacing_rate == last.pacing_rate
+				&& sample.mode == last.mode
+				&& sample.utility.sending_rate == last.utility.sending_rate
+				&& sample.utility.utility == last.utility.utility)
+				return;
+		}
+		sample.congestion_window = controller.GetCongestionWindow();
+		recorder->OnSample(sample);
+	}
+
+	// Runs a seeded controller over paced packets, some lost and some never
+	// acked, and its timers, recording its calls to |path| and its timeline
+	// to |live|.
+	bool RecordLog(const char* path, SampleRecorder* live, ReplayResult* counts)
+	{
+		ReplayLogWriter writer;
+		std::string error;
+		if (!writer.Open(path, kRttUs, 10, 100000, &error))
+		{
+			fprintf(stderr, "%s\n", error.c_str());
+			return false;
+		}
+		CongestionController controller(kRttUs, 10, 100000);
+		controller.set_random_seed(1);
+		*counts = ReplayResult();
+		const QuicPacketNumber rtt_packets = kRttUs / kSendIntervalUs;
+		for (QuicPacketNumber i = 0; i < kNumPackets; ++i)
+		{
+			QuicTime now = i * kSendIntervalUs;
+			controller.OnPacketSent(now, i, kPacketSize, true);
+			writer.OnPacketSent(now, i, kPacketSize, true);
+			++counts->packets_sent;
+			Sample(controller, now, live);
+
+			bool is_acked = i >= rtt_packets && (i - rtt_packets < kUnackedStart || i - rtt_packets >= kUnackedEnd);
+			if (is_acked && (i + 1) % kAckGroup == 0)
+			{
+				AckedPacketVector acked;
+				LostPacketVector lost;
+				for (QuicPacketNumber j = i + 1 - kAckGroup - rtt_packets; j < i + 1 - rtt_packets; ++j)
+				{
+					CongestionEvent packet = {};
+					packet.packet_number = j;
+					packet.time = static_cast<uint64_t> (now);
+					bool is_lost = j + 1 == i + 1 - rtt_packets && (j / kAckGroup) % kLossPeriod == 0;
+					if (is_lost)
+					{
+						packet.bytes_lost = static_cast<int32_t> (kPacketSize);
+						lost.push_back(packet);
+					}
+					else
+					{
+						packet.bytes_acked = static_cast<int32_t> (kPacketSize);
+						acked.push_back(packet);
+					}
+				}
+				controller.OnCongestionEvent(now, kRttUs, acked, lost);
+				writer.OnCongestionEvent(now, kRttUs, acked, lost);
+				++counts->congestion_events;
+				counts->packets_acked += acked.size();
+				counts->packets_lost += lost.size();
+				Sample(controller, now, live);
+			}
+
+			if (controller.NextTimerDeadline() <= now)
+			{
+				controller.OnTimer(now);
+				writer.OnTimer(now);
+				++counts->timers;
+				Sample(controller, now, live);
+			}
+		}
+		counts->samples = live->samples.size();
+		return writer.Close();
+	}
+
+	bool SameTimeline(const std::vector<ReplaySample>& lhs, const std::vector<ReplaySample>& rhs)
+	{
+		if (lhs.size() != rhs.size())
+			return false;
+		for (size_t i = 0; i < lhs.size(); ++i)
+			if (!SameSample(lhs[i], rhs[i]))
+				return false;
+		return true;
+	}
+
+	bool SameCounts(const ReplayResult& lhs, const ReplayResult& rhs)
+	{
+		return lhs.packets_sent == rhs.packets_sent
+			&& lhs.congestion_events == rhs.congestion_events
+			&& lhs.packets_acked == rhs.packets_acked
+			&& lhs.packets_lost == rhs.packets_lost
+			&& lhs.timers == rhs.timers
+			&& lhs.samples == rhs.samples;
+	}
+
+	bool TestMatchesLiveController()
+	{
+		const char* test = "matches live controller";
+		SampleRecorder live;
+		ReplayResult expected;
+		if (!Check(RecordLog(kLogPath, &live, &expected), test, "log not recorded"))
+			return false;
+		ReplayLog log;
+		std::string error;
+		if (!Check(log.Open(kLogPath, &error), test, error.c_str()))
+			return false;
+		bool ok = Check(log.header().initial_rtt_us == kRttUs && log.header().max_congestion_window == 100000,
+			test, "controller arguments not kept");
+
+		SampleRecorder first;
+		SampleRecorder second;
+		ReplayResult result;
+		ok = Check(ReplayLogInto<VivaceLatencyUtility>(log, PccConfig::Default(), 1, &first, &result, &error), test, error.c_str()) && ok;
+		ok = Check(SameCounts(result, expected), test, "events miscounted") && ok;
+		ok = Check(expected.packets_lost > 0 && expected.timers > 0, test, "log lacks losses or timers") && ok;
+		ok = Check(SameTimeline(first.samples, live.samples), test, "replay differs from the live controller") && ok;
+		ReplayLogInto<VivaceLatencyUtility>(log, PccConfig::Default(), 1, &second, &result, &error);
+		ok = Check(SameTimeline(first.samples, second.samples), test, "replays differ") && ok;
+		bool left_starting = false;
+		for (const ReplaySample& sample : live.samples)
+			left_starting = left_starting || sample.mode != CongestionControllerBase::STARTING;
+		ok = Check(left_starting, test, "controller never left STARTING") && ok;
+		return ok;
+	}
+
+	bool TestMalformedLogs()
+	{
+		const char* test = "malformed logs";
+		SampleRecorder live;
+		ReplayResult expected;
+		if (!Check(RecordLog(kLogPath, &live, &expected), test, "log not recorded"))
+			return false;
+
+		// A record cut in half is left out.
+		ReplayLog log;
+		std::string error;
+		bool ok = Check(log.Open(kLogPath, &error), test, error.c_str());
+		size_t num_records = log.num_records();
+		size_t last_event = 0;
+		for (size_t i = 0; i < num_records; ++i)
+			if (log.records()[i].type == REPLAY_CONGESTION_EVENT)
+				last_event = i;
+		QuicPacketCount last_event_packets = log.records()[last_event].num_acked + log.records()[last_event].num_lost;
+		off_t bytes = static_cast<off_t> (sizeof(ReplayLogHeader) + num_records * sizeof(ReplayRecord));
+		ok = Check(truncate(kLogPath, bytes - static_cast<off_t> (sizeof(ReplayRecord) / 2)) == 0, test, "log not cut") && ok;
+		ok = Check(log.Open(kLogPath, &error) && log.num_records() == num_records - 1, test, "half record kept") && ok;
+
+		// A congestion event without its last packet stops the replay there,
+		// after the events before.
+		bytes = static_cast<off_t> (sizeof(ReplayLogHeader) + (last_event + last_event_packets) * sizeof(ReplayRecord));
+		ok = Check(truncate(kLogPath, bytes) == 0, test, "log not cut") && ok;
+		ok = Check(log.Open(kLogPath, &error), test, error.c_str()) && ok;
+		ReplayResult result;
+		bool replayed = ReplayLogInto<VivaceLatencyUtility>(log, PccConfig::Default(), 1, nullptr, &result, &error);
+		ok = Check(!replayed && error == "record " + std::to_string(last_event) + ": congestion event cut short",
+			test, "cut event replayed") && ok;
+		ok = Check(result.congestion_events == expected.congestion_events - 1, test, "events before not replayed") && ok;
+
+		// Neither a file too short for a header nor one of another format
+		// is a log.
+		ok = Check(truncate(kLogPath, sizeof(ReplayLogHeader) - 1) == 0, test, "log not cut") && ok;
+		ok = Check(!log.Open(kLogPath, &error) && error.find("not an event log") != std::string::npos, test, "short file opened") && ok;
+		FILE* file = fopen(kLogPath, "wb");
+		std::vector<uint8_t> garbage(sizeof(ReplayLogHeader) + sizeof(ReplayRecord), 0xab);
+		ok = Check(file != nullptr && fwrite(garbage.data(), 1, garbage.size(), file) == garbage.size(), test, "file not written") && ok;
+		if (file != nullptr)
+			fclose(file);
+		ok = Check(!log.Open(kLogPath, &error) && error.find("not an event log") != std::string::npos, test, "other format opened") && ok;
+		ok = Check(!log.Open("/nonexistent/pcc.log", &error), test, "missing file opened") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestMatchesLiveController() && ok;
+	ok = TestMalformedLogs() && ok;
+	remove(kLogPath);
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+// pcc_rtt_stats_test: checks that RTT_STATS_HALF_SPLIT derives the latency
+// inflation of an interval exactly as the per-packet sample vector it
+// replaces did, within the runs reserved for it, and that
+// RTT_STATS_REGRESSION fits the RTT trend over send time.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "MonitorIntervalQueue.h"
+
+namespace
+{
+	const QuicTime kRttUs = 20000;
+	const QuicByteCount kPacketSize = 1000;
+	const size_t kMaxTrackedPackets = 4096;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	// The latency inflation of the samples in arrival order, as the
+	// per-packet sample vector computed it.
+	float SampleVectorLatencyInflation(const std::vector<QuicTime>& samples)
+	{
+		size_t half_samples = samples.size() / 2;
+		float rtt_first_half_sum = 0.0;
+		float rtt_second_half_sum = 0.0;
+		for (size_t i = 0; i < half_samples; ++i)
+		{
+			rtt_first_half_sum += static_cast<float> (samples[i]);
+			rtt_second_half_sum += static_cast<float> (samples[i + half_samples]);
+		}
+		return 2.0 * (rtt_second_half_sum - rtt_first_half_sum) / (rtt_first_half_sum + rtt_second_half_sum);
+	}
+
+	// Acks the 1001 packets of an interval singly and in ranges, out of
+	// order and repeated, with RTTs that wander and repeat.
+	bool TestHalfSplitMatchesSampleVector()
+	{
+		const char* test = "half split matches sample vector";
+		const QuicPacketNumber kNumPackets = 1001;
+		MonitorInterval interval;
+		interval.Reset(1e8, true, 0.1f, kRttUs, kNumPackets * 100, RTT_STATS_HALF_SPLIT, kMaxTrackedPackets);
+		for (QuicPacketNumber i = 0; i < kNumPackets; ++i)
+			interval.OnPacketSent(i * 100, i, kPacketSize);
+
+		std::mt19937 rng(1);
+		std::vector<QuicTime> samples;
+		QuicTime rtt = kRttUs;
+		QuicTime event_time = kRttUs;
+		while (samples.size() < static_cast<size_t> (kNumPackets))
+		{
+			// RTTs of 20ms and up, often the same as the last one.
+			if (rng() % 3 != 0)
+				rtt = kRttUs + static_cast<QuicTime> (rng() % 5000);
+			event_time += 100;
+			QuicPacketNumber first = static_cast<QuicPacketNumber> (rng() % kNumPackets);
+			if (rng() % 2 == 0)
+			{
+				bool was_lost;
+				if (interval.OnPacketAcked(first, rtt, event_time, &was_lost))
+					samples.push_back(rtt);
+			} else {
+				QuicPacketCount num_reversed;
+				QuicPacketNumber last = std::min<QuicPacketNumber>(first + static_cast<QuicPacketNumber> (rng() % 40), kNumPackets - 1);
+				QuicPacketCount num_acked = interval.OnPacketsAcked(first, last, rtt, event_time, &num_reversed);
+				samples.insert(samples.end(), static_cast<size_t> (num_acked), rtt);
+			}
+		}
+
+		bool ok = Check(interval.rtt_samples.num_samples() == samples.size(), test, "samples miscounted");
+		ok = Check(interval.rtt_samples.num_runs() < samples.size(), test, "equal samples not run together") && ok;
+		ok = Check(interval.LatencyInflation() == SampleVectorLatencyInflation(samples), test, "latency inflation differs") && ok;
+		return ok;
+	}
+
+	// Samples past the reserved runs join the last run rather than growing
+	// the storage, and a Reset() empties it for reuse.
+	bool TestHalfSplitStorage()
+	{
+		const char* test = "half split storage";
+		RttSampleAccumulator accumulator;
+		accumulator.Reset(true, 4);
+		std::vector<QuicTime> samples;
+		for (QuicTime i = 0; i < 4; ++i)
+		{
+			accumulator.OnSamples(2, i * 100, kRttUs + i);
+			samples.insert(samples.end(), 2, kRttUs + i);
+		}
+		float first_half_sum;
+		float second_half_sum;
+		accumulator.HalfSplitSums(&first_half_sum, &second_half_sum);
+		bool ok = Check(accumulator.num_runs() == 4, test, "runs miscounted");
+		float latency_inflation = 2.0 * (second_half_sum - first_half_sum) / (first_half_sum + second_half_sum);
+		ok = Check(latency_inflation == SampleVectorLatencyInflation(samples), test, "sums within the runs differ") && ok;
+
+		accumulator.OnSample(500, kRttUs + 100);
+		accumulator.OnSample(600, kRttUs + 200);
+		ok = Check(accumulator.num_runs() == 4, test, "runs grew past their storage") && ok;
+		ok = Check(accumulator.num_samples() == 10, test, "samples past the runs dropped") && ok;
+
+		accumulator.Reset(true, 4);
+		ok = Check(accumulator.num_runs() == 0 && accumulator.num_samples() == 0, test, "samples kept across reset") && ok;
+		accumulator.Reset(false, 4);
+		accumulator.OnSample(0, kRttUs);
+		ok = Check(accumulator.num_runs() == 0, test, "runs kept without history") && ok;
+		return ok;
+	}
+
+	// Packets sent at uneven gaps, with an RTT that grows by a quarter of
+	// the time since the first was sent. The fit over send time finds that
+	// slope where one over packet numbers would not.
+	bool TestRegressionOverSendTime()
+	{
+		const char* test = "regression over send time";
+		const QuicPacketNumber kNumPackets = 200;
+		MonitorInterval interval;
+		interval.Reset(1e8, true, 0.1f, kRttUs, 100000, RTT_STATS_REGRESSION, kMaxTrackedPackets);
+		std::vector<QuicTime> sent_times;
+		QuicTime sent_time = 0;
+		for (QuicPacketNumber i = 0; i < kNumPackets; ++i)
+		{
+			interval.OnPacketSent(sent_time, i, kPacketSize);
+			sent_times.push_back(sent_time);
+			sent_time += i < kNumPackets / 2 ? 100 : 300;
+		}
+		double mean_rtt = 0.0;
+		for (QuicPacketNumber i = 0; i < kNumPackets; ++i)
+		{
+			QuicTime rtt = kRttUs + sent_times[i] / 4;
+			mean_rtt += static_cast<double> (rtt) / kNumPackets;
+			bool was_lost;
+			interval.OnPacketAcked(i, rtt, sent_times[i] + rtt, &was_lost);
+		}
+
+		double slope = interval.rtt_samples.Slope();
+		double send_span = static_cast<double> (sent_times.back());
+		float expected_inflation = static_cast<float> (0.25 * send_span / 2.0 / mean_rtt);
+		bool ok = Check(std::fabs(slope - 0.25) < 1e-6, test, "slope not over send time");
+		ok = Check(std::fabs(interval.rtt_samples.MeanRtt() - mean_rtt) < 1e-6, test, "mean differs") && ok;
+		ok = Check(std::fabs(interval.LatencyInflation() - expected_inflation) < 1e-6, test, "latency inflation differs") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestHalfSplitMatchesSampleVector() && ok;
+	ok = TestHalfSplitStorage() && ok;
+	ok = TestRegressionOverSendTime() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+// pcc_sharded_test: checks that a ShardedFlowManager whose flows all hash to
+// the shards of one worker spreads them over its idle workers, while every
+// flow makes the decisions a standalone controller seeded with its key makes
+// and reports its rate changes to the observer, and that flows beyond a
+// shard's capacity and events beyond a ring's are rejected and counted.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CongestionController.h"
+#include "ShardedFlowManager.h"
+
+namespace
+{
+	const QuicTime kRttUs = 20000;
+	const QuicByteCount kPacketSize = 1000;
+	const QuicTime kSendIntervalUs = 100;
+	const QuicPacketNumber kPacketsPerFlow = 3000;
+	// Packets are acked in groups of this many.
+	const QuicPacketNumber kAckGroup = 4;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	// Keeps the latest outputs reported for each flow, which the workers may
+	// report at once. If |hold_until_steal| is set, the first report holds
+	// its worker, and the shard it claimed, until another worker has stolen a
+	// shard, which a worker on a single core might otherwise finish first.
+	class RateRecorder : public FlowRateObserverInterface
+	{
+	public:
+		void OnFlowRateChanged(uint64_t flow_key, QuicBandwidth pacing_rate, QuicByteCount congestion_window) override
+		{
+			if (hold_until_steal != nullptr && !held.exchange(true))
+			{
+				std::chrono::steady_clock::time_point give_up = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+				while (hold_until_steal->num_steals() == 0 && std::chrono::steady_clock::now() < give_up)
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			Outputs& outputs = flows[flow_key];
+			outputs.pacing_rate = pacing_rate;
+			outputs.congestion_window = congestion_window;
+			++outputs.num_reports;
+		}
+
+		struct Outputs
+		{
+			QuicBandwidth pacing_rate = 0;
+			QuicByteCount congestion_window = 0;
+			uint64_t num_reports = 0;
+		};
+		const ShardedFlowManager* hold_until_steal = nullptr;
+		std::atomic<bool> held{false};
+		std::mutex mutex;
+		std::map<uint64_t, Outputs> flows;
+	};
+
+	void WaitForWorkers(const ShardedFlowManager& manager)
+	{
+		while (manager.num_processed_slots() < manager.num_posted_slots())
+			std::this_thread::yield();
+	}
+
+	bool TestSkewedLoad()
+	{
+		const char* test = "skewed load";
+		const size_t kNumFlows = 8;
+		ShardedFlowManagerConfig config;
+		RateRecorder recorder;
+		config.num_workers = 4;
+		config.num_shards = 8;
+		config.ring_capacity = 1 << 15;
+		config.observer = &recorder;
+		ShardedFlowManager manager(config);
+		recorder.hold_until_steal = &manager;
+
+		// Half the keys hashed to shard 0 and half to shard 4, both of worker
+		// 0, so one has a backlog while the other is held.
+		std::vector<uint64_t> keys;
+		size_t num_keys[2] = { 0, 0 };
+		for (uint64_t key = 1; keys.size() < kNumFlows; ++key)
+		{
+			size_t shard = manager.ShardOf(key);
+			if (shard % config.num_workers == 0 && num_keys[shard / config.num_workers] < kNumFlows / 2)
+			{
+				++num_keys[shard / config.num_workers];
+				keys.push_back(key);
+			}
+		}
+		std::vector<std::unique_ptr<CongestionController>> controllers;
+		bool ok = true;
+		for (uint64_t key : keys)
+		{
+			ok = Check(manager.PostFlowAdded(key, kRttUs, 10, 100000), test, "flow refused") && ok;
+			controllers.emplace_back(new CongestionController(kRttUs, 10, 100000));
+			controllers.back()->set_random_seed(key);
+		}
+
+		// Each flow's packets are acked an RTT later, which grows with its
+		// rate. All are posted before the workers start.
+		const QuicPacketNumber rtt_packets = kRttUs / kSendIntervalUs;
+		for (QuicPacketNumber i = 0; i < kPacketsPerFlow; ++i)
+		{
+			QuicTime now = i * kSendIntervalUs;
+			for (size_t f = 0; f < kNumFlows; ++f)
+			{
+				ok = Check(manager.PostPacketSent(keys[f], now, i, kPacketSize, true), test, "packet refused") && ok;
+				controllers[f]->OnPacketSent(now, i, kPacketSize, true);
+				if (i < rtt_packets || (i + 1) % kAckGroup != 0)
+					continue;
+				AckedPacketVector acked;
+				for (QuicPacketNumber j = i + 1 - kAckGroup - rtt_packets; j < i + 1 - rtt_packets; ++j)
+				{
+					CongestionEvent packet = {};
+					packet.packet_number = j;
+					packet.bytes_acked = static_cast<int32_t> (kPacketSize);
+					packet.time = static_cast<uint64_t> (now);
+					acked.push_back(packet);
+				}
+				QuicTime rtt = kRttUs + static_cast<QuicTime> (controllers[f]->PacingRate() / 1e5);
+				ok = Check(manager.PostCongestionEvent(keys[f], now, rtt, acked, LostPacketVector()), test, "event refused") && ok;
+				controllers[f]->OnCongestionEvent(now, rtt, acked, LostPacketVector());
+			}
+		}
+		manager.Start();
+		WaitForWorkers(manager);
+		manager.Stop();
+
+		ok = Check(manager.num_steals() > 0, test, "idle workers stole no shard") && ok;
+		ok = Check(manager.num_dropped_events() == 0 && manager.num_rejected_flows() == 0, test, "events dropped") && ok;
+		bool left_starting = false;
+		for (size_t f = 0; f < kNumFlows; ++f)
+		{
+			const RateRecorder::Outputs& outputs = recorder.flows[keys[f]];
+			ok = Check(outputs.pacing_rate == controllers[f]->PacingRate(), test, "flow differs from its standalone controller") && ok;
+			ok = Check(outputs.num_reports > 1, test, "rate changes not reported") && ok;
+			left_starting = left_starting || controllers[f]->mode() != CongestionController::STARTING;
+		}
+		ok = Check(recorder.flows.size() == kNumFlows, test, "rates of unknown flows reported") && ok;
+		ok = Check(left_starting, test, "no flow left STARTING") && ok;
+		return ok;
+	}
+
+	bool TestRejectedEvents()
+	{
+		const char* test = "rejected events";
+		ShardedFlowManagerConfig config;
+		RateRecorder recorder;
+		config.num_shards = 1;
+		config.max_flows_per_shard = 1;
+		config.ring_capacity = 8;
+		config.observer = &recorder;
+		ShardedFlowManager manager(config);
+
+		// A second flow in the full shard is rejected with its events.
+		bool ok = Check(manager.PostFlowAdded(1, kRttUs, 10, 100000), test, "flow refused");
+		ok = Check(manager.PostFlowAdded(2, kRttUs, 10, 100000), test, "flow refused") && ok;
+		ok = Check(manager.PostPacketSent(2, 0, 0, kPacketSize, true), test, "packet refused") && ok;
+		manager.Start();
+		WaitForWorkers(manager);
+		ok = Check(manager.num_rejected_flows() == 1, test, "rejected flow not counted") && ok;
+		ok = Check(recorder.flows.count(1) == 1 && recorder.flows.count(2) == 0, test, "wrong flows reported") && ok;
+
+		// Once the first is removed, it fits.
+		ok = Check(manager.PostFlowRemoved(1), test, "removal refused") && ok;
+		ok = Check(manager.PostFlowAdded(2, kRttUs, 10, 100000), test, "flow refused") && ok;
+		WaitForWorkers(manager);
+		manager.Stop();
+		ok = Check(manager.num_rejected_flows() == 1 && recorder.flows.count(2) == 1, test, "flow not added after a removal") && ok;
+
+		// With the workers stopped, the ring fills up and drops the rest.
+		for (QuicPacketNumber i = 0; i < config.ring_capacity; ++i)
+			ok = Check(manager.PostPacketSent(2, 0, i, kPacketSize, true), test, "packet refused") && ok;
+		ok = Check(!manager.PostPacketSent(2, 0, config.ring_capacity, kPacketSize, true), test, "full ring took a packet") && ok;
+		ok = Check(manager.num_dropped_events() == 1, test, "dropped event not counted") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestSkewedLoad() && ok;
+	ok = TestRejectedEvents() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
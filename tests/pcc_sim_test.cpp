@@ -0,0 +1,96 @@
+// pcc_sim_test: runs a flow through steep drops of the bottleneck bandwidth,
+// with and without the controller timer, and checks that the simulation
+// finishes and that the flow settles onto the narrower link. The ctest
+// timeout catches a simulation that never finishes.
+
+#include <algorithm>
+#include <cstdio>
+
+#include "Simulator.h"
+
+namespace
+{
+	const double kBandwidthBps = 100e6;
+	// Time after the step, in sample intervals, over which the flow is
+	// checked.
+	const size_t kNumSettledSamples = 20;
+	// Largest pacing rate, relative to the narrower link, a settled flow may
+	// average.
+	const double kMaxSettledRateRatio = 1.5;
+	// Smallest utilization of the narrower link.
+	const double kMinUtilization = 0.5;
+
+	struct Scenario
+	{
+		const char* name;
+		QuicTime step_time_us;
+		double step_bandwidth_bps;
+		QuicTime duration_us;
+	};
+
+	const Scenario kScenarios[] = {
+		{ "100 to 30 Mbps at 20 s", 20000000, 30e6, 30000000 },
+		{ "100 to 30 Mbps at 5 s", 5000000, 30e6, 15000000 },
+		// The full buffer holds 600 ms of the narrower link, so the intervals
+		// that see the drop take long to complete and the flow takes about
+		// 40 s to come down.
+		{ "100 to 5 Mbps at 5 s", 5000000, 5e6, 75000000 },
+	};
+
+	bool RunScenario(const Scenario& scenario, bool use_controller_timer)
+	{
+		SimulationConfig config;
+		config.link.bandwidth_bps = kBandwidthBps;
+		BandwidthStep step;
+		step.time_us = scenario.step_time_us;
+		step.bandwidth_bps = scenario.step_bandwidth_bps;
+		config.link.bandwidth_steps.push_back(step);
+		config.duration_us = scenario.duration_us;
+		FlowConfig flow;
+		flow.use_controller_timer = use_controller_timer;
+		config.flows.push_back(flow);
+
+		Simulator simulator(config);
+		SimulationResult result = simulator.Run();
+
+		const FlowResult& flow_result = result.flows[0];
+		const std::vector<double>& rates = flow_result.pacing_rate_samples_bps;
+		size_t num_samples = std::min(kNumSettledSamples, rates.size());
+		double mean_rate = 0.0;
+		for (size_t i = rates.size() - num_samples; i < rates.size(); ++i)
+			mean_rate += rates[i] / num_samples;
+		const EpochResult& epoch = result.epochs.back();
+		printf("%s%s: %llu events, settled rate %.1f Mbps, utilization %.3f\n",
+			scenario.name, use_controller_timer ? " with timer" : "",
+			static_cast<unsigned long long> (result.num_events), mean_rate / 1e6, epoch.link_utilization);
+
+		bool ok = true;
+		if (epoch.start_time_us != scenario.step_time_us)
+		{
+			fprintf(stderr, "FAIL %s: no epoch starts at the step\n", scenario.name);
+			ok = false;
+		}
+		if (mean_rate > kMaxSettledRateRatio * scenario.step_bandwidth_bps)
+		{
+			fprintf(stderr, "FAIL %s: the flow kept sending faster than the link\n", scenario.name);
+			ok = false;
+		}
+		if (epoch.link_utilization < kMinUtilization)
+		{
+			fprintf(stderr, "FAIL %s: the flow left the link idle\n", scenario.name);
+			ok = false;
+		}
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	for (const Scenario& scenario : kScenarios)
+	{
+		ok = RunScenario(scenario, false) && ok;
+		ok = RunScenario(scenario, true) && ok;
+	}
+	return ok ? 0 : 1;
+}
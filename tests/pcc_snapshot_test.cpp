@@ -0,0 +1,294 @@
+// pcc_snapshot_test: checks that monitor intervals and controllers come back
+// from their snapshots as they were saved, and that truncated, corrupted or
+// inconsistent snapshots are rejected without being allocated for.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "CongestionController.h"
+#include "MonitorIntervalQueue.h"
+#include "PccConfig.h"
+#include "Snapshot.h"
+
+namespace
+{
+	const QuicTime kRttUs = 20000;
+	const QuicByteCount kPacketSize = 1400;
+	const size_t kMaxTrackedPackets = 4096;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	// Overwrites the 8 bytes at |offset| of |snapshot| with |value|, in the
+	// byte order of SnapshotWriter.
+	void PatchUint64(std::vector<uint8_t>* snapshot, size_t offset, uint64_t value)
+	{
+		std::vector<uint8_t> bytes;
+		SnapshotWriter writer(&bytes);
+		writer.WriteUint64(value);
+		memcpy(snapshot->data() + offset, bytes.data(), bytes.size());
+	}
+
+	// An interval of 300 packets with a gap in its packet numbers, acked out
+	// of order, with a loss reversed by a late ack and a repeated ack.
+	void FillInterval(MonitorInterval* interval)
+	{
+		interval->Reset(1e8, true, 0.1f, kRttUs, 10 * kRttUs, RTT_STATS_HALF_SPLIT, kMaxTrackedPackets);
+		for (QuicPacketNumber i = 0; i < 300; ++i)
+		{
+			QuicPacketNumber packet_number = i < 100 ? i : i + 50;
+			interval->OnPacketSent(i * 100, packet_number, kPacketSize);
+		}
+		QuicPacketCount num_reversed;
+		bool was_lost;
+		interval->OnPacketsLost(150, 159);
+		interval->OnPacketsAcked(0, 99, kRttUs, 2 * kRttUs, &num_reversed);
+		interval->OnPacketAcked(200, kRttUs + 500, 2 * kRttUs + 9000, &was_lost);
+		interval->OnPacketAcked(160, kRttUs + 700, 2 * kRttUs + 9500, &was_lost);
+		interval->OnPacketAcked(200, kRttUs + 500, 2 * kRttUs + 9500, &was_lost);
+	}
+
+	bool TestIntervalRoundTrip()
+	{
+		const char* test = "interval round trip";
+		MonitorInterval interval;
+		FillInterval(&interval);
+		std::vector<uint8_t> snapshot;
+		SnapshotWriter writer(&snapshot);
+		interval.SaveSnapshot(&writer);
+
+		MonitorInterval restored;
+		SnapshotReader reader(snapshot.data(), snapshot.size());
+		if (!Check(restored.RestoreSnapshot(&reader, kMaxTrackedPackets) && reader.remaining() == 0, test, "not restored"))
+			return false;
+		std::vector<uint8_t> resaved;
+		SnapshotWriter rewriter(&resaved);
+		restored.SaveSnapshot(&rewriter);
+
+		bool ok = Check(resaved == snapshot, test, "saved differently once restored");
+		ok = Check(restored.packets_acked == interval.packets_acked && restored.packets_lost == interval.packets_lost
+			&& restored.packets_outstanding() == 188, test, "packet counts differ") && ok;
+		ok = Check(restored.LatencyInflation() == interval.LatencyInflation(), test, "latency inflation differs") && ok;
+		// The restored packet states still tell repeated acks apart.
+		bool was_lost;
+		ok = Check(!restored.OnPacketAcked(160, kRttUs, 3 * kRttUs, &was_lost), test, "repeated ack counted") && ok;
+		ok = Check(restored.OnPacketAcked(155, kRttUs, 3 * kRttUs, &was_lost) && was_lost, test, "lost packet not reversed") && ok;
+		return ok;
+	}
+
+	bool TestIntervalMalformed()
+	{
+		const char* test = "interval malformed";
+		MonitorInterval interval;
+		FillInterval(&interval);
+		std::vector<uint8_t> snapshot;
+		SnapshotWriter writer(&snapshot);
+		interval.SaveSnapshot(&writer);
+
+		bool ok = true;
+		for (size_t size = 0; size < snapshot.size(); ++size)
+		{
+			MonitorInterval restored;
+			SnapshotReader reader(snapshot.data(), size);
+			if (restored.RestoreSnapshot(&reader, kMaxTrackedPackets))
+			{
+				ok = Check(false, test, "truncated snapshot restored");
+				break;
+			}
+		}
+
+		// The state word count precedes the words, 24 bytes each.
+		size_t num_words_offset = snapshot.size() - interval.packet_states.size() * 3 * sizeof(uint64_t) - sizeof(uint64_t);
+		for (uint64_t num_words : { uint64_t(1) << 60, uint64_t(1), uint64_t(interval.packet_states.size() + 1) })
+		{
+			std::vector<uint8_t> corrupted = snapshot;
+			PatchUint64(&corrupted, num_words_offset, num_words);
+			MonitorInterval restored;
+			SnapshotReader reader(corrupted.data(), corrupted.size());
+			ok = Check(!restored.RestoreSnapshot(&reader, kMaxTrackedPackets), test, "bad state word count restored") && ok;
+		}
+
+		// More packets than the restoring queue tracks.
+		MonitorInterval restored;
+		SnapshotReader reader(snapshot.data(), snapshot.size());
+		ok = Check(!restored.RestoreSnapshot(&reader, 64), test, "untracked packet states restored") && ok;
+		return ok;
+	}
+
+	// Writes the snapshot of an RttSampleAccumulator that keeps its history,
+	// of |num_samples| samples in |num_runs| runs of |run_counts| samples.
+	std::vector<uint8_t> WriteRttSamples(uint64_t num_samples, uint64_t num_runs, const std::vector<int32_t>& run_counts)
+	{
+		std::vector<uint8_t> snapshot;
+		SnapshotWriter writer(&snapshot);
+		writer.WriteUint64(num_samples);
+		writer.WriteInt64(kRttUs);
+		writer.WriteInt64(0);
+		for (int i = 0; i < 5; ++i)
+			writer.WriteDouble(0.0);
+		writer.WriteBool(true);
+		writer.WriteUint64(num_runs);
+		for (int32_t count : run_counts)
+		{
+			writer.WriteInt32(0);
+			writer.WriteInt32(count);
+		}
+		return snapshot;
+	}
+
+	bool RestoresRttSamples(const std::vector<uint8_t>& snapshot)
+	{
+		RttSampleAccumulator samples;
+		SnapshotReader reader(snapshot.data(), snapshot.size());
+		// Storage for 4 runs.
+		return samples.RestoreSnapshot(&reader, 4);
+	}
+
+	bool TestRttSamplesMalformed()
+	{
+		const char* test = "rtt samples malformed";
+		bool ok = Check(RestoresRttSamples(WriteRttSamples(5, 2, { 2, 3 })), test, "valid runs rejected");
+		ok = Check(!RestoresRttSamples(WriteRttSamples(uint64_t(1) << 40, uint64_t(1) << 40, { 2, 3 })), test,
+			"more runs than the snapshot holds restored") && ok;
+		ok = Check(!RestoresRttSamples(WriteRttSamples(5, 3, { 2, 3 })), test, "truncated runs restored") && ok;
+		ok = Check(!RestoresRttSamples(WriteRttSamples(5, 5, { 1, 1, 1, 1, 1 })), test, "runs past their storage restored") && ok;
+		ok = Check(!RestoresRttSamples(WriteRttSamples(5, 3, { 2, 0, 3 })), test, "empty run restored") && ok;
+		ok = Check(!RestoresRttSamples(WriteRttSamples(5, 2, { 2, -1 })), test, "negative run restored") && ok;
+		ok = Check(!RestoresRttSamples(WriteRttSamples(5, 2, { 2, 2 })), test, "runs short of the samples restored") && ok;
+		ok = Check(!RestoresRttSamples(WriteRttSamples(5, 2, { 2, 4 })), test, "runs past the samples restored") && ok;
+		return ok;
+	}
+
+	// Paces packets at a controller's rate over a path of a fixed RTT, with
+	// every 50th packet lost, and acks them 8 at a time.
+	class Flow
+	{
+	public:
+		explicit Flow(CongestionController* controller) :
+			controller_(controller)
+		{
+		}
+
+		// Runs until |end_time|.
+		void Run(QuicTime end_time)
+		{
+			while (now_ < end_time)
+			{
+				while (in_flight_.size() < 8 || next_send_time_ <= in_flight_[7] + kRttUs)
+				{
+					QuicTime sent_time = next_send_time_;
+					controller_->OnPacketSent(sent_time, next_packet_number_++, kPacketSize, true);
+					in_flight_.push_back(sent_time);
+					next_send_time_ += static_cast<QuicTime> (kPacketSize * 8 * 1e6 / std::max(controller_->PacingRate(), 1.0));
+				}
+				AckedPacketVector acked;
+				LostPacketVector lost;
+				for (int i = 0; i < 8; ++i)
+				{
+					CongestionEvent event;
+					event.packet_number = next_packet_number_ - static_cast<QuicPacketNumber> (in_flight_.size());
+					bool is_lost = event.packet_number % 50 == 0;
+					event.bytes_acked = is_lost ? 0 : static_cast<int32_t> (kPacketSize);
+					event.bytes_lost = is_lost ? static_cast<int32_t> (kPacketSize) : 0;
+					now_ = in_flight_.front() + kRttUs;
+					event.time = static_cast<uint64_t> (now_);
+					(is_lost ? lost : acked).push_back(event);
+					in_flight_.pop_front();
+				}
+				controller_->OnCongestionEvent(now_, kRttUs, acked, lost);
+			}
+		}
+
+		void set_controller(CongestionController* controller) { controller_ = controller; }
+
+	private:
+		CongestionController* controller_;
+		QuicTime now_ = 0;
+		QuicTime next_send_time_ = 0;
+		QuicPacketNumber next_packet_number_ = 0;
+		// Sent times of the packets not yet acked or lost, oldest first.
+		std::deque<QuicTime> in_flight_;
+	};
+
+	bool TestControllerRoundTrip()
+	{
+		const char* test = "controller round trip";
+		PccConfig config;
+		config.rtt_stats_mode = RTT_STATS_HALF_SPLIT;
+		std::shared_ptr<const PccConfig> pcc_config = PccConfig::Create(config, nullptr);
+		CongestionController controller(kRttUs, 10, 100000, pcc_config);
+		Flow flow(&controller);
+		flow.Run(2000000);
+		std::vector<uint8_t> snapshot;
+		controller.SaveSnapshot(&snapshot);
+
+		CongestionController restored(kRttUs, 10, 100000, pcc_config);
+		std::string error;
+		if (!Check(restored.RestoreSnapshot(snapshot.data(), snapshot.size(), &error), test, error.c_str()))
+			return false;
+		std::vector<uint8_t> resaved;
+		restored.SaveSnapshot(&resaved);
+		bool ok = Check(resaved == snapshot, test, "saved differently once restored");
+		ok = Check(restored.PacingRate() == controller.PacingRate() && restored.mode() == controller.mode(), test,
+			"rate or mode differs") && ok;
+
+		// Both go on alike.
+		Flow copy = flow;
+		flow.Run(4000000);
+		copy.set_controller(&restored);
+		copy.Run(4000000);
+		ok = Check(restored.PacingRate() == controller.PacingRate(), test, "rate differs later on") && ok;
+		return ok;
+	}
+
+	bool TestControllerMalformed()
+	{
+		const char* test = "controller malformed";
+		std::shared_ptr<const PccConfig> pcc_config = PccConfig::Default();
+		CongestionController controller(kRttUs, 10, 100000, pcc_config);
+		Flow flow(&controller);
+		flow.Run(2000000);
+		std::vector<uint8_t> snapshot;
+		controller.SaveSnapshot(&snapshot);
+
+		bool ok = true;
+		CongestionController restored(kRttUs, 10, 100000, pcc_config);
+		QuicBandwidth rate = restored.PacingRate();
+		for (size_t size = 0; size < snapshot.size(); ++size)
+		{
+			if (restored.RestoreSnapshot(snapshot.data(), size, nullptr))
+			{
+				ok = Check(false, test, "truncated snapshot restored");
+				break;
+			}
+		}
+
+		std::vector<uint8_t> corrupted = snapshot;
+		corrupted.back() ^= 1;
+		std::string error;
+		ok = Check(!restored.RestoreSnapshot(corrupted.data(), corrupted.size(), &error)
+			&& error == "snapshot checksum mismatch", test, "bad checksum not detected") && ok;
+		ok = Check(restored.PacingRate() == rate, test, "controller changed by a rejected snapshot") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestIntervalRoundTrip() && ok;
+	ok = TestIntervalMalformed() && ok;
+	ok = TestRttSamplesMalformed() && ok;
+	ok = TestControllerRoundTrip() && ok;
+	ok = TestControllerMalformed() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
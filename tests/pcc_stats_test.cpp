@@ -0,0 +1,257 @@
+// pcc_stats_test: checks that a controller counts its time, rounds and
+// decisions in each mode, that stats add up over controllers and over the
+// removed flows of a FlowTable, that a published copy is read back whole
+// while another thread publishes, and that the Prometheus export lists
+// every series of every metric.
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CongestionController.h"
+#include "ControllerStats.h"
+#include "FlowTable.h"
+
+namespace
+{
+	const char* const kStatsPath = "pcc_stats_test.prom";
+	const QuicTime kRttUs = 20000;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	bool Contains(const std::string& text, const std::string& line)
+	{
+		return text.find(line) != std::string::npos;
+	}
+
+	// An event that only moves the controller's clock.
+	void Tick(CongestionController* controller, QuicTime now)
+	{
+		controller->OnCongestionEvent(now, kRttUs, AckedPacketVector(), LostPacketVector());
+	}
+
+	bool TestControllerCounters()
+	{
+		const char* test = "controller counters";
+		CongestionController controller(kRttUs, 10, 100000);
+		QuicBandwidth rate = controller.PacingRate();
+		// 2 ms of STARTING with two rounds doubling the rate, and a third
+		// moving to PROBING.
+		Tick(&controller, 1000);
+		controller.OnUtilityAvailable(std::vector<UtilityInfo>{ UtilityInfo(rate, 10.0f) });
+		controller.OnUtilityAvailable(std::vector<UtilityInfo>{ UtilityInfo(2 * rate, 20.0f) });
+		Tick(&controller, 3000);
+		controller.OnUtilityAvailable(std::vector<UtilityInfo>{ UtilityInfo(4 * rate, 5.0f) });
+		// Time until an event counts for the mode the controller is in then:
+		// 4 ms of PROBING, then a round whose groups disagree, one whose
+		// groups both favour the higher rate, and 1 ms of DECISION_MADE.
+		Tick(&controller, 7000);
+		rate = controller.PacingRate();
+		controller.OnUtilityAvailable(std::vector<UtilityInfo>{ UtilityInfo(1.05 * rate, 10.0f),
+			UtilityInfo(0.95 * rate, 5.0f), UtilityInfo(1.05 * rate, 5.0f), UtilityInfo(0.95 * rate, 10.0f) });
+		controller.OnUtilityAvailable(std::vector<UtilityInfo>{ UtilityInfo(1.05 * rate, 10.0f),
+			UtilityInfo(0.95 * rate, 5.0f), UtilityInfo(0.95 * rate, 5.0f), UtilityInfo(1.05 * rate, 10.0f) });
+		Tick(&controller, 8000);
+
+		ControllerStats stats = controller.stats();
+		bool ok = Check(controller.mode() == CongestionController::DECISION_MADE, test, "no decision made");
+		ok = Check(stats.mode_time_us[CongestionController::STARTING] == 2000
+			&& stats.mode_time_us[CongestionController::PROBING] == 4000
+			&& stats.mode_time_us[CongestionController::DECISION_MADE] == 1000,
+			test, "wrong time in modes") && ok;
+		ok = Check(stats.mode_rounds[CongestionController::STARTING] == 3
+			&& stats.mode_rounds[CongestionController::PROBING] == 2
+			&& stats.mode_rounds[CongestionController::DECISION_MADE] == 0,
+			test, "wrong rounds in modes") && ok;
+		ok = Check(stats.probing_decisions == 1 && stats.inconclusive_probing_rounds == 1, test, "probing rounds miscounted") && ok;
+		ok = Check(stats.rtt_inflation_exits == 0 && stats.quiescent_intervals == 0, test, "counted what did not happen") && ok;
+		ok = Check(stats.num_flows == 1 && stats.flows_in_mode[CongestionController::DECISION_MADE] == 1
+			&& stats.flows_in_mode[CongestionController::STARTING] + stats.flows_in_mode[CongestionController::PROBING] == 0,
+			test, "wrong flows in modes") && ok;
+		ok = Check(stats.max_rounds_in_mode[CongestionController::DECISION_MADE] == 0, test, "rounds in a mode just entered") && ok;
+		ok = Check(stats.sending_rate == controller.PacingRate(), test, "wrong sending rate") && ok;
+
+		// Time going backwards is not counted.
+		Tick(&controller, 6000);
+		ok = Check(controller.stats().mode_time_us[CongestionController::DECISION_MADE] == 1000, test, "time went backwards") && ok;
+		return ok;
+	}
+
+	ControllerStats MakeStats(uint64_t counter, uint64_t max_rounds, double rate)
+	{
+		ControllerStats stats;
+		stats.mode_time_us[CongestionController::PROBING] = counter;
+		stats.mode_rounds[CongestionController::STARTING] = counter;
+		stats.intervals_created = counter;
+		stats.quiescent_fallbacks = counter;
+		stats.num_flows = 1;
+		stats.flows_in_mode[CongestionController::PROBING] = 1;
+		stats.max_rounds_in_mode[CongestionController::PROBING] = max_rounds;
+		stats.quiescent_flows = 1;
+		stats.sending_rate = rate;
+		stats.utility_gradient = rate / 1e6;
+		return stats;
+	}
+
+	bool TestAdd()
+	{
+		const char* test = "add";
+		ControllerStats total = MakeStats(3, 7, 1e6);
+		total.Add(MakeStats(4, 5, 2e6));
+		bool ok = Check(total.mode_time_us[CongestionController::PROBING] == 7 && total.mode_rounds[CongestionController::STARTING] == 7
+			&& total.intervals_created == 7 && total.quiescent_fallbacks == 7, test, "counters not summed");
+		ok = Check(total.num_flows == 2 && total.flows_in_mode[CongestionController::PROBING] == 2 && total.quiescent_flows == 2,
+			test, "flows not summed") && ok;
+		ok = Check(total.max_rounds_in_mode[CongestionController::PROBING] == 7, test, "rounds in mode not the maximum") && ok;
+		ok = Check(total.sending_rate == 3e6 && total.utility_gradient == 3.0, test, "gauges not summed") && ok;
+
+		ControllerStats counters = MakeStats(3, 7, 1e6);
+		counters.AddCounters(MakeStats(4, 9, 2e6));
+		ok = Check(counters.intervals_created == 7 && counters.quiescent_fallbacks == 7, test, "counters not summed") && ok;
+		ok = Check(counters.num_flows == 1 && counters.max_rounds_in_mode[CongestionController::PROBING] == 7
+			&& counters.sending_rate == 1e6, test, "gauges of a removed flow added") && ok;
+		return ok;
+	}
+
+	bool TestFlowTable()
+	{
+		const char* test = "flow table";
+		FlowTable table(2);
+		FlowId removed;
+		FlowId kept;
+		bool ok = Check(table.AddFlow(kRttUs, 10, 100000, &removed) && table.AddFlow(kRttUs, 10, 100000, &kept), test, "flow refused");
+		AckedPacketVector acked;
+		LostPacketVector lost;
+		FlowCongestionEvent events[4];
+		const FlowId kFlows[] = { removed, kept, removed, kept };
+		const QuicTime kTimes[] = { 1000, 2000, 5000, 3000 };
+		for (size_t i = 0; i < 4; ++i)
+		{
+			events[i].flow = kFlows[i];
+			events[i].event_time = kTimes[i];
+			events[i].rtt = kRttUs;
+			events[i].acked_packets = &acked;
+			events[i].lost_packets = &lost;
+		}
+		table.OnCongestionEvent(events, 4);
+		ok = Check(table.Stats().num_flows == 2 && table.Stats().mode_time_us[CongestionController::STARTING] == 5000,
+			test, "flows not added up") && ok;
+
+		// The counters of a removed flow stay in the totals.
+		table.RemoveFlow(removed);
+		ControllerStats stats = table.Stats();
+		ok = Check(stats.num_flows == 1 && stats.flows_in_mode[CongestionController::STARTING] == 1, test, "removed flow still counted") && ok;
+		ok = Check(stats.mode_time_us[CongestionController::STARTING] == 5000, test, "counters of the removed flow lost") && ok;
+		ok = Check(stats.sending_rate == table.PacingRate(kept), test, "gauges of the removed flow kept") && ok;
+		return ok;
+	}
+
+	// A stats record whose every word is |value|, so that a torn read shows.
+	ControllerStats Uniform(uint64_t value)
+	{
+		ControllerStats stats;
+		uint64_t words[sizeof(ControllerStats) / sizeof(uint64_t)];
+		for (uint64_t& word : words)
+			word = value;
+		memcpy(&stats, words, sizeof(stats));
+		return stats;
+	}
+
+	bool IsUniform(const ControllerStats& stats)
+	{
+		uint64_t words[sizeof(ControllerStats) / sizeof(uint64_t)];
+		memcpy(words, &stats, sizeof(words));
+		for (uint64_t word : words)
+			if (word != words[0])
+				return false;
+		return true;
+	}
+
+	bool TestPublisher()
+	{
+		const char* test = "publisher";
+		ControllerStatsPublisher publisher;
+		bool ok = Check(IsUniform(publisher.Read()) && publisher.Read().num_flows == 0, test, "not empty before a publish");
+		ControllerStats stats = MakeStats(3, 7, 1e6);
+		publisher.Publish(stats);
+		ControllerStats copy = publisher.Read();
+		ok = Check(memcmp(&copy, &stats, sizeof(stats)) == 0, test, "published stats not read back") && ok;
+
+		// Whichever publishes a reader sees, it sees one of them whole.
+		const uint64_t kNumPublishes = 200000;
+		std::atomic<bool> done{false};
+		std::atomic<bool> torn{false};
+		std::thread reader([&]()
+		{
+			while (!done.load())
+				if (!IsUniform(publisher.Read()))
+					torn = true;
+		});
+		for (uint64_t i = 1; i <= kNumPublishes; ++i)
+			publisher.Publish(Uniform(i));
+		done = true;
+		reader.join();
+		ok = Check(!torn, test, "read a publish in progress") && ok;
+		copy = publisher.Read();
+		ok = Check(IsUniform(copy) && copy.num_flows == kNumPublishes, test, "last publish not read") && ok;
+		return ok;
+	}
+
+	bool TestPrometheus()
+	{
+		const char* test = "prometheus";
+		std::vector<std::pair<std::string, ControllerStats> > series;
+		series.emplace_back("flow=\"1\"", MakeStats(2500000, 7, 1.5e6));
+		series.emplace_back("", MakeStats(4, 5, 2e6));
+		std::string text;
+		AppendPrometheusStats(series, &text);
+
+		bool ok = Check(Contains(text, "# HELP pcc_mode_seconds_total ") && Contains(text, "# TYPE pcc_mode_seconds_total counter\n"),
+			test, "counter without its header");
+		ok = Check(Contains(text, "# TYPE pcc_flows gauge\n"), test, "gauge without its header") && ok;
+		ok = Check(Contains(text, "pcc_mode_seconds_total{flow=\"1\",mode=\"probing\"} 2.5\n"), test, "labelled mode sample missing") && ok;
+		ok = Check(Contains(text, "pcc_mode_rounds_total{mode=\"starting\"} 4\n"), test, "mode sample of an unlabelled series missing") && ok;
+		ok = Check(Contains(text, "pcc_intervals_created_total{flow=\"1\"} 2500000\n"), test, "labelled sample missing") && ok;
+		ok = Check(Contains(text, "pcc_sending_rate_bits_per_second 2000000\n"), test, "unlabelled sample missing") && ok;
+		ok = Check(Contains(text, "pcc_max_rounds_in_mode{flow=\"1\",mode=\"probing\"} 7\npcc_max_rounds_in_mode{flow=\"1\",mode=\"decision_made\"} 0\n"
+			"pcc_max_rounds_in_mode{mode=\"starting\"} 0\n"), test, "series out of order") && ok;
+
+		std::string error;
+		ok = Check(WritePrometheusStats(kStatsPath, series, &error), test, error.c_str()) && ok;
+		std::string written;
+		FILE* file = fopen(kStatsPath, "rb");
+		if (file != nullptr)
+		{
+			char buffer[4096];
+			size_t bytes;
+			while ((bytes = fread(buffer, 1, sizeof(buffer), file)) > 0)
+				written.append(buffer, bytes);
+			fclose(file);
+		}
+		ok = Check(written == text, test, "file differs from the text") && ok;
+		ok = Check(!WritePrometheusStats("/nonexistent/pcc.prom", series, &error)
+			&& Contains(error, "/nonexistent/pcc.prom"), test, "written where no file can be made") && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestControllerCounters() && ok;
+	ok = TestAdd() && ok;
+	ok = TestFlowTable() && ok;
+	ok = TestPublisher() && ok;
+	ok = TestPrometheus() && ok;
+	remove(kStatsPath);
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+// pcc_trace_test: checks that a trace records a controller's decisions with
+// their values, that the trace file wraps around to keep the latest chunks,
+// and that a trace cannot be started twice or where no file can be made.
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "CongestionController.h"
+#include "Trace.h"
+
+namespace
+{
+	const char* const kTracePath = "pcc_trace_test.trace";
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	// The header of the trace file at |path|, and its records in the order
+	// their chunks were written. Returns false if it cannot be read.
+	bool ReadTrace(const char* path, TraceFileHeader* header, std::vector<TraceRecord>* records)
+	{
+		FILE* file = fopen(path, "rb");
+		if (file == nullptr)
+			return false;
+		bool ok = fread(header, sizeof(*header), 1, file) == 1 && header->magic == TraceFileHeader::kMagic;
+		std::vector<std::pair<uint64_t, std::vector<TraceRecord>>> chunks;
+		for (uint64_t i = 0; ok && i < header->num_chunks; ++i)
+		{
+			TraceChunkHeader chunk;
+			std::vector<TraceRecord> chunk_records(header->records_per_chunk);
+			ok = fread(&chunk, sizeof(chunk), 1, file) == 1
+				&& fread(chunk_records.data(), sizeof(TraceRecord), chunk_records.size(), file) == chunk_records.size();
+			if (ok && chunk.sequence != 0)
+			{
+				chunk_records.resize(chunk.num_records);
+				chunks.emplace_back(chunk.sequence, chunk_records);
+			}
+		}
+		fclose(file);
+		std::sort(chunks.begin(), chunks.end(), [](const std::pair<uint64_t, std::vector<TraceRecord>>& lhs,
+			const std::pair<uint64_t, std::vector<TraceRecord>>& rhs) { return lhs.first < rhs.first; });
+		records->clear();
+		for (const auto& chunk : chunks)
+			records->insert(records->end(), chunk.second.begin(), chunk.second.end());
+		return ok;
+	}
+
+	const TraceRecord* Find(const std::vector<TraceRecord>& records, TraceRecordType type)
+	{
+		for (const TraceRecord& record : records)
+			if (record.type == type)
+				return &record;
+		return nullptr;
+	}
+
+	bool TestControllerDecisions()
+	{
+		const char* test = "controller decisions";
+		std::string error;
+		if (!Check(Trace::Start(kTracePath, 1 << 20, &error), test, error.c_str()))
+			return false;
+		CongestionController controller(20000, 10, 100000);
+		QuicBandwidth initial_rate = controller.PacingRate();
+		controller.OnPacketSent(0, 0, 1000, true);
+		// STARTING doubles the rate on a higher utility, and moves to PROBING
+		// on a lower one.
+		controller.OnUtilityAvailable(std::vector<UtilityInfo>{ UtilityInfo(initial_rate, 10.0f) });
+		controller.OnUtilityAvailable(std::vector<UtilityInfo>{ UtilityInfo(2 * initial_rate, 5.0f) });
+		Trace::Flush();
+		Trace::Stop();
+		bool ok = Check(!Trace::enabled(), test, "enabled after Stop");
+
+		TraceFileHeader header;
+		std::vector<TraceRecord> records;
+		ok = Check(ReadTrace(kTracePath, &header, &records), test, "trace not readable") && ok;
+		ok = Check(header.record_size == sizeof(TraceRecord) && header.records_per_chunk == Trace::kRecordsPerChunk,
+			test, "wrong header") && ok;
+		ok = Check(header.ticks_per_second > 0, test, "timestamps not calibrated") && ok;
+		bool one_controller = !records.empty();
+		for (const TraceRecord& record : records)
+			one_controller = one_controller && record.controller == records[0].controller;
+		ok = Check(one_controller, test, "records of other controllers") && ok;
+
+		const TraceRecord* created = Find(records, TRACE_INTERVAL_CREATED);
+		ok = Check(created != nullptr && created->values[0] == initial_rate, test, "interval creation not traced") && ok;
+		const TraceRecord* rate_change = Find(records, TRACE_RATE_CHANGE);
+		ok = Check(rate_change != nullptr
+			&& rate_change->values[0] == initial_rate
+			&& rate_change->values[1] == 2 * initial_rate
+			&& rate_change->values[2] == TRACE_RATE_STARTING,
+			test, "doubling not traced") && ok;
+		const TraceRecord* mode_change = Find(records, TRACE_MODE_CHANGE);
+		ok = Check(mode_change != nullptr
+			&& mode_change->values[0] == CongestionController::STARTING
+			&& mode_change->values[1] == CongestionController::PROBING,
+			test, "move to PROBING not traced") && ok;
+		ok = Check(std::string(TraceFieldName(TRACE_RATE_CHANGE, 1)) == "new_rate", test, "wrong field name") && ok;
+		return ok;
+	}
+
+	bool TestWrap()
+	{
+		const char* test = "wrap";
+		const size_t kFileChunks = 2;
+		const size_t kChunkBytes = sizeof(TraceChunkHeader) + Trace::kRecordsPerChunk * sizeof(TraceRecord);
+		const size_t kNumRecords = 5 * Trace::kRecordsPerChunk;
+		std::string error;
+		if (!Check(Trace::Start(kTracePath, sizeof(TraceFileHeader) + kFileChunks * kChunkBytes, &error), test, error.c_str()))
+			return false;
+		uint32_t id = Trace::NewId();
+		for (size_t i = 0; i < kNumRecords; ++i)
+			Trace::Record(TRACE_UTILITY, id, static_cast<double> (i));
+		Trace::Flush();
+		Trace::Stop();
+
+		// The last 2 of the 5 chunks written, in order.
+		TraceFileHeader header;
+		std::vector<TraceRecord> records;
+		bool ok = Check(ReadTrace(kTracePath, &header, &records), test, "trace not readable");
+		ok = Check(header.num_chunks == kFileChunks, test, "wrong number of chunks") && ok;
+		ok = Check(records.size() == kFileChunks * Trace::kRecordsPerChunk, test, "wrong number of records") && ok;
+		bool latest = !records.empty();
+		for (size_t i = 0; i < records.size(); ++i)
+			latest = latest && records[i].values[0] == static_cast<double> (kNumRecords - records.size() + i);
+		ok = Check(latest, test, "file does not hold the latest records") && ok;
+		return ok;
+	}
+
+	bool TestStartErrors()
+	{
+		const char* test = "start errors";
+		std::string error;
+		bool ok = Check(!Trace::Start("/nonexistent/pcc.trace", 1 << 20, &error), test, "trace started without a file");
+		ok = Check(error.find("/nonexistent/pcc.trace") != std::string::npos, test, "reason does not name the path") && ok;
+		ok = Check(!Trace::enabled(), test, "failed trace enabled") && ok;
+
+		ok = Check(Trace::Start(kTracePath, 1 << 20, nullptr), test, "trace not started") && ok;
+		error.clear();
+		ok = Check(!Trace::Start(kTracePath, 1 << 20, &error), test, "second trace started") && ok;
+		ok = Check(!error.empty() && Trace::enabled(), test, "first trace disturbed") && ok;
+		Trace::Stop();
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestControllerDecisions() && ok;
+	ok = TestWrap() && ok;
+	ok = TestStartErrors() && ok;
+	remove(kTracePath);
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
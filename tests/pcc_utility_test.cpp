@@ -0,0 +1,161 @@
+// pcc_utility_test: checks that a queue computes the utilities of its
+// intervals with the utility function it is instantiated for, and that each
+// utility function responds to the losses and RTTs it is meant to.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "CongestionController.h"
+#include "MonitorIntervalQueue.h"
+#include "PccConfig.h"
+#include "UtilityFunctions.h"
+
+namespace
+{
+	const QuicTime kRttUs = 20000;
+	const QuicByteCount kPacketSize = 1000;
+	const QuicPacketNumber kNumPackets = 100;
+	const QuicTime kSendIntervalUs = 100;
+
+	bool Check(bool condition, const char* test, const char* what)
+	{
+		if (!condition)
+			fprintf(stderr, "FAIL %s: %s\n", test, what);
+		return condition;
+	}
+
+	// Keeps the utilities of the last report.
+	class UtilityRecorder : public MonitorIntervalQueueDelegateInterface
+	{
+	public:
+		void OnUtilityAvailable(UtilityInfoSpan utility_info) override
+		{
+			utilities.assign(utility_info.begin(), utility_info.end());
+		}
+
+		std::vector<UtilityInfo> utilities;
+	};
+
+	// An interval of kNumPackets packets, the last |num_lost| lost, whose
+	// RTTs alternate |rtt_jitter_us| above and below kRttUs, and are
+	// |rtt_step_us| higher for the last 10 acked.
+	struct Scenario
+	{
+		QuicPacketNumber num_lost;
+		QuicTime rtt_jitter_us;
+		QuicTime rtt_step_us;
+	};
+	const Scenario kClean = { 0, 0, 0 };
+	const Scenario kLossy = { 10, 0, 0 };
+	const Scenario kJittery = { 0, 4000, 0 };
+	// Within and beyond the tolerance of 0.1 the intervals are enqueued with.
+	const Scenario kSmallRttStep = { 0, 0, kRttUs / 20 };
+	const Scenario kLargeRttStep = { 0, 0, kRttUs / 2 };
+
+	// The utility a queue of |UtilityFunction| computes for |scenario| under
+	// |config|, or 0 if it reports none.
+	template <class UtilityFunction>
+	float Utility(const Scenario& scenario, const PccConfig& config = *PccConfig::Default())
+	{
+		UtilityRecorder recorder;
+		BasicMonitorIntervalQueue<UtilityFunction> queue(recorder, config);
+		QuicTime end_time = kNumPackets * kSendIntervalUs;
+		queue.EnqueueNewMonitorInterval(1e8, true, 0.1f, kRttUs, end_time);
+		for (QuicPacketNumber i = 0; i < kNumPackets; ++i)
+			queue.OnPacketSent(i * kSendIntervalUs, i, kPacketSize);
+		for (QuicPacketNumber i = 0; i < kNumPackets; ++i)
+		{
+			bool lost = i >= kNumPackets - scenario.num_lost;
+			QuicTime rtt = kRttUs + (i % 2 == 0 ? scenario.rtt_jitter_us : -scenario.rtt_jitter_us);
+			if (i >= kNumPackets - 10)
+				rtt += scenario.rtt_step_us;
+			CongestionEvent event;
+			event.packet_number = i;
+			event.bytes_acked = lost ? 0 : static_cast<int32_t> (kPacketSize);
+			event.bytes_lost = lost ? static_cast<int32_t> (kPacketSize) : 0;
+			QuicTime event_time = std::max(i * kSendIntervalUs + rtt, end_time);
+			event.time = static_cast<uint64_t> (event_time);
+			AckedPacketVector events(1, event);
+			if (lost)
+				queue.OnCongestionEvent(AckedPacketVector(), events, rtt, event_time);
+			else
+				queue.OnCongestionEvent(events, LostPacketVector(), rtt, event_time);
+		}
+		return recorder.utilities.size() == 1 ? recorder.utilities[0].utility : 0.0f;
+	}
+
+	bool TestLatencyUtility()
+	{
+		const char* test = "latency utility";
+		const PccConfig& config = *PccConfig::Default();
+		float expected = CalculateVivaceUtility(static_cast<float> (kNumPackets * kPacketSize),
+			0.0f,
+			static_cast<float> ((kNumPackets - 1) * kSendIntervalUs),
+			kNumPackets,
+			0.0f,
+			config.vivace_utility);
+		bool ok = Check(Utility<VivaceLatencyUtility>(kClean) == expected, test, "utility differs from the Vivace formula");
+		ok = Check(Utility<VivaceLatencyUtility>(kLossy) < expected, test, "losses not penalized") && ok;
+		return ok;
+	}
+
+	bool TestLossUtility()
+	{
+		const char* test = "loss utility";
+		float clean = Utility<VivaceLossUtility>(kClean);
+		bool ok = Check(clean > 0.0f, test, "no utility");
+		ok = Check(clean != Utility<VivaceLatencyUtility>(kClean), test, "latency utility computed") && ok;
+		ok = Check(Utility<VivaceLossUtility>(kLossy) < clean, test, "losses not penalized") && ok;
+		ok = Check(Utility<VivaceLossUtility>(kSmallRttStep) == clean, test, "RTT change within the tolerance penalized") && ok;
+		ok = Check(Utility<VivaceLossUtility>(kLargeRttStep) < clean, test, "RTT change beyond the tolerance not penalized") && ok;
+		return ok;
+	}
+
+	bool TestScavengerUtility()
+	{
+		const char* test = "scavenger utility";
+		bool ok = Check(Utility<ScavengerUtility>(kClean) == Utility<VivaceLatencyUtility>(kClean), test, "steady RTTs penalized");
+		ok = Check(Utility<ScavengerUtility>(kJittery) < Utility<VivaceLatencyUtility>(kJittery), test, "RTT deviation not penalized") && ok;
+
+		PccConfig config;
+		config.scavenger_rtt_deviation_coefficient *= 2;
+		float penalty = Utility<VivaceLatencyUtility>(kJittery) - Utility<ScavengerUtility>(kJittery);
+		float doubled_penalty = Utility<VivaceLatencyUtility>(kJittery, config) - Utility<ScavengerUtility>(kJittery, config);
+		ok = Check(std::fabs(doubled_penalty - 2 * penalty) <= 1e-3f * penalty, test, "penalty not proportional to the coefficient") && ok;
+		return ok;
+	}
+
+	// A controller of each utility function runs the same STARTING as the
+	// others, from its own queue.
+	template <class UtilityFunction>
+	bool ControllerStarts(const char* test)
+	{
+		BasicCongestionController<UtilityFunction> controller(kRttUs, 10, 100000);
+		QuicBandwidth initial_rate = controller.PacingRate();
+		controller.OnUtilityAvailable(std::vector<UtilityInfo>{ UtilityInfo(initial_rate, 1.0f) });
+		return Check(controller.mode() == CongestionControllerBase::STARTING && controller.PacingRate() == 2 * initial_rate,
+			test, "rate not doubled");
+	}
+
+	bool TestControllers()
+	{
+		const char* test = "controllers";
+		bool ok = ControllerStarts<VivaceLatencyUtility>(test);
+		ok = ControllerStarts<VivaceLossUtility>(test) && ok;
+		ok = ControllerStarts<ScavengerUtility>(test) && ok;
+		return ok;
+	}
+} // namespace
+
+int main()
+{
+	bool ok = true;
+	ok = TestLatencyUtility() && ok;
+	ok = TestLossUtility() && ok;
+	ok = TestScavengerUtility() && ok;
+	ok = TestControllers() && ok;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
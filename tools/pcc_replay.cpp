@@ -0,0 +1,197 @@
+// pcc_replay: replays an event log into a controller and prints the pacing
+// rate and utility timeline that results.
+//
+//   pcc_replay [--utility=latency|loss|scavenger] [--preset=NAME] [--seed=N]
+//              [--fixed_point] [--gradient=NAME] [--csv] events.log
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "Replayer.h"
+#include "UtilityFunctions.h"
+
+namespace
+{
+	const char* const kModeNames[] = { "starting", "probing", "decision_made" };
+
+	void PrintUsage()
+	{
+		fprintf(stderr,
+			"usage: pcc_replay [flags] FILE\n"
+			"  --utility=NAME  utility function: latency, loss or scavenger (latency)\n"
+			"  --preset=NAME   controller tuning: default, datacenter, wan or satellite (default)\n"
+			"  --seed=N        seed of the probing order (1)\n"
+			"  --fixed_point   compute utilities and rate changes in fixed point\n"
+			"  --gradient=NAME utility gradient: pair or least_squares (pair)\n"
+			"  --csv           print the timeline as CSV\n"
+			"  --quiet         only print the summary\n");
+	}
+
+	// Returns the value of |arg| if it is --|name|=value, otherwise nullptr.
+	const char* FlagValue(const char* arg, const char* name)
+	{
+		size_t length = strlen(name);
+		if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, length) != 0 || arg[2 + length] != '=')
+			return nullptr;
+		return arg + 3 + length;
+	}
+
+	class TimelinePrinter : public ReplayTimelineInterface
+	{
+	public:
+		explicit TimelinePrinter(bool csv) :
+			csv_(csv)
+		{
+			if (csv_)
+				printf("time_us,pacing_rate_bps,congestion_window_bytes,mode,utility_rate_bps,utility\n");
+		}
+
+		void OnSample(const ReplaySample& sample) override
+		{
+			if (csv_)
+				printf("%lld,%.17g,%lld,%s,%.17g,%.9g\n",
+					static_cast<long long> (sample.time),
+					sample.pacing_rate,
+					static_cast<long long> (sample.congestion_window),
+					kModeNames[sample.mode],
+					sample.utility.sending_rate,
+					sample.utility.utility);
+			else
+				printf("%.6f s  %.3f Mbps  cwnd %lld  %s  utility %.6g at %.3f Mbps\n",
+					sample.time / 1e6,
+					sample.pacing_rate / 1e6,
+					static_cast<long long> (sample.congestion_window),
+					kModeNames[sample.mode],
+					sample.utility.utility,
+					sample.utility.sending_rate / 1e6);
+		}
+
+	private:
+		bool csv_;
+	};
+} // namespace
+
+int main(int argc, char** argv)
+{
+	std::string utility = "latency";
+	std::shared_ptr<const PccConfig> config = PccConfig::Default();
+	uint64_t seed = 1;
+	bool csv = false;
+	bool quiet = false;
+	bool fixed_point = false;
+	GradientEstimatorMode gradient_estimator = GRADIENT_PAIR;
+	const char* path = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* value = nullptr;
+		if ((value = FlagValue(argv[i], "utility")))
+			utility = value;
+		else if ((value = FlagValue(argv[i], "seed")))
+			seed = strtoull(value, nullptr, 10);
+		else if ((value = FlagValue(argv[i], "preset")))
+		{
+			if (strcmp(value, "default") == 0)
+				config = PccConfig::Default();
+			else if (strcmp(value, "datacenter") == 0)
+				config = PccConfig::Datacenter();
+			else if (strcmp(value, "wan") == 0)
+				config = PccConfig::Wan();
+			else if (strcmp(value, "satellite") == 0)
+				config = PccConfig::Satellite();
+			else
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--csv") == 0)
+			csv = true;
+		else if (strcmp(argv[i], "--quiet") == 0)
+			quiet = true;
+		else if (strcmp(argv[i], "--fixed_point") == 0)
+			fixed_point = true;
+		else if ((value = FlagValue(argv[i], "gradient")))
+		{
+			if (strcmp(value, "pair") == 0)
+				gradient_estimator = GRADIENT_PAIR;
+			else if (strcmp(value, "least_squares") == 0)
+				gradient_estimator = GRADIENT_WEIGHTED_LEAST_SQUARES;
+			else
+			{
+				PrintUsage();
+				return 1;
+			}
+		}
+		else if (argv[i][0] != '-' && path == nullptr)
+			path = argv[i];
+		else
+		{
+			PrintUsage();
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
+	if (path == nullptr)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (fixed_point || gradient_estimator != GRADIENT_PAIR)
+	{
+		PccConfig tuned_config = *config;
+		tuned_config.fixed_point_arithmetic = fixed_point;
+		tuned_config.gradient_estimator = gradient_estimator;
+		std::string config_error;
+		config = PccConfig::Create(tuned_config, &config_error);
+		if (config == nullptr)
+		{
+			fprintf(stderr, "pcc_replay: %s\n", config_error.c_str());
+			return 1;
+		}
+	}
+
+	ReplayLog log;
+	std::string error;
+	if (!log.Open(path, &error))
+	{
+		fprintf(stderr, "pcc_replay: %s\n", error.c_str());
+		return 1;
+	}
+
+	TimelinePrinter printer(csv);
+	ReplayTimelineInterface* timeline = quiet ? nullptr : &printer;
+	ReplayResult result;
+	bool ok;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (utility == "latency")
+		ok = ReplayLogInto<VivaceLatencyUtility>(log, config, seed, timeline, &result, &error);
+	else if (utility == "loss")
+		ok = ReplayLogInto<VivaceLossUtility>(log, config, seed, timeline, &result, &error);
+	else if (utility == "scavenger")
+		ok = ReplayLogInto<ScavengerUtility>(log, config, seed, timeline, &result, &error);
+	else
+	{
+		PrintUsage();
+		return 1;
+	}
+	double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	fprintf(stderr, "replayed %llu sent, %llu congestion events (%llu acked, %llu lost), %llu timers in %.3f s, %.1fM records/s\n",
+		static_cast<unsigned long long> (result.packets_sent),
+		static_cast<unsigned long long> (result.congestion_events),
+		static_cast<unsigned long long> (result.packets_acked),
+		static_cast<unsigned long long> (result.packets_lost),
+		static_cast<unsigned long long> (result.timers),
+		wall_seconds,
+		wall_seconds > 0 ? log.num_records() / wall_seconds / 1e6 : 0.0);
+	if (!ok)
+	{
+		fprintf(stderr, "pcc_replay: %s: %s\n", path, error.c_str());
+		return 1;
+	}
+	return 0;
+}
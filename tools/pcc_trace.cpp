@@ -0,0 +1,184 @@
+// pcc_trace: prints the records of a trace file written by Trace, oldest
+// first.
+//
+//   pcc_trace [--csv] [--type=NAME] [--controller=N] trace.bin
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "Trace.h"
+
+namespace
+{
+	void PrintUsage()
+	{
+		fprintf(stderr,
+			"usage: pcc_trace [flags] FILE\n"
+			"  --csv           print CSV instead of text\n"
+			"  --type=NAME     only print records of type NAME, e.g. utility\n"
+			"  --controller=N  only print records of controller N\n");
+	}
+
+	// Returns the value of |arg| if it is --|name|=value, otherwise nullptr.
+	const char* FlagValue(const char* arg, const char* name)
+	{
+		size_t length = strlen(name);
+		if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, length) != 0 || arg[2 + length] != '=')
+			return nullptr;
+		return arg + 3 + length;
+	}
+
+	struct Chunk
+	{
+		TraceChunkHeader header;
+		std::vector<TraceRecord> records;
+	};
+
+	bool ReadTrace(const char* path, TraceFileHeader* header, std::vector<Chunk>* chunks)
+	{
+		FILE* file = fopen(path, "rb");
+		if (file == nullptr)
+		{
+			fprintf(stderr, "pcc_trace: cannot open %s\n", path);
+			return false;
+		}
+
+		bool ok = fread(header, sizeof(*header), 1, file) == 1
+			&& header->magic == TraceFileHeader::kMagic
+			&& header->record_size == sizeof(TraceRecord);
+		if (!ok)
+			fprintf(stderr, "pcc_trace: %s is not a trace file\n", path);
+		for (uint64_t i = 0; ok && i < header->num_chunks; ++i)
+		{
+			Chunk chunk;
+			chunk.records.resize(header->records_per_chunk);
+			if (fread(&chunk.header, sizeof(chunk.header), 1, file) != 1
+				|| fread(chunk.records.data(), sizeof(TraceRecord), chunk.records.size(), file) != chunk.records.size())
+			{
+				fprintf(stderr, "pcc_trace: %s is truncated\n", path);
+				ok = false;
+				break;
+			}
+			if (chunk.header.sequence == 0)
+				continue;
+			chunk.records.resize(std::min<size_t>(chunk.header.num_records, chunk.records.size()));
+			chunks->push_back(std::move(chunk));
+		}
+		fclose(file);
+		return ok;
+	}
+
+	void PrintCsvHeader(int type)
+	{
+		printf("time_s,thread,controller,type");
+		for (size_t i = 0; i < TraceRecord::kNumValues; ++i)
+		{
+			if (type < 0)
+				printf(",value%zu", i);
+			else if (TraceFieldName(static_cast<uint16_t> (type), i)[0] != '\0')
+				printf(",%s", TraceFieldName(static_cast<uint16_t> (type), i));
+		}
+		printf("\n");
+	}
+
+	void PrintRecord(const TraceRecord& record, double time_s, bool csv, bool named_columns)
+	{
+		if (csv)
+			printf("%.9f,%u,%u,%s", time_s, record.thread, record.controller, TraceRecordTypeName(record.type));
+		else
+			printf("%.9f t%u c%u %s", time_s, record.thread, record.controller, TraceRecordTypeName(record.type));
+
+		for (size_t i = 0; i < TraceRecord::kNumValues; ++i)
+		{
+			const char* name = TraceFieldName(record.type, i);
+			if (csv && !named_columns)
+				printf(",%.17g", record.values[i]);
+			else if (name[0] == '\0')
+				continue;
+			else if (csv)
+				printf(",%.17g", record.values[i]);
+			else
+				printf(" %s=%.17g", name, record.values[i]);
+		}
+		printf("\n");
+	}
+} // namespace
+
+int main(int argc, char** argv)
+{
+	bool csv = false;
+	int type = -1;
+	long long controller = -1;
+	const char* path = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* value = nullptr;
+		if ((value = FlagValue(argv[i], "type")))
+		{
+			for (uint16_t j = 0; j < NUM_TRACE_RECORD_TYPES; ++j)
+			{
+				if (strcmp(value, TraceRecordTypeName(j)) == 0)
+					type = j;
+			}
+			if (type < 0)
+			{
+				fprintf(stderr, "pcc_trace: unknown record type %s\n", value);
+				return 1;
+			}
+		}
+		else if ((value = FlagValue(argv[i], "controller")))
+			controller = atoll(value);
+		else if (strcmp(argv[i], "--csv") == 0)
+			csv = true;
+		else if (argv[i][0] != '-' && path == nullptr)
+			path = argv[i];
+		else
+		{
+			PrintUsage();
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
+	if (path == nullptr)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	TraceFileHeader header;
+	std::vector<Chunk> chunks;
+	if (!ReadTrace(path, &header, &chunks))
+		return 1;
+	std::sort(chunks.begin(), chunks.end(), [](const Chunk& lhs, const Chunk& rhs)
+	{
+		return lhs.header.sequence < rhs.header.sequence;
+	});
+
+	// Chunks are ordered by when they were flushed; records of different
+	// threads interleave within that order, so sort them by time as well.
+	std::vector<TraceRecord> records;
+	for (const Chunk& chunk : chunks)
+	{
+		for (const TraceRecord& record : chunk.records)
+		{
+			if ((type < 0 || record.type == type) && (controller < 0 || record.controller == controller))
+				records.push_back(record);
+		}
+	}
+	std::stable_sort(records.begin(), records.end(), [](const TraceRecord& lhs, const TraceRecord& rhs)
+	{
+		return lhs.timestamp < rhs.timestamp;
+	});
+
+	if (csv)
+		PrintCsvHeader(type);
+	for (const TraceRecord& record : records)
+	{
+		double time_s = (static_cast<double> (record.timestamp) - static_cast<double> (header.start_timestamp)) / header.ticks_per_second;
+		PrintRecord(record, time_s, csv, type >= 0);
+	}
+	return 0;
+}